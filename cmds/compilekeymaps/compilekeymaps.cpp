@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <input/CompiledKeyMap.h>
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+#include <utils/String8.h>
+
+using namespace android;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--overlay] <input.kl|input.kcm> [<output>]\n\n", program);
+    fprintf(stderr, "Precompiles a key layout or key character map file.  The output\n"
+            "defaults to the input path with a 'c' appended, which is where the\n"
+            "compiled file must be installed to be used.\n");
+}
+
+static bool endsWith(const String8& str, const char* suffix) {
+    size_t length = strlen(suffix);
+    return str.length() >= length && !strcmp(str.string() + str.length() - length, suffix);
+}
+
+int main(int argc, char** argv) {
+    int arg = 1;
+    bool overlay = false;
+    if (arg < argc && !strcmp(argv[arg], "--overlay")) {
+        overlay = true;
+        arg += 1;
+    }
+    if (arg >= argc || argc - arg > 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    String8 filename(argv[arg]);
+    String8 outFilename = arg + 1 < argc ? String8(argv[arg + 1])
+            : CompiledKeyMap::getCompiledPath(filename);
+
+    status_t status;
+    if (endsWith(filename, ".kl")) {
+        status = KeyLayoutMap::compile(filename, outFilename);
+    } else if (endsWith(filename, ".kcm")) {
+        status = KeyCharacterMap::compile(filename,
+                overlay ? KeyCharacterMap::FORMAT_OVERLAY : KeyCharacterMap::FORMAT_BASE,
+                outFilename);
+    } else {
+        fprintf(stderr, "%s: Unrecognized key map file type.\n", filename.string());
+        return 1;
+    }
+
+    if (status) {
+        fprintf(stderr, "%s: Failed to compile, error %d.\n", filename.string(), status);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SurfaceReplayerBenchmark"
+
+#include "CompositorModel.h"
+
+#include <utils/Log.h>
+
+#include <algorithm>
+
+namespace android {
+
+// From hwcomposer_defs.h
+static const int32_t POWER_MODE_OFF = 0;
+
+// The size SurfaceFlinger gives a display until its size is set
+static const uint32_t DEFAULT_DISPLAY_WIDTH = 1080;
+static const uint32_t DEFAULT_DISPLAY_HEIGHT = 1920;
+
+const char* toString(Stage stage) {
+    switch (stage) {
+        case Stage::VisibleRegions:
+            return "visible regions";
+        case Stage::Composition:
+            return "composition";
+    }
+    return "unknown";
+}
+
+static Rect toRect(const Rectangle& rectangle) {
+    return Rect(rectangle.left(), rectangle.top(), rectangle.right(), rectangle.bottom());
+}
+
+Rect CompositorModel::Display::getViewport() const {
+    if (viewport.isValid() && !viewport.isEmpty()) {
+        return viewport;
+    }
+    return Rect(w > 0 ? w : DEFAULT_DISPLAY_WIDTH, h > 0 ? h : DEFAULT_DISPLAY_HEIGHT);
+}
+
+void CompositorModel::queue(const Increment& increment) {
+    mPendingIncrements.push_back(increment);
+}
+
+FrameStats CompositorModel::onVsync() {
+    FrameStats stats;
+
+    for (const auto& increment : mPendingIncrements) {
+        applyIncrement(increment);
+    }
+    mPendingIncrements.clear();
+    rebuildLayerStacks();
+
+    nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+    for (auto& display : mDisplays) {
+        if (display.second->on) {
+            computeVisibleRegions(*display.second, stats);
+        }
+    }
+    nsecs_t end = systemTime(SYSTEM_TIME_THREAD);
+    stats.stageTimes[static_cast<size_t>(Stage::VisibleRegions)] = end - start;
+
+    start = end;
+    for (auto& display : mDisplays) {
+        if (display.second->on) {
+            compose(*display.second, stats);
+        }
+    }
+    for (auto& layer : mLayers) {
+        layer.second->contentDirty = false;
+    }
+    end = systemTime(SYSTEM_TIME_THREAD);
+    stats.stageTimes[static_cast<size_t>(Stage::Composition)] = end - start;
+
+    return stats;
+}
+
+void CompositorModel::applyIncrement(const Increment& increment) {
+    switch (increment.increment_case()) {
+        case Increment::kTransaction:
+            applyTransaction(increment.transaction());
+            break;
+        case Increment::kSurfaceCreation: {
+            const SurfaceCreation& creation = increment.surface_creation();
+            std::unique_ptr<Layer> layer(new Layer());
+            layer->id = creation.id();
+            layer->sequence = mNextSequence++;
+            layer->w = creation.w();
+            layer->h = creation.h();
+            mLayers[creation.id()] = std::move(layer);
+        } break;
+        case Increment::kSurfaceDeletion:
+            mLayers.erase(increment.surface_deletion().id());
+            break;
+        case Increment::kBufferUpdate: {
+            auto layer = mLayers.find(increment.buffer_update().id());
+            if (layer != mLayers.end()) {
+                layer->second->contentDirty = true;
+            }
+        } break;
+        case Increment::kDisplayCreation: {
+            std::unique_ptr<Display> display(new Display());
+            display->id = increment.display_creation().id();
+            mDisplays[display->id] = std::move(display);
+        } break;
+        case Increment::kDisplayDeletion:
+            mDisplays.erase(increment.display_deletion().id());
+            break;
+        case Increment::kPowerModeUpdate: {
+            auto display = mDisplays.find(increment.power_mode_update().id());
+            if (display != mDisplays.end()) {
+                display->second->on = increment.power_mode_update().mode() != POWER_MODE_OFF;
+            }
+        } break;
+        case Increment::kVsyncEvent:
+        case Increment::INCREMENT_NOT_SET:
+            break;
+    }
+}
+
+void CompositorModel::applyTransaction(const Transaction& transaction) {
+    for (const auto& change : transaction.surface_change()) {
+        applySurfaceChange(change);
+    }
+    for (const auto& change : transaction.display_change()) {
+        applyDisplayChange(change);
+    }
+}
+
+void CompositorModel::applySurfaceChange(const SurfaceChange& change) {
+    auto found = mLayers.find(change.id());
+    if (found == mLayers.end()) {
+        ALOGV("Change to unknown surface %d", change.id());
+        return;
+    }
+    Layer& layer(*found->second);
+
+    switch (change.SurfaceChange_case()) {
+        case SurfaceChange::kPosition:
+            layer.x = change.position().x();
+            layer.y = change.position().y();
+            break;
+        case SurfaceChange::kSize:
+            layer.w = change.size().w();
+            layer.h = change.size().h();
+            break;
+        case SurfaceChange::kAlpha:
+            layer.alpha = change.alpha().alpha();
+            break;
+        case SurfaceChange::kLayer:
+            layer.z = change.layer().layer();
+            break;
+        case SurfaceChange::kCrop:
+            layer.crop = toRect(change.crop().rectangle());
+            break;
+        case SurfaceChange::kFinalCrop:
+            layer.finalCrop = toRect(change.final_crop().rectangle());
+            break;
+        case SurfaceChange::kMatrix:
+            layer.dsdx = change.matrix().dsdx();
+            layer.dtdx = change.matrix().dtdx();
+            layer.dsdy = change.matrix().dsdy();
+            layer.dtdy = change.matrix().dtdy();
+            break;
+        case SurfaceChange::kTransparentRegionHint:
+            layer.transparentRegionHint.clear();
+            for (const auto& rectangle : change.transparent_region_hint().region()) {
+                layer.transparentRegionHint.orSelf(toRect(rectangle));
+            }
+            break;
+        case SurfaceChange::kLayerStack:
+            layer.layerStack = change.layer_stack().layer_stack();
+            break;
+        case SurfaceChange::kHiddenFlag:
+            layer.hidden = change.hidden_flag().hidden_flag();
+            break;
+        case SurfaceChange::kOpaqueFlag:
+            layer.opaque = change.opaque_flag().opaque_flag();
+            break;
+        case SurfaceChange::kSecureFlag:
+        case SurfaceChange::kOverrideScalingMode:
+        case SurfaceChange::kDeferredTransaction:
+        case SurfaceChange::SURFACECHANGE_NOT_SET:
+            // no effect on composition here
+            return;
+    }
+    layer.contentDirty = true;
+}
+
+void CompositorModel::applyDisplayChange(const DisplayChange& change) {
+    auto found = mDisplays.find(change.id());
+    if (found == mDisplays.end()) {
+        ALOGV("Change to unknown display %d", change.id());
+        return;
+    }
+    Display& display(*found->second);
+
+    switch (change.DisplayChange_case()) {
+        case DisplayChange::kLayerStack:
+            display.layerStack = change.layer_stack().layer_stack();
+            break;
+        case DisplayChange::kSize:
+            display.w = change.size().w();
+            display.h = change.size().h();
+            break;
+        case DisplayChange::kProjection:
+            display.viewport = toRect(change.projection().viewport());
+            break;
+        case DisplayChange::kSurface:
+        case DisplayChange::DISPLAYCHANGE_NOT_SET:
+            break;
+    }
+}
+
+void CompositorModel::computeBounds(Layer& layer) const {
+    // Layer::computeScreenBounds() of a layer without a parent, with the transform
+    // Layer::setPosition() and Layer::setMatrix() set.
+    Transform t;
+    t.set(layer.dsdx, layer.dtdy, layer.dtdx, layer.dsdy);
+    t.set(layer.x, layer.y);
+    const Region transparentRegion(t.transform(layer.transparentRegionHint));
+    layer.bounds = LayerGeometry::reduce(
+            LayerGeometry::computeScreenBounds(layer.w, layer.h, layer.crop, t,
+                    layer.finalCrop),
+            transparentRegion);
+
+    // Like SurfaceFlinger::computeVisibleRegions, the transparent region is only kept
+    // for translucent layers, when the transform preserves rectangles.
+    layer.transparentRegion.clear();
+    if (!layer.opaque && t.preserveRects()) {
+        layer.transparentRegion = transparentRegion;
+    }
+}
+
+void CompositorModel::rebuildLayerStacks() {
+    std::vector<Layer*> sorted;
+    sorted.reserve(mLayers.size());
+    for (auto& layer : mLayers) {
+        computeBounds(*layer.second);
+        sorted.push_back(layer.second.get());
+    }
+    // front to back, in the reverse of LayerVector's order
+    std::sort(sorted.begin(), sorted.end(), [](const Layer* lhs, const Layer* rhs) {
+        return LayerGeometry::compareZOrder(
+                lhs->layerStack, lhs->z, lhs->sequence,
+                rhs->layerStack, rhs->z, rhs->sequence) > 0;
+    });
+
+    for (auto& entry : mDisplays) {
+        Display& display(*entry.second);
+        display.layers.clear();
+        if (!display.on) {
+            continue;
+        }
+        for (Layer* layer : sorted) {
+            if (layer->layerStack == display.layerStack) {
+                display.layers.push_back(layer);
+            }
+        }
+    }
+}
+
+void CompositorModel::computeVisibleRegions(Display& display, FrameStats& stats) {
+    std::vector<VisibleRegionTracker::LayerRegions> regions(display.layers.size());
+    for (size_t i = 0; i < display.layers.size(); i++) {
+        const Layer& layer(*display.layers[i]);
+        VisibleRegionTracker::LayerRegions& layerRegions(regions[i]);
+        const bool visible = !layer.hidden && layer.alpha > 0.0f;
+        layerRegions.id = static_cast<uintptr_t>(layer.sequence);
+        layerRegions.bounds = visible ? layer.bounds : Rect::EMPTY_RECT;
+        layerRegions.opaque = visible && layer.opaque && layer.alpha >= 1.0f;
+        layerRegions.transparentRegion = layer.transparentRegion;
+        layerRegions.contentDirty = layer.contentDirty;
+        layerRegions.oldVisibleRegion = layer.visibleRegion;
+        layerRegions.oldCoveredRegion = layer.coveredRegion;
+    }
+
+    Region dirtyRegion;
+    Region opaqueRegion;
+    display.tracker.compute(regions, dirtyRegion, opaqueRegion);
+    stats.recomputedLayers += display.tracker.getRecomputedCount();
+
+    // As in rebuildLayerStacks(), only the layers which draw something on the
+    // display are composed.
+    const Rect viewport(display.getViewport());
+    std::vector<Layer*> layers;
+    layers.reserve(display.layers.size());
+    for (size_t i = 0; i < display.layers.size(); i++) {
+        Layer* layer = display.layers[i];
+        layer->visibleRegion = regions[i].visibleRegion;
+        layer->coveredRegion = regions[i].coveredRegion;
+        if (regions[i].visibleNonTransparentRegion.intersects(viewport)) {
+            layers.push_back(layer);
+        }
+    }
+    display.layers.swap(layers);
+    display.dirtyRegion.orSelf(dirtyRegion.intersect(viewport));
+    stats.visibleLayers += display.layers.size();
+}
+
+void CompositorModel::compose(Display& display, FrameStats& stats) {
+    if (display.dirtyRegion.isEmpty()) {
+        return;
+    }
+
+    // The fake HWC takes the bottom layers on its planes, and leaves the others to
+    // client composition, like a device which runs out of overlays.
+    const Rect viewport(display.getViewport());
+    const size_t count = display.layers.size();
+    const size_t clientLayers = count > HWC_PLANES ? count - HWC_PLANES : 0;
+    stats.clientLayers += clientLayers;
+
+    // The fake RenderEngine walks the rectangles it would draw for each client layer,
+    // back to front.
+    for (size_t i = clientLayers; i > 0; i--) {
+        const Layer& layer(*display.layers[i - 1]);
+        const Region clip(layer.visibleRegion.intersect(display.dirtyRegion));
+        for (const Rect& rect : clip) {
+            Rect drawn;
+            if (rect.intersect(viewport, &drawn)) {
+                mDrawnPixels += uint64_t(drawn.getWidth()) * uint64_t(drawn.getHeight());
+            }
+        }
+    }
+    display.dirtyRegion.clear();
+}
+
+}  // namespace android
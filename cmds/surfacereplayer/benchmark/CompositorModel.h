@@ -0,0 +1,152 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SURFACEREPLAYER_COMPOSITOR_MODEL_H
+#define ANDROID_SURFACEREPLAYER_COMPOSITOR_MODEL_H
+
+#include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/Timers.h>
+
+#include <LayerGeometry.h>
+#include <VisibleRegionTracker.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+
+// The stages of a frame which are timed separately. Applying the transactions and
+// rebuilding the layer stacks run the model's own code, not SurfaceFlinger's, so they
+// aren't timed.
+enum class Stage {
+    // SurfaceFlinger's VisibleRegionTracker
+    VisibleRegions,
+    // the fake HWC validate and the fake RenderEngine pass over the client layers
+    Composition,
+};
+const size_t STAGE_COUNT = static_cast<size_t>(Stage::Composition) + 1;
+
+const char* toString(Stage stage);
+
+struct FrameStats {
+    // thread CPU time spent in each stage
+    nsecs_t stageTimes[STAGE_COUNT] = {};
+    size_t visibleLayers = 0;
+    size_t recomputedLayers = 0;
+    size_t clientLayers = 0;
+};
+
+/*
+ * An in-process stand-in for SurfaceFlinger which consumes the increments of a
+ * SurfaceInterceptor trace. It keeps the layer and display state of the trace, and
+ * runs a frame for each vsync like SurfaceFlinger's refresh: latch the pending
+ * state, rebuild the layer stacks, compute the visible regions with SurfaceFlinger's
+ * own VisibleRegionTracker, then compose through fake HWC and RenderEngine back ends
+ * which only walk the regions they would draw.
+ *
+ * Only the visible regions stage runs SurfaceFlinger's code as it is. The layer and
+ * display state, the transactions and the layer stacks are the model's own, and
+ * CompositorModel_test checks their results against Layer and LayerVector. They only
+ * set up the inputs of the timed stages.
+ */
+class CompositorModel {
+  public:
+    // Number of layers the fake HWC composes itself, the others are client composited
+    static const size_t HWC_PLANES = 4;
+
+    // Queues an increment which isn't a vsync until the next frame.
+    void queue(const Increment& increment);
+
+    // Runs a frame, and returns the time spent in each timed stage.
+    FrameStats onVsync();
+
+    // Number of pixels the fake RenderEngine drew since the model was created
+    uint64_t getDrawnPixels() const { return mDrawnPixels; }
+
+  private:
+    friend class CompositorModelTest;
+
+    struct Layer {
+        int32_t id;
+        // creation order, breaks ties between layers with the same z like
+        // SurfaceFlinger's LayerVector
+        int32_t sequence;
+        uint32_t w;
+        uint32_t h;
+        float x = 0.0f;
+        float y = 0.0f;
+        // the transform matrix, as in Layer::setMatrix()
+        float dsdx = 1.0f;
+        float dtdx = 0.0f;
+        float dsdy = 1.0f;
+        float dtdy = 0.0f;
+        float alpha = 1.0f;
+        uint32_t z = 0;
+        uint32_t layerStack = 0;
+        Rect crop = Rect::INVALID_RECT;
+        Rect finalCrop = Rect::INVALID_RECT;
+        Region transparentRegionHint;
+        bool hidden = false;
+        bool opaque = false;
+        bool contentDirty = true;
+
+        // computed by the frame
+        Rect bounds;
+        Region transparentRegion;
+        Region visibleRegion;
+        Region coveredRegion;
+    };
+
+    struct Display {
+        int32_t id;
+        uint32_t layerStack = 0;
+        uint32_t w = 0;
+        uint32_t h = 0;
+        Rect viewport = Rect::INVALID_RECT;
+        bool on = true;
+        VisibleRegionTracker tracker;
+        // the layers on the display, sorted front to back
+        std::vector<Layer*> layers;
+        Region dirtyRegion;
+
+        Rect getViewport() const;
+    };
+
+    void applyIncrement(const Increment& increment);
+    void applyTransaction(const Transaction& transaction);
+    void applySurfaceChange(const SurfaceChange& change);
+    void applyDisplayChange(const DisplayChange& change);
+
+    void rebuildLayerStacks();
+    void computeBounds(Layer& layer) const;
+    void computeVisibleRegions(Display& display, FrameStats& stats);
+    void compose(Display& display, FrameStats& stats);
+
+    std::vector<Increment> mPendingIncrements;
+    std::map<int32_t, std::unique_ptr<Layer>> mLayers;
+    std::map<int32_t, std::unique_ptr<Display>> mDisplays;
+    int32_t mNextSequence = 0;
+    uint64_t mDrawnPixels = 0;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_SURFACEREPLAYER_COMPOSITOR_MODEL_H
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompositorModel.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <libgen.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace android {
+
+static const int32_t DISPLAY_ID = 1;
+
+// Checks what the model computes in its layer stacks stage against the code
+// SurfaceFlinger's Layer and LayerVector run for the same layer state:
+// Layer::computeScreenBounds(), which gives the bounds the visible regions are
+// computed from, and the order of LayerVector.
+class CompositorModelTest : public ::testing::Test {
+protected:
+    void createSurface(int32_t id, uint32_t w, uint32_t h) {
+        Increment increment;
+        SurfaceCreation* creation = increment.mutable_surface_creation();
+        creation->set_id(id);
+        creation->set_w(w);
+        creation->set_h(h);
+        mModel.queue(increment);
+    }
+
+    SurfaceChange* addChange(int32_t id) {
+        SurfaceChange* change = mTransaction.mutable_transaction()->add_surface_change();
+        change->set_id(id);
+        return change;
+    }
+
+    void runFrame() {
+        if (mTransaction.has_transaction()) {
+            mModel.queue(mTransaction);
+            mTransaction.Clear();
+        }
+        mModel.onVsync();
+    }
+
+    Rect getBounds(int32_t id) const {
+        return mModel.mLayers.at(id)->bounds;
+    }
+
+    // The visible layers of the display, front to back
+    std::vector<int32_t> getLayerStack(int32_t displayId) const {
+        std::vector<int32_t> ids;
+        for (const CompositorModel::Layer* layer : mModel.mDisplays.at(displayId)->layers) {
+            ids.push_back(layer->id);
+        }
+        return ids;
+    }
+
+    // Checks every layer and display of model after a frame.
+    static void checkAgainstSurfaceFlinger(const CompositorModel& model) {
+        std::vector<const CompositorModel::Layer*> layerVector;
+        for (const auto& entry : model.mLayers) {
+            const CompositorModel::Layer& layer(*entry.second);
+            layerVector.push_back(&layer);
+
+            // Layer::setPosition() and Layer::setMatrix()
+            Transform t;
+            t.set(layer.dsdx, layer.dtdy, layer.dtdx, layer.dsdy);
+            t.set(layer.x, layer.y);
+            const Rect expected = LayerGeometry::reduce(
+                    LayerGeometry::computeScreenBounds(layer.w, layer.h, layer.crop, t,
+                            layer.finalCrop),
+                    t.transform(layer.transparentRegionHint));
+            EXPECT_EQ(expected, layer.bounds) << "layer " << layer.id;
+        }
+
+        std::stable_sort(layerVector.begin(), layerVector.end(),
+                [](const CompositorModel::Layer* lhs, const CompositorModel::Layer* rhs) {
+                    return LayerGeometry::compareZOrder(
+                            lhs->layerStack, lhs->z, lhs->sequence,
+                            rhs->layerStack, rhs->z, rhs->sequence) < 0;
+                });
+        for (const auto& entry : model.mDisplays) {
+            const CompositorModel::Display& display(*entry.second);
+            // SurfaceFlinger::computeVisibleRegions() traverses in reverse z order
+            std::vector<const CompositorModel::Layer*> expected;
+            for (auto layer = layerVector.rbegin(); layer != layerVector.rend(); ++layer) {
+                if (std::find(display.layers.begin(), display.layers.end(), *layer) !=
+                        display.layers.end()) {
+                    expected.push_back(*layer);
+                }
+            }
+            EXPECT_TRUE(std::equal(expected.begin(), expected.end(),
+                    display.layers.begin(), display.layers.end()))
+                    << "display " << display.id;
+        }
+    }
+
+    CompositorModel mModel;
+    Increment mTransaction;
+};
+
+TEST_F(CompositorModelTest, BoundsRoundLikeTransform) {
+    Increment display;
+    display.mutable_display_creation()->set_id(DISPLAY_ID);
+    mModel.queue(display);
+    createSurface(1, 100, 50);
+    MatrixChange* matrix = addChange(1)->mutable_matrix();
+    matrix->set_dsdx(2.0f);
+    matrix->set_dtdx(0.0f);
+    matrix->set_dsdy(0.5f);
+    matrix->set_dtdy(0.0f);
+    PositionChange* position = addChange(1)->mutable_position();
+    position->set_x(10.4f);
+    position->set_y(20.6f);
+    runFrame();
+
+    // Transform::transform() rounds the corners to the nearest pixel
+    EXPECT_EQ(Rect(10, 21, 210, 46), getBounds(1));
+    checkAgainstSurfaceFlinger(mModel);
+}
+
+TEST_F(CompositorModelTest, BoundsFollowRotation) {
+    createSurface(1, 100, 50);
+    // 90 degrees: x' = tx - y, y' = ty + x
+    MatrixChange* matrix = addChange(1)->mutable_matrix();
+    matrix->set_dsdx(0.0f);
+    matrix->set_dtdx(1.0f);
+    matrix->set_dsdy(0.0f);
+    matrix->set_dtdy(-1.0f);
+    PositionChange* position = addChange(1)->mutable_position();
+    position->set_x(200.0f);
+    position->set_y(0.0f);
+    runFrame();
+
+    EXPECT_EQ(Rect(150, 0, 200, 100), getBounds(1));
+    checkAgainstSurfaceFlinger(mModel);
+}
+
+TEST_F(CompositorModelTest, BoundsExcludeTransparentRegion) {
+    createSurface(1, 100, 100);
+    Rectangle* transparent = addChange(1)->mutable_transparent_region_hint()->add_region();
+    transparent->set_left(0);
+    transparent->set_top(50);
+    transparent->set_right(100);
+    transparent->set_bottom(100);
+    runFrame();
+
+    EXPECT_EQ(Rect(0, 0, 100, 50), getBounds(1));
+    checkAgainstSurfaceFlinger(mModel);
+}
+
+TEST_F(CompositorModelTest, LayerStackIsInReverseLayerVectorOrder) {
+    Increment display;
+    display.mutable_display_creation()->set_id(DISPLAY_ID);
+    mModel.queue(display);
+    // Overlapping translucent layers, so all of them stay visible
+    createSurface(1, 100, 100);
+    createSurface(2, 100, 100);
+    createSurface(3, 100, 100);
+    addChange(1)->mutable_layer()->set_layer(5);
+    addChange(2)->mutable_layer()->set_layer(7);
+    addChange(3)->mutable_layer()->set_layer(5);
+    runFrame();
+
+    // By z, then the newest layer first
+    EXPECT_EQ(std::vector<int32_t>({2, 3, 1}), getLayerStack(DISPLAY_ID));
+    checkAgainstSurfaceFlinger(mModel);
+}
+
+class CompositorModelCorpusTest : public CompositorModelTest,
+                                  public ::testing::WithParamInterface<const char*> {
+protected:
+    static std::string getCorpusPath(const char* name) {
+        std::string path(android::base::GetExecutablePath());
+        return std::string(dirname(&path[0])) + "/corpus/" + name;
+    }
+};
+
+TEST_P(CompositorModelCorpusTest, MatchesSurfaceFlingerEveryFrame) {
+    std::string input;
+    Trace trace;
+    ASSERT_TRUE(android::base::ReadFileToString(getCorpusPath(GetParam()), &input, true));
+    ASSERT_TRUE(trace.ParseFromString(input));
+
+    size_t frames = 0;
+    for (const auto& increment : trace.increment()) {
+        if (increment.increment_case() != Increment::kVsyncEvent) {
+            mModel.queue(increment);
+            continue;
+        }
+        mModel.onVsync();
+        frames++;
+        checkAgainstSurfaceFlinger(mModel);
+        if (HasFailure()) {
+            FAIL() << "at frame " << frames;
+        }
+    }
+    EXPECT_GT(frames, 0u);
+}
+
+INSTANTIATE_TEST_CASE_P(Corpus, CompositorModelCorpusTest, ::testing::Values(
+        "app_launch.dat",
+        "freeform.dat",
+        "launcher_scroll.dat",
+        "multi_window.dat",
+        "video_playback.dat"));
+
+}  // namespace android
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark - Main.cpp
+ *
+ * 1. Get flags from command line
+ * 2. Load each trace passed in
+ * 3. Run the trace through a CompositorModel, once per iteration
+ * 4. Print the CPU time of each compositor stage per frame
+ */
+
+#include "CompositorModel.h"
+
+#include <android-base/file.h>
+
+#include <algorithm>
+#include <inttypes.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+using namespace android;
+
+static const int DEFAULT_ITERATIONS = 10;
+
+void printHelpMenu() {
+    std::cout << "SurfaceReplayer benchmark options:\n";
+    std::cout << "Usage: surfacereplayer_benchmark [OPTIONS...] <TRACE FILE>...\n";
+
+    std::cout << "\n  -i [Iterations]  Number of times each trace is run (default is "
+              << DEFAULT_ITERATIONS << ")\n";
+
+    std::cout << "  -f  Print the stage times of every frame as CSV\n";
+
+    std::cout << "  -h  Display help menu\n";
+
+    std::cout << std::endl;
+}
+
+static double toMicroseconds(nsecs_t time) {
+    return time / 1000.0;
+}
+
+// Runs all the frames of a trace once.
+static std::vector<FrameStats> runTrace(const Trace& trace, uint64_t* outDrawnPixels) {
+    // Traces recorded without vsync events are run a frame per increment
+    bool hasVsync = false;
+    for (const auto& increment : trace.increment()) {
+        if (increment.increment_case() == Increment::kVsyncEvent) {
+            hasVsync = true;
+            break;
+        }
+    }
+
+    CompositorModel model;
+    std::vector<FrameStats> frames;
+    for (const auto& increment : trace.increment()) {
+        if (increment.increment_case() == Increment::kVsyncEvent) {
+            frames.push_back(model.onVsync());
+            continue;
+        }
+        model.queue(increment);
+        if (!hasVsync) {
+            frames.push_back(model.onVsync());
+        }
+    }
+    *outDrawnPixels = model.getDrawnPixels();
+    return frames;
+}
+
+static void printFrames(const std::string& filename, int iteration,
+        const std::vector<FrameStats>& frames) {
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameStats& frame(frames[i]);
+        printf("%s,%d,%zu", filename.c_str(), iteration, i);
+        for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+            printf(",%.1f", toMicroseconds(frame.stageTimes[stage]));
+        }
+        printf(",%zu,%zu,%zu\n", frame.visibleLayers, frame.recomputedLayers,
+                frame.clientLayers);
+    }
+}
+
+static void printSummary(const std::string& filename, int iterations,
+        const std::vector<FrameStats>& frames, uint64_t drawnPixels) {
+    const size_t count = frames.size();
+    printf("%s: %zu frames, %d iterations\n", filename.c_str(), count / iterations, iterations);
+    if (count == 0) {
+        return;
+    }
+
+    size_t visibleLayers = 0;
+    size_t recomputedLayers = 0;
+    size_t clientLayers = 0;
+    for (const auto& frame : frames) {
+        visibleLayers += frame.visibleLayers;
+        recomputedLayers += frame.recomputedLayers;
+        clientLayers += frame.clientLayers;
+    }
+    printf("  per frame: %.1f visible layers, %.1f recomputed, %.1f client composited, "
+           "%" PRIu64 " pixels drawn\n",
+            double(visibleLayers) / count, double(recomputedLayers) / count,
+            double(clientLayers) / count, drawnPixels / count);
+
+    printf("  %-16s %10s %10s %10s %10s  (us of CPU time per frame)\n",
+            "stage", "mean", "median", "p95", "max");
+    std::vector<nsecs_t> totals(count, 0);
+    std::vector<nsecs_t> times(count);
+    for (size_t stage = 0; stage <= STAGE_COUNT; stage++) {
+        const bool total = stage == STAGE_COUNT;
+        nsecs_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (total) {
+                times[i] = totals[i];
+            } else {
+                times[i] = frames[i].stageTimes[stage];
+                totals[i] += times[i];
+            }
+            sum += times[i];
+        }
+        std::sort(times.begin(), times.end());
+        printf("  %-16s %10.1f %10.1f %10.1f %10.1f\n",
+                total ? "total" : toString(static_cast<Stage>(stage)),
+                toMicroseconds(sum) / count, toMicroseconds(times[count / 2]),
+                toMicroseconds(times[std::min(count - 1, count * 95 / 100)]),
+                toMicroseconds(times[count - 1]));
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = DEFAULT_ITERATIONS;
+    bool printAllFrames = false;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "i:fh?")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'f':
+                printAllFrames = true;
+                break;
+            case 'h':
+            case '?':
+                printHelpMenu();
+                exit(0);
+            default:
+                std::cerr << "Invalid argument...exiting" << std::endl;
+                printHelpMenu();
+                exit(1);
+        }
+    }
+
+    if (optind >= argc) {
+        std::cerr << "No trace file provided...exiting" << std::endl;
+        printHelpMenu();
+        exit(1);
+    }
+    if (iterations < 1) {
+        std::cerr << "Invalid number of iterations...exiting" << std::endl;
+        exit(1);
+    }
+
+    if (printAllFrames) {
+        printf("trace,iteration,frame");
+        for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+            printf(",%s", toString(static_cast<Stage>(stage)));
+        }
+        printf(",visible layers,recomputed layers,client layers\n");
+    }
+
+    for (int i = optind; i < argc; i++) {
+        const std::string filename(argv[i]);
+        std::string input;
+        Trace trace;
+        if (!android::base::ReadFileToString(filename, &input, true) ||
+                !trace.ParseFromString(input)) {
+            std::cerr << "Trace did not load. Does " << filename << " exist?" << std::endl;
+            exit(1);
+        }
+
+        std::vector<FrameStats> frames;
+        uint64_t drawnPixels = 0;
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            uint64_t iterationPixels = 0;
+            std::vector<FrameStats> iterationFrames(runTrace(trace, &iterationPixels));
+            if (printAllFrames) {
+                printFrames(filename, iteration, iterationFrames);
+            }
+            frames.insert(frames.end(), iterationFrames.begin(), iterationFrames.end());
+            drawnPixels += iterationPixels;
+        }
+        if (!printAllFrames) {
+            printSummary(filename, iterations, frames, drawnPixels);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,283 @@
+#!/usr/bin/python
+#
+# Generates the traces of the benchmark corpus. They are written as text protos
+# and encoded with aprotoc, set PROTOC to use another protoc binary.
+#
+#   $ ./generate_corpus.py
+#
+from subprocess import Popen, PIPE
+import os
+import sys
+
+corpus_path = os.path.dirname(os.path.abspath(__file__))
+proto_path = os.path.join(corpus_path, "..", "..", "proto", "src")
+protoc = os.environ.get("PROTOC", "aprotoc")
+
+WIDTH = 1080
+HEIGHT = 1920
+STATUS_BAR_HEIGHT = 63
+NAV_BAR_HEIGHT = 126
+VSYNC_PERIOD = 16666667
+
+class TraceWriter:
+    def __init__(self):
+        self.lines = []
+        self.time = 0
+        self.next_id = 1
+
+    def increment(self, body):
+        self.lines.append("increment { time_stamp: %d %s }" % (self.time, body))
+
+    def transaction(self, changes, animation=False):
+        self.increment("transaction { %s synchronous: false animation: %s }" %
+                (" ".join(changes), "true" if animation else "false"))
+
+    def display(self, display_id):
+        self.increment('display_creation { id: %d name: "Built-in Screen" type: 0 '
+                'is_secure: true }' % display_id)
+        viewport = rect(0, 0, WIDTH, HEIGHT)
+        self.transaction([
+            "display_change { id: %d layer_stack { layer_stack: 0 } }" % display_id,
+            "display_change { id: %d size { w: %d h: %d } }" % (display_id, WIDTH, HEIGHT),
+            "display_change { id: %d projection { orientation: 0 viewport { %s } frame { %s } } }"
+                    % (display_id, viewport, viewport),
+        ])
+
+    def surface(self, name, w, h, x, y, z, opaque=False):
+        surface_id = self.next_id
+        self.next_id += 1
+        self.increment('surface_creation { id: %d name: "%s" w: %d h: %d }' %
+                (surface_id, name, w, h))
+        changes = [position(surface_id, x, y), layer(surface_id, z),
+                "surface_change { id: %d layer_stack { layer_stack: 0 } }" % surface_id,
+                "surface_change { id: %d alpha { alpha: 1.0 } }" % surface_id]
+        if opaque:
+            changes.append("surface_change { id: %d opaque_flag { opaque_flag: true } }" %
+                    surface_id)
+        self.transaction(changes)
+        return surface_id
+
+    def delete(self, surface_id):
+        self.increment("surface_deletion { id: %d }" % surface_id)
+
+    def buffer(self, surface_id, w, h, frame):
+        self.increment("buffer_update { id: %d w: %d h: %d frame_number: %d }" %
+                (surface_id, w, h, frame))
+
+    def vsync(self):
+        self.time += VSYNC_PERIOD
+        self.increment("vsync_event { when: %d }" % self.time)
+
+    def write(self, name):
+        path = os.path.join(corpus_path, name)
+        process = Popen([protoc, "-I=" + proto_path, "--encode=Trace",
+                os.path.join(proto_path, "trace.proto")], stdin=PIPE, stdout=PIPE)
+        output = process.communicate("\n".join(self.lines).encode())[0]
+        if process.returncode != 0:
+            sys.exit("Could not encode " + name)
+        with open(path, "wb") as f:
+            f.write(output)
+        print("Wrote %s (%d increments)" % (name, len(self.lines)))
+
+def rect(left, top, right, bottom):
+    return "left: %d top: %d right: %d bottom: %d" % (left, top, right, bottom)
+
+def position(surface_id, x, y):
+    return "surface_change { id: %d position { x: %f y: %f } }" % (surface_id, x, y)
+
+def layer(surface_id, z):
+    return "surface_change { id: %d layer { layer: %d } }" % (surface_id, z)
+
+def alpha(surface_id, value):
+    return "surface_change { id: %d alpha { alpha: %f } }" % (surface_id, value)
+
+def hidden(surface_id, value):
+    return "surface_change { id: %d hidden_flag { hidden_flag: %s } }" % (surface_id,
+            "true" if value else "false")
+
+def scale(surface_id, value):
+    return ("surface_change { id: %d matrix { dsdx: %f dtdx: 0 dsdy: %f dtdy: 0 } }" %
+            (surface_id, value, value))
+
+def size(surface_id, w, h):
+    return "surface_change { id: %d size { w: %d h: %d } }" % (surface_id, w, h)
+
+def system_bars(trace):
+    status_bar = trace.surface("StatusBar", WIDTH, STATUS_BAR_HEIGHT, 0, 0, 161000)
+    nav_bar = trace.surface("NavigationBar", WIDTH, NAV_BAR_HEIGHT,
+            0, HEIGHT - NAV_BAR_HEIGHT, 231000)
+    return status_bar, nav_bar
+
+def ease(t):
+    return t * t * (3 - 2 * t)
+
+# The home screen paging: the wallpaper scrolls under the launcher, which
+# draws every frame.
+def launcher_scroll():
+    trace = TraceWriter()
+    trace.display(0)
+    wallpaper = trace.surface("com.android.systemui.ImageWallpaper", 2 * WIDTH, HEIGHT,
+            0, 0, 21000, opaque=True)
+    launcher = trace.surface("com.android.launcher3/.Launcher", WIDTH, HEIGHT, 0, 0, 21005)
+    status_bar, nav_bar = system_bars(trace)
+    frame = 0
+    for page in range(4):
+        for i in range(40):
+            x = -(page + ease(i / 39.0)) * WIDTH / 4.0
+            trace.transaction([position(wallpaper, x, 0)], animation=True)
+            frame += 1
+            trace.buffer(launcher, WIDTH, HEIGHT, frame)
+            trace.vsync()
+        for i in range(20):
+            trace.vsync()
+    trace.write("launcher_scroll.dat")
+
+# An app opening over the launcher: the starting window and the app window
+# scale and fade in, then the app draws its first frames.
+def app_launch():
+    trace = TraceWriter()
+    trace.display(0)
+    wallpaper = trace.surface("com.android.systemui.ImageWallpaper", 2 * WIDTH, HEIGHT,
+            0, 0, 21000, opaque=True)
+    launcher = trace.surface("com.android.launcher3/.Launcher", WIDTH, HEIGHT, 0, 0, 21005)
+    status_bar, nav_bar = system_bars(trace)
+    for i in range(10):
+        trace.vsync()
+
+    starting = trace.surface("Starting com.android.settings", WIDTH, HEIGHT, 0, 0, 21010,
+            opaque=True)
+    trace.buffer(starting, WIDTH, HEIGHT, 1)
+    for i in range(20):
+        t = ease((i + 1) / 20.0)
+        value = 0.3 + 0.7 * t
+        x = (1 - value) * WIDTH / 2
+        y = (1 - value) * HEIGHT / 2
+        trace.transaction([scale(starting, value), position(starting, x, y),
+                alpha(starting, t)], animation=True)
+        trace.vsync()
+
+    app = trace.surface("com.android.settings/.Settings", WIDTH, HEIGHT, 0, 0, 21015,
+            opaque=True)
+    for frame in range(1, 121):
+        trace.buffer(app, WIDTH, HEIGHT, frame)
+        if frame == 3:
+            trace.delete(starting)
+            trace.transaction([hidden(launcher, True), hidden(wallpaper, True)])
+        trace.vsync()
+    trace.write("app_launch.dat")
+
+# A video played in an app: the video updates at 30fps under the playback
+# controls, which come and go.
+def video_playback():
+    trace = TraceWriter()
+    trace.display(0)
+    app = trace.surface("com.google.android.youtube/.WatchWhileActivity", WIDTH, HEIGHT,
+            0, 0, 21005, opaque=True)
+    video = trace.surface("SurfaceView - com.google.android.youtube", WIDTH, 608,
+            0, STATUS_BAR_HEIGHT, 21004, opaque=True)
+    controls = trace.surface("PopupWindow:playback_controls", WIDTH, 608,
+            0, STATUS_BAR_HEIGHT, 21010)
+    status_bar, nav_bar = system_bars(trace)
+    # The video is in a hole punched in the app window
+    trace.transaction(["surface_change { id: %d transparent_region_hint { region { %s } } }" %
+            (app, rect(0, STATUS_BAR_HEIGHT, WIDTH, STATUS_BAR_HEIGHT + 608))])
+    trace.buffer(app, WIDTH, HEIGHT, 1)
+    for frame in range(600):
+        if frame % 2 == 0:
+            trace.buffer(video, WIDTH, 608, frame // 2 + 1)
+        if frame % 180 == 0:
+            trace.transaction([hidden(controls, frame % 360 != 0)])
+            trace.buffer(controls, WIDTH, 608, frame // 180 + 1)
+        trace.vsync()
+    trace.write("video_playback.dat")
+
+# Split screen with an IME and a picture-in-picture window being dragged
+# around, with many more layers and overlaps.
+def multi_window():
+    trace = TraceWriter()
+    trace.display(0)
+    half = (HEIGHT - STATUS_BAR_HEIGHT - NAV_BAR_HEIGHT) / 2
+    top = trace.surface("com.android.chrome/.Main", WIDTH, half - 16,
+            0, STATUS_BAR_HEIGHT, 21005, opaque=True)
+    divider = trace.surface("DockedStackDivider", WIDTH, 32,
+            0, STATUS_BAR_HEIGHT + half - 16, 21010)
+    bottom = trace.surface("com.google.android.gm/.ConversationListActivity", WIDTH,
+            half - 16, 0, STATUS_BAR_HEIGHT + half + 16, 21005, opaque=True)
+    ime = trace.surface("InputMethod", WIDTH, 800, 0, HEIGHT - NAV_BAR_HEIGHT - 800,
+            21020)
+    trace.transaction([hidden(ime, True)])
+    pip = trace.surface("PipMenuActivity", 480, 270, 560, 1200, 21030, opaque=True)
+    toasts = [trace.surface("Toast", 400, 120, 340, 1500 - 130 * i, 21040 + i)
+            for i in range(6)]
+    status_bar, nav_bar = system_bars(trace)
+
+    frame = 0
+    for i in range(300):
+        frame += 1
+        trace.buffer(top, WIDTH, half - 16, frame)
+        if i % 4 == 0:
+            trace.buffer(bottom, WIDTH, half - 16, frame // 4 + 1)
+        if i == 60:
+            trace.transaction([hidden(ime, False)])
+        if i == 200:
+            trace.transaction([hidden(ime, True)])
+        if 60 <= i < 200:
+            trace.buffer(ime, WIDTH, 800, frame)
+        x = 560 - 500 * ease(abs((i % 100) - 50) / 50.0)
+        y = 1200 - 900 * ease((i % 150) / 150.0)
+        trace.transaction([position(pip, x, y)], animation=True)
+        trace.buffer(pip, 480, 270, frame)
+        visible = (i // 50) % len(toasts)
+        trace.transaction([hidden(toast, n > visible) for n, toast in enumerate(toasts)])
+        trace.vsync()
+    trace.write("multi_window.dat")
+
+# Freeform windows cascaded over the wallpaper, each with a shadow and a
+# caption, while a window in the middle of the stack is dragged around: about
+# 50 layers, most of them overlapping and left to client composition.
+def freeform():
+    trace = TraceWriter()
+    trace.display(0)
+    trace.surface("com.android.systemui.ImageWallpaper", WIDTH, HEIGHT, 0, 0, 21000,
+            opaque=True)
+    w = 600
+    h = 700
+    caption_height = 56
+    shadow = 24
+    windows = []
+    for i in range(15):
+        x = 40 + (i % 5) * 100
+        y = 150 + (i // 5) * 450
+        z = 21005 + 10 * i
+        windows.append((
+            trace.surface("Shadow %d" % i, w + 2 * shadow, h + 2 * shadow,
+                    x - shadow, y - shadow - caption_height, z),
+            trace.surface("DecorCaptionView %d" % i, w, caption_height,
+                    x, y - caption_height, z + 1),
+            trace.surface("com.example.freeform/.Window%d" % i, w, h, x, y, z + 2,
+                    opaque=True)))
+    status_bar, nav_bar = system_bars(trace)
+
+    dragged = windows[7]
+    for frame in range(1, 301):
+        trace.buffer(windows[14][2], w, h, frame)
+        if frame % 2 == 0:
+            trace.buffer(windows[3][2], w, h, frame // 2)
+        x = 140 + 300 * ease(abs((frame % 120) - 60) / 60.0)
+        y = 600 - 400 * ease(abs((frame % 200) - 100) / 100.0)
+        trace.transaction([position(dragged[0], x - shadow, y - shadow - caption_height),
+                position(dragged[1], x, y - caption_height), position(dragged[2], x, y)],
+                animation=True)
+        trace.buffer(dragged[2], w, h, frame)
+        trace.vsync()
+    trace.write("freeform.dat")
+
+def main():
+    launcher_scroll()
+    app_launch()
+    video_playback()
+    multi_window()
+    freeform()
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_COMPILED_KEY_MAP_H
+#define _LIBINPUT_COMPILED_KEY_MAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct KeyMapFileStamp;
+
+/*
+ * Key layout and key character map files can be precompiled into a binary form that
+ * is installed next to the source file, with a 'c' appended to its name (for example
+ * Generic.klc next to Generic.kl).  The compiled file is a header followed by a flat
+ * array of native endian 32-bit words, so loading it is an mmap and a copy.
+ *
+ * A compiled file records the size and a hash of the contents of the source it was
+ * compiled from, and is only used while the source still matches them.  Modification
+ * times are not compared, since they do not survive being copied into a system image
+ * and cannot tell apart two edits within their granularity.  Otherwise the source is
+ * parsed as usual.
+ */
+class CompiledKeyMap {
+public:
+    enum {
+        MAGIC_KEY_LAYOUT_MAP = 0x434c4b41,    // 'AKLC'
+        MAGIC_KEY_CHARACTER_MAP = 0x434d4b41, // 'AKMC'
+    };
+
+    /* Returns the path of the compiled form of a key map file. */
+    static String8 getCompiledPath(const String8& sourcePath);
+};
+
+/*
+ * Builds a compiled key map.
+ */
+class CompiledKeyMapWriter {
+public:
+    CompiledKeyMapWriter(uint32_t magic, const KeyMapFileStamp& sourceStamp);
+
+    void writeInt32(int32_t value);
+
+    /* Writes the compiled map to a file, replacing it atomically. */
+    status_t writeToFile(const String8& path) const;
+
+private:
+    uint32_t mMagic;
+    uint64_t mSourceSize;
+    uint64_t mSourceHash;
+    Vector<int32_t> mWords;
+};
+
+/*
+ * Reads a compiled key map.  Reads past the end return 0 and latch an error.
+ */
+class CompiledKeyMapReader {
+public:
+    CompiledKeyMapReader();
+    ~CompiledKeyMapReader();
+
+    /* Maps the compiled form of the given source file, whose current stamp is given.
+     * Returns NAME_NOT_FOUND if there is none, or if it is out of date or not a compiled
+     * map of the expected kind. */
+    status_t open(const String8& sourcePath, const KeyMapFileStamp& sourceStamp,
+            uint32_t magic);
+
+    int32_t readInt32();
+
+    /* Returns the number of words left to read. */
+    inline size_t remaining() const { return mError ? 0 : mWordCount - mPosition; }
+
+    /* Returns NO_ERROR if all reads so far were in bounds. */
+    inline status_t errorCheck() const { return mError; }
+
+private:
+    void* mMapping;
+    size_t mMappingSize;
+    const int32_t* mWords;
+    size_t mWordCount;
+    size_t mPosition;
+    status_t mError;
+
+    void close();
+};
+
+/*
+ * Identifies a version of a file by its inode, size and a hash of its contents.
+ */
+struct KeyMapFileStamp {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    uint64_t contentHash; // 64-bit FNV-1a
+
+    /* Reads the stamp of a file.  Returns false if the file cannot be read. */
+    bool read(const String8& path);
+
+    inline bool operator==(const KeyMapFileStamp& other) const {
+        return device == other.device && inode == other.inode && size == other.size
+                && contentHash == other.contentHash;
+    }
+};
+
+/*
+ * Shares immutable key maps loaded from files that have not changed since.
+ */
+template <typename T>
+class KeyMapCache {
+public:
+    /* Looks up the map loaded from a file with the given stamp. */
+    bool get(const String8& path, const KeyMapFileStamp& stamp, sp<T>* outMap) {
+        AutoMutex _l(mLock);
+        ssize_t index = mEntries.indexOfKey(path);
+        if (index < 0) {
+            return false;
+        }
+        const Entry& entry = mEntries.valueAt(index);
+        if (!(entry.stamp == stamp)) {
+            return false;
+        }
+        *outMap = entry.map;
+        return true;
+    }
+
+    void put(const String8& path, const KeyMapFileStamp& stamp, const sp<T>& map) {
+        Entry entry;
+        entry.stamp = stamp;
+        entry.map = map;
+
+        AutoMutex _l(mLock);
+        mEntries.add(path, entry);
+    }
+
+private:
+    struct Entry {
+        KeyMapFileStamp stamp;
+        sp<T> map;
+    };
+
+    Mutex mLock;
+    KeyedVector<String8, Entry> mEntries;
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_COMPILED_KEY_MAP_H
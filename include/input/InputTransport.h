@@ -29,6 +29,7 @@
 
 #include <input/Input.h>
 #include <utils/Errors.h>
+#include <utils/Looper.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
 #include <utils/String8.h>
@@ -37,6 +38,8 @@
 
 namespace android {
 
+class InputMessageRing;
+
 /*
  * Intermediate representation used to send input events and related signals.
  *
@@ -48,6 +51,14 @@ struct InputMessage {
         TYPE_KEY = 1,
         TYPE_MOTION = 2,
         TYPE_FINISHED = 3,
+
+        // Used by InputChannel itself to set up the transport when shared memory is
+        // enabled.  The server queues either ATTACH, which carries the shared memory
+        // fd, or NONE when the pair is created.  WAKE signals new messages in shared
+        // memory.
+        TYPE_SHARED_MEMORY_ATTACH = 4,
+        TYPE_SHARED_MEMORY_WAKE = 5,
+        TYPE_SHARED_MEMORY_NONE = 6,
     };
 
     struct Header {
@@ -135,6 +146,11 @@ struct InputMessage {
  *
  * Each endpoint has its own InputChannel object that specifies its file descriptor.
  *
+ * With the shared memory transport, messages from the server to the client are
+ * copied through a ring buffer in shared memory instead, and the socket only carries
+ * wakeups and the messages from the client to the server.  The ring is handed to the
+ * client over the socket, so the client end is still described by its fd alone.
+ *
  * The input channel is closed when all references to it are released.
  */
 class InputChannel : public RefBase {
@@ -144,13 +160,35 @@ protected:
 public:
     InputChannel(const String8& name, int fd);
 
-    /* Creates a pair of input channels.
+    enum {
+        // Every message is a packet on the socket pair.
+        TRANSPORT_SOCKET = 0,
+        // Messages from the server to the client go through shared memory.
+        TRANSPORT_SHARED_MEMORY = 1,
+    };
+
+    /* Creates a pair of input channels using the default transport, which is
+     * TRANSPORT_SHARED_MEMORY if ro.input.shared_memory_channel is 1 and
+     * TRANSPORT_SOCKET otherwise.
      *
      * Returns OK on success.
      */
     static status_t openInputChannelPair(const String8& name,
             sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
 
+    /* Returns true if ro.input.shared_memory_channel is 1. */
+    static bool isSharedMemoryTransportEnabled();
+
+    /* Creates a pair of input channels using the specified transport.
+     *
+     * A client end recreated from its fd only looks for the ring if
+     * ro.input.shared_memory_channel is 1.
+     *
+     * Returns OK on success.
+     */
+    static status_t openInputChannelPair(const String8& name, int transport,
+            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
+
     inline String8 getName() const { return mName; }
     inline int getFd() const { return mFd; }
 
@@ -179,12 +217,58 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
-    /* Returns a new object that has a duplicate of this channel's fd. */
+    /* Sends up to count messages to the other endpoint, using as few system calls
+     * as possible.  Each message is still delivered separately.
+     *
+     * Messages are sent in order.  On return, outSent holds the number of messages
+     * that were sent, which is less than count only when an error is returned.
+     *
+     * Returns OK if all of the messages were sent.
+     * Returns WOULD_BLOCK if the channel filled up before all of the messages were sent.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count, size_t* outSent);
+
+    /* Receives up to capacity messages sent by the other endpoint, using as few
+     * system calls as possible.
+     *
+     * On success, outCount holds the number of messages received, which is at least 1.
+     * A count less than capacity means that the channel was empty when it was read.
+     *
+     * Returns OK on success.
+     * Returns WOULD_BLOCK if there is no message present.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t receiveMessages(InputMessage* msgs, size_t capacity, size_t* outCount);
+
+    /* Returns a new object that has a duplicate of this channel's fd.
+     *
+     * The two objects share the ring that the client end receives from, so they
+     * must not receive messages concurrently.
+     */
     sp<InputChannel> dup() const;
 
 private:
+    struct ReceiveRingState;
+
     String8 mName;
     int mFd;
+
+    // The ring that carries messages from the server to the client, if any.  The
+    // server end creates it and sends to it, the client end maps it when it receives
+    // the ATTACH message and receives from it.
+    sp<InputMessageRing> mSendRing;
+
+    // The client end of the ring.  A channel and its dups receive from the same
+    // socket, and only the one that gets the ATTACH message can map the ring, so
+    // they share it.
+    sp<ReceiveRingState> mReceiveRingState;
+
+    status_t sendSocketMessage(const InputMessage* msg);
+    status_t receiveSocketMessage(InputMessage* msg);
+    status_t wakeRingReader();
 };
 
 /*
@@ -264,8 +348,42 @@ public:
      */
     status_t receiveFinishedSignal(uint32_t* outSeq, bool* outHandled);
 
+    /* Starts queueing published events instead of sending them immediately.
+     *
+     * While a batch is open, publishKeyEvent() and publishMotionEvent() validate and
+     * queue their event and return OK.  endBatch() then sends all of the queued events
+     * with as few system calls as possible.  If the queue fills up, the events queued
+     * so far are sent before the new one is queued, and any error from doing so is
+     * returned by the publish call.
+     */
+    void beginBatch();
+
+    /* Sends the events queued since beginBatch() and closes the batch.
+     *
+     * Events that could not be sent stay queued and the batch stays open, so the
+     * caller can call endBatch() again once the consumer has finished some events.
+     *
+     * Returns OK if all of the queued events were sent.
+     * Returns WOULD_BLOCK if the channel is full.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t endBatch();
+
+    /* Returns the number of events queued by the open batch that have not been sent. */
+    inline size_t getPendingBatchSize() const { return mPendingMessages.size(); }
+
 private:
     sp<InputChannel> mChannel;
+
+    // True between beginBatch() and a successful endBatch().
+    bool mBatching;
+
+    // Events published while batching that have not been sent yet.
+    Vector<InputMessage> mPendingMessages;
+
+    status_t sendMessage(const InputMessage* msg);
+    status_t flushPendingMessages();
 };
 
 /*
@@ -336,7 +454,8 @@ public:
      *
      * Alternately, the caller can call hasDeferredEvent() to determine whether there is
      * a deferred event waiting and then ensure that its event loop wakes up at least
-     * one more time to consume the deferred event.
+     * one more time to consume the deferred event, or let setDeferredEventHandler()
+     * do that for it.
      */
     bool hasDeferredEvent() const;
 
@@ -347,6 +466,29 @@ public:
      */
     bool hasPendingBatch() const;
 
+    /* Sets the maximum number of messages to drain from the input channel per
+     * system call.
+     *
+     * The default of 1 receives one message at a time.  Larger values let a single
+     * wakeup drain a whole burst of messages, for example all of the touch samples
+     * that arrived while the application was busy drawing.  Messages drained this
+     * way are held by the consumer until they are consumed, so hasDeferredEvent()
+     * returns true while any of them are left.  See setDeferredEventHandler() for
+     * callers that only consume events when the channel's fd is readable.
+     */
+    void setReceiveBurstSize(size_t burstSize);
+
+    /* Sets a handler to be woken up through the looper while the consumer holds
+     * deferred events.
+     *
+     * Deferred events have already been removed from the input channel, so its fd
+     * does not wake the looper up for them.  When consume() returns and
+     * hasDeferredEvent() is true, a message is posted to the handler on the looper,
+     * and the handler is expected to call consume() again.  Only one message is
+     * pending at a time.  Pass NULL to stop posting messages.
+     */
+    void setDeferredEventHandler(const sp<Looper>& looper, const sp<MessageHandler>& handler);
+
 private:
     int mTouchMoveCounter = 0;
 
@@ -363,6 +505,31 @@ private:
     // call to consume and that still needs to be handled.
     bool mMsgDeferred;
 
+    // Messages drained from the input channel by a burst receive.  The messages
+    // in [mReceiveHead, mReceiveCount) have not been handled yet.
+    size_t mReceiveBurstSize;
+    Vector<InputMessage> mReceiveBuffer;
+    size_t mReceiveHead;
+    size_t mReceiveCount;
+
+    // True if a burst receive during the current call to consume() found the input
+    // channel empty, so the next receive can report WOULD_BLOCK without asking the
+    // channel again.
+    bool mReceiveDrained;
+
+    // Forwards the wakeup for deferred events to the caller's handler, and remembers
+    // whether one is already pending on the looper.
+    class DeferredEventWaker : public MessageHandler {
+    public:
+        explicit DeferredEventWaker(const sp<MessageHandler>& handler);
+        virtual void handleMessage(const Message& message);
+
+        const sp<MessageHandler> handler;
+        bool pending;
+    };
+    sp<Looper> mDeferredEventLooper;
+    sp<DeferredEventWaker> mDeferredEventWaker;
+
     // Batched motion events per device and source.
     struct Batch {
         Vector<InputMessage> samples;
@@ -472,6 +639,13 @@ private:
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
 
+    status_t consumeMessages(InputEventFactoryInterface* factory, bool consumeBatches,
+            nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent, int32_t* displayId);
+    status_t consumeMessages(InputEventFactoryInterface* factory, bool consumeBatches,
+            nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent, int32_t* displayId,
+            int* motionEventType, int* touchMoveNumber, bool* flag);
+    void wakeForDeferredEvent();
+    status_t receiveMessage(InputMessage* msg);
     status_t sendUnchainedFinishedSignal(uint32_t seq, bool handled);
 
     static void initializeKeyEvent(KeyEvent* event, const InputMessage* msg);
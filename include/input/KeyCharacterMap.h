@@ -36,6 +36,10 @@
 
 namespace android {
 
+class CompiledKeyMapReader;
+class CompiledKeyMapWriter;
+struct KeyMapFileStamp;
+
 /**
  * Describes a mapping from Android key codes to characters.
  * Also specifies other functions of the keyboard such as the keyboard type
@@ -71,9 +75,14 @@ public:
         int32_t metaState;
     };
 
-    /* Loads a key character map from a file. */
+    /* Loads a key character map from a file.  Uses its compiled form when it is up to
+     * date, and returns the same map again until the file changes. */
     static status_t load(const String8& filename, Format format, sp<KeyCharacterMap>* outMap);
 
+    /* Parses a key character map file and writes its compiled form to outFilename. */
+    static status_t compile(const String8& filename, Format format,
+            const String8& outFilename);
+
     /* Loads a key character map from its string contents. */
     static status_t loadContents(const String8& filename,
             const char* contents, Format format, sp<KeyCharacterMap>* outMap);
@@ -241,6 +250,17 @@ private:
     bool findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMetaState) const;
 
     static status_t load(Tokenizer* tokenizer, Format format, sp<KeyCharacterMap>* outMap);
+    static status_t loadSource(const String8& filename, Format format,
+            sp<KeyCharacterMap>* outMap);
+    static status_t loadCompiled(const String8& filename, const KeyMapFileStamp& stamp,
+            sp<KeyCharacterMap>* outMap);
+    static status_t readCompiledKeyCodes(CompiledKeyMapReader& reader,
+            KeyedVector<int32_t, int32_t>* outKeyCodes);
+    static void writeCompiledKeyCodes(CompiledKeyMapWriter& writer,
+            const KeyedVector<int32_t, int32_t>& keyCodes);
+
+    /* Checks that the keyboard type is allowed by the given format. */
+    status_t checkFormat(const String8& location, Format format) const;
 
     static void addKey(Vector<KeyEvent>& outEvents,
             int32_t deviceId, int32_t keyCode, int32_t metaState, bool down, nsecs_t time);
@@ -25,6 +25,10 @@
 
 namespace android {
 
+class CompiledKeyMapReader;
+class CompiledKeyMapWriter;
+struct KeyMapFileStamp;
+
 struct AxisInfo {
     enum Mode {
         // Axis value is reported directly.
@@ -62,8 +66,13 @@ struct AxisInfo {
  */
 class KeyLayoutMap : public RefBase {
 public:
+    /* Loads a key layout map file.  Uses its compiled form when it is up to date, and
+     * returns the same map again until the file changes. */
     static status_t load(const String8& filename, sp<KeyLayoutMap>* outMap);
 
+    /* Parses a key layout map file and writes its compiled form to outFilename. */
+    static status_t compile(const String8& filename, const String8& outFilename);
+
     status_t mapKey(int32_t scanCode, int32_t usageCode,
             int32_t* outKeyCode, uint32_t* outFlags) const;
     status_t findScanCodesForKey(int32_t keyCode, Vector<int32_t>* outScanCodes) const;
@@ -96,6 +105,18 @@ private:
 
     const Key* getKey(int32_t scanCode, int32_t usageCode) const;
 
+    static status_t loadSource(const String8& filename, sp<KeyLayoutMap>* outMap);
+    static status_t loadCompiled(const String8& filename, const KeyMapFileStamp& stamp,
+            sp<KeyLayoutMap>* outMap);
+    static status_t readCompiledKeys(CompiledKeyMapReader& reader,
+            KeyedVector<int32_t, Key>* outKeys);
+    static status_t readCompiledLeds(CompiledKeyMapReader& reader,
+            KeyedVector<int32_t, Led>* outLeds);
+    static void writeCompiledKeys(CompiledKeyMapWriter& writer,
+            const KeyedVector<int32_t, Key>& keys);
+    static void writeCompiledLeds(CompiledKeyMapWriter& writer,
+            const KeyedVector<int32_t, Led>& leds);
+
     class Parser {
         KeyLayoutMap* mMap;
         Tokenizer* mTokenizer;
@@ -95,6 +95,13 @@ public:
     // about the pointer.
     bool getEstimator(uint32_t id, Estimator* outEstimator) const;
 
+    // Gets estimators for several pointers at once, which is cheaper than getting them
+    // one at a time.  The outEstimators array receives an estimator for each id in
+    // idBits, in order by increasing id.
+    // Returns the ids of the pointers for which information was available; the estimators
+    // of the others are cleared.
+    BitSet32 getEstimators(BitSet32 idBits, Estimator* outEstimators) const;
+
     // Gets the active pointer id, or -1 if none.
     inline int32_t getActivePointerId() const { return mActivePointerId; }
 
@@ -130,6 +137,8 @@ public:
     virtual void addMovement(nsecs_t eventTime, BitSet32 idBits,
             const VelocityTracker::Position* positions) = 0;
     virtual bool getEstimator(uint32_t id, VelocityTracker::Estimator* outEstimator) const = 0;
+    virtual BitSet32 getEstimators(BitSet32 idBits,
+            VelocityTracker::Estimator* outEstimators) const;
 };
 
 
@@ -162,6 +171,8 @@ public:
     virtual void addMovement(nsecs_t eventTime, BitSet32 idBits,
             const VelocityTracker::Position* positions);
     virtual bool getEstimator(uint32_t id, VelocityTracker::Estimator* outEstimator) const;
+    virtual BitSet32 getEstimators(BitSet32 idBits,
+            VelocityTracker::Estimator* outEstimators) const;
 
 private:
     // Sample horizon.
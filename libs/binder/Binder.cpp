@@ -24,6 +24,8 @@
 #include <binder/IShellCallback.h>
 #include <binder/Parcel.h>
 
+#include <private/binder/TransactionProfiler.h>
+
 #include <stdio.h>
 
 namespace android {
@@ -86,8 +88,12 @@ status_t IBinder::shellCommand(const sp<IBinder>& target, int in, int out, int e
 class BBinder::Extras
 {
 public:
+    Extras() : mProfileInterface(TransactionProfiler::NO_INTERFACE) { }
+
     Mutex mLock;
     BpBinder::ObjectManager mObjects;
+    // TransactionProfiler's id for this binder's interface.
+    std::atomic<uint32_t> mProfileInterface;
 };
 
 // ---------------------------------------------------------------------------
@@ -120,6 +126,8 @@ status_t BBinder::transact(
 {
     data.setDataPosition(0);
 
+    const nsecs_t profileStart = TransactionProfiler::isEnabled() ? systemTime() : 0;
+
     status_t err = NO_ERROR;
     switch (code) {
         case PING_TRANSACTION:
@@ -130,6 +138,11 @@ status_t BBinder::transact(
             break;
     }
 
+    if (profileStart != 0) {
+        TransactionProfiler::recordServer(getProfileInterface(), code, data, reply,
+                systemTime() - profileStart);
+    }
+
     if (reply != NULL) {
         reply->setDataPosition(0);
     }
@@ -160,19 +173,8 @@ void BBinder::attachObject(
     const void* objectID, void* object, void* cleanupCookie,
     object_cleanup_func func)
 {
-    Extras* e = mExtras.load(std::memory_order_acquire);
-
-    if (!e) {
-        e = new Extras;
-        Extras* expected = nullptr;
-        if (!mExtras.compare_exchange_strong(expected, e,
-                                             std::memory_order_release,
-                                             std::memory_order_acquire)) {
-            delete e;
-            e = expected;  // Filled in by CAS
-        }
-        if (e == 0) return; // out of memory
-    }
+    Extras* e = getOrCreateExtras();
+    if (e == 0) return; // out of memory
 
     AutoMutex _l(e->mLock);
     e->mObjects.attach(objectID, object, cleanupCookie, func);
@@ -201,6 +203,36 @@ BBinder* BBinder::localBinder()
     return this;
 }
 
+BBinder::Extras* BBinder::getOrCreateExtras()
+{
+    Extras* e = mExtras.load(std::memory_order_acquire);
+
+    if (!e) {
+        e = new Extras;
+        Extras* expected = nullptr;
+        if (!mExtras.compare_exchange_strong(expected, e,
+                                             std::memory_order_release,
+                                             std::memory_order_acquire)) {
+            delete e;
+            e = expected;  // Filled in by CAS
+        }
+    }
+    return e;
+}
+
+uint32_t BBinder::getProfileInterface()
+{
+    Extras* e = getOrCreateExtras();
+    if (e == 0) return TransactionProfiler::UNKNOWN_INTERFACE;
+
+    uint32_t interface = e->mProfileInterface.load(std::memory_order_relaxed);
+    if (interface == TransactionProfiler::NO_INTERFACE) {
+        interface = TransactionProfiler::internInterface(getInterfaceDescriptor());
+        e->mProfileInterface.store(interface, std::memory_order_relaxed);
+    }
+    return interface;
+}
+
 BBinder::~BBinder()
 {
     Extras* e = mExtras.load(std::memory_order_relaxed);
@@ -223,6 +255,9 @@ status_t BBinder::onTransact(
             for (int i = 0; i < argc && data.dataAvail() > 0; i++) {
                args.add(data.readString16());
             }
+            if (TransactionProfiler::handleDumpArgs(fd, args)) {
+                return NO_ERROR;
+            }
             return dump(fd, args);
         }
 
@@ -21,6 +21,7 @@
 
 #include <binder/IPCThreadState.h>
 #include <binder/IResultReceiver.h>
+#include <private/binder/TransactionProfiler.h>
 #include <utils/Log.h>
 
 #include <stdio.h>
@@ -92,6 +93,7 @@ BpBinder::BpBinder(int32_t handle)
     , mAlive(1)
     , mObitsSent(0)
     , mObituaries(NULL)
+    , mProfileInterface(TransactionProfiler::NO_INTERFACE)
 {
     ALOGV("Creating BpBinder %p handle %d\n", this, mHandle);
 
@@ -162,9 +164,25 @@ status_t BpBinder::transact(
 {
     // Once a binder has died, it will never come back to life.
     if (mAlive) {
+        const nsecs_t profileStart = TransactionProfiler::isEnabled() ? systemTime() : 0;
         status_t status = IPCThreadState::self()->transact(
             mHandle, code, data, reply, flags);
         if (status == DEAD_OBJECT) mAlive = 0;
+        if (profileStart != 0) {
+            const nsecs_t elapsed = systemTime() - profileStart;
+            uint32_t interface = mProfileInterface.load(std::memory_order_relaxed);
+            if (interface == TransactionProfiler::NO_INTERFACE) {
+                // Only calls start with an interface token; keep looking
+                // until one does.
+                interface = TransactionProfiler::internInterfaceToken(data);
+                if (interface != TransactionProfiler::NO_INTERFACE) {
+                    mProfileInterface.store(interface, std::memory_order_relaxed);
+                } else {
+                    interface = TransactionProfiler::UNKNOWN_INTERFACE;
+                }
+            }
+            TransactionProfiler::recordClient(interface, code, data, reply, elapsed);
+        }
         return status;
     }
 
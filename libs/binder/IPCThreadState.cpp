@@ -32,10 +32,12 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <unistd.h>
@@ -105,7 +107,9 @@ static const char *kCommandStrings[] = {
     "BC_EXIT_LOOPER",
     "BC_REQUEST_DEATH_NOTIFICATION",
     "BC_CLEAR_DEATH_NOTIFICATION",
-    "BC_DEAD_BINDER_DONE"
+    "BC_DEAD_BINDER_DONE",
+    "BC_TRANSACTION_SG",
+    "BC_REPLY_SG"
 };
 
 static const char* getReturnString(uint32_t cmd)
@@ -218,6 +222,16 @@ static const void* printCommand(TextOutput& out, const void* _cmd)
             out << dedent;
         } break;
 
+        case BC_TRANSACTION_SG:
+        case BC_REPLY_SG: {
+            out << ": " << indent;
+            cmd = (const int32_t *)printBinderTransactionData(out, cmd);
+            const binder_size_t* buffersSize = (const binder_size_t*)cmd;
+            out << endl << "buffers=" << (void*)(long)*buffersSize << " bytes";
+            cmd = (const int32_t *)(buffersSize+1);
+            out << dedent;
+        } break;
+
         case BC_ACQUIRE_RESULT: {
             const int32_t res = *cmd++;
             out << ": " << res << (res ? " (SUCCESS)" : " (FAILURE)");
@@ -414,11 +428,16 @@ void IPCThreadState::flushCommands()
 void IPCThreadState::blockUntilThreadAvailable()
 {
     pthread_mutex_lock(&mProcess->mThreadCountLock);
-    while (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads) {
-        ALOGW("Waiting for thread to be free. mExecutingThreadsCount=%lu mMaxThreads=%lu\n",
-                static_cast<unsigned long>(mProcess->mExecutingThreadsCount),
-                static_cast<unsigned long>(mProcess->mMaxThreads));
-        pthread_cond_wait(&mProcess->mThreadCountDecrement, &mProcess->mThreadCountLock);
+    if (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads) {
+        const nsecs_t waitStart = systemTime();
+        while (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads) {
+            ALOGW("Waiting for thread to be free. mExecutingThreadsCount=%lu mMaxThreads=%lu\n",
+                    static_cast<unsigned long>(mProcess->mExecutingThreadsCount),
+                    static_cast<unsigned long>(mProcess->mMaxThreads));
+            pthread_cond_wait(&mProcess->mThreadCountDecrement, &mProcess->mThreadCountLock);
+        }
+        mProcess->mBlockedWaits++;
+        mProcess->mBlockedWaitNs += systemTime() - waitStart;
     }
     pthread_mutex_unlock(&mProcess->mThreadCountLock);
 }
@@ -438,17 +457,37 @@ status_t IPCThreadState::getAndExecuteCommand()
                  << getReturnString(cmd) << endl;
         }
 
+        bool spawnLooper = false;
         pthread_mutex_lock(&mProcess->mThreadCountLock);
         mProcess->mExecutingThreadsCount++;
         if (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads &&
                 mProcess->mStarvationStartTimeMs == 0) {
             mProcess->mStarvationStartTimeMs = uptimeMillis();
         }
+        // With an adaptive pool, make sure another looper is waiting for the
+        // next command once this one is busy.
+        if (mProcess->mAdaptiveThreadPool && mProcess->mThreadPoolStarted &&
+                mProcess->mExecutingThreadsCount >= mProcess->mPoolThreads &&
+                mProcess->mPoolThreads < mProcess->mMaxThreads) {
+            mProcess->mPoolThreads++;
+            mProcess->mPolicySpawns++;
+            if (mProcess->mPoolThreads > mProcess->mPeakPoolThreads) {
+                mProcess->mPeakPoolThreads = mProcess->mPoolThreads;
+            }
+            spawnLooper = true;
+        }
         pthread_mutex_unlock(&mProcess->mThreadCountLock);
 
+        if (spawnLooper) {
+            mProcess->spawnPolicyThread();
+        }
+
+        const nsecs_t commandStart = systemTime();
         result = executeCommand(cmd);
+        const nsecs_t commandTime = systemTime() - commandStart;
 
         pthread_mutex_lock(&mProcess->mThreadCountLock);
+        mProcess->mBusyTimeNs += commandTime;
         mProcess->mExecutingThreadsCount--;
         if (mProcess->mExecutingThreadsCount < mProcess->mMaxThreads &&
                 mProcess->mStarvationStartTimeMs != 0) {
@@ -491,14 +530,74 @@ void IPCThreadState::processPendingDerefs()
 }
 
 void IPCThreadState::joinThreadPool(bool isMain)
+{
+    runLooper(isMain, false);
+}
+
+// Blocks until the driver has work for this looper, or until the adaptive
+// pool's idle timeout expires. Returns true if this looper should leave the
+// pool.
+bool IPCThreadState::waitForWorkOrRetire()
+{
+    pthread_mutex_lock(&mProcess->mThreadCountLock);
+    const bool adaptive = mProcess->mAdaptiveThreadPool;
+    const int timeoutMs = mProcess->mIdleTimeoutMs;
+    pthread_mutex_unlock(&mProcess->mThreadCountLock);
+
+    if (!adaptive || timeoutMs <= 0 || mIn.dataPosition() < mIn.dataSize()) {
+        return false;
+    }
+
+    // Make sure queued commands (buffer frees, refcounts, BC_ENTER_LOOPER)
+    // reach the driver before we go to sleep.
+    if (mOut.dataSize() > 0) {
+        talkWithDriver(false);
+    }
+
+    struct pollfd pfd;
+    pfd.fd = mProcess->mDriverFD;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeoutMs));
+    if (ret != 0) {
+        // Work is pending, or the driver reported an error that the next
+        // read will surface.
+        return false;
+    }
+    return mProcess->retireIdleLooper();
+}
+
+void IPCThreadState::runLooper(bool isMain, bool policySpawned)
 {
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS JOINING THE THREAD POOL\n", (void*)pthread_self(), getpid());
 
     mOut.writeInt32(isMain ? BC_ENTER_LOOPER : BC_REGISTER_LOOPER);
 
-    status_t result;
+    // Loopers spawned by the adaptive policy were counted when they were
+    // requested; everyone else is counted here.
+    pthread_mutex_lock(&mProcess->mThreadCountLock);
+    if (!policySpawned) {
+        mProcess->mPoolThreads++;
+        if (mProcess->mPoolThreads > mProcess->mPeakPoolThreads) {
+            mProcess->mPeakPoolThreads = mProcess->mPoolThreads;
+        }
+    }
+    pthread_mutex_unlock(&mProcess->mThreadCountLock);
+
+    // The looper that started the pool, and any thread that joined it
+    // directly as main, never retires.
+    const bool canRetire = !isMain || policySpawned;
+    bool retired = false;
+
+    status_t result = NO_ERROR;
     do {
         processPendingDerefs();
+
+        if (canRetire && waitForWorkOrRetire()) {
+            retired = true;
+            break;
+        }
+
         // now get the next command to be processed, waiting if necessary
         result = getAndExecuteCommand();
 
@@ -515,6 +614,14 @@ void IPCThreadState::joinThreadPool(bool isMain)
         }
     } while (result != -ECONNREFUSED && result != -EBADF);
 
+    if (retired) {
+        result = TIMED_OUT;
+    } else {
+        pthread_mutex_lock(&mProcess->mThreadCountLock);
+        mProcess->mPoolThreads--;
+        pthread_mutex_unlock(&mProcess->mThreadCountLock);
+    }
+
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS LEAVING THE THREAD POOL err=%d\n",
         (void*)pthread_self(), getpid(), result);
 
@@ -571,6 +678,17 @@ status_t IPCThreadState::transact(int32_t handle,
             << indent << data << dedent << endl;
     }
 
+    if (err == NO_ERROR && mBatchDepth > 0 && (flags & TF_ONE_WAY) != 0
+            && data.ipcBuffersSize() == 0) {
+        // Buffer references point into caller memory that may be gone by
+        // the time the batch is flushed, so those are never batched.
+        err = batchTransaction(handle, code, data, flags);
+        if (err != NO_ERROR) {
+            mLastError = err;
+        }
+        return err;
+    }
+
     if (err == NO_ERROR) {
         LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
             (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
@@ -618,6 +736,139 @@ status_t IPCThreadState::transact(int32_t handle,
     return err;
 }
 
+void IPCThreadState::beginBatch(size_t flushThreshold)
+{
+    if (mBatchDepth++ == 0) {
+        mBatchFlushThreshold = flushThreshold;
+    }
+}
+
+status_t IPCThreadState::endBatch()
+{
+    if (mBatchDepth == 0) {
+        ALOGE("endBatch() called without a matching beginBatch()");
+        return INVALID_OPERATION;
+    }
+    if (--mBatchDepth > 0) {
+        return NO_ERROR;
+    }
+    return flushBatch();
+}
+
+status_t IPCThreadState::flushBatch()
+{
+    status_t err = NO_ERROR;
+
+    // The first talkWithDriver() hands every queued command to the driver
+    // in one write; the remaining iterations only read back the results.
+    while (mBatchPendingResults > 0) {
+        if ((err=talkWithDriver()) < NO_ERROR) break;
+        err = mIn.errorCheck();
+        if (err < NO_ERROR) break;
+        if (mIn.dataAvail() == 0) continue;
+
+        const int32_t cmd = mIn.readInt32();
+        if (consumeBatchResult(cmd)) continue;
+
+        const status_t result = executeCommand(cmd);
+        if (result != NO_ERROR && mBatchError == NO_ERROR) {
+            mBatchError = result;
+        }
+    }
+
+    if (err < NO_ERROR) {
+        // The driver is unusable; nothing queued will ever be consumed.
+        ALOGE("Lost %zu batched transactions: %s", mBatchPendingResults, strerror(-err));
+        mBatchPendingResults = 0;
+        mOut.setDataSize(0);
+        if (mBatchError == NO_ERROR) {
+            mBatchError = err;
+        }
+    }
+
+    // The driver has copied every batched transaction by now, so the Parcels
+    // backing them can be recycled.
+    for (size_t i = 0; i < mBatchCount; i++) {
+        mBatchParcels[i]->freeData();
+    }
+    mBatchCount = 0;
+    mBatchBytes = 0;
+
+    err = mBatchError;
+    mBatchError = NO_ERROR;
+    if (err != NO_ERROR) {
+        mLastError = err;
+    }
+    return err;
+}
+
+uint64_t IPCThreadState::getDriverCallCount() const
+{
+    return mDriverCalls;
+}
+
+status_t IPCThreadState::batchTransaction(int32_t handle, uint32_t code,
+        const Parcel& data, uint32_t flags)
+{
+    Parcel* copy;
+    if (mBatchCount < mBatchParcels.size()) {
+        copy = mBatchParcels[mBatchCount];
+    } else {
+        copy = new Parcel;
+        mBatchParcels.push(copy);
+    }
+
+    // The caller may destroy its Parcel as soon as we return, so the queued
+    // command references a copy that lives until the batch is flushed.
+    status_t err = copy->appendFrom(&data, 0, data.dataSize());
+    if (err == NO_ERROR) {
+        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, NULL);
+    }
+    if (err != NO_ERROR) {
+        copy->freeData();
+        return err;
+    }
+
+    mBatchCount++;
+    mBatchPendingResults++;
+    mBatchBytes += copy->dataSize() + copy->objectsCount() * sizeof(binder_size_t);
+    if (mBatchBytes >= mBatchFlushThreshold || mBatchCount >= MAX_BATCHED_TRANSACTIONS) {
+        return flushBatch();
+    }
+    return NO_ERROR;
+}
+
+// The driver answers every BC_TRANSACTION with exactly one of these, in the
+// order the commands were written, so results for batched transactions
+// always arrive ahead of those for anything written after them.
+bool IPCThreadState::consumeBatchResult(int32_t cmd)
+{
+    if (mBatchPendingResults == 0) {
+        return false;
+    }
+
+    status_t err;
+    switch ((uint32_t)cmd) {
+    case BR_TRANSACTION_COMPLETE:
+        err = NO_ERROR;
+        break;
+    case BR_DEAD_REPLY:
+        err = DEAD_OBJECT;
+        break;
+    case BR_FAILED_REPLY:
+        err = FAILED_TRANSACTION;
+        break;
+    default:
+        return false;
+    }
+
+    mBatchPendingResults--;
+    if (err != NO_ERROR && mBatchError == NO_ERROR) {
+        mBatchError = err;
+    }
+    return true;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
@@ -697,7 +948,14 @@ status_t IPCThreadState::clearDeathNotification(int32_t handle, BpBinder* proxy)
 IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mBatchDepth(0),
+      mBatchCount(0),
+      mBatchBytes(0),
+      mBatchFlushThreshold(DEFAULT_BATCH_FLUSH_BYTES),
+      mBatchPendingResults(0),
+      mBatchError(NO_ERROR),
+      mDriverCalls(0)
 {
     pthread_setspecific(gTLS, this);
     clearCaller();
@@ -707,6 +965,9 @@ IPCThreadState::IPCThreadState()
 
 IPCThreadState::~IPCThreadState()
 {
+    for (size_t i = 0; i < mBatchParcels.size(); i++) {
+        delete mBatchParcels[i];
+    }
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
@@ -737,6 +998,9 @@ status_t IPCThreadState::waitForResponse(Parcel *reply, status_t *acquireResult)
                 << getReturnString(cmd) << endl;
         }
 
+        // Results for batched transactions written ahead of ours.
+        if (consumeBatchResult(cmd)) continue;
+
         switch (cmd) {
         case BR_TRANSACTION_COMPLETE:
             if (!reply && !acquireResult) goto finish;
@@ -862,6 +1126,7 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
         IF_LOG_COMMANDS() {
             alog << "About to read/write, write size = " << mOut.dataSize() << endl;
         }
+        mDriverCalls++;
 #if defined(__ANDROID__)
         if (ioctl(mProcess->mDriverFD, BINDER_WRITE_READ, &bwr) >= 0)
             err = NO_ERROR;
@@ -941,6 +1206,19 @@ status_t IPCThreadState::writeTransactionData(int32_t cmd, uint32_t binderFlags,
         return (mLastError = err);
     }
 
+    // Parcels carrying buffer references (see Parcel::writeBufferReference)
+    // go through the scatter-gather variants so the driver copies the
+    // referenced memory straight into the target's buffer.
+    const size_t buffersSize = (tr.flags & TF_STATUS_CODE) ? 0 : data.ipcBuffersSize();
+    if (buffersSize > 0) {
+        binder_transaction_data_sg trsg;
+        trsg.transaction_data = tr;
+        trsg.buffers_size = buffersSize;
+        mOut.writeInt32(cmd == BC_REPLY ? BC_REPLY_SG : BC_TRANSACTION_SG);
+        mOut.write(&trsg, sizeof(trsg));
+        return NO_ERROR;
+    }
+
     mOut.writeInt32(cmd);
     mOut.write(&tr, sizeof(tr));
 
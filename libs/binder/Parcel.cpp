@@ -48,6 +48,7 @@
 #include <utils/String16.h>
 
 #include <private/binder/binder_module.h>
+#include <private/binder/ParcelBufferPool.h>
 #include <private/binder/Static.h>
 
 #ifndef INT32_MAX
@@ -138,6 +139,9 @@ void acquire_object(const sp<ProcessState>& proc,
             }
             return;
         }
+        case BINDER_TYPE_PTR:
+            // Buffer references don't hold anything that needs acquiring.
+            return;
     }
 
     ALOGD("Invalid object type 0x%08x", obj.type);
@@ -189,6 +193,8 @@ static void release_object(const sp<ProcessState>& proc,
             }
             return;
         }
+        case BINDER_TYPE_PTR:
+            return;
     }
 
     ALOGE("Invalid object type 0x%08x", obj.type);
@@ -523,8 +529,8 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
         if (mObjectsCapacity < mObjectsSize + numObjects) {
             size_t newSize = ((mObjectsSize + numObjects)*3)/2;
             if (newSize*sizeof(binder_size_t) < mObjectsSize) return NO_MEMORY;   // overflow
-            binder_size_t *objects =
-                (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+            binder_size_t *objects = (binder_size_t*)ParcelBufferPool::reallocate(mObjects,
+                    mObjectsCapacity*sizeof(binder_size_t), newSize*sizeof(binder_size_t));
             if (objects == (binder_size_t*)0) {
                 return NO_MEMORY;
             }
@@ -1335,7 +1341,8 @@ restart_write:
     if (!enoughObjects) {
         size_t newSize = ((mObjectsSize+2)*3)/2;
         if (newSize*sizeof(binder_size_t) < mObjectsSize) return NO_MEMORY;   // overflow
-        binder_size_t* objects = (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+        binder_size_t* objects = (binder_size_t*)ParcelBufferPool::reallocate(mObjects,
+                mObjectsCapacity*sizeof(binder_size_t), newSize*sizeof(binder_size_t));
         if (objects == NULL) return NO_MEMORY;
         mObjects = objects;
         mObjectsCapacity = newSize;
@@ -1344,6 +1351,39 @@ restart_write:
     goto restart_write;
 }
 
+status_t Parcel::writeBufferReference(const void* data, size_t len)
+{
+    if (len > INT32_MAX) {
+        // don't accept size_t values which may have come from an
+        // inadvertent conversion from a negative int.
+        return BAD_VALUE;
+    }
+
+    binder_buffer_object obj;
+    memset(&obj, 0, sizeof(obj));
+    obj.hdr.type = BINDER_TYPE_PTR;
+    obj.buffer = reinterpret_cast<binder_uintptr_t>(data);
+    obj.length = len;
+
+    if ((mDataPos+sizeof(obj)) > mDataCapacity) {
+        const status_t err = growData(sizeof(obj));
+        if (err != NO_ERROR) return err;
+    }
+    if (mObjectsSize >= mObjectsCapacity) {
+        size_t newSize = ((mObjectsSize+2)*3)/2;
+        if (newSize*sizeof(binder_size_t) < mObjectsSize) return NO_MEMORY;   // overflow
+        binder_size_t* objects = (binder_size_t*)ParcelBufferPool::reallocate(mObjects,
+                mObjectsCapacity*sizeof(binder_size_t), newSize*sizeof(binder_size_t));
+        if (objects == NULL) return NO_MEMORY;
+        mObjects = objects;
+        mObjectsCapacity = newSize;
+    }
+
+    memcpy(mData+mDataPos, &obj, sizeof(obj));
+    mObjects[mObjectsSize++] = mDataPos;
+    return finishWrite(sizeof(obj));
+}
+
 status_t Parcel::writeNoException()
 {
     binder::Status status;
@@ -1464,9 +1504,23 @@ status_t Parcel::readNullableMap(std::unique_ptr<binder::Map>* map) const
 
 
 
-void Parcel::remove(size_t /*start*/, size_t /*amt*/)
+void Parcel::remove(size_t start, size_t amt)
 {
-    LOG_ALWAYS_FATAL("Parcel::remove() not yet implemented!");
+    // Only plain data can be removed; object offsets are not rewritten.
+    // This is what IPCThreadState needs when the driver consumes part of
+    // its command buffer.
+    LOG_ALWAYS_FATAL_IF(mObjectsSize != 0,
+            "Parcel::remove() on a Parcel holding objects is not supported");
+    if (start > mDataSize || amt > mDataSize - start) {
+        ALOGE("Parcel::remove(%zu, %zu) out of range (size %zu)", start, amt, mDataSize);
+        return;
+    }
+
+    memmove(mData + start, mData + start + amt, mDataSize - start - amt);
+    mDataSize -= amt;
+    if (mDataPos > start) {
+        mDataPos = mDataPos >= start + amt ? mDataPos - amt : start;
+    }
 }
 
 status_t Parcel::read(void* outData, size_t len) const
@@ -2315,6 +2369,39 @@ const flat_binder_object* Parcel::readObject(bool nullMetaData) const
     return NULL;
 }
 
+status_t Parcel::readBufferView(const void** outData, size_t* outLen) const
+{
+    const size_t DPOS = mDataPos;
+    if ((DPOS+sizeof(binder_buffer_object)) > mDataSize) {
+        return NOT_ENOUGH_DATA;
+    }
+
+    // Only accept a buffer object the parcel actually declared, otherwise
+    // a sender could make us dereference an arbitrary pointer.
+    bool found = false;
+    for (size_t i = 0; i < mObjectsSize; i++) {
+        if (mObjects[i] == DPOS) {
+            found = true;
+            break;
+        }
+    }
+    const binder_buffer_object* obj
+            = reinterpret_cast<const binder_buffer_object*>(mData+DPOS);
+    if (!found || obj->hdr.type != BINDER_TYPE_PTR) {
+        ALOGW("Attempt to read buffer from Parcel %p at offset %zu that is not a buffer object",
+             this, DPOS);
+        return BAD_TYPE;
+    }
+    if (obj->length > INT32_MAX || (obj->buffer == 0 && obj->length != 0)) {
+        return BAD_VALUE;
+    }
+
+    mDataPos = DPOS + sizeof(binder_buffer_object);
+    *outData = reinterpret_cast<const void*>(obj->buffer);
+    *outLen = obj->length;
+    return NO_ERROR;
+}
+
 void Parcel::closeFileDescriptors()
 {
     size_t i = mObjectsSize;
@@ -2352,6 +2439,21 @@ size_t Parcel::ipcObjectsCount() const
     return mObjectsSize;
 }
 
+size_t Parcel::ipcBuffersSize() const
+{
+    // The driver copies each referenced buffer into the transaction after
+    // the offsets array, 8-byte aligned.
+    size_t size = 0;
+    for (size_t i = 0; i < mObjectsSize; i++) {
+        const binder_buffer_object* obj
+                = reinterpret_cast<const binder_buffer_object*>(mData+mObjects[i]);
+        if (obj->hdr.type == BINDER_TYPE_PTR) {
+            size += (obj->length + 7) & ~static_cast<binder_size_t>(7);
+        }
+    }
+    return size;
+}
+
 void Parcel::ipcSetDataReference(const uint8_t* data, size_t dataSize,
     const binder_size_t* objects, size_t objectsCount, release_func relFunc, void* relCookie)
 {
@@ -2462,9 +2564,11 @@ void Parcel::freeDataNoInit()
               gParcelGlobalAllocCount--;
             }
             pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
-            free(mData);
+            ParcelBufferPool::release(mData, mDataCapacity);
+        }
+        if (mObjects) {
+            ParcelBufferPool::release(mObjects, mObjectsCapacity*sizeof(binder_size_t));
         }
-        if (mObjects) free(mObjects);
     }
 }
 
@@ -2495,7 +2599,7 @@ status_t Parcel::restartWrite(size_t desired)
         return continueWrite(desired);
     }
 
-    uint8_t* data = (uint8_t*)realloc(mData, desired);
+    uint8_t* data = (uint8_t*)ParcelBufferPool::reallocate(mData, mDataCapacity, desired);
     if (!data && desired > mDataCapacity) {
         mError = NO_MEMORY;
         return NO_MEMORY;
@@ -2520,7 +2624,7 @@ status_t Parcel::restartWrite(size_t desired)
     ALOGV("restartWrite Setting data size of %p to %zu", this, mDataSize);
     ALOGV("restartWrite Setting data pos of %p to %zu", this, mDataPos);
 
-    free(mObjects);
+    ParcelBufferPool::release(mObjects, mObjectsCapacity*sizeof(binder_size_t));
     mObjects = NULL;
     mObjectsSize = mObjectsCapacity = 0;
     mNextObjectHint = 0;
@@ -2563,7 +2667,7 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        uint8_t* data = (uint8_t*)ParcelBufferPool::allocate(desired);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -2571,9 +2675,10 @@ status_t Parcel::continueWrite(size_t desired)
         binder_size_t* objects = NULL;
 
         if (objectsSize) {
-            objects = (binder_size_t*)calloc(objectsSize, sizeof(binder_size_t));
+            objects = (binder_size_t*)ParcelBufferPool::allocate(
+                    objectsSize*sizeof(binder_size_t));
             if (!objects) {
-                free(data);
+                ParcelBufferPool::release(data, desired);
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -2624,18 +2729,16 @@ status_t Parcel::continueWrite(size_t desired)
                 }
                 release_object(proc, *flat, this, &mOpenAshmemSize);
             }
-            binder_size_t* objects =
-                (binder_size_t*)realloc(mObjects, objectsSize*sizeof(binder_size_t));
-            if (objects) {
-                mObjects = objects;
-            }
+            // Keep the pooled objects buffer at its current capacity; it is
+            // handed back to the pool with the rest of the Parcel.
             mObjectsSize = objectsSize;
             mNextObjectHint = 0;
         }
 
-        // We own the data, so we can just do a realloc().
+        // We own the data, so we can just resize it in the pool.
         if (desired > mDataCapacity) {
-            uint8_t* data = (uint8_t*)realloc(mData, desired);
+            uint8_t* data = (uint8_t*)ParcelBufferPool::reallocate(mData, mDataCapacity,
+                    desired);
             if (data) {
                 LOG_ALLOC("Parcel %p: continue from %zu to %zu capacity", this, mDataCapacity,
                         desired);
@@ -2662,7 +2765,7 @@ status_t Parcel::continueWrite(size_t desired)
 
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        uint8_t* data = (uint8_t*)ParcelBufferPool::allocate(desired);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
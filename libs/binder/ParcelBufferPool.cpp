@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ParcelBufferPool"
+
+#include <private/binder/ParcelBufferPool.h>
+
+#include <atomic>
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+struct ParcelBufferPool::ThreadCache {
+    void*   buffers[NUM_CLASSES][MAX_CACHED_PER_CLASS];
+    size_t  counts[NUM_CLASSES];
+};
+
+static pthread_once_t gPoolKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gPoolKey;
+static bool gHavePoolKey = false;
+
+static std::atomic<uint64_t> gPoolHits(0);
+static std::atomic<uint64_t> gPoolMisses(0);
+static std::atomic<uint64_t> gOversize(0);
+static std::atomic<uint64_t> gInPlaceResizes(0);
+static std::atomic<uint64_t> gRecycled(0);
+static std::atomic<uint64_t> gFreed(0);
+static std::atomic<uint64_t> gCachedBytes(0);
+
+static inline size_t classSize(int sizeClass)
+{
+    return size_t(1) << (sizeClass + ParcelBufferPool::MIN_CLASS_SHIFT);
+}
+
+static inline void countEvent(std::atomic<uint64_t>& counter)
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Accounts for |size| more bytes in the thread caches, unless that would take
+// them over MAX_CACHED_BYTES.
+static bool reserveCachedBytes(size_t size)
+{
+    uint64_t cached = gCachedBytes.load(std::memory_order_relaxed);
+    do {
+        if (cached + size > ParcelBufferPool::MAX_CACHED_BYTES) {
+            return false;
+        }
+    } while (!gCachedBytes.compare_exchange_weak(cached, cached + size,
+            std::memory_order_relaxed));
+    return true;
+}
+
+int ParcelBufferPool::classForSize(size_t size)
+{
+    if (size > MAX_CLASS_SIZE) {
+        return -1;
+    }
+    int sizeClass = 0;
+    while (classSize(sizeClass) < size) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+void ParcelBufferPool::createKey()
+{
+    int err = pthread_key_create(&gPoolKey, threadDestructor);
+    if (err != 0) {
+        ALOGW("Unable to create TLS key, Parcel buffers will not be pooled: %s",
+                strerror(err));
+        return;
+    }
+    gHavePoolKey = true;
+}
+
+ParcelBufferPool::ThreadCache* ParcelBufferPool::getThreadCache(bool create)
+{
+    pthread_once(&gPoolKeyOnce, createKey);
+    if (!gHavePoolKey) {
+        return NULL;
+    }
+    ThreadCache* cache = static_cast<ThreadCache*>(pthread_getspecific(gPoolKey));
+    if (cache == NULL && create) {
+        cache = static_cast<ThreadCache*>(calloc(1, sizeof(ThreadCache)));
+        if (cache != NULL) {
+            pthread_setspecific(gPoolKey, cache);
+        }
+    }
+    return cache;
+}
+
+void ParcelBufferPool::threadDestructor(void* c)
+{
+    ThreadCache* cache = static_cast<ThreadCache*>(c);
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        while (cache->counts[i] > 0) {
+            free(cache->buffers[i][--cache->counts[i]]);
+            gCachedBytes.fetch_sub(classSize(i), std::memory_order_relaxed);
+        }
+    }
+    free(cache);
+}
+
+void* ParcelBufferPool::allocate(size_t size)
+{
+    const int sizeClass = classForSize(size);
+    if (sizeClass < 0) {
+        countEvent(gOversize);
+        return malloc(size);
+    }
+
+    ThreadCache* cache = getThreadCache(true);
+    if (cache != NULL && cache->counts[sizeClass] > 0) {
+        countEvent(gPoolHits);
+        gCachedBytes.fetch_sub(classSize(sizeClass), std::memory_order_relaxed);
+        return cache->buffers[sizeClass][--cache->counts[sizeClass]];
+    }
+
+    countEvent(gPoolMisses);
+    return malloc(classSize(sizeClass));
+}
+
+void* ParcelBufferPool::reallocate(void* buffer, size_t oldSize, size_t newSize)
+{
+    if (buffer == NULL) {
+        return allocate(newSize);
+    }
+
+    const int oldClass = classForSize(oldSize);
+    const int newClass = classForSize(newSize);
+    if (oldClass >= 0 && oldClass == newClass) {
+        countEvent(gInPlaceResizes);
+        return buffer;
+    }
+    if (oldClass < 0 && newClass < 0) {
+        countEvent(gOversize);
+        return realloc(buffer, newSize);
+    }
+
+    void* newBuffer = allocate(newSize);
+    if (newBuffer == NULL) {
+        return NULL;
+    }
+    memcpy(newBuffer, buffer, oldSize < newSize ? oldSize : newSize);
+    release(buffer, oldSize);
+    return newBuffer;
+}
+
+void ParcelBufferPool::release(void* buffer, size_t size)
+{
+    if (buffer == NULL) {
+        return;
+    }
+
+    const int sizeClass = classForSize(size);
+    // Never create a cache here: a thread that is tearing down its TLS may
+    // still destroy Parcels after our destructor has run.
+    ThreadCache* cache = sizeClass >= 0 ? getThreadCache(false) : NULL;
+    if (cache != NULL && cache->counts[sizeClass] < MAX_CACHED_PER_CLASS &&
+            reserveCachedBytes(classSize(sizeClass))) {
+        countEvent(gRecycled);
+        cache->buffers[sizeClass][cache->counts[sizeClass]++] = buffer;
+        return;
+    }
+
+    countEvent(gFreed);
+    free(buffer);
+}
+
+void ParcelBufferPool::trimCurrentThread()
+{
+    ThreadCache* cache = getThreadCache(false);
+    if (cache != NULL) {
+        pthread_setspecific(gPoolKey, NULL);
+        threadDestructor(cache);
+    }
+}
+
+void ParcelBufferPool::getStats(Stats* outStats)
+{
+    outStats->poolHits = gPoolHits.load(std::memory_order_relaxed);
+    outStats->poolMisses = gPoolMisses.load(std::memory_order_relaxed);
+    outStats->oversize = gOversize.load(std::memory_order_relaxed);
+    outStats->inPlaceResizes = gInPlaceResizes.load(std::memory_order_relaxed);
+    outStats->recycled = gRecycled.load(std::memory_order_relaxed);
+    outStats->freed = gFreed.load(std::memory_order_relaxed);
+    outStats->cachedBytes = gCachedBytes.load(std::memory_order_relaxed);
+}
+
+void ParcelBufferPool::resetStats()
+{
+    gPoolHits.store(0, std::memory_order_relaxed);
+    gPoolMisses.store(0, std::memory_order_relaxed);
+    gOversize.store(0, std::memory_order_relaxed);
+    gInPlaceResizes.store(0, std::memory_order_relaxed);
+    gRecycled.store(0, std::memory_order_relaxed);
+    gFreed.store(0, std::memory_order_relaxed);
+}
+
+void ParcelBufferPool::dump(String8& result)
+{
+    Stats stats;
+    getStats(&stats);
+    const uint64_t requests = stats.poolHits + stats.poolMisses;
+    result.appendFormat("Parcel buffer pool:\n");
+    result.appendFormat("  hits=%" PRIu64 " misses=%" PRIu64 " (%.1f%% reuse)\n",
+            stats.poolHits, stats.poolMisses,
+            requests ? 100.0 * stats.poolHits / requests : 0.0);
+    result.appendFormat("  oversize=%" PRIu64 " in-place resizes=%" PRIu64 "\n",
+            stats.oversize, stats.inPlaceResizes);
+    result.appendFormat("  recycled=%" PRIu64 " freed=%" PRIu64 " cached bytes=%" PRIu64 "\n",
+            stats.recycled, stats.freed, stats.cachedBytes);
+}
+
+}; // namespace android
@@ -32,6 +32,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -50,19 +52,21 @@ namespace android {
 class PoolThread : public Thread
 {
 public:
-    explicit PoolThread(bool isMain)
+    explicit PoolThread(bool isMain, bool policySpawned = false)
         : mIsMain(isMain)
+        , mPolicySpawned(policySpawned)
     {
     }
     
 protected:
     virtual bool threadLoop()
     {
-        IPCThreadState::self()->joinThreadPool(mIsMain);
+        IPCThreadState::self()->runLooper(mIsMain, mPolicySpawned);
         return false;
     }
     
     const bool mIsMain;
+    const bool mPolicySpawned;
 };
 
 sp<ProcessState> ProcessState::self()
@@ -222,23 +226,109 @@ ssize_t ProcessState::getKernelReferences(size_t buf_count, uintptr_t* buf)
     return count;
 }
 
+// Marks the calling thread as reading the handle table for its lifetime.
+// Threads are spread over a few counter shards to keep lookups from
+// bouncing a single cache line between cores.
+class ProcessState::HandleReadGuard
+{
+public:
+    explicit HandleReadGuard(const ProcessState* proc)
+    {
+        handle_reader_shard& shard = proc->mHandleReaders[
+                (reinterpret_cast<uintptr_t>(pthread_self()) >> 12) % HANDLE_READER_SHARDS];
+        // Only count in the set of shards for the current epoch. If a writer
+        // flipped it before we were counted, it may not have seen us; undo
+        // and count again in the new set.
+        uint32_t epoch = proc->mHandleReaderEpoch.load();
+        for (;;) {
+            mCount = &shard.count[epoch & 1];
+            mCount->fetch_add(1);
+            const uint32_t current = proc->mHandleReaderEpoch.load();
+            if (current == epoch) break;
+            mCount->fetch_sub(1, std::memory_order_release);
+            epoch = current;
+        }
+    }
+
+    ~HandleReadGuard()
+    {
+        mCount->fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<int32_t>* mCount;
+};
+
+ProcessState::handle_entry* ProcessState::findHandle(int32_t handle) const
+{
+    if (handle < 0) return NULL;
+    const size_t segment = (size_t)handle >> HANDLE_SEGMENT_SHIFT;
+    if (segment >= HANDLE_MAX_SEGMENTS) return NULL;
+    handle_entry* entries = mHandleSegments[segment].load(std::memory_order_acquire);
+    if (entries == NULL) return NULL;
+    return &entries[handle & (HANDLE_SEGMENT_SIZE - 1)];
+}
+
 ProcessState::handle_entry* ProcessState::lookupHandleLocked(int32_t handle)
 {
-    const size_t N=mHandleToObject.size();
-    if (N <= (size_t)handle) {
-        handle_entry e;
-        e.binder = NULL;
-        e.refs = NULL;
-        status_t err = mHandleToObject.insertAt(e, N, handle+1-N);
-        if (err < NO_ERROR) return NULL;
-    }
-    return &mHandleToObject.editItemAt(handle);
+    handle_entry* e = findHandle(handle);
+    if (e != NULL || handle < 0) return e;
+
+    const size_t segment = (size_t)handle >> HANDLE_SEGMENT_SHIFT;
+    if (segment >= HANDLE_MAX_SEGMENTS) {
+        ALOGE("Binder handle %d exceeds the handle table", handle);
+        return NULL;
+    }
+    handle_entry* entries = new handle_entry[HANDLE_SEGMENT_SIZE];
+    for (size_t i = 0; i < HANDLE_SEGMENT_SIZE; i++) {
+        entries[i].binder.store(NULL, std::memory_order_relaxed);
+    }
+    mHandleSegments[segment].store(entries, std::memory_order_release);
+    return &entries[handle & (HANDLE_SEGMENT_SIZE - 1)];
+}
+
+void ProcessState::waitForHandleReaders()
+{
+    // Flip the epoch so new readers count in the other set of shards, then
+    // wait for everyone who may have seen the old entry to leave. Readers
+    // increment their shard and check the epoch again before loading the
+    // entry (all seq_cst), so a reader we don't see here is guaranteed to
+    // observe the cleared entry. Readers counted under an older epoch were
+    // drained by the previous writer, since waits are serialized.
+    AutoMutex _l(mHandleReadersLock);
+    const uint32_t old = mHandleReaderEpoch.fetch_add(1) & 1;
+    for (size_t i = 0; i < HANDLE_READER_SHARDS; i++) {
+        while (mHandleReaders[i].count[old].load() != 0) {
+            sched_yield();
+        }
+    }
 }
 
 sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
 {
     sp<IBinder> result;
 
+    // Fast path: an existing proxy we can still take a weak reference on.
+    // attemptIncWeak() is safe without mLock because expungeHandle() waits
+    // for all readers before the BpBinder (and its weakref) can go away.
+    IBinder* b = NULL;
+    {
+        HandleReadGuard guard(this);
+        handle_entry* e = findHandle(handle);
+        if (e != NULL) {
+            b = e->binder.load();
+            if (b != NULL && !b->getWeakRefs()->attemptIncWeak(this)) {
+                b = NULL;
+            }
+        }
+    }
+    if (b != NULL) {
+        // See the comment in the locked path below.
+        result.force_set(b);
+        b->getWeakRefs()->decWeak(this);
+        return result;
+    }
+
     AutoMutex _l(mLock);
 
     handle_entry* e = lookupHandleLocked(handle);
@@ -247,8 +337,8 @@ sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
         // We need to create a new BpBinder if there isn't currently one, OR we
         // are unable to acquire a weak reference on this current one.  See comment
         // in getWeakProxyForHandle() for more info about this.
-        IBinder* b = e->binder;
-        if (b == NULL || !e->refs->attemptIncWeak(this)) {
+        b = e->binder.load(std::memory_order_relaxed);
+        if (b == NULL || !b->getWeakRefs()->attemptIncWeak(this)) {
             if (handle == 0) {
                 // Special case for context manager...
                 // The context manager is the only object for which we create
@@ -277,15 +367,14 @@ sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
             }
 
             b = new BpBinder(handle); 
-            e->binder = b;
-            if (b) e->refs = b->getWeakRefs();
+            e->binder.store(b, std::memory_order_release);
             result = b;
         } else {
             // This little bit of nastyness is to allow us to add a primary
             // reference to the remote proxy when this team doesn't have one
             // but another team is sending the handle to us.
             result.force_set(b);
-            e->refs->decWeak(this);
+            b->getWeakRefs()->decWeak(this);
         }
     }
 
@@ -296,6 +385,23 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
 {
     wp<IBinder> result;
 
+    IBinder* b = NULL;
+    {
+        HandleReadGuard guard(this);
+        handle_entry* e = findHandle(handle);
+        if (e != NULL) {
+            b = e->binder.load();
+            if (b != NULL && !b->getWeakRefs()->attemptIncWeak(this)) {
+                b = NULL;
+            }
+        }
+    }
+    if (b != NULL) {
+        result = b;
+        b->getWeakRefs()->decWeak(this);
+        return result;
+    }
+
     AutoMutex _l(mLock);
 
     handle_entry* e = lookupHandleLocked(handle);
@@ -308,15 +414,14 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
         // We need to do this because there is a race condition between someone
         // releasing a reference on this BpBinder, and a new reference on its handle
         // arriving from the driver.
-        IBinder* b = e->binder;
-        if (b == NULL || !e->refs->attemptIncWeak(this)) {
+        b = e->binder.load(std::memory_order_relaxed);
+        if (b == NULL || !b->getWeakRefs()->attemptIncWeak(this)) {
             b = new BpBinder(handle);
             result = b;
-            e->binder = b;
-            if (b) e->refs = b->getWeakRefs();
+            e->binder.store(b, std::memory_order_release);
         } else {
             result = b;
-            e->refs->decWeak(this);
+            b->getWeakRefs()->decWeak(this);
         }
     }
 
@@ -325,14 +430,22 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
 
 void ProcessState::expungeHandle(int32_t handle, IBinder* binder)
 {
-    AutoMutex _l(mLock);
-    
-    handle_entry* e = lookupHandleLocked(handle);
+    {
+        AutoMutex _l(mLock);
 
-    // This handle may have already been replaced with a new BpBinder
-    // (if someone failed the AttemptIncWeak() above); we don't want
-    // to overwrite it.
-    if (e && e->binder == binder) e->binder = NULL;
+        handle_entry* e = findHandle(handle);
+
+        // This handle may have already been replaced with a new BpBinder
+        // (if someone failed the AttemptIncWeak() above); we don't want
+        // to overwrite it.
+        IBinder* expected = binder;
+        if (e) e->binder.compare_exchange_strong(expected, NULL);
+    }
+
+    // Lock-free readers may still be looking at |binder|; it must stay
+    // valid until they are done. This waits without mLock, so a slow
+    // reader doesn't hold up lookups that take the locked path.
+    waitForHandleReaders();
 }
 
 String8 ProcessState::makeBinderThreadName() {
@@ -346,6 +459,11 @@ String8 ProcessState::makeBinderThreadName() {
 void ProcessState::spawnPooledThread(bool isMain)
 {
     if (mThreadPoolStarted) {
+        if (!isMain) {
+            pthread_mutex_lock(&mThreadCountLock);
+            mDriverSpawns++;
+            pthread_mutex_unlock(&mThreadCountLock);
+        }
         String8 name = makeBinderThreadName();
         ALOGV("Spawning new pooled thread, name=%s\n", name.string());
         sp<Thread> t = new PoolThread(isMain);
@@ -353,8 +471,127 @@ void ProcessState::spawnPooledThread(bool isMain)
     }
 }
 
+void ProcessState::spawnPolicyThread()
+{
+    // The caller has already counted this thread in mPoolThreads.
+    String8 name = makeBinderThreadName();
+    ALOGV("Spawning new pooled thread (policy), name=%s\n", name.string());
+    sp<Thread> t = new PoolThread(true /* isMain */, true /* policySpawned */);
+    t->run(name.string());
+}
+
+bool ProcessState::retireIdleLooper()
+{
+    bool retire = false;
+    pthread_mutex_lock(&mThreadCountLock);
+    if (mAdaptiveThreadPool && mPoolThreads > mMinThreads) {
+        mPoolThreads--;
+        mIdleExits++;
+        retire = true;
+    }
+    pthread_mutex_unlock(&mThreadCountLock);
+    return retire;
+}
+
+status_t ProcessState::setThreadPoolPolicy(size_t minThreads, size_t maxThreads,
+        uint32_t idleTimeoutMs)
+{
+    if (maxThreads == 0 || minThreads > maxThreads) {
+        return BAD_VALUE;
+    }
+
+    // Growth is driven from user space from now on, so stop the driver from
+    // requesting loopers on its own. Loopers we start register with
+    // BC_ENTER_LOOPER, which the driver doesn't count against this limit.
+    size_t driverMaxThreads = 0;
+    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &driverMaxThreads) == -1) {
+        status_t result = -errno;
+        ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+        return result;
+    }
+
+    pthread_mutex_lock(&mThreadCountLock);
+    if (!mAdaptiveThreadPool) {
+        mFixedMaxThreads = mMaxThreads;
+    }
+    mAdaptiveThreadPool = true;
+    mMinThreads = minThreads;
+    mMaxThreads = maxThreads;
+    mIdleTimeoutMs = idleTimeoutMs;
+    pthread_cond_broadcast(&mThreadCountDecrement);
+    pthread_mutex_unlock(&mThreadCountLock);
+    return NO_ERROR;
+}
+
+status_t ProcessState::clearThreadPoolPolicy()
+{
+    pthread_mutex_lock(&mThreadCountLock);
+    if (!mAdaptiveThreadPool) {
+        pthread_mutex_unlock(&mThreadCountLock);
+        return NO_ERROR;
+    }
+    // Idle loopers see this the next time their poll() times out, and go
+    // back to blocking in the driver instead of retiring.
+    mAdaptiveThreadPool = false;
+    mMinThreads = 0;
+    mIdleTimeoutMs = 0;
+    mMaxThreads = mFixedMaxThreads;
+    size_t driverMaxThreads = mMaxThreads;
+    pthread_mutex_unlock(&mThreadCountLock);
+
+    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &driverMaxThreads) == -1) {
+        status_t result = -errno;
+        ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+        return result;
+    }
+    return NO_ERROR;
+}
+
+void ProcessState::getThreadPoolStats(ThreadPoolStats* outStats)
+{
+    pthread_mutex_lock(&mThreadCountLock);
+    outStats->adaptive = mAdaptiveThreadPool;
+    outStats->minThreads = mMinThreads;
+    outStats->maxThreads = mMaxThreads;
+    outStats->threads = mPoolThreads;
+    outStats->peakThreads = mPeakPoolThreads;
+    outStats->executing = mExecutingThreadsCount;
+    outStats->driverSpawns = mDriverSpawns;
+    outStats->policySpawns = mPolicySpawns;
+    outStats->idleExits = mIdleExits;
+    outStats->blockedWaits = mBlockedWaits;
+    outStats->busyTimeNs = mBusyTimeNs;
+    outStats->blockedWaitNs = mBlockedWaitNs;
+    pthread_mutex_unlock(&mThreadCountLock);
+}
+
+void ProcessState::dumpThreadPool(String8& result)
+{
+    ThreadPoolStats stats;
+    getThreadPoolStats(&stats);
+    result.appendFormat("Binder thread pool (%s):\n", stats.adaptive ? "adaptive" : "fixed");
+    result.appendFormat("  threads=%zu peak=%zu executing=%zu min=%zu max=%zu\n",
+            stats.threads, stats.peakThreads, stats.executing, stats.minThreads,
+            stats.maxThreads);
+    result.appendFormat("  driver spawns=%" PRIu64 " policy spawns=%" PRIu64
+            " idle exits=%" PRIu64 "\n",
+            stats.driverSpawns, stats.policySpawns, stats.idleExits);
+    result.appendFormat("  busy=%.1fms blocked waits=%" PRIu64 " (%.1fms)\n",
+            stats.busyTimeNs / 1e6, stats.blockedWaits, stats.blockedWaitNs / 1e6);
+}
+
 status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
     status_t result = NO_ERROR;
+    pthread_mutex_lock(&mThreadCountLock);
+    const bool adaptive = mAdaptiveThreadPool;
+    if (adaptive) {
+        // The driver stays at zero; the policy enforces the new limit.
+        mMaxThreads = maxThreads;
+    }
+    pthread_mutex_unlock(&mThreadCountLock);
+    if (adaptive) {
+        return result;
+    }
     if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &maxThreads) != -1) {
         mMaxThreads = maxThreads;
     } else {
@@ -409,12 +646,33 @@ ProcessState::ProcessState(const char *driver)
     , mExecutingThreadsCount(0)
     , mMaxThreads(DEFAULT_MAX_BINDER_THREADS)
     , mStarvationStartTimeMs(0)
+    , mAdaptiveThreadPool(false)
+    , mMinThreads(0)
+    , mIdleTimeoutMs(0)
+    , mFixedMaxThreads(DEFAULT_MAX_BINDER_THREADS)
+    , mPoolThreads(0)
+    , mPeakPoolThreads(0)
+    , mDriverSpawns(0)
+    , mPolicySpawns(0)
+    , mIdleExits(0)
+    , mBlockedWaits(0)
+    , mBusyTimeNs(0)
+    , mBlockedWaitNs(0)
+    , mHandleReaderEpoch(0)
     , mManagesContexts(false)
     , mBinderContextCheckFunc(NULL)
     , mBinderContextUserData(NULL)
     , mThreadPoolStarted(false)
     , mThreadPoolSeq(1)
 {
+    for (size_t i = 0; i < HANDLE_MAX_SEGMENTS; i++) {
+        mHandleSegments[i].store(NULL, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < HANDLE_READER_SHARDS; i++) {
+        mHandleReaders[i].count[0].store(0, std::memory_order_relaxed);
+        mHandleReaders[i].count[1].store(0, std::memory_order_relaxed);
+    }
+
     if (mDriverFD >= 0) {
         // mmap the binder, providing a chunk of virtual address space to receive transactions.
         mVMStart = mmap(0, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, mDriverFD, 0);
@@ -439,6 +697,10 @@ ProcessState::~ProcessState()
         close(mDriverFD);
     }
     mDriverFD = -1;
+
+    for (size_t i = 0; i < HANDLE_MAX_SEGMENTS; i++) {
+        delete[] mHandleSegments[i].load(std::memory_order_relaxed);
+    }
 }
         
 }; // namespace android
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionProfiler"
+
+#include <private/binder/TransactionProfiler.h>
+#include <private/binder/ParcelBufferPool.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <binder/Binder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/Parcel.h>
+#include <binder/PermissionCache.h>
+#include <binder/ProcessState.h>
+#include <private/android_filesystem_config.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct ProfileSlot {
+    // 0 while the slot is free; claimed with a CAS and released by reset().
+    std::atomic<uint64_t> key;
+    // Set after the claiming thread has filled in the fields below.
+    std::atomic<bool> named;
+    bool server;
+    uint32_t interface;
+    uint32_t code;
+
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> totalNs;
+    std::atomic<uint64_t> maxNs;
+    std::atomic<uint64_t> requestBytes;
+    std::atomic<uint64_t> replyBytes;
+    std::atomic<uint64_t> objects;
+    std::atomic<uint64_t> buckets[TransactionProfiler::NUM_LATENCY_BUCKETS];
+};
+
+// Zero-initialized static storage; no constructor runs.
+ProfileSlot gSlots[TransactionProfiler::NUM_SLOTS];
+std::atomic<uint64_t> gDroppedKeys(0);
+
+// Interned interface descriptors, indexed by interface id. Entries below
+// gInterfaceCount are never modified again; new ones are added under
+// gInterfacesLock.
+char gInterfaceNames[TransactionProfiler::NUM_INTERFACES][96];
+std::atomic<uint32_t> gInterfaceCount(TransactionProfiler::UNKNOWN_INTERFACE + 1);
+Mutex gInterfacesLock;
+
+// Descriptors are Java-style names; anything else isn't an interface token.
+bool isDescriptor(const char16_t* str, size_t len)
+{
+    if (str == NULL || len == 0 || len >= sizeof(gInterfaceNames[0])) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] <= 0x20 || str[i] >= 0x7f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* interfaceName(uint32_t interface)
+{
+    if (interface <= TransactionProfiler::UNKNOWN_INTERFACE ||
+            interface >= gInterfaceCount.load(std::memory_order_acquire)) {
+        return "<unknown>";
+    }
+    return gInterfaceNames[interface];
+}
+
+uint64_t makeKey(uint64_t id, uint32_t code, bool server)
+{
+    uint64_t x = id * 0x9e3779b97f4a7c15ull + code;
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 29;
+    // Never 0, and the two sides never share a key.
+    return (x << 2) | 2 | (server ? 1 : 0);
+}
+
+ProfileSlot* findSlot(uint64_t key, bool server, uint32_t interface, uint32_t code)
+{
+    const size_t start = key % TransactionProfiler::NUM_SLOTS;
+    for (size_t probe = 0; probe < TransactionProfiler::NUM_SLOTS; probe++) {
+        ProfileSlot& slot = gSlots[(start + probe) % TransactionProfiler::NUM_SLOTS];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == key) {
+            return &slot;
+        }
+        if (current == 0) {
+            if (slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                slot.server = server;
+                slot.interface = interface;
+                slot.code = code;
+                slot.named.store(true, std::memory_order_release);
+                return &slot;
+            }
+            if (current == key) {
+                return &slot;
+            }
+        }
+    }
+    gDroppedKeys.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+}
+
+size_t bucketFor(nsecs_t elapsed)
+{
+    const uint64_t us = elapsed > 0 ? uint64_t(elapsed) / 1000 : 0;
+    if (us == 0) {
+        return 0;
+    }
+    const size_t bucket = 64 - __builtin_clzll(us);
+    return std::min(bucket, size_t(TransactionProfiler::NUM_LATENCY_BUCKETS - 1));
+}
+
+void record(ProfileSlot* slot, size_t requestBytes, size_t replyBytes, size_t objects,
+        nsecs_t elapsed)
+{
+    const uint64_t ns = elapsed > 0 ? uint64_t(elapsed) : 0;
+    slot->count.fetch_add(1, std::memory_order_relaxed);
+    slot->totalNs.fetch_add(ns, std::memory_order_relaxed);
+    slot->requestBytes.fetch_add(requestBytes, std::memory_order_relaxed);
+    slot->replyBytes.fetch_add(replyBytes, std::memory_order_relaxed);
+    slot->objects.fetch_add(objects, std::memory_order_relaxed);
+    slot->buckets[bucketFor(elapsed)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = slot->maxNs.load(std::memory_order_relaxed);
+    while (ns > max && !slot->maxNs.compare_exchange_weak(max, ns,
+            std::memory_order_relaxed)) {
+    }
+}
+
+// Upper bound, in microseconds, of the bucket holding the given percentile.
+uint64_t percentileUs(const uint64_t* buckets, uint64_t count, int percentile)
+{
+    const uint64_t target = (count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < TransactionProfiler::NUM_LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return uint64_t(1) << i;
+        }
+    }
+    return uint64_t(1) << (TransactionProfiler::NUM_LATENCY_BUCKETS - 1);
+}
+
+struct SlotSnapshot {
+    const ProfileSlot* slot;
+    uint64_t count;
+    uint64_t totalNs;
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+std::atomic<bool> TransactionProfiler::sEnabled(false);
+
+void TransactionProfiler::setEnabled(bool enabled)
+{
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void TransactionProfiler::reset()
+{
+    // Releases every key. Transactions that race with a reset may be
+    // partially accounted, or accounted to the key that claims their slot
+    // next, which is fine for a profiler.
+    for (size_t i = 0; i < NUM_SLOTS; i++) {
+        ProfileSlot& slot = gSlots[i];
+        slot.named.store(false, std::memory_order_relaxed);
+        slot.count.store(0, std::memory_order_relaxed);
+        slot.totalNs.store(0, std::memory_order_relaxed);
+        slot.maxNs.store(0, std::memory_order_relaxed);
+        slot.requestBytes.store(0, std::memory_order_relaxed);
+        slot.replyBytes.store(0, std::memory_order_relaxed);
+        slot.objects.store(0, std::memory_order_relaxed);
+        for (size_t b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+            slot.buckets[b].store(0, std::memory_order_relaxed);
+        }
+        slot.key.store(0, std::memory_order_release);
+    }
+    gDroppedKeys.store(0, std::memory_order_relaxed);
+}
+
+uint32_t TransactionProfiler::internInterface(const String16& descriptor)
+{
+    if (!isDescriptor(descriptor.string(), descriptor.size())) {
+        return UNKNOWN_INTERFACE;
+    }
+    const String8 name(descriptor);
+
+    AutoMutex _l(gInterfacesLock);
+    const uint32_t count = gInterfaceCount.load(std::memory_order_relaxed);
+    for (uint32_t i = UNKNOWN_INTERFACE + 1; i < count; i++) {
+        if (strcmp(gInterfaceNames[i], name.string()) == 0) {
+            return i;
+        }
+    }
+    if (count == NUM_INTERFACES) {
+        return UNKNOWN_INTERFACE;
+    }
+    snprintf(gInterfaceNames[count], sizeof(gInterfaceNames[count]), "%s", name.string());
+    gInterfaceCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+uint32_t TransactionProfiler::internInterfaceToken(const Parcel& data)
+{
+    // See Parcel::writeInterfaceToken(): the strict mode policy, then the
+    // descriptor.
+    const size_t pos = data.dataPosition();
+    data.setDataPosition(0);
+    size_t len = 0;
+    const char16_t* str = NULL;
+    if (data.dataAvail() >= sizeof(int32_t)) {
+        data.readInt32();
+        str = data.readString16Inplace(&len);
+    }
+    data.setDataPosition(pos);
+    if (!isDescriptor(str, len)) {
+        return NO_INTERFACE;
+    }
+    return internInterface(String16(str, len));
+}
+
+void TransactionProfiler::recordClient(uint32_t interface, uint32_t code,
+        const Parcel& data, const Parcel* reply, nsecs_t elapsed)
+{
+    ProfileSlot* slot = findSlot(makeKey(interface, code, false), false, interface, code);
+    if (slot != NULL) {
+        record(slot, data.dataSize(), reply ? reply->dataSize() : 0, data.objectsCount(),
+                elapsed);
+    }
+}
+
+void TransactionProfiler::recordServer(uint32_t interface, uint32_t code,
+        const Parcel& data, const Parcel* reply, nsecs_t elapsed)
+{
+    ProfileSlot* slot = findSlot(makeKey(interface, code, true), true, interface, code);
+    if (slot != NULL) {
+        record(slot, data.dataSize(), reply ? reply->dataSize() : 0, data.objectsCount(),
+                elapsed);
+    }
+}
+
+void TransactionProfiler::dump(String8& result)
+{
+    std::vector<SlotSnapshot> snapshots;
+    for (size_t i = 0; i < NUM_SLOTS; i++) {
+        const ProfileSlot& slot = gSlots[i];
+        if (slot.key.load(std::memory_order_relaxed) == 0 ||
+                !slot.named.load(std::memory_order_acquire)) {
+            continue;
+        }
+        const uint64_t count = slot.count.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        snapshots.push_back({ &slot, count, slot.totalNs.load(std::memory_order_relaxed) });
+    }
+    std::sort(snapshots.begin(), snapshots.end(),
+            [](const SlotSnapshot& a, const SlotSnapshot& b) {
+                return a.totalNs > b.totalNs;
+            });
+
+    result.appendFormat("Binder transaction profile (pid %d, %s, %zu keys, %" PRIu64
+            " dropped):\n", getpid(), isEnabled() ? "enabled" : "disabled",
+            snapshots.size(), gDroppedKeys.load(std::memory_order_relaxed));
+    result.appendFormat("  %-6s %-48s %10s %8s %10s %8s %8s %8s %10s %9s %9s %6s\n",
+            "side", "interface", "code", "count", "total(ms)", "avg(us)", "p50(us)",
+            "p99(us)", "max(us)", "avg req", "avg rep", "objs");
+
+    for (const SlotSnapshot& snapshot : snapshots) {
+        const ProfileSlot& slot = *snapshot.slot;
+        uint64_t buckets[NUM_LATENCY_BUCKETS];
+        for (size_t b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+            buckets[b] = slot.buckets[b].load(std::memory_order_relaxed);
+        }
+        const uint64_t count = snapshot.count;
+        result.appendFormat("  %-6s %-48s %10u %8" PRIu64 " %10.2f %8.1f %8" PRIu64
+                " %8" PRIu64 " %10.1f %9" PRIu64 " %9" PRIu64 " %6.2f\n",
+                slot.server ? "server" : "client", interfaceName(slot.interface), slot.code,
+                count,
+                snapshot.totalNs / 1e6,
+                snapshot.totalNs / 1e3 / count,
+                percentileUs(buckets, count, 50),
+                percentileUs(buckets, count, 99),
+                slot.maxNs.load(std::memory_order_relaxed) / 1e3,
+                slot.requestBytes.load(std::memory_order_relaxed) / count,
+                slot.replyBytes.load(std::memory_order_relaxed) / count,
+                double(slot.objects.load(std::memory_order_relaxed)) / count);
+    }
+}
+
+static const String16 sDump("android.permission.DUMP");
+
+bool TransactionProfiler::handleDumpArgs(int fd, const Vector<String16>& args)
+{
+    if (args.size() == 0 || args[0] != String16("--binder-profile")) {
+        return false;
+    }
+
+    String8 result;
+    // BBinder::onTransact() handles these arguments before the service's dump(),
+    // which is where services check the caller, so the check is done here.
+    IPCThreadState* ipc = IPCThreadState::self();
+    const int pid = ipc->getCallingPid();
+    const int uid = ipc->getCallingUid();
+    if ((uid != AID_ROOT) && (uid != AID_SHELL) &&
+            !PermissionCache::checkPermission(sDump, pid, uid)) {
+        result.appendFormat("Permission Denial: "
+                "can't dump the binder profile from pid=%d, uid=%d\n", pid, uid);
+    } else {
+        if (args.size() > 1) {
+            const String16& command = args[1];
+            if (command == String16("enable")) {
+                setEnabled(true);
+            } else if (command == String16("disable")) {
+                setEnabled(false);
+            } else if (command == String16("reset")) {
+                reset();
+            } else {
+                result.appendFormat("Unknown --binder-profile command '%s', expected "
+                        "enable, disable or reset\n", String8(command).string());
+            }
+        }
+        dump(result);
+        sp<ProcessState> proc = ProcessState::selfOrNull();
+        if (proc != NULL) {
+            proc->dumpThreadPool(result);
+        }
+        ParcelBufferPool::dump(result);
+    }
+    if (write(fd, result.string(), result.size()) < 0) {
+        ALOGW("Unable to write binder profile: %s", strerror(errno));
+    }
+    return true;
+}
+
+}; // namespace android
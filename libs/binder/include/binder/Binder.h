@@ -71,6 +71,9 @@ private:
 
     class Extras;
 
+            Extras*     getOrCreateExtras();
+            uint32_t    getProfileInterface();
+
     std::atomic<Extras*> mExtras;
             void*       mReserved0;
 };
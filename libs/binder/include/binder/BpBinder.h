@@ -21,6 +21,8 @@
 #include <utils/KeyedVector.h>
 #include <utils/threads.h>
 
+#include <atomic>
+
 // ---------------------------------------------------------------------------
 namespace android {
 
@@ -115,6 +117,8 @@ private:
             ObjectManager       mObjects;
             Parcel*             mConstantData;
     mutable String16            mDescriptorCache;
+            // TransactionProfiler's id for this proxy's interface.
+            std::atomic<uint32_t> mProfileInterface;
 };
 
 }; // namespace android
@@ -31,7 +31,15 @@ namespace android {
 
 class IPCThreadState
 {
+    friend class PoolThread;
+
 public:
+    enum {
+        DEFAULT_BATCH_FLUSH_BYTES = 16 * 1024,
+        // Bounds the number of Parcels held by a batch regardless of size.
+        MAX_BATCHED_TRANSACTIONS = 256,
+    };
+
     static  IPCThreadState*     self();
     static  IPCThreadState*     selfOrNull();  // self(), but won't instantiate
     
@@ -64,6 +72,22 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // Oneway transactions issued between beginBatch() and endBatch()
+            // are queued and handed to the driver together in a single
+            // BINDER_WRITE_READ, instead of one ioctl per call. The queue is
+            // flushed early once the batched payload reaches flushThreshold
+            // bytes, and by any synchronous call made in the meantime, so
+            // ordering with respect to other transactions is preserved.
+            // Batches nest; only the outermost endBatch() flushes. Errors for
+            // individual batched calls are not reported by their transact();
+            // the first one is returned by whichever call flushes the batch.
+            void                beginBatch(size_t flushThreshold = DEFAULT_BATCH_FLUSH_BYTES);
+            status_t            endBatch();
+            status_t            flushBatch();
+
+            // Number of BINDER_WRITE_READ ioctls issued by this thread.
+            uint64_t            getDriverCallCount() const;
+
             void                incStrongHandle(int32_t handle);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle);
@@ -93,6 +117,8 @@ private:
                                 IPCThreadState();
                                 ~IPCThreadState();
 
+            void                runLooper(bool isMain, bool policySpawned);
+            bool                waitForWorkOrRetire();
             status_t            sendReply(const Parcel& reply, uint32_t flags);
             status_t            waitForResponse(Parcel *reply,
                                                 status_t *acquireResult=NULL);
@@ -103,6 +129,9 @@ private:
                                                      uint32_t code,
                                                      const Parcel& data,
                                                      status_t* statusBuffer);
+            status_t            batchTransaction(int32_t handle, uint32_t code,
+                                                 const Parcel& data, uint32_t flags);
+            bool                consumeBatchResult(int32_t cmd);
             status_t            getAndExecuteCommand();
             status_t            executeCommand(int32_t command);
             void                processPendingDerefs();
@@ -126,6 +155,20 @@ private:
             uid_t               mCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+
+            // Copies of the batched Parcels, which must stay alive until the
+            // driver has consumed the commands referencing them. Reused
+            // across batches.
+            Vector<Parcel*>     mBatchParcels;
+            size_t              mBatchDepth;
+            size_t              mBatchCount;
+            size_t              mBatchBytes;
+            size_t              mBatchFlushThreshold;
+            // Batched transactions whose BR_TRANSACTION_COMPLETE (or
+            // failure) has not been read back yet.
+            size_t              mBatchPendingResults;
+            status_t            mBatchError;
+            uint64_t            mDriverCalls;
 };
 
 }; // namespace android
@@ -233,6 +233,14 @@ public:
 
     status_t            writeObject(const flat_binder_object& val, bool nullMetaData);
 
+    // Writes a reference to |len| bytes owned by the caller instead of copying
+    // them into the parcel. When the parcel is sent, the driver copies the
+    // bytes straight into the recipient's transaction buffer, so they must
+    // stay valid and unmodified until the transaction has been handed to the
+    // driver (i.e. until transact() returns). Only native code reading with
+    // readBufferView() understands this encoding.
+    status_t            writeBufferReference(const void* data, size_t len);
+
     // Like Parcel.java's writeNoException().  Just writes a zero int32.
     // Currently the native implementation doesn't do any of the StrictMode
     // stack gathering and serialization that the Java implementation does.
@@ -377,6 +385,12 @@ public:
 
     const flat_binder_object* readObject(bool nullMetaData) const;
 
+    // Reads a buffer written with writeBufferReference() without copying it.
+    // The returned view is valid for as long as this parcel keeps its data;
+    // for an incoming transaction that is until the transaction buffer is
+    // handed back to the driver.
+    status_t            readBufferView(const void** outData, size_t* outLen) const;
+
     // Explicitly close all file descriptors in the parcel.
     void                closeFileDescriptors();
 
@@ -394,6 +408,7 @@ private:
     size_t              ipcDataSize() const;
     uintptr_t           ipcObjects() const;
     size_t              ipcObjectsCount() const;
+    size_t              ipcBuffersSize() const;
     void                ipcSetDataReference(const uint8_t* data, size_t dataSize,
                                             const binder_size_t* objects, size_t objectsCount,
                                             release_func relFunc, void* relCookie);
@@ -24,6 +24,8 @@
 
 #include <utils/threads.h>
 
+#include <atomic>
+
 #include <pthread.h>
 
 // ---------------------------------------------------------------------------
@@ -70,6 +72,34 @@ public:
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
             void                giveThreadPoolName();
 
+            // Lets libbinder size the thread pool itself instead of relying on
+            // BR_SPAWN_LOOPER. A looper is added whenever every looper in the
+            // pool is busy, up to maxThreads, and loopers beyond minThreads
+            // leave the pool once they have been idle for idleTimeoutMs.
+            status_t            setThreadPoolPolicy(size_t minThreads, size_t maxThreads,
+                                                    uint32_t idleTimeoutMs);
+            // Hands thread pool sizing back to the driver, with the maximum
+            // the pool had before setThreadPoolPolicy(). Loopers the policy
+            // started stay in the pool.
+            status_t            clearThreadPoolPolicy();
+
+            struct ThreadPoolStats {
+                bool        adaptive;
+                size_t      minThreads;
+                size_t      maxThreads;
+                size_t      threads;        // loopers currently in the pool
+                size_t      peakThreads;
+                size_t      executing;      // threads executing a command
+                uint64_t    driverSpawns;   // BR_SPAWN_LOOPER requests honoured
+                uint64_t    policySpawns;   // loopers added by the policy
+                uint64_t    idleExits;      // loopers retired after idling
+                uint64_t    blockedWaits;   // blockUntilThreadAvailable() waits
+                int64_t     busyTimeNs;     // total time spent executing commands
+                int64_t     blockedWaitNs;  // total time spent in blocked waits
+            };
+            void                getThreadPoolStats(ThreadPoolStats* outStats);
+            void                dumpThreadPool(String8& result);
+
             String8             getDriverName();
 
             ssize_t             getKernelReferences(size_t count, uintptr_t* buf);
@@ -83,13 +113,34 @@ private:
                                 ProcessState(const ProcessState& o);
             ProcessState&       operator=(const ProcessState& o);
             String8             makeBinderThreadName();
+            void                spawnPolicyThread();
+            bool                retireIdleLooper();
+
+            // The handle table is a two-level array of fixed-size segments
+            // that are never moved or freed while the process runs, so
+            // existing entries can be read without holding mLock. Readers
+            // announce themselves in mHandleReaders; expungeHandle() waits
+            // for them to drain before the BpBinder may be destroyed.
+            enum {
+                HANDLE_SEGMENT_SHIFT = 10,
+                HANDLE_SEGMENT_SIZE = 1 << HANDLE_SEGMENT_SHIFT,
+                HANDLE_MAX_SEGMENTS = 1024,
+                HANDLE_READER_SHARDS = 8,
+            };
 
             struct handle_entry {
-                IBinder* binder;
-                RefBase::weakref_type* refs;
+                std::atomic<IBinder*> binder;
             };
 
+            struct alignas(64) handle_reader_shard {
+                std::atomic<int32_t> count[2];
+            };
+
+            class HandleReadGuard;
+
+            handle_entry*       findHandle(int32_t handle) const;
             handle_entry*       lookupHandleLocked(int32_t handle);
+            void                waitForHandleReaders();
 
             String8             mDriverName;
             int                 mDriverFD;
@@ -104,10 +155,32 @@ private:
             size_t              mMaxThreads;
             // Time when thread pool was emptied
             int64_t             mStarvationStartTimeMs;
+            // Adaptive pool state, see setThreadPoolPolicy().
+            bool                mAdaptiveThreadPool;
+            size_t              mMinThreads;
+            uint32_t            mIdleTimeoutMs;
+            // mMaxThreads from before the policy, restored by
+            // clearThreadPoolPolicy().
+            size_t              mFixedMaxThreads;
+            // Number of loopers currently inside joinThreadPool(), including
+            // ones the policy has spawned that have not started yet.
+            size_t              mPoolThreads;
+            size_t              mPeakPoolThreads;
+            uint64_t            mDriverSpawns;
+            uint64_t            mPolicySpawns;
+            uint64_t            mIdleExits;
+            uint64_t            mBlockedWaits;
+            int64_t             mBusyTimeNs;
+            int64_t             mBlockedWaitNs;
+
+            // Serializes waitForHandleReaders(), which runs without mLock.
+            Mutex               mHandleReadersLock;
 
     mutable Mutex               mLock;  // protects everything below.
 
-            Vector<handle_entry>mHandleToObject;
+            std::atomic<handle_entry*> mHandleSegments[HANDLE_MAX_SEGMENTS];
+    mutable handle_reader_shard mHandleReaders[HANDLE_READER_SHARDS];
+    mutable std::atomic<uint32_t> mHandleReaderEpoch;
 
             bool                mManagesContexts;
             context_check_func  mBinderContextCheckFunc;
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PARCEL_BUFFER_POOL_H
+#define ANDROID_PARCEL_BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/String8.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+/*
+ * Per-thread, size-classed cache for the mData and mObjects buffers owned
+ * by Parcel.
+ *
+ * Buffers are rounded up to a power-of-two size class between
+ * MIN_CLASS_SIZE and MAX_CLASS_SIZE. Released buffers go back to a small
+ * free list owned by the calling thread, so the Parcels that a binder thread
+ * builds for every transact()/sendReply() reuse the same memory instead of
+ * going through malloc/free each time. Larger buffers bypass the pool.
+ * The caches of all threads together hold at most MAX_CACHED_BYTES, so a
+ * large binder thread pool sitting idle doesn't pin memory per thread.
+ *
+ * The caller always passes the size it originally asked for when resizing
+ * or releasing a buffer; the size class is derived from it, so no header
+ * is stored in front of the data.
+ */
+class ParcelBufferPool
+{
+public:
+    enum {
+        MIN_CLASS_SHIFT = 8,
+        MAX_CLASS_SHIFT = 16,
+        NUM_CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1,
+        MIN_CLASS_SIZE = 1 << MIN_CLASS_SHIFT,
+        MAX_CLASS_SIZE = 1 << MAX_CLASS_SHIFT,
+        // Number of free buffers each thread keeps per size class.
+        MAX_CACHED_PER_CLASS = 4,
+        // Bytes kept in the caches of all threads together. Buffers released
+        // beyond it go back to free().
+        MAX_CACHED_BYTES = 256 * 1024,
+    };
+
+    struct Stats {
+        // Buffers handed out, split by whether a cached buffer was reused.
+        uint64_t    poolHits;
+        uint64_t    poolMisses;
+        // Requests larger than MAX_CLASS_SIZE, served by malloc directly.
+        uint64_t    oversize;
+        // Resizes that stayed within the same size class and cost nothing.
+        uint64_t    inPlaceResizes;
+        // Buffers returned to a thread cache vs. handed back to free().
+        uint64_t    recycled;
+        uint64_t    freed;
+        // Bytes currently parked in thread caches across the process.
+        uint64_t    cachedBytes;
+    };
+
+    // Returns a buffer of at least |size| bytes, or NULL on failure.
+    static  void*       allocate(size_t size);
+
+    // Resizes a buffer previously obtained for |oldSize| bytes. Like
+    // realloc(), |buffer| is left untouched and NULL is returned on failure.
+    static  void*       reallocate(void* buffer, size_t oldSize, size_t newSize);
+
+    // Gives back a buffer previously obtained for |size| bytes.
+    static  void        release(void* buffer, size_t size);
+
+    // Frees every buffer cached by the calling thread.
+    static  void        trimCurrentThread();
+
+    static  void        getStats(Stats* outStats);
+    static  void        resetStats();
+    // Appended to the output of "dumpsys <service> --binder-profile".
+    static  void        dump(String8& result);
+
+private:
+    struct ThreadCache;
+
+    static  int         classForSize(size_t size);
+    static  void        createKey();
+    static  ThreadCache* getThreadCache(bool create);
+    static  void        threadDestructor(void* cache);
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_PARCEL_BUFFER_POOL_H
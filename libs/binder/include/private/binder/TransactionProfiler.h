@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_TRANSACTION_PROFILER_H
+#define ANDROID_TRANSACTION_PROFILER_H
+
+#include <atomic>
+
+#include <stdint.h>
+
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+class Parcel;
+
+/*
+ * Opt-in, process-wide binder transaction profiler.
+ *
+ * When enabled, BpBinder records the client-side round trip of every
+ * transact() and BBinder the server-side execution time of every
+ * transaction, both per (interface descriptor, code). Each key gets a
+ * log2-bucketed latency histogram plus payload size and object counters.
+ *
+ * Descriptors are interned into small interface ids, under a lock, once per
+ * binder object; each BpBinder and BBinder caches its id. A proxy learns its
+ * descriptor from the interface token of the first call it makes, so the
+ * transactions it makes before that are counted under <unknown>.
+ *
+ * Recording never takes a lock: keys live in a fixed-size open-addressed
+ * table that is claimed with a compare-and-swap, and all counters are
+ * relaxed atomics. If the table fills up, further keys are counted as
+ * dropped rather than recorded. reset() releases every key.
+ *
+ * The profile, followed by the thread pool and Parcel buffer pool
+ * statistics, is reachable from any native service with
+ *     dumpsys <service> --binder-profile [enable|disable|reset]
+ */
+class TransactionProfiler
+{
+public:
+    enum {
+        // Bucket i counts latencies below 2^i microseconds; the last bucket
+        // is open-ended.
+        NUM_LATENCY_BUCKETS = 24,
+        NUM_SLOTS = 512,
+        NUM_INTERFACES = 256,
+    };
+
+    // Interface ids. NO_INTERFACE is never returned by the intern functions,
+    // so binder objects can use it to mean that they haven't looked theirs
+    // up yet.
+    enum {
+        NO_INTERFACE = 0,
+        UNKNOWN_INTERFACE = 1,
+    };
+
+    static inline bool  isEnabled() {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+    static  void        setEnabled(bool enabled);
+    static  void        reset();
+
+    // Returns the id of |descriptor|, or UNKNOWN_INTERFACE if it is empty or
+    // the interface table is full.
+    static  uint32_t    internInterface(const String16& descriptor);
+    // Returns the id of the descriptor in the interface token at the start
+    // of |data|, or NO_INTERFACE if |data| doesn't start with one. The data
+    // position of |data| is left unchanged.
+    static  uint32_t    internInterfaceToken(const Parcel& data);
+
+    static  void        recordClient(uint32_t interface, uint32_t code,
+                                     const Parcel& data, const Parcel* reply,
+                                     nsecs_t elapsed);
+    static  void        recordServer(uint32_t interface, uint32_t code,
+                                     const Parcel& data, const Parcel* reply,
+                                     nsecs_t elapsed);
+
+    static  void        dump(String8& result);
+
+    // Handles "--binder-profile [enable|disable|reset]" dump arguments, for
+    // callers that are root, shell or hold android.permission.DUMP. Returns
+    // false if |args| is not a profiler request.
+    static  bool        handleDumpArgs(int fd, const Vector<String16>& args);
+
+private:
+    static  std::atomic<bool> sEnabled;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_TRANSACTION_PROFILER_H
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares a burst of tiny oneway notifications sent one ioctl at a time
+// with the same burst sent inside an IPCThreadState batch, the way an event
+// fan-out service emits them once per frame.
+
+#include <binder/Binder.h>
+#include <binder/IBinder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace android;
+
+static const String16 kServiceName("binderBatchBenchmark");
+
+enum {
+    NOTIFY_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION,
+    GET_COUNT_TRANSACTION,
+};
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+class NotificationSink : public BBinder
+{
+public:
+    NotificationSink() : mCount(0) {}
+
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags = 0) {
+        switch (code) {
+        case NOTIFY_TRANSACTION:
+            mCount.fetch_add(1, std::memory_order_relaxed);
+            return NO_ERROR;
+        case GET_COUNT_TRANSACTION:
+            return reply->writeInt64(mCount.load(std::memory_order_relaxed));
+        default:
+            return BBinder::onTransact(code, data, reply, flags);
+        }
+    }
+
+private:
+    std::atomic<int64_t> mCount;
+};
+
+static void runServer()
+{
+    defaultServiceManager()->addService(kServiceName, new NotificationSink());
+    ProcessState::self()->startThreadPool();
+    IPCThreadState::self()->joinThreadPool();
+    exit(EXIT_FAILURE);
+}
+
+// Blocks until the sink has executed |expected| notifications, so that one
+// frame never starts while the previous one still occupies the target's
+// async buffer space.
+static void waitForDelivery(const sp<IBinder>& sink, int64_t expected)
+{
+    for (;;) {
+        Parcel data, reply;
+        if (sink->transact(GET_COUNT_TRANSACTION, data, &reply) != NO_ERROR) {
+            fprintf(stderr, "lost the notification sink\n");
+            exit(EXIT_FAILURE);
+        }
+        if (reply.readInt64() >= expected) {
+            return;
+        }
+        sched_yield();
+    }
+}
+
+static void runRound(const sp<IBinder>& sink, bool batched, int frames, int perFrame,
+        int payloadSize, int64_t* delivered)
+{
+    IPCThreadState* ipc = IPCThreadState::self();
+    uint64_t elapsed = 0;
+    uint64_t ioctls = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        const uint64_t startIoctls = ipc->getDriverCallCount();
+        const uint64_t start = nowNs();
+        if (batched) {
+            ipc->beginBatch();
+        }
+        for (int i = 0; i < perFrame; i++) {
+            Parcel data;
+            for (int sz = payloadSize; sz >= int(sizeof(int32_t)); sz -= sizeof(int32_t)) {
+                data.writeInt32(i);
+            }
+            if (sink->transact(NOTIFY_TRANSACTION, data, NULL, IBinder::FLAG_ONEWAY)
+                    != NO_ERROR) {
+                fprintf(stderr, "oneway notification failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (batched && ipc->endBatch() != NO_ERROR) {
+            fprintf(stderr, "batched notification failed\n");
+            exit(EXIT_FAILURE);
+        }
+        elapsed += nowNs() - start;
+        ioctls += ipc->getDriverCallCount() - startIoctls;
+
+        *delivered += perFrame;
+        waitForDelivery(sink, *delivered);
+    }
+
+    const double calls = double(frames) * perFrame;
+    printf("%-9s: %8.0f ns/call, %10.0f calls/s, %10.0f ioctls/s, %6.3f ioctls/call\n",
+            batched ? "batched" : "unbatched", elapsed / calls, calls * 1e9 / elapsed,
+            ioctls * 1e9 / elapsed, ioctls / calls);
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = 100;
+    int perFrame = 1000;
+    int payloadSize = 16;
+
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--help") {
+            printf("Usage: binderBatchBenchmark [OPTIONS]\n");
+            printf("\t-f N    : Number of frames.\n");
+            printf("\t-n N    : Oneway notifications per frame.\n");
+            printf("\t-p N    : Payload size of each notification in bytes.\n");
+            return 0;
+        }
+        if (string(argv[i]) == "-f" && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+            continue;
+        }
+        if (string(argv[i]) == "-n" && i + 1 < argc) {
+            perFrame = atoi(argv[++i]);
+            continue;
+        }
+        if (string(argv[i]) == "-p" && i + 1 < argc) {
+            payloadSize = atoi(argv[++i]);
+            continue;
+        }
+    }
+
+    // Fork before touching binder so each process gets its own driver fd.
+    pid_t server = fork();
+    if (server == 0) {
+        runServer();
+    }
+
+    sp<IBinder> sink = defaultServiceManager()->getService(kServiceName);
+    if (sink == NULL) {
+        fprintf(stderr, "unable to find %s\n", String8(kServiceName).string());
+        kill(server, SIGKILL);
+        return EXIT_FAILURE;
+    }
+
+    printf("%d frames of %d oneway calls, %d byte payload\n", frames, perFrame, payloadSize);
+    int64_t delivered = 0;
+    runRound(sink, false, frames, perFrame, payloadSize, &delivered);
+    runRound(sink, true, frames, perFrame, payloadSize, &delivered);
+
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    return 0;
+}
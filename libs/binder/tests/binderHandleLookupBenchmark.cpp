@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how ProcessState::getStrongProxyForHandle() scales when many
+// threads resolve existing proxies at once, which is what readStrongBinder()
+// does for every remote object it unparcels.
+
+#include <binder/BpBinder.h>
+#include <binder/IBinder.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+using namespace std;
+using namespace android;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void lookupLoop(const vector<int32_t>& handles, int iterations)
+{
+    sp<ProcessState> proc = ProcessState::self();
+    for (int i = 0; i < iterations; i++) {
+        for (int32_t handle : handles) {
+            sp<IBinder> binder = proc->getStrongProxyForHandle(handle);
+            if (binder == NULL) {
+                fprintf(stderr, "lost proxy for handle %d\n", handle);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 100000;
+    int maxThreads = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--help") {
+            printf("Usage: binderHandleLookupBenchmark [OPTIONS]\n");
+            printf("\t-i N    : Lookups of every handle per thread.\n");
+            printf("\t-t N    : Maximum number of threads.\n");
+            return 0;
+        }
+        if (string(argv[i]) == "-i" && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+            continue;
+        }
+        if (string(argv[i]) == "-t" && i + 1 < argc) {
+            maxThreads = atoi(argv[++i]);
+            continue;
+        }
+    }
+
+    // Hold a proxy for every registered service so the lookups below all
+    // hit existing entries, as they do when unparceling known binders.
+    sp<IServiceManager> sm = defaultServiceManager();
+    vector<sp<IBinder>> proxies;
+    vector<int32_t> handles;
+    proxies.push_back(IInterface::asBinder(sm));
+    handles.push_back(0);
+    for (const String16& name : sm->listServices()) {
+        sp<IBinder> binder = sm->checkService(name);
+        if (binder != NULL && binder->remoteBinder() != NULL) {
+            proxies.push_back(binder);
+            handles.push_back(binder->remoteBinder()->handle());
+        }
+    }
+    printf("%zu handles, %d iterations per thread\n", handles.size(), iterations);
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        vector<thread> workers;
+        const uint64_t start = nowNs();
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(thread(lookupLoop, cref(handles), iterations));
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        const uint64_t elapsed = nowNs() - start;
+        const double lookups = double(threads) * iterations * handles.size();
+        printf("threads %2d: %8.1f ns/lookup per thread, %8.2f M lookups/s total\n",
+                threads, elapsed * threads / lookups, lookups * 1e3 / elapsed);
+    }
+
+    return 0;
+}
@@ -20,6 +20,8 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
@@ -28,6 +30,8 @@
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 
+#include <private/binder/TransactionProfiler.h>
+
 #define ARRAY_SIZE(array) (sizeof array / sizeof array[0])
 
 using namespace android;
@@ -58,6 +62,7 @@ enum BinderLibTestTranscationCode {
     BINDER_LIB_TEST_DELAYED_EXIT_TRANSACTION,
     BINDER_LIB_TEST_GET_PTR_SIZE_TRANSACTION,
     BINDER_LIB_TEST_CREATE_BINDER_TRANSACTION,
+    BINDER_LIB_TEST_ECHO_BUFFER_TRANSACTION,
 };
 
 pid_t start_server_process(int arg2)
@@ -310,6 +315,50 @@ class BinderLibTestCallBack : public BBinder, public BinderLibTestEvent
         status_t m_result;
 };
 
+// Blocks every BINDER_LIB_TEST_CALL_BACK until |count| of them are executing
+// at the same time, or a few seconds have passed.
+class BinderLibTestBarrierCallBack : public BBinder, public BinderLibTestEvent
+{
+    public:
+        explicit BinderLibTestBarrierCallBack(int count)
+            : m_count(count), m_arrived(0)
+        {
+            pthread_mutex_init(&m_barrierMutex, NULL);
+            pthread_cond_init(&m_barrierCond, NULL);
+        }
+
+    private:
+        virtual status_t onTransact(uint32_t code,
+                                    const Parcel& data, Parcel* reply,
+                                    uint32_t flags = 0)
+        {
+            (void)data;
+            (void)reply;
+            (void)flags;
+            if (code != BINDER_LIB_TEST_CALL_BACK) {
+                return UNKNOWN_TRANSACTION;
+            }
+            pthread_mutex_lock(&m_barrierMutex);
+            if (++m_arrived == m_count) {
+                pthread_cond_broadcast(&m_barrierCond);
+                triggerEvent();
+            }
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 5;
+            while (m_arrived < m_count &&
+                    pthread_cond_timedwait(&m_barrierCond, &m_barrierMutex, &ts) == 0) {
+            }
+            pthread_mutex_unlock(&m_barrierMutex);
+            return NO_ERROR;
+        }
+
+        const int m_count;
+        int m_arrived;
+        pthread_mutex_t m_barrierMutex;
+        pthread_cond_t m_barrierCond;
+};
+
 class TestDeathRecipient : public IBinder::DeathRecipient, public BinderLibTestEvent
 {
     private:
@@ -362,6 +411,125 @@ TEST_F(BinderLibTest, PtrSize) {
     RecordProperty("ServerPtrSize", sizeof(void *));
 }
 
+TEST_F(BinderLibTest, EchoBufferReference) {
+    status_t ret;
+    Parcel data, reply;
+    std::vector<uint8_t> payload(64 * 1024 + 3);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = i * 31;
+    }
+    ret = data.writeBufferReference(payload.data(), payload.size());
+    ASSERT_EQ(NO_ERROR, ret);
+    ret = m_server->transact(BINDER_LIB_TEST_ECHO_BUFFER_TRANSACTION, data, &reply);
+    ASSERT_EQ(NO_ERROR, ret);
+
+    const void* echoed = NULL;
+    size_t echoedSize = 0;
+    ret = reply.readBufferView(&echoed, &echoedSize);
+    ASSERT_EQ(NO_ERROR, ret);
+    ASSERT_EQ(payload.size(), echoedSize);
+    EXPECT_NE(payload.data(), echoed);
+    EXPECT_EQ(0, memcmp(payload.data(), echoed, echoedSize));
+}
+
+TEST_F(BinderLibTest, TransactionProfiler) {
+    status_t ret;
+    TransactionProfiler::reset();
+    TransactionProfiler::setEnabled(true);
+    for (int i = 0; i < 10; i++) {
+        Parcel data, reply;
+        data.writeInterfaceToken(String16("binderLibTest.IProfiled"));
+        ret = m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, &reply);
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+    TransactionProfiler::setEnabled(false);
+
+    // Keyed by the descriptor in the interface token, not the handle.
+    String8 profile;
+    TransactionProfiler::dump(profile);
+    EXPECT_TRUE(strstr(profile.string(), "binderLibTest.IProfiled") != NULL)
+            << profile.string();
+}
+
+TEST_F(BinderLibTest, ThreadPoolPolicy) {
+    const int count = 3;
+    sp<ProcessState> proc = ProcessState::self();
+    EXPECT_EQ(BAD_VALUE, proc->setThreadPoolPolicy(4, 2, 1000));
+    EXPECT_EQ(BAD_VALUE, proc->setThreadPoolPolicy(0, 0, 1000));
+
+    ASSERT_EQ(NO_ERROR, proc->setThreadPoolPolicy(1, 8, 100));
+    ProcessState::ThreadPoolStats stats;
+    proc->getThreadPoolStats(&stats);
+    EXPECT_TRUE(stats.adaptive);
+    EXPECT_EQ(1u, stats.minThreads);
+    EXPECT_EQ(8u, stats.maxThreads);
+    EXPECT_LE(stats.threads, stats.maxThreads);
+    const uint64_t startPolicySpawns = stats.policySpawns;
+    const uint64_t startIdleExits = stats.idleExits;
+
+    // Each server calls back from its own thread, and the callbacks only
+    // return once all of them are running, so the pool has to grow.
+    sp<BinderLibTestBarrierCallBack> callBack = new BinderLibTestBarrierCallBack(count);
+    sp<IBinder> servers[count];
+    for (int i = 0; i < count; i++) {
+        servers[i] = addServer();
+        ASSERT_TRUE(servers[i] != NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        Parcel data, reply;
+        data.writeStrongBinder(callBack);
+        EXPECT_EQ(NO_ERROR, servers[i]->transact(BINDER_LIB_TEST_NOP_CALL_BACK, data, &reply,
+                TF_ONE_WAY));
+    }
+    EXPECT_EQ(NO_ERROR, callBack->waitEvent(5));
+    proc->getThreadPoolStats(&stats);
+    EXPECT_GT(stats.policySpawns, startPolicySpawns);
+    EXPECT_GT(stats.peakThreads, size_t(count));
+
+    // Once idle, the loopers the policy added leave the pool again.
+    for (int i = 0; i < 50; i++) {
+        proc->getThreadPoolStats(&stats);
+        if (stats.idleExits > startIdleExits && stats.threads < stats.peakThreads) {
+            break;
+        }
+        usleep(100000);
+    }
+    EXPECT_GT(stats.idleExits, startIdleExits);
+    EXPECT_LT(stats.threads, stats.peakThreads);
+
+    EXPECT_EQ(NO_ERROR, proc->clearThreadPoolPolicy());
+    proc->getThreadPoolStats(&stats);
+    EXPECT_FALSE(stats.adaptive);
+
+    for (int i = 0; i < count; i++) {
+        Parcel data, reply;
+        EXPECT_EQ(NO_ERROR, servers[i]->transact(BINDER_LIB_TEST_EXIT_TRANSACTION, data, &reply,
+                TF_ONE_WAY));
+    }
+}
+
+TEST_F(BinderLibTest, BatchedOnewayTransactions) {
+    const int count = 32;
+    IPCThreadState* ipc = IPCThreadState::self();
+    const uint64_t startIoctls = ipc->getDriverCallCount();
+
+    ipc->beginBatch();
+    for (int i = 0; i < count; i++) {
+        Parcel data;
+        data.writeInt32(i);
+        EXPECT_EQ(NO_ERROR, m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, NULL,
+                IBinder::FLAG_ONEWAY));
+    }
+    EXPECT_EQ(startIoctls, ipc->getDriverCallCount());
+    EXPECT_EQ(NO_ERROR, ipc->endBatch());
+    EXPECT_LT(ipc->getDriverCallCount() - startIoctls, uint64_t(count));
+
+    // Nothing from the batch may leak into the next synchronous call.
+    Parcel data, reply;
+    EXPECT_EQ(NO_ERROR, m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, &reply));
+    EXPECT_EQ(INVALID_OPERATION, ipc->endBatch());
+}
+
 TEST_F(BinderLibTest, IndirectGetId2)
 {
     status_t ret;
@@ -955,6 +1123,17 @@ class BinderLibTestService : public BBinder
                 }
                 return NO_ERROR;
             }
+            case BINDER_LIB_TEST_ECHO_BUFFER_TRANSACTION: {
+                const void* buffer;
+                size_t size;
+                status_t ret = data.readBufferView(&buffer, &size);
+                if (ret != NO_ERROR) {
+                    return ret;
+                }
+                // |data| outlives sendReply(), so the view can be referenced
+                // directly from the reply.
+                return reply->writeBufferReference(buffer, size);
+            }
             default:
                 return UNKNOWN_TRANSACTION;
             };
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <binder/Parcel.h>
+#include <private/binder/ParcelBufferPool.h>
+
+using namespace android;
+
+static const size_t kIterations = 10000;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Builds the kind of request/reply pair a typical AIDL call produces: a
+// handful of primitives, a string and a small blob, grown incrementally.
+static void simulateTransaction(size_t payloadSize)
+{
+    std::vector<uint8_t> payload(payloadSize, 0x5a);
+
+    Parcel data;
+    data.writeInt32(42);
+    data.writeString16(String16("android.os.IParcelBufferPoolTest"));
+    data.writeByteArray(payload.size(), payload.data());
+    data.writeInt64(0x1234567890abcdefll);
+
+    Parcel reply;
+    reply.writeInt32(0);
+    reply.writeByteArray(payload.size(), payload.data());
+
+    data.setDataPosition(0);
+    ASSERT_EQ(42, data.readInt32());
+}
+
+class ParcelBufferPoolTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        ParcelBufferPool::trimCurrentThread();
+        ParcelBufferPool::resetStats();
+    }
+
+    virtual void TearDown() {
+        ParcelBufferPool::trimCurrentThread();
+    }
+};
+
+TEST_F(ParcelBufferPoolTest, SteadyStateTransactionsDoNotAllocate) {
+    // The first transaction populates the thread cache.
+    simulateTransaction(1024);
+
+    ParcelBufferPool::resetStats();
+    for (size_t i = 0; i < kIterations; i++) {
+        simulateTransaction(1024);
+    }
+
+    ParcelBufferPool::Stats stats;
+    ParcelBufferPool::getStats(&stats);
+    EXPECT_EQ(0u, stats.poolMisses);
+    EXPECT_EQ(0u, stats.freed);
+    EXPECT_GE(stats.poolHits, kIterations);
+}
+
+TEST_F(ParcelBufferPoolTest, ResizeWithinClassIsInPlace) {
+    void* buffer = ParcelBufferPool::allocate(300);
+    ASSERT_TRUE(buffer != NULL);
+    memset(buffer, 0xa5, 300);
+
+    void* resized = ParcelBufferPool::reallocate(buffer, 300, 500);
+    EXPECT_EQ(buffer, resized);
+
+    void* grown = ParcelBufferPool::reallocate(resized, 500, 4000);
+    ASSERT_TRUE(grown != NULL);
+    const uint8_t* bytes = static_cast<const uint8_t*>(grown);
+    for (size_t i = 0; i < 300; i++) {
+        ASSERT_EQ(0xa5, bytes[i]);
+    }
+    ParcelBufferPool::release(grown, 4000);
+
+    ParcelBufferPool::Stats stats;
+    ParcelBufferPool::getStats(&stats);
+    EXPECT_EQ(1u, stats.inPlaceResizes);
+}
+
+TEST_F(ParcelBufferPoolTest, ReleasedBufferIsReused) {
+    void* first = ParcelBufferPool::allocate(2000);
+    ParcelBufferPool::release(first, 2000);
+    void* second = ParcelBufferPool::allocate(1500);
+    EXPECT_EQ(first, second);
+    ParcelBufferPool::release(second, 1500);
+}
+
+TEST_F(ParcelBufferPoolTest, OversizeBypassesPool) {
+    const size_t size = ParcelBufferPool::MAX_CLASS_SIZE + 1;
+    void* buffer = ParcelBufferPool::allocate(size);
+    ASSERT_TRUE(buffer != NULL);
+    ParcelBufferPool::release(buffer, size);
+
+    ParcelBufferPool::Stats stats;
+    ParcelBufferPool::getStats(&stats);
+    EXPECT_EQ(1u, stats.oversize);
+    EXPECT_EQ(1u, stats.freed);
+    EXPECT_EQ(0u, stats.recycled);
+}
+
+TEST_F(ParcelBufferPoolTest, ThreadCacheIsBounded) {
+    std::vector<void*> buffers;
+    for (size_t i = 0; i < ParcelBufferPool::MAX_CACHED_PER_CLASS * 2; i++) {
+        buffers.push_back(ParcelBufferPool::allocate(64));
+    }
+    for (void* buffer : buffers) {
+        ParcelBufferPool::release(buffer, 64);
+    }
+
+    ParcelBufferPool::Stats stats;
+    ParcelBufferPool::getStats(&stats);
+    EXPECT_EQ(size_t(ParcelBufferPool::MAX_CACHED_PER_CLASS), stats.recycled);
+    EXPECT_EQ(size_t(ParcelBufferPool::MAX_CACHED_PER_CLASS), stats.freed);
+}
+
+struct CacheFiller {
+    pthread_barrier_t filled;
+    pthread_barrier_t checked;
+};
+
+// Fills the calling thread's cache for the largest size class, then stays
+// alive until the test has looked at the stats.
+static void* fillThreadCache(void* arg)
+{
+    CacheFiller* filler = static_cast<CacheFiller*>(arg);
+    std::vector<void*> buffers;
+    for (size_t i = 0; i < ParcelBufferPool::MAX_CACHED_PER_CLASS; i++) {
+        buffers.push_back(ParcelBufferPool::allocate(ParcelBufferPool::MAX_CLASS_SIZE));
+    }
+    for (void* buffer : buffers) {
+        ParcelBufferPool::release(buffer, ParcelBufferPool::MAX_CLASS_SIZE);
+    }
+    pthread_barrier_wait(&filler->filled);
+    pthread_barrier_wait(&filler->checked);
+    return NULL;
+}
+
+TEST_F(ParcelBufferPoolTest, CachesAreBoundedAcrossThreads) {
+    const size_t kThreads = 8;
+    CacheFiller filler;
+    ASSERT_EQ(0, pthread_barrier_init(&filler.filled, NULL, kThreads + 1));
+    ASSERT_EQ(0, pthread_barrier_init(&filler.checked, NULL, kThreads + 1));
+    pthread_t threads[kThreads];
+    for (size_t i = 0; i < kThreads; i++) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, fillThreadCache, &filler));
+    }
+    pthread_barrier_wait(&filler.filled);
+
+    ParcelBufferPool::Stats stats;
+    ParcelBufferPool::getStats(&stats);
+    EXPECT_LE(stats.cachedBytes, uint64_t(ParcelBufferPool::MAX_CACHED_BYTES));
+    EXPECT_EQ(kThreads * ParcelBufferPool::MAX_CACHED_PER_CLASS,
+            stats.recycled + stats.freed);
+    EXPECT_GT(stats.freed, 0u);
+
+    pthread_barrier_wait(&filler.checked);
+    for (size_t i = 0; i < kThreads; i++) {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+    }
+    pthread_barrier_destroy(&filler.filled);
+    pthread_barrier_destroy(&filler.checked);
+}
+
+static void* releaseOnOtherThread(void* arg)
+{
+    Parcel* parcel = static_cast<Parcel*>(arg);
+    delete parcel;
+    return NULL;
+}
+
+TEST_F(ParcelBufferPoolTest, ParcelMayBeFreedOnAnotherThread) {
+    Parcel* parcel = new Parcel();
+    std::vector<uint8_t> payload(8192, 1);
+    parcel->writeByteArray(payload.size(), payload.data());
+
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, releaseOnOtherThread, parcel));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+}
+
+TEST_F(ParcelBufferPoolTest, Benchmark) {
+    const size_t payloadSizes[] = { 64, 1024, 16 * 1024 };
+    for (size_t payloadSize : payloadSizes) {
+        simulateTransaction(payloadSize);
+        ParcelBufferPool::resetStats();
+
+        const uint64_t start = nowNs();
+        for (size_t i = 0; i < kIterations; i++) {
+            simulateTransaction(payloadSize);
+        }
+        const uint64_t elapsed = nowNs() - start;
+
+        ParcelBufferPool::Stats stats;
+        ParcelBufferPool::getStats(&stats);
+        const uint64_t requests = stats.poolHits + stats.poolMisses + stats.inPlaceResizes;
+        printf("payload %6zu bytes: %6.0f ns/transaction, %.2f buffer requests and "
+                "%.3f mallocs per transaction\n",
+                payloadSize, double(elapsed) / kIterations,
+                double(requests) / kIterations,
+                double(stats.poolMisses + stats.oversize) / kIterations);
+    }
+
+    String8 dump;
+    ParcelBufferPool::dump(dump);
+    printf("%s", dump.string());
+}
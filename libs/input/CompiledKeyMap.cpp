@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CompiledKeyMap"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <input/CompiledKeyMap.h>
+#include <utils/Log.h>
+
+namespace android {
+
+// Bump when the layout of any compiled map changes.
+static const uint32_t COMPILED_KEY_MAP_VERSION = 2;
+
+struct CompiledKeyMapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+    uint32_t wordCount;
+    uint32_t reserved;
+};
+
+static const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+
+// --- CompiledKeyMap ---
+
+String8 CompiledKeyMap::getCompiledPath(const String8& sourcePath) {
+    String8 path(sourcePath);
+    path.append("c");
+    return path;
+}
+
+
+// --- CompiledKeyMapWriter ---
+
+CompiledKeyMapWriter::CompiledKeyMapWriter(uint32_t magic,
+        const KeyMapFileStamp& sourceStamp) :
+        mMagic(magic), mSourceSize(sourceStamp.size), mSourceHash(sourceStamp.contentHash) {
+}
+
+void CompiledKeyMapWriter::writeInt32(int32_t value) {
+    mWords.push(value);
+}
+
+status_t CompiledKeyMapWriter::writeToFile(const String8& path) const {
+    CompiledKeyMapHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = mMagic;
+    header.version = COMPILED_KEY_MAP_VERSION;
+    header.sourceSize = mSourceSize;
+    header.sourceHash = mSourceHash;
+    header.wordCount = mWords.size();
+
+    String8 tempPath(path);
+    tempPath.append(".tmp");
+    int fd = ::open(tempPath.string(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        status_t status = -errno;
+        ALOGE("Could not create compiled key map '%s', %s.", tempPath.string(),
+                strerror(-status));
+        return status;
+    }
+
+    status_t status = OK;
+    const void* chunks[] = { &header, mWords.array() };
+    size_t chunkSizes[] = { sizeof(header), mWords.size() * sizeof(int32_t) };
+    for (size_t i = 0; i < 2 && !status; i++) {
+        const uint8_t* data = static_cast<const uint8_t*>(chunks[i]);
+        size_t size = chunkSizes[i];
+        while (size) {
+            ssize_t nWrite = ::write(fd, data, size);
+            if (nWrite < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                status = -errno;
+                ALOGE("Could not write compiled key map '%s', %s.", tempPath.string(),
+                        strerror(-status));
+                break;
+            }
+            data += nWrite;
+            size -= nWrite;
+        }
+    }
+    ::close(fd);
+
+    if (!status && rename(tempPath.string(), path.string())) {
+        status = -errno;
+        ALOGE("Could not rename compiled key map '%s' to '%s', %s.", tempPath.string(),
+                path.string(), strerror(-status));
+    }
+    if (status) {
+        unlink(tempPath.string());
+    }
+    return status;
+}
+
+
+// --- CompiledKeyMapReader ---
+
+CompiledKeyMapReader::CompiledKeyMapReader() :
+        mMapping(NULL), mMappingSize(0), mWords(NULL), mWordCount(0), mPosition(0),
+        mError(NO_INIT) {
+}
+
+CompiledKeyMapReader::~CompiledKeyMapReader() {
+    close();
+}
+
+void CompiledKeyMapReader::close() {
+    if (mMapping) {
+        munmap(mMapping, mMappingSize);
+        mMapping = NULL;
+    }
+    mMappingSize = 0;
+    mWords = NULL;
+    mWordCount = 0;
+    mPosition = 0;
+    mError = NO_INIT;
+}
+
+status_t CompiledKeyMapReader::open(const String8& sourcePath,
+        const KeyMapFileStamp& sourceStamp, uint32_t magic) {
+    close();
+
+    String8 path = CompiledKeyMap::getCompiledPath(sourcePath);
+    int fd = ::open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    struct stat compiledStat;
+    if (fstat(fd, &compiledStat)
+            || size_t(compiledStat.st_size) < sizeof(CompiledKeyMapHeader)) {
+        ALOGW("Ignoring invalid compiled key map '%s'.", path.string());
+        ::close(fd);
+        return NAME_NOT_FOUND;
+    }
+
+    size_t size = compiledStat.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ALOGE("Could not map compiled key map '%s', %s.", path.string(), strerror(errno));
+        ::close(fd);
+        return NAME_NOT_FOUND;
+    }
+    ::close(fd);
+
+    const CompiledKeyMapHeader* header = static_cast<const CompiledKeyMapHeader*>(mapping);
+    if (header->magic != magic || header->version != COMPILED_KEY_MAP_VERSION
+            || header->sourceSize != uint64_t(sourceStamp.size)
+            || header->sourceHash != sourceStamp.contentHash
+            || header->wordCount != (size - sizeof(*header)) / sizeof(int32_t)) {
+        ALOGW("Ignoring out of date or invalid compiled key map '%s'.", path.string());
+        munmap(mapping, size);
+        return NAME_NOT_FOUND;
+    }
+
+    mMapping = mapping;
+    mMappingSize = size;
+    mWords = reinterpret_cast<const int32_t*>(header + 1);
+    mWordCount = header->wordCount;
+    mPosition = 0;
+    mError = NO_ERROR;
+    return OK;
+}
+
+int32_t CompiledKeyMapReader::readInt32() {
+    if (mError || mPosition >= mWordCount) {
+        mError = NOT_ENOUGH_DATA;
+        return 0;
+    }
+    return mWords[mPosition++];
+}
+
+
+// --- KeyMapFileStamp ---
+
+bool KeyMapFileStamp::read(const String8& path) {
+    int fd = ::open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Key maps are a few kilobytes, so hashing them costs much less than parsing.
+    uint64_t hash = FNV_OFFSET_BASIS;
+    off_t hashedSize = 0;
+    uint8_t buffer[4096];
+    for (;;) {
+        ssize_t nRead = ::read(fd, buffer, sizeof(buffer));
+        if (nRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::close(fd);
+            return false;
+        }
+        if (nRead == 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < nRead; i++) {
+            hash = (hash ^ buffer[i]) * FNV_PRIME;
+        }
+        hashedSize += nRead;
+    }
+    ::close(fd);
+
+    device = st.st_dev;
+    inode = st.st_ino;
+    size = hashedSize;
+    contentHash = hash;
+    return true;
+}
+
+} // namespace android
@@ -23,10 +23,17 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <new>
+
+#include <cutils/ashmem.h>
 #include <cutils/properties.h>
 #include <log/log.h>
 
@@ -40,6 +47,14 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Size of the data area of a shared memory ring.  Like the socket buffer, it holds
+// a few dozen large multi-finger motion events.  Must be a power of two.
+static const uint32_t RING_CAPACITY = 32 * 1024;
+
+// Maximum number of messages moved by a single sendmmsg() or recvmmsg() call.
+// The socket buffer rarely holds more than this many messages at once.
+static const size_t MAX_MESSAGES_PER_SYSCALL = 32;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
@@ -78,6 +93,9 @@ bool InputMessage::isValid(size_t actualSize) const {
             return body.motion.pointerCount > 0
                     && body.motion.pointerCount <= MAX_POINTERS;
         case TYPE_FINISHED:
+        case TYPE_SHARED_MEMORY_ATTACH:
+        case TYPE_SHARED_MEMORY_WAKE:
+        case TYPE_SHARED_MEMORY_NONE:
             return true;
         }
     }
@@ -97,10 +115,234 @@ size_t InputMessage::size() const {
 }
 
 
+// --- InputMessageRing ---
+
+// A single producer, single consumer ring of InputMessages in shared memory.
+//
+// Both offsets count bytes modulo twice the capacity, so that a full ring can be
+// told apart from an empty one without letting the counters overflow.  Each end
+// keeps a private copy of the offset it owns, and only trusts the other one after
+// checking it, since the memory is writable by both processes.
+class InputMessageRing : public RefBase {
+public:
+    // Creates a ring and returns the fd of its shared memory in outFd.
+    static sp<InputMessageRing> create(const String8& name, int* outFd);
+
+    // Maps a ring that was created by the other end.  Does not take ownership of fd.
+    static sp<InputMessageRing> map(int fd);
+
+    // Copies msg into the ring.  If the reader had already read everything that
+    // came before it, sets outWasEmpty to tell the caller to wake the reader up.
+    //
+    // Returns WOULD_BLOCK if the ring is full.
+    status_t write(const InputMessage* msg, bool* outWasEmpty);
+
+    // Copies the oldest message out of the ring.
+    //
+    // Returns WOULD_BLOCK if the ring is empty.
+    status_t read(InputMessage* msg);
+
+protected:
+    virtual ~InputMessageRing();
+
+private:
+    static const uint32_t MAGIC = 0x474e5249; // "IRNG"
+
+    // Record size that marks the unused end of the data area before a wrap.
+    static const uint32_t WRAP = 0xffffffff;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t capacity;
+        // The two ends write these from different cpus, so each one gets its own
+        // cache line.
+        alignas(64) std::atomic<uint32_t> writeOffset;
+        alignas(64) std::atomic<uint32_t> readOffset;
+    };
+
+    struct Record {
+        uint32_t size; // size of the message that follows, or WRAP
+        uint32_t padding;
+    };
+
+    void* mBase;
+    size_t mMapSize;
+    Header* mHeader;
+    uint8_t* mData;
+    uint32_t mCapacity;
+    uint32_t mWriteOffset;
+    uint32_t mReadOffset;
+
+    InputMessageRing(void* base, size_t mapSize);
+
+    uint32_t advance(uint32_t offset, uint32_t size) const {
+        return (offset + size) & (2 * mCapacity - 1);
+    }
+
+    uint32_t distance(uint32_t from, uint32_t to) const {
+        return to >= from ? to - from : to + 2 * mCapacity - from;
+    }
+
+    static uint32_t recordSize(uint32_t messageSize) {
+        return (sizeof(Record) + messageSize + 7) & ~7;
+    }
+};
+
+InputMessageRing::InputMessageRing(void* base, size_t mapSize) :
+        mBase(base), mMapSize(mapSize),
+        mHeader(static_cast<Header*>(base)),
+        mData(static_cast<uint8_t*>(base) + sizeof(Header)),
+        mCapacity(mHeader->capacity),
+        mWriteOffset(mHeader->writeOffset.load()),
+        mReadOffset(mHeader->readOffset.load()) {
+}
+
+InputMessageRing::~InputMessageRing() {
+    munmap(mBase, mMapSize);
+}
+
+sp<InputMessageRing> InputMessageRing::create(const String8& name, int* outFd) {
+    size_t mapSize = sizeof(Header) + RING_CAPACITY;
+    int fd = ashmem_create_region(name.string(), mapSize);
+    if (fd < 0) {
+        ALOGE("channel '%s' ~ Could not create shared memory.  errno=%d",
+                name.string(), errno);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("channel '%s' ~ Could not map shared memory.  errno=%d",
+                name.string(), errno);
+        ::close(fd);
+        return NULL;
+    }
+
+    Header* header = new (base) Header;
+    header->magic = MAGIC;
+    header->capacity = RING_CAPACITY;
+    header->writeOffset.store(0);
+    header->readOffset.store(0);
+    *outFd = fd;
+    return new InputMessageRing(base, mapSize);
+}
+
+sp<InputMessageRing> InputMessageRing::map(int fd) {
+    int size = ashmem_get_size_region(fd);
+    if (size < int(sizeof(Header))) {
+        ALOGE("Shared memory for input channel is too small: %d bytes", size);
+        return NULL;
+    }
+
+    size_t mapSize = size;
+    void* base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Could not map shared memory for input channel.  errno=%d", errno);
+        return NULL;
+    }
+
+    const Header* header = static_cast<const Header*>(base);
+    uint32_t capacity = header->capacity;
+    if (header->magic != MAGIC || capacity != mapSize - sizeof(Header)
+            || capacity < sizeof(InputMessage) || (capacity & (capacity - 1))) {
+        ALOGE("Shared memory for input channel is not a valid ring.");
+        munmap(base, mapSize);
+        return NULL;
+    }
+    return new InputMessageRing(base, mapSize);
+}
+
+status_t InputMessageRing::write(const InputMessage* msg, bool* outWasEmpty) {
+    uint32_t size = msg->size();
+    uint32_t needed = recordSize(size);
+    uint32_t readOffset = mHeader->readOffset.load(std::memory_order_acquire);
+    uint32_t used = distance(readOffset, mWriteOffset);
+    if (readOffset >= 2 * mCapacity || used > mCapacity) {
+        ALOGE("Input channel ring was corrupted by the reader.");
+        return DEAD_OBJECT;
+    }
+
+    // Records never wrap around, so skip the end of the data area if the record
+    // does not fit there.
+    uint32_t position = mWriteOffset & (mCapacity - 1);
+    uint32_t skip = needed > mCapacity - position ? mCapacity - position : 0;
+    if (skip + needed > mCapacity - used) {
+        return WOULD_BLOCK;
+    }
+
+    uint32_t writeOffset = mWriteOffset;
+    if (skip) {
+        reinterpret_cast<Record*>(mData + position)->size = WRAP;
+        writeOffset = advance(writeOffset, skip);
+        position = 0;
+    }
+    Record* record = reinterpret_cast<Record*>(mData + position);
+    record->size = size;
+    memcpy(record + 1, msg, size);
+    writeOffset = advance(writeOffset, needed);
+
+    // Publishing the record and then checking the reader's progress pairs with the
+    // reader updating its progress and then checking for new records, so that one
+    // of the two always notices the other.
+    uint32_t previousWriteOffset = mWriteOffset;
+    mWriteOffset = writeOffset;
+    mHeader->writeOffset.store(writeOffset, std::memory_order_seq_cst);
+    *outWasEmpty = mHeader->readOffset.load(std::memory_order_seq_cst) == previousWriteOffset;
+    return OK;
+}
+
+status_t InputMessageRing::read(InputMessage* msg) {
+    uint32_t readOffset = mReadOffset;
+    for (;;) {
+        uint32_t writeOffset = mHeader->writeOffset.load(std::memory_order_seq_cst);
+        if (writeOffset == readOffset) {
+            return WOULD_BLOCK;
+        }
+        uint32_t available = distance(readOffset, writeOffset);
+        if (writeOffset >= 2 * mCapacity || available > mCapacity) {
+            ALOGE("Input channel ring was corrupted by the writer.");
+            return BAD_VALUE;
+        }
+
+        uint32_t position = readOffset & (mCapacity - 1);
+        uint32_t size = reinterpret_cast<volatile Record*>(mData + position)->size;
+        if (size == WRAP) {
+            // The writer publishes the wrap together with the record after it.
+            readOffset = advance(readOffset, mCapacity - position);
+            continue;
+        }
+
+        uint32_t recordedSize = recordSize(size);
+        if (size > sizeof(InputMessage) || recordedSize > mCapacity - position
+                || recordedSize > available) {
+            ALOGE("Input channel ring contains an invalid record.");
+            return BAD_VALUE;
+        }
+        memcpy(msg, mData + position + sizeof(Record), size);
+
+        mReadOffset = advance(readOffset, recordedSize);
+        mHeader->readOffset.store(mReadOffset, std::memory_order_seq_cst);
+        return msg->isValid(size) ? OK : BAD_VALUE;
+    }
+}
+
+
 // --- InputChannel ---
 
+struct InputChannel::ReceiveRingState : public RefBase {
+    // Without shared memory, servers never send a ring, so clients don't look for one.
+    ReceiveRingState() : mayReceiveRing(isSharedMemoryTransportEnabled()) {
+    }
+
+    sp<InputMessageRing> ring;
+
+    // True until the socket delivers the ATTACH or NONE message.  Until then, every
+    // message is received with room for the ring's fd.
+    bool mayReceiveRing;
+};
+
 InputChannel::InputChannel(const String8& name, int fd) :
-        mName(name), mFd(fd) {
+        mName(name), mFd(fd), mReceiveRingState(new ReceiveRingState()) {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel constructed: name='%s', fd=%d",
             mName.string(), fd);
@@ -120,8 +362,30 @@ InputChannel::~InputChannel() {
     ::close(mFd);
 }
 
+bool InputChannel::isSharedMemoryTransportEnabled() {
+    char value[PROPERTY_VALUE_MAX];
+    int length = property_get("ro.input.shared_memory_channel", value, NULL);
+    if (length > 0) {
+        if (!strcmp("1", value)) {
+            return true;
+        }
+        if (strcmp("0", value)) {
+            ALOGD("Unrecognized property value for 'ro.input.shared_memory_channel'.  "
+                    "Use '1' or '0'.");
+        }
+    }
+    return false;
+}
+
 status_t InputChannel::openInputChannelPair(const String8& name,
         sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
+    int transport = isSharedMemoryTransportEnabled() ? TRANSPORT_SHARED_MEMORY
+            : TRANSPORT_SOCKET;
+    return openInputChannelPair(name, transport, outServerChannel, outClientChannel);
+}
+
+status_t InputChannel::openInputChannelPair(const String8& name, int transport,
+        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
     int sockets[2];
     if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets)) {
         status_t result = -errno;
@@ -145,10 +409,135 @@ status_t InputChannel::openInputChannelPair(const String8& name,
     String8 clientChannelName = name;
     clientChannelName.append(" (client)");
     outClientChannel = new InputChannel(clientChannelName, sockets[1]);
+
+    // The server never receives a ring.
+    outServerChannel->mReceiveRingState->mayReceiveRing = false;
+
+    if (transport != TRANSPORT_SHARED_MEMORY) {
+        // Without shared memory nothing is sent, so the socket is exactly as it was
+        // before the ring existed.  With it, clients look for a ring until they are
+        // told there is none.  This is the first message on the socket, so it cannot
+        // fail for lack of space.
+        if (outClientChannel->mReceiveRingState->mayReceiveRing) {
+            InputMessage msg;
+            msg.header.type = InputMessage::TYPE_SHARED_MEMORY_NONE;
+            msg.header.padding = 0;
+            status_t result = outServerChannel->sendSocketMessage(&msg);
+            if (result) {
+                ALOGE("channel '%s' ~ Could not send the transport to the client.  "
+                        "status=%d", name.string(), result);
+                outServerChannel.clear();
+                outClientChannel.clear();
+                return result;
+            }
+        }
+    } else {
+        // Queue the ring's fd on the socket, where the client end will find it even
+        // after the socket has been passed to another process.
+        outClientChannel->mReceiveRingState->mayReceiveRing = true;
+        int ringFd;
+        sp<InputMessageRing> ring = InputMessageRing::create(name, &ringFd);
+        if (ring == NULL) {
+            outServerChannel.clear();
+            outClientChannel.clear();
+            return NO_MEMORY;
+        }
+
+        InputMessage msg;
+        msg.header.type = InputMessage::TYPE_SHARED_MEMORY_ATTACH;
+        msg.header.padding = 0;
+        struct iovec iov;
+        iov.iov_base = &msg;
+        iov.iov_len = msg.size();
+        union {
+            struct cmsghdr align;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &iov;
+        header.msg_iovlen = 1;
+        header.msg_control = control.buffer;
+        header.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &ringFd, sizeof(int));
+
+        ssize_t nWrite;
+        do {
+            nWrite = ::sendmsg(sockets[0], &header, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nWrite == -1 && errno == EINTR);
+        status_t result = nWrite == ssize_t(iov.iov_len) ? OK : -errno;
+        ::close(ringFd);
+        if (result) {
+            ALOGE("channel '%s' ~ Could not send shared memory to the client.  errno=%d",
+                    name.string(), -result);
+            outServerChannel.clear();
+            outClientChannel.clear();
+            return result;
+        }
+        outServerChannel->mSendRing = ring;
+    }
     return OK;
 }
 
 status_t InputChannel::sendMessage(const InputMessage* msg) {
+    if (mSendRing == NULL) {
+        return sendSocketMessage(msg);
+    }
+
+    bool wasEmpty;
+    status_t result = mSendRing->write(msg, &wasEmpty);
+    if (!result && wasEmpty) {
+        result = wakeRingReader();
+    }
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ wrote message of type %d to ring, result=%d", mName.string(),
+            msg->header.type, result);
+#endif
+    return result;
+}
+
+status_t InputChannel::receiveMessage(InputMessage* msg) {
+    for (;;) {
+        const sp<InputMessageRing>& ring = mReceiveRingState->ring;
+        if (ring != NULL) {
+            status_t result = ring->read(msg);
+            if (result != WOULD_BLOCK) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ read message of type %d from ring, result=%d",
+                        mName.string(), msg->header.type, result);
+#endif
+                return result;
+            }
+        }
+
+        status_t result = receiveSocketMessage(msg);
+        if (result) {
+            return result;
+        }
+        if (msg->header.type != InputMessage::TYPE_SHARED_MEMORY_ATTACH
+                && msg->header.type != InputMessage::TYPE_SHARED_MEMORY_WAKE
+                && msg->header.type != InputMessage::TYPE_SHARED_MEMORY_NONE) {
+            return OK;
+        }
+        // The ring may have new messages now.
+    }
+}
+
+status_t InputChannel::wakeRingReader() {
+    InputMessage msg;
+    msg.header.type = InputMessage::TYPE_SHARED_MEMORY_WAKE;
+    msg.header.padding = 0;
+    status_t result = sendSocketMessage(&msg);
+    // If the socket is full, the reader has plenty to wake up for already.
+    return result == WOULD_BLOCK ? OK : result;
+}
+
+status_t InputChannel::sendSocketMessage(const InputMessage* msg) {
     size_t msgLength = msg->size();
     ssize_t nWrite;
     do {
@@ -184,11 +573,39 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
     return OK;
 }
 
-status_t InputChannel::receiveMessage(InputMessage* msg) {
+status_t InputChannel::receiveSocketMessage(InputMessage* msg) {
     ssize_t nRead;
-    do {
-        nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
-    } while (nRead == -1 && errno == EINTR);
+    int ringFd = -1;
+    ReceiveRingState* state = mReceiveRingState.get();
+    if (state->mayReceiveRing) {
+        // Look for the ring's fd in case this is the ATTACH message.
+        struct iovec iov;
+        iov.iov_base = msg;
+        iov.iov_len = sizeof(InputMessage);
+        union {
+            struct cmsghdr align;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &iov;
+        header.msg_iovlen = 1;
+        header.msg_control = control.buffer;
+        header.msg_controllen = sizeof(control.buffer);
+        do {
+            nRead = ::recvmsg(mFd, &header, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        } while (nRead == -1 && errno == EINTR);
+
+        struct cmsghdr* cmsg = nRead > 0 ? CMSG_FIRSTHDR(&header) : NULL;
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+                && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(&ringFd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    } else {
+        do {
+            nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
+        } while (nRead == -1 && errno == EINTR);
+    }
 
     if (nRead < 0) {
         int error = errno;
@@ -215,25 +632,216 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 #if DEBUG_CHANNEL_MESSAGES
         ALOGD("channel '%s' ~ received invalid message", mName.string());
 #endif
+        if (ringFd >= 0) {
+            ::close(ringFd);
+        }
         return BAD_VALUE;
     }
 
+    if (state->mayReceiveRing) {
+        if (msg->header.type == InputMessage::TYPE_SHARED_MEMORY_ATTACH) {
+            state->mayReceiveRing = false;
+            if (ringFd < 0) {
+                ALOGE("channel '%s' ~ shared memory was announced but not received",
+                        mName.string());
+                return BAD_VALUE;
+            }
+            state->ring = InputMessageRing::map(ringFd);
+            ::close(ringFd);
+            if (state->ring == NULL) {
+                return BAD_VALUE;
+            }
+            ringFd = -1;
+        } else if (msg->header.type == InputMessage::TYPE_SHARED_MEMORY_NONE) {
+            state->mayReceiveRing = false;
+        }
+    }
+    if (ringFd >= 0) {
+        ::close(ringFd);
+    }
+
 #if DEBUG_CHANNEL_MESSAGES
     ALOGD("channel '%s' ~ received message of type %d", mName.string(), msg->header.type);
 #endif
     return OK;
 }
 
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count, size_t* outSent) {
+    *outSent = 0;
+    if (mSendRing != NULL) {
+        // Wake the reader up at most once for the whole batch.
+        bool needWake = false;
+        status_t result = OK;
+        while (*outSent < count) {
+            bool wasEmpty;
+            result = mSendRing->write(&msgs[*outSent], &wasEmpty);
+            if (result) {
+                break;
+            }
+            needWake |= wasEmpty;
+            *outSent += 1;
+        }
+        if (needWake) {
+            status_t wakeResult = wakeRingReader();
+            if (!result) {
+                result = wakeResult;
+            }
+        }
+        return result;
+    }
+
+    struct iovec iov[MAX_MESSAGES_PER_SYSCALL];
+    struct mmsghdr headers[MAX_MESSAGES_PER_SYSCALL];
+    while (*outSent < count) {
+        size_t n = min(count - *outSent, MAX_MESSAGES_PER_SYSCALL);
+        memset(headers, 0, sizeof(struct mmsghdr) * n);
+        for (size_t i = 0; i < n; i++) {
+            const InputMessage* msg = &msgs[*outSent + i];
+            iov[i].iov_base = const_cast<InputMessage*>(msg);
+            iov[i].iov_len = msg->size();
+            headers[i].msg_hdr.msg_iov = &iov[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int nSent;
+        do {
+            nSent = ::sendmmsg(mFd, headers, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ error sending %zu messages, errno=%d", mName.string(),
+                    n, error);
+#endif
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return WOULD_BLOCK;
+            }
+            if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED
+                    || error == ECONNRESET) {
+                return DEAD_OBJECT;
+            }
+            return -error;
+        }
+
+        for (int i = 0; i < nSent; i++) {
+            if (headers[i].msg_len != iov[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.string(), msgs[*outSent + i].header.type);
+#endif
+                *outSent += i;
+                return DEAD_OBJECT;
+            }
+        }
+        *outSent += nSent;
+
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ sent %d messages", mName.string(), nSent);
+#endif
+        // If fewer messages than requested were sent, the next call reports why.
+    }
+    return OK;
+}
+
+status_t InputChannel::receiveMessages(InputMessage* msgs, size_t capacity,
+        size_t* outCount) {
+    *outCount = 0;
+    if (mReceiveRingState->ring != NULL || mReceiveRingState->mayReceiveRing) {
+        // Reading the ring costs no system calls, and the message that attaches it
+        // must be received on its own to get the fd.
+        while (*outCount < capacity) {
+            status_t result = receiveMessage(&msgs[*outCount]);
+            if (result) {
+                return *outCount ? OK : result;
+            }
+            *outCount += 1;
+        }
+        return OK;
+    }
+
+    struct iovec iov[MAX_MESSAGES_PER_SYSCALL];
+    struct mmsghdr headers[MAX_MESSAGES_PER_SYSCALL];
+    size_t n = min(capacity, MAX_MESSAGES_PER_SYSCALL);
+    memset(headers, 0, sizeof(struct mmsghdr) * n);
+    for (size_t i = 0; i < n; i++) {
+        iov[i].iov_base = &msgs[i];
+        iov[i].iov_len = sizeof(InputMessage);
+        headers[i].msg_hdr.msg_iov = &iov[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nRead;
+    do {
+        nRead = ::recvmmsg(mFd, headers, n, MSG_DONTWAIT, NULL);
+    } while (nRead == -1 && errno == EINTR);
+
+    if (nRead < 0) {
+        int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed, errno=%d", mName.string(), errno);
+#endif
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+
+    for (int i = 0; i < nRead; i++) {
+        size_t length = headers[i].msg_len;
+        if (length == 0) { // check for EOF
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ receive message failed because peer was closed",
+                    mName.string());
+#endif
+            if (i == 0) {
+                return DEAD_OBJECT;
+            }
+            // Report the messages that arrived before the peer went away first.
+            break;
+        }
+
+        if ((headers[i].msg_hdr.msg_flags & MSG_TRUNC) || !msgs[i].isValid(length)) {
+            if (i == 0) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ received invalid message", mName.string());
+#endif
+                return BAD_VALUE;
+            }
+            // The messages before it are fine, but this one cannot be put back.
+            ALOGE("channel '%s' ~ dropped invalid message received after %d valid ones",
+                    mName.string(), i);
+            break;
+        }
+        *outCount = i + 1;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received %zu messages", mName.string(), *outCount);
+#endif
+    return OK;
+}
+
+
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
-    return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    sp<InputChannel> channel = new InputChannel(getName(), fd);
+    channel->mSendRing = mSendRing;
+    channel->mReceiveRingState = mReceiveRingState;
+    return channel;
 }
 
 
 // --- InputPublisher ---
 
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mBatching(false) {
 }
 
 InputPublisher::~InputPublisher() {
@@ -278,7 +886,7 @@ status_t InputPublisher::publishKeyEvent(
     msg.body.key.repeatCount = repeatCount;
     msg.body.key.downTime = downTime;
     msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    return sendMessage(&msg);
 }
 
 status_t InputPublisher::publishMotionEvent(
@@ -346,7 +954,7 @@ status_t InputPublisher::publishMotionEvent(
         msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
         msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
     }
-    return mChannel->sendMessage(&msg);
+    return sendMessage(&msg);
 }
 
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
@@ -372,14 +980,63 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
     return OK;
 }
 
+void InputPublisher::beginBatch() {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ beginBatch", mChannel->getName().string());
+#endif
+    mBatching = true;
+}
+
+status_t InputPublisher::endBatch() {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ endBatch: %zu pending messages",
+            mChannel->getName().string(), mPendingMessages.size());
+#endif
+    status_t result = flushPendingMessages();
+    if (!result) {
+        mBatching = false;
+    }
+    return result;
+}
+
+status_t InputPublisher::sendMessage(const InputMessage* msg) {
+    if (!mBatching) {
+        return mChannel->sendMessage(msg);
+    }
+
+    if (mPendingMessages.size() >= MAX_MESSAGES_PER_SYSCALL) {
+        status_t result = flushPendingMessages();
+        if (result) {
+            return result;
+        }
+    }
+    mPendingMessages.push(*msg);
+    return OK;
+}
+
+status_t InputPublisher::flushPendingMessages() {
+    size_t sent = 0;
+    status_t result = OK;
+    if (!mPendingMessages.isEmpty()) {
+        result = mChannel->sendMessages(mPendingMessages.array(), mPendingMessages.size(),
+                &sent);
+        mPendingMessages.removeItemsAt(0, sent);
+    }
+    return result;
+}
+
 // --- InputConsumer ---
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
-        mChannel(channel), mMsgDeferred(false) {
+        mChannel(channel), mMsgDeferred(false),
+        mReceiveBurstSize(1), mReceiveHead(0), mReceiveCount(0), mReceiveDrained(false) {
 }
 
 InputConsumer::~InputConsumer() {
+    if (mDeferredEventWaker != NULL) {
+        mDeferredEventLooper->removeMessages(mDeferredEventWaker);
+    }
 }
 
 bool InputConsumer::isTouchResamplingEnabled() {
@@ -400,6 +1057,24 @@ bool InputConsumer::isTouchResamplingEnabled() {
 status_t InputConsumer::consume(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent,
         int32_t* displayId) {
+    status_t result = consumeMessages(factory, consumeBatches, frameTime, outSeq, outEvent,
+            displayId);
+    wakeForDeferredEvent();
+    return result;
+}
+
+status_t InputConsumer::consume(InputEventFactoryInterface* factory,
+        bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent,
+        int32_t* displayId, int* motionEventType, int* touchMoveNumber, bool* flag) {
+    status_t result = consumeMessages(factory, consumeBatches, frameTime, outSeq, outEvent,
+            displayId, motionEventType, touchMoveNumber, flag);
+    wakeForDeferredEvent();
+    return result;
+}
+
+status_t InputConsumer::consumeMessages(InputEventFactoryInterface* factory,
+        bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent,
+        int32_t* displayId) {
 #if DEBUG_TRANSPORT_ACTIONS
     ALOGD("channel '%s' consumer ~ consume: consumeBatches=%s, frameTime=%lld",
             mChannel->getName().string(), consumeBatches ? "true" : "false", frameTime);
@@ -409,6 +1084,9 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
     *outEvent = NULL;
     *displayId = -1;  // Invalid display.
 
+    // Only trust an empty channel seen during this call, see receiveMessage().
+    mReceiveDrained = false;
+
     // Fetch the next input message.
     // Loop until an event can be returned or no additional events are received.
     while (!*outEvent) {
@@ -418,7 +1096,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result) {
                 // Consume the next batched event unless batches are being held for later.
                 if (consumeBatches || result != WOULD_BLOCK) {
@@ -517,7 +1195,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
     return OK;
 }
 
-status_t InputConsumer::consume(InputEventFactoryInterface* factory,
+status_t InputConsumer::consumeMessages(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent,
         int32_t* displayId, int* motionEventType, int* touchMoveNumber, bool* flag) {
 #if DEBUG_TRANSPORT_ACTIONS
@@ -529,6 +1207,9 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
     *outEvent = NULL;
     *displayId = -1;  // Invalid display.
 
+    // Only trust an empty channel seen during this call, see receiveMessage().
+    mReceiveDrained = false;
+
     // Fetch the next input message.
     // Loop until an event can be returned or no additional events are received.
     while (!*outEvent) {
@@ -538,7 +1219,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result == 0) {
                 if ((mMsg.body.motion.action & AMOTION_EVENT_ACTION_MASK) == AMOTION_EVENT_ACTION_MOVE){
                     mTouchMoveCounter++;
@@ -647,6 +1328,80 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
     return OK;
 }
 
+void InputConsumer::setReceiveBurstSize(size_t burstSize) {
+    // The buffer is resized the next time it runs empty, so that messages
+    // already drained into it are not lost.
+    mReceiveBurstSize = burstSize < 1 ? 1 : min(burstSize, MAX_MESSAGES_PER_SYSCALL);
+}
+
+void InputConsumer::setDeferredEventHandler(const sp<Looper>& looper,
+        const sp<MessageHandler>& handler) {
+    if (mDeferredEventWaker != NULL) {
+        mDeferredEventLooper->removeMessages(mDeferredEventWaker);
+    }
+    if (looper != NULL && handler != NULL) {
+        mDeferredEventLooper = looper;
+        mDeferredEventWaker = new DeferredEventWaker(handler);
+    } else {
+        mDeferredEventLooper.clear();
+        mDeferredEventWaker.clear();
+    }
+    wakeForDeferredEvent();
+}
+
+void InputConsumer::wakeForDeferredEvent() {
+    if (mDeferredEventWaker == NULL || mDeferredEventWaker->pending || !hasDeferredEvent()) {
+        return;
+    }
+    mDeferredEventWaker->pending = true;
+    mDeferredEventLooper->sendMessage(mDeferredEventWaker, Message());
+}
+
+InputConsumer::DeferredEventWaker::DeferredEventWaker(const sp<MessageHandler>& handler) :
+        handler(handler), pending(false) {
+}
+
+void InputConsumer::DeferredEventWaker::handleMessage(const Message& message) {
+    // Cleared first, so that a consume() called by the handler can post again.
+    pending = false;
+    handler->handleMessage(message);
+}
+
+status_t InputConsumer::receiveMessage(InputMessage* msg) {
+    if (mReceiveHead == mReceiveCount) {
+        if (mReceiveDrained) {
+            // The channel was empty when this call to consume() drained the last
+            // burst.  Anything that arrived since then keeps the fd readable, so the
+            // caller will be woken up again to receive it.
+            mReceiveDrained = false;
+            return WOULD_BLOCK;
+        }
+        if (mReceiveBurstSize <= 1) {
+            return mChannel->receiveMessage(msg);
+        }
+
+        mReceiveHead = 0;
+        mReceiveCount = 0;
+        if (mReceiveBuffer.size() != mReceiveBurstSize) {
+            mReceiveBuffer.clear();
+            mReceiveBuffer.insertAt(0, mReceiveBurstSize);
+        }
+        status_t result = mChannel->receiveMessages(mReceiveBuffer.editArray(),
+                mReceiveBuffer.size(), &mReceiveCount);
+        if (result) {
+            return result;
+        }
+        mReceiveDrained = mReceiveCount < mReceiveBuffer.size();
+#if DEBUG_TRANSPORT_ACTIONS
+        ALOGD("channel '%s' consumer ~ received a burst of %zu messages",
+                mChannel->getName().string(), mReceiveCount);
+#endif
+    }
+
+    *msg = mReceiveBuffer.itemAt(mReceiveHead++);
+    return OK;
+}
+
 status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
         nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent, int32_t* displayId) {
     status_t result;
@@ -1053,7 +1808,7 @@ status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled)
 }
 
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    return mMsgDeferred || mReceiveHead < mReceiveCount;
 }
 
 bool InputConsumer::hasPendingBatch() const {
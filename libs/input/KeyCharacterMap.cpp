@@ -24,6 +24,7 @@
 #endif
 
 #include <android/keycodes.h>
+#include <input/CompiledKeyMap.h>
 #include <input/InputEventLabels.h>
 #include <input/Keyboard.h>
 #include <input/KeyCharacterMap.h>
@@ -106,10 +107,41 @@ KeyCharacterMap::~KeyCharacterMap() {
     }
 }
 
+// Key character maps loaded from files that have not changed since.
+static KeyMapCache<KeyCharacterMap> gCache;
+
 status_t KeyCharacterMap::load(const String8& filename,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    KeyMapFileStamp stamp;
+    bool haveStamp = stamp.read(filename);
+    sp<KeyCharacterMap> map;
+    status_t status;
+    if (haveStamp && gCache.get(filename, stamp, &map)) {
+        status = OK;
+    } else {
+        // The map is cached regardless of format, which only affects validation.  The
+        // compiled form can only be checked against the stamp of its source.
+        status = haveStamp ? loadCompiled(filename, stamp, &map) : NAME_NOT_FOUND;
+        if (status) {
+            status = loadSource(filename, FORMAT_ANY, &map);
+        }
+        if (!status && haveStamp) {
+            gCache.put(filename, stamp, map);
+        }
+    }
+    if (!status) {
+        status = map->checkFormat(filename, format);
+        if (!status) {
+            *outMap = map;
+        }
+    }
+    return status;
+}
+
+status_t KeyCharacterMap::loadSource(const String8& filename,
+        Format format, sp<KeyCharacterMap>* outMap) {
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -121,6 +153,147 @@ status_t KeyCharacterMap::load(const String8& filename,
     return status;
 }
 
+status_t KeyCharacterMap::loadCompiled(const String8& filename,
+        const KeyMapFileStamp& stamp, sp<KeyCharacterMap>* outMap) {
+    CompiledKeyMapReader reader;
+    status_t status = reader.open(filename, stamp, CompiledKeyMap::MAGIC_KEY_CHARACTER_MAP);
+    if (status) {
+        return status;
+    }
+
+#if DEBUG_PARSER_PERFORMANCE
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+#endif
+    sp<KeyCharacterMap> map = new KeyCharacterMap();
+    map->mType = reader.readInt32();
+    size_t numKeys = reader.readInt32();
+    if (reader.errorCheck() || numKeys > MAX_KEYS) {
+        ALOGE("Compiled key character map for '%s' is malformed.", filename.string());
+        return BAD_VALUE;
+    }
+
+    map->mKeys.setCapacity(numKeys);
+    for (size_t i = 0; i < numKeys; i++) {
+        int32_t keyCode = reader.readInt32();
+        Key* key = new Key();
+        key->label = reader.readInt32();
+        key->number = reader.readInt32();
+        map->mKeys.add(keyCode, key);
+
+        Behavior* lastBehavior = NULL;
+        while (reader.readInt32()) {
+            Behavior* behavior = new Behavior();
+            behavior->metaState = reader.readInt32();
+            behavior->character = reader.readInt32();
+            behavior->fallbackKeyCode = reader.readInt32();
+            behavior->replacementKeyCode = reader.readInt32();
+            if (lastBehavior) {
+                lastBehavior->next = behavior;
+            } else {
+                key->firstBehavior = behavior;
+            }
+            lastBehavior = behavior;
+        }
+        if (reader.errorCheck()) {
+            ALOGE("Compiled key character map for '%s' is malformed.", filename.string());
+            return BAD_VALUE;
+        }
+    }
+
+    if (readCompiledKeyCodes(reader, &map->mKeysByScanCode)
+            || readCompiledKeyCodes(reader, &map->mKeysByUsageCode)
+            || reader.remaining()) {
+        ALOGE("Compiled key character map for '%s' is malformed.", filename.string());
+        return BAD_VALUE;
+    }
+#if DEBUG_PARSER_PERFORMANCE
+    nsecs_t elapsedTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+    ALOGD("Loaded compiled key character map '%s' in %0.3fms.",
+            filename.string(), elapsedTime / 1000000.0);
+#endif
+    *outMap = map;
+    return OK;
+}
+
+status_t KeyCharacterMap::readCompiledKeyCodes(CompiledKeyMapReader& reader,
+        KeyedVector<int32_t, int32_t>* outKeyCodes) {
+    size_t count = reader.readInt32();
+    if (count > reader.remaining()) {
+        return BAD_VALUE;
+    }
+    outKeyCodes->setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        int32_t code = reader.readInt32();
+        outKeyCodes->add(code, reader.readInt32());
+    }
+    return reader.errorCheck();
+}
+
+status_t KeyCharacterMap::compile(const String8& filename, Format format,
+        const String8& outFilename) {
+    KeyMapFileStamp stamp;
+    if (!stamp.read(filename)) {
+        ALOGE("Could not read key character map file %s.", filename.string());
+        return NAME_NOT_FOUND;
+    }
+
+    sp<KeyCharacterMap> map;
+    status_t status = loadSource(filename, format, &map);
+    if (status) {
+        return status;
+    }
+
+    CompiledKeyMapWriter writer(CompiledKeyMap::MAGIC_KEY_CHARACTER_MAP, stamp);
+    writer.writeInt32(map->mType);
+    writer.writeInt32(map->mKeys.size());
+    for (size_t i = 0; i < map->mKeys.size(); i++) {
+        const Key* key = map->mKeys.valueAt(i);
+        writer.writeInt32(map->mKeys.keyAt(i));
+        writer.writeInt32(key->label);
+        writer.writeInt32(key->number);
+        for (const Behavior* behavior = key->firstBehavior; behavior != NULL;
+                behavior = behavior->next) {
+            writer.writeInt32(1);
+            writer.writeInt32(behavior->metaState);
+            writer.writeInt32(behavior->character);
+            writer.writeInt32(behavior->fallbackKeyCode);
+            writer.writeInt32(behavior->replacementKeyCode);
+        }
+        writer.writeInt32(0);
+    }
+
+    writeCompiledKeyCodes(writer, map->mKeysByScanCode);
+    writeCompiledKeyCodes(writer, map->mKeysByUsageCode);
+    return writer.writeToFile(outFilename);
+}
+
+void KeyCharacterMap::writeCompiledKeyCodes(CompiledKeyMapWriter& writer,
+        const KeyedVector<int32_t, int32_t>& keyCodes) {
+    writer.writeInt32(keyCodes.size());
+    for (size_t i = 0; i < keyCodes.size(); i++) {
+        writer.writeInt32(keyCodes.keyAt(i));
+        writer.writeInt32(keyCodes.valueAt(i));
+    }
+}
+
+status_t KeyCharacterMap::checkFormat(const String8& location, Format format) const {
+    if (format == FORMAT_BASE) {
+        if (mType == KEYBOARD_TYPE_OVERLAY) {
+            ALOGE("%s: Base keyboard layout must specify a keyboard 'type' other than 'OVERLAY'.",
+                    location.string());
+            return BAD_VALUE;
+        }
+    } else if (format == FORMAT_OVERLAY) {
+        if (mType != KEYBOARD_TYPE_OVERLAY) {
+            ALOGE("%s: Overlay keyboard layout missing required keyboard "
+                    "'type OVERLAY' declaration.",
+                    location.string());
+            return BAD_VALUE;
+        }
+    }
+    return NO_ERROR;
+}
+
 status_t KeyCharacterMap::loadContents(const String8& filename, const char* contents,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
@@ -788,22 +961,7 @@ status_t KeyCharacterMap::Parser::parse() {
         return BAD_VALUE;
     }
 
-    if (mFormat == FORMAT_BASE) {
-        if (mMap->mType == KEYBOARD_TYPE_OVERLAY) {
-            ALOGE("%s: Base keyboard layout must specify a keyboard 'type' other than 'OVERLAY'.",
-                    mTokenizer->getLocation().string());
-            return BAD_VALUE;
-        }
-    } else if (mFormat == FORMAT_OVERLAY) {
-        if (mMap->mType != KEYBOARD_TYPE_OVERLAY) {
-            ALOGE("%s: Overlay keyboard layout missing required keyboard "
-                    "'type OVERLAY' declaration.",
-                    mTokenizer->getLocation().string());
-            return BAD_VALUE;
-        }
-    }
-
-    return NO_ERROR;
+    return mMap->checkFormat(mTokenizer->getLocation(), mFormat);
 }
 
 status_t KeyCharacterMap::Parser::parseType() {
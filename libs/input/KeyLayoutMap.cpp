@@ -19,6 +19,7 @@
 #include <stdlib.h>
 
 #include <android/keycodes.h>
+#include <input/CompiledKeyMap.h>
 #include <input/InputEventLabels.h>
 #include <input/Keyboard.h>
 #include <input/KeyLayoutMap.h>
@@ -49,9 +50,34 @@ KeyLayoutMap::KeyLayoutMap() {
 KeyLayoutMap::~KeyLayoutMap() {
 }
 
+// Key layout maps loaded from files that have not changed since.
+static KeyMapCache<KeyLayoutMap> gCache;
+
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    KeyMapFileStamp stamp;
+    bool haveStamp = stamp.read(filename);
+    if (haveStamp && gCache.get(filename, stamp, outMap)) {
+        return OK;
+    }
+
+    // The compiled form can only be checked against the stamp of its source.
+    sp<KeyLayoutMap> map;
+    status_t status = haveStamp ? loadCompiled(filename, stamp, &map) : NAME_NOT_FOUND;
+    if (status) {
+        status = loadSource(filename, &map);
+    }
+    if (!status) {
+        if (haveStamp) {
+            gCache.put(filename, stamp, map);
+        }
+        *outMap = map;
+    }
+    return status;
+}
+
+status_t KeyLayoutMap::loadSource(const String8& filename, sp<KeyLayoutMap>* outMap) {
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -82,6 +108,139 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     return status;
 }
 
+status_t KeyLayoutMap::loadCompiled(const String8& filename, const KeyMapFileStamp& stamp,
+        sp<KeyLayoutMap>* outMap) {
+    CompiledKeyMapReader reader;
+    status_t status = reader.open(filename, stamp, CompiledKeyMap::MAGIC_KEY_LAYOUT_MAP);
+    if (status) {
+        return status;
+    }
+
+#if DEBUG_PARSER_PERFORMANCE
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+#endif
+    sp<KeyLayoutMap> map = new KeyLayoutMap();
+    size_t axisCount = 0;
+    if (readCompiledKeys(reader, &map->mKeysByScanCode)
+            || readCompiledKeys(reader, &map->mKeysByUsageCode)
+            || (axisCount = reader.readInt32()) > reader.remaining()) {
+        ALOGE("Compiled key layout map for '%s' is malformed.", filename.string());
+        return BAD_VALUE;
+    }
+    map->mAxes.setCapacity(axisCount);
+    for (size_t i = 0; i < axisCount; i++) {
+        int32_t scanCode = reader.readInt32();
+        AxisInfo axisInfo;
+        axisInfo.mode = static_cast<AxisInfo::Mode>(reader.readInt32());
+        axisInfo.axis = reader.readInt32();
+        axisInfo.highAxis = reader.readInt32();
+        axisInfo.splitValue = reader.readInt32();
+        axisInfo.flatOverride = reader.readInt32();
+        map->mAxes.add(scanCode, axisInfo);
+    }
+
+    if (reader.errorCheck()
+            || readCompiledLeds(reader, &map->mLedsByScanCode)
+            || readCompiledLeds(reader, &map->mLedsByUsageCode)
+            || reader.remaining()) {
+        ALOGE("Compiled key layout map for '%s' is malformed.", filename.string());
+        return BAD_VALUE;
+    }
+#if DEBUG_PARSER_PERFORMANCE
+    nsecs_t elapsedTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+    ALOGD("Loaded compiled key layout map '%s' in %0.3fms.",
+            filename.string(), elapsedTime / 1000000.0);
+#endif
+    *outMap = map;
+    return OK;
+}
+
+status_t KeyLayoutMap::readCompiledKeys(CompiledKeyMapReader& reader,
+        KeyedVector<int32_t, Key>* outKeys) {
+    size_t count = reader.readInt32();
+    if (count > reader.remaining()) {
+        return BAD_VALUE;
+    }
+    outKeys->setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        int32_t code = reader.readInt32();
+        Key key;
+        key.keyCode = reader.readInt32();
+        key.flags = reader.readInt32();
+        outKeys->add(code, key);
+    }
+    return reader.errorCheck();
+}
+
+status_t KeyLayoutMap::readCompiledLeds(CompiledKeyMapReader& reader,
+        KeyedVector<int32_t, Led>* outLeds) {
+    size_t count = reader.readInt32();
+    if (count > reader.remaining()) {
+        return BAD_VALUE;
+    }
+    outLeds->setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        int32_t code = reader.readInt32();
+        Led led;
+        led.ledCode = reader.readInt32();
+        outLeds->add(code, led);
+    }
+    return reader.errorCheck();
+}
+
+status_t KeyLayoutMap::compile(const String8& filename, const String8& outFilename) {
+    KeyMapFileStamp stamp;
+    if (!stamp.read(filename)) {
+        ALOGE("Could not read key layout map file %s.", filename.string());
+        return NAME_NOT_FOUND;
+    }
+
+    sp<KeyLayoutMap> map;
+    status_t status = loadSource(filename, &map);
+    if (status) {
+        return status;
+    }
+
+    CompiledKeyMapWriter writer(CompiledKeyMap::MAGIC_KEY_LAYOUT_MAP, stamp);
+    writeCompiledKeys(writer, map->mKeysByScanCode);
+    writeCompiledKeys(writer, map->mKeysByUsageCode);
+
+    writer.writeInt32(map->mAxes.size());
+    for (size_t i = 0; i < map->mAxes.size(); i++) {
+        const AxisInfo& axisInfo = map->mAxes.valueAt(i);
+        writer.writeInt32(map->mAxes.keyAt(i));
+        writer.writeInt32(axisInfo.mode);
+        writer.writeInt32(axisInfo.axis);
+        writer.writeInt32(axisInfo.highAxis);
+        writer.writeInt32(axisInfo.splitValue);
+        writer.writeInt32(axisInfo.flatOverride);
+    }
+
+    writeCompiledLeds(writer, map->mLedsByScanCode);
+    writeCompiledLeds(writer, map->mLedsByUsageCode);
+    return writer.writeToFile(outFilename);
+}
+
+void KeyLayoutMap::writeCompiledKeys(CompiledKeyMapWriter& writer,
+        const KeyedVector<int32_t, Key>& keys) {
+    writer.writeInt32(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        const Key& key = keys.valueAt(i);
+        writer.writeInt32(keys.keyAt(i));
+        writer.writeInt32(key.keyCode);
+        writer.writeInt32(key.flags);
+    }
+}
+
+void KeyLayoutMap::writeCompiledLeds(CompiledKeyMapWriter& writer,
+        const KeyedVector<int32_t, Led>& leds) {
+    writer.writeInt32(leds.size());
+    for (size_t i = 0; i < leds.size(); i++) {
+        writer.writeInt32(leds.keyAt(i));
+        writer.writeInt32(leds.valueAt(i).ledCode);
+    }
+}
+
 status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
         int32_t* outKeyCode, uint32_t* outFlags) const {
     const Key* key = getKey(scanCode, usageCode);
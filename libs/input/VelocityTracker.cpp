@@ -76,7 +76,9 @@ static std::string vectorToString(const float* a, uint32_t m) {
     return str;
 }
 
-static std::string matrixToString(const float* a, uint32_t m, uint32_t n, bool rowMajor) {
+// Rows (or columns, if not row major) of the matrix are stride elements apart.
+static std::string matrixToString(const float* a, uint32_t m, uint32_t n, uint32_t stride,
+        bool rowMajor) {
     std::string str;
     str = "[";
     for (size_t i = 0; i < m; i++) {
@@ -88,7 +90,7 @@ static std::string matrixToString(const float* a, uint32_t m, uint32_t n, bool r
             if (j) {
                 str += ",";
             }
-            str += android::base::StringPrintf(" %f", a[rowMajor ? i * n + j : j * m + i]);
+            str += android::base::StringPrintf(" %f", a[rowMajor ? i * stride + j : j * stride + i]);
         }
         str += " ]";
     }
@@ -349,6 +351,25 @@ bool VelocityTracker::getEstimator(uint32_t id, Estimator* outEstimator) const {
     return mStrategy->getEstimator(id, outEstimator);
 }
 
+BitSet32 VelocityTracker::getEstimators(BitSet32 idBits, Estimator* outEstimators) const {
+    return mStrategy->getEstimators(idBits, outEstimators);
+}
+
+
+// --- VelocityTrackerStrategy ---
+
+BitSet32 VelocityTrackerStrategy::getEstimators(BitSet32 idBits,
+        VelocityTracker::Estimator* outEstimators) const {
+    BitSet32 validIdBits;
+    for (BitSet32 iterBits(idBits); !iterBits.isEmpty(); ) {
+        uint32_t id = iterBits.clearFirstMarkedBit();
+        if (getEstimator(id, &outEstimators[idBits.getIndexOfBit(id)])) {
+            validIdBits.markBit(id);
+        }
+    }
+    return validIdBits;
+}
+
 
 // --- LeastSquaresVelocityTrackerStrategy ---
 
@@ -389,12 +410,27 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
     }
 }
 
+// The most samples and coefficients of a least squares fit.
+static const uint32_t MAX_LEAST_SQUARES_SAMPLES = 20;
+static const uint32_t MAX_LEAST_SQUARES_COEFFICIENTS = VelocityTracker::Estimator::MAX_DEGREE + 1;
+
+/**
+ * The QR decomposition of the weighted sample matrix of a least squares fit.
+ *
+ * It only depends on the sample times and weights, so it is shared by the fits of
+ * both axes of every pointer that has samples at the same times.
+ */
+struct LeastSquaresDecomposition {
+    uint32_t m; // number of samples
+    uint32_t n; // number of coefficients
+    float q[MAX_LEAST_SQUARES_COEFFICIENTS][MAX_LEAST_SQUARES_SAMPLES]; // column-major order
+    float r[MAX_LEAST_SQUARES_COEFFICIENTS][MAX_LEAST_SQUARES_COEFFICIENTS]; // row-major order
+};
+
 /**
  * Solves a linear least squares problem to obtain a N degree polynomial that fits
  * the specified input data as nearly as possible.
  *
- * Returns true if a solution is found, false otherwise.
- *
  * The input consists of two vectors of data points X and Y with indices 0..m-1
  * along with a weight vector W of the same size.
  *
@@ -420,17 +456,17 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  * of fit of the model for the given data.  It is a value between 0 and 1, where 1
  * indicates perfect correspondence.
  *
- * This function first expands the X vector to a m by n matrix A such that
+ * decomposeLeastSquares() first expands the X vector to a m by n matrix A such that
  * A[i][0] = 1, A[i][1] = X[i], A[i][2] = X[i]^2, ..., A[i][n] = X[i]^n, then
- * multiplies it by w[i]./
+ * multiplies it by w[i].
  *
  * Then it calculates the QR decomposition of A yielding an m by m orthonormal matrix Q
  * and an m by n upper triangular matrix R.  Because R is upper triangular (lower
  * part is all zeroes), we can simplify the decomposition into an m by n matrix
- * Q1 and a n by n matrix R1 such that A = Q1 R1.
+ * Q1 and a n by n matrix R1 such that A = Q1 R1.  Returns false if there is no solution.
  *
- * Finally we solve the system of linear equations given by R1 B = (Qtranspose W Y)
- * to find B.
+ * Finally solveLeastSquares() solves the system of linear equations given by
+ * R1 B = (Qtranspose W Y) to find B, once for every Y fitted at the same X and W.
  *
  * For efficiency, we lay out A and Q column-wise in memory because we frequently
  * operate on the column vectors.  Conversely, we lay out R row-wise.
@@ -438,16 +474,19 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  * http://en.wikipedia.org/wiki/Numerical_methods_for_linear_least_squares
  * http://en.wikipedia.org/wiki/Gram-Schmidt
  */
-static bool solveLeastSquares(const float* x, const float* y,
-        const float* w, uint32_t m, uint32_t n, float* outB, float* outDet) {
+static bool decomposeLeastSquares(const float* x, const float* w, uint32_t m, uint32_t n,
+        LeastSquaresDecomposition* outDecomposition) {
 #if DEBUG_STRATEGY
-    ALOGD("solveLeastSquares: m=%d, n=%d, x=%s, y=%s, w=%s", int(m), int(n),
-            vectorToString(x, m).c_str(), vectorToString(y, m).c_str(),
-            vectorToString(w, m).c_str());
+    ALOGD("decomposeLeastSquares: m=%d, n=%d, x=%s, w=%s", int(m), int(n),
+            vectorToString(x, m).c_str(), vectorToString(w, m).c_str());
 #endif
+    LOG_ALWAYS_FATAL_IF(m > MAX_LEAST_SQUARES_SAMPLES || n > MAX_LEAST_SQUARES_COEFFICIENTS,
+            "Least squares fit of %u samples with %u coefficients is too large.", m, n);
+    outDecomposition->m = m;
+    outDecomposition->n = n;
 
     // Expand the X vector to a matrix A, pre-multiplied by the weights.
-    float a[n][m]; // column-major order
+    float a[MAX_LEAST_SQUARES_COEFFICIENTS][MAX_LEAST_SQUARES_SAMPLES]; // column-major order
     for (uint32_t h = 0; h < m; h++) {
         a[0][h] = w[h];
         for (uint32_t i = 1; i < n; i++) {
@@ -455,12 +494,13 @@ static bool solveLeastSquares(const float* x, const float* y,
         }
     }
 #if DEBUG_STRATEGY
-    ALOGD("  - a=%s", matrixToString(&a[0][0], m, n, false /*rowMajor*/).c_str());
+    ALOGD("  - a=%s", matrixToString(&a[0][0], m, n, MAX_LEAST_SQUARES_SAMPLES,
+            false /*rowMajor*/).c_str());
 #endif
 
     // Apply the Gram-Schmidt process to A to obtain its QR decomposition.
-    float q[n][m]; // orthonormal basis, column-major order
-    float r[n][n]; // upper triangular matrix, row-major order
+    float (*q)[MAX_LEAST_SQUARES_SAMPLES] = outDecomposition->q;
+    float (*r)[MAX_LEAST_SQUARES_COEFFICIENTS] = outDecomposition->r;
     for (uint32_t j = 0; j < n; j++) {
         for (uint32_t h = 0; h < m; h++) {
             q[j][h] = a[j][h];
@@ -490,11 +530,13 @@ static bool solveLeastSquares(const float* x, const float* y,
         }
     }
 #if DEBUG_STRATEGY
-    ALOGD("  - q=%s", matrixToString(&q[0][0], m, n, false /*rowMajor*/).c_str());
-    ALOGD("  - r=%s", matrixToString(&r[0][0], n, n, true /*rowMajor*/).c_str());
+    ALOGD("  - q=%s", matrixToString(&q[0][0], m, n, MAX_LEAST_SQUARES_SAMPLES,
+            false /*rowMajor*/).c_str());
+    ALOGD("  - r=%s", matrixToString(&r[0][0], n, n, MAX_LEAST_SQUARES_COEFFICIENTS,
+            true /*rowMajor*/).c_str());
 
     // calculate QR, if we factored A correctly then QR should equal A
-    float qr[n][m];
+    float qr[MAX_LEAST_SQUARES_COEFFICIENTS][MAX_LEAST_SQUARES_SAMPLES];
     for (uint32_t h = 0; h < m; h++) {
         for (uint32_t i = 0; i < n; i++) {
             qr[i][h] = 0;
@@ -503,12 +545,25 @@ static bool solveLeastSquares(const float* x, const float* y,
             }
         }
     }
-    ALOGD("  - qr=%s", matrixToString(&qr[0][0], m, n, false /*rowMajor*/).c_str());
+    ALOGD("  - qr=%s", matrixToString(&qr[0][0], m, n, MAX_LEAST_SQUARES_SAMPLES,
+            false /*rowMajor*/).c_str());
+#endif
+    return true;
+}
+
+static void solveLeastSquares(const LeastSquaresDecomposition& decomposition,
+        const float* x, const float* y, const float* w, float* outB, float* outDet) {
+    const uint32_t m = decomposition.m;
+    const uint32_t n = decomposition.n;
+    const float (*q)[MAX_LEAST_SQUARES_SAMPLES] = decomposition.q;
+    const float (*r)[MAX_LEAST_SQUARES_COEFFICIENTS] = decomposition.r;
+#if DEBUG_STRATEGY
+    ALOGD("solveLeastSquares: m=%d, n=%d, y=%s", int(m), int(n), vectorToString(y, m).c_str());
 #endif
 
     // Solve R B = Qt W Y to find B.  This is easy because R is upper triangular.
     // We just work from bottom-right to top-left calculating B's coefficients.
-    float wy[m];
+    float wy[MAX_LEAST_SQUARES_SAMPLES];
     for (uint32_t h = 0; h < m; h++) {
         wy[h] = y[h] * w[h];
     }
@@ -553,24 +608,34 @@ static bool solveLeastSquares(const float* x, const float* y,
     ALOGD("  - sstot=%f", sstot);
     ALOGD("  - det=%f", *outDet);
 #endif
-    return true;
 }
 
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         VelocityTracker::Estimator* outEstimator) const {
-    outEstimator->clear();
+    return getEstimators(BitSet32(BitSet32::valueForBit(id)), outEstimator).hasBit(id);
+}
+
+BitSet32 LeastSquaresVelocityTrackerStrategy::getEstimators(BitSet32 idBits,
+        VelocityTracker::Estimator* outEstimators) const {
+    static_assert(HISTORY_SIZE <= MAX_LEAST_SQUARES_SAMPLES, "History too long to fit.");
 
     // Iterate over movement samples in reverse time order and collect samples.
-    float x[HISTORY_SIZE];
-    float y[HISTORY_SIZE];
+    // Every pointer uses the samples up to the first movement it is missing from,
+    // and shares the sample times and weights with the other pointers.
+    const Movement& newestMovement = mMovements[mIndex];
+    const BitSet32 trackedIdBits(idBits.value & newestMovement.idBits.value);
+    float x[MAX_POINTERS][HISTORY_SIZE];
+    float y[MAX_POINTERS][HISTORY_SIZE];
+    uint32_t sampleCounts[MAX_POINTERS];
     float w[HISTORY_SIZE];
     float time[HISTORY_SIZE];
     uint32_t m = 0;
     uint32_t index = mIndex;
-    const Movement& newestMovement = mMovements[mIndex];
-    do {
+    BitSet32 remainingIdBits(trackedIdBits);
+    while (m < HISTORY_SIZE) {
         const Movement& movement = mMovements[index];
-        if (!movement.idBits.hasBit(id)) {
+        remainingIdBits.value &= movement.idBits.value;
+        if (remainingIdBits.isEmpty()) {
             break;
         }
 
@@ -579,49 +644,76 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
             break;
         }
 
-        const VelocityTracker::Position& position = movement.getPosition(id);
-        x[m] = position.x;
-        y[m] = position.y;
+        for (BitSet32 iterBits(remainingIdBits); !iterBits.isEmpty(); ) {
+            uint32_t id = iterBits.clearFirstMarkedBit();
+            uint32_t slot = trackedIdBits.getIndexOfBit(id);
+            const VelocityTracker::Position& position = movement.getPosition(id);
+            x[slot][m] = position.x;
+            y[slot][m] = position.y;
+            sampleCounts[slot] = m + 1;
+        }
         w[m] = chooseWeight(index);
         time[m] = -age * 0.000000001f;
         index = (index == 0 ? HISTORY_SIZE : index) - 1;
-    } while (++m < HISTORY_SIZE);
-
-    if (m == 0) {
-        return false; // no data
+        m += 1;
     }
 
-    // Calculate a least squares polynomial fit.
-    uint32_t degree = mDegree;
-    if (degree > m - 1) {
-        degree = m - 1;
+    for (BitSet32 iterBits(idBits); !iterBits.isEmpty(); ) {
+        uint32_t id = iterBits.clearFirstMarkedBit();
+        if (!trackedIdBits.hasBit(id)) {
+            outEstimators[idBits.getIndexOfBit(id)].clear(); // no data
+        }
     }
-    if (degree >= 1) {
-        float xdet, ydet;
+
+    // Calculate a least squares polynomial fit, once per distinct number of samples.
+    for (BitSet32 unfittedIdBits(trackedIdBits); !unfittedIdBits.isEmpty(); ) {
+        m = sampleCounts[trackedIdBits.getIndexOfBit(unfittedIdBits.firstMarkedBit())];
+        uint32_t degree = mDegree;
+        if (degree > m - 1) {
+            degree = m - 1;
+        }
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        LeastSquaresDecomposition decomposition;
+        bool solvable = degree >= 1 && decomposeLeastSquares(time, w, m, n, &decomposition);
+
+        for (BitSet32 iterBits(unfittedIdBits); !iterBits.isEmpty(); ) {
+            uint32_t id = iterBits.clearFirstMarkedBit();
+            uint32_t slot = trackedIdBits.getIndexOfBit(id);
+            if (sampleCounts[slot] != m) {
+                continue;
+            }
+            unfittedIdBits.clearBit(id);
+
+            VelocityTracker::Estimator* outEstimator =
+                    &outEstimators[idBits.getIndexOfBit(id)];
+            outEstimator->clear();
             outEstimator->time = newestMovement.eventTime;
-            outEstimator->degree = degree;
-            outEstimator->confidence = xdet * ydet;
+            if (solvable) {
+                float xdet, ydet;
+                solveLeastSquares(decomposition, time, x[slot], w,
+                        outEstimator->xCoeff, &xdet);
+                solveLeastSquares(decomposition, time, y[slot], w,
+                        outEstimator->yCoeff, &ydet);
+                outEstimator->degree = degree;
+                outEstimator->confidence = xdet * ydet;
 #if DEBUG_STRATEGY
-            ALOGD("estimate: degree=%d, xCoeff=%s, yCoeff=%s, confidence=%f",
-                    int(outEstimator->degree),
-                    vectorToString(outEstimator->xCoeff, n).c_str(),
-                    vectorToString(outEstimator->yCoeff, n).c_str(),
-                    outEstimator->confidence);
+                ALOGD("estimate: id=%d, degree=%d, xCoeff=%s, yCoeff=%s, confidence=%f",
+                        int(id), int(outEstimator->degree),
+                        vectorToString(outEstimator->xCoeff, n).c_str(),
+                        vectorToString(outEstimator->yCoeff, n).c_str(),
+                        outEstimator->confidence);
 #endif
-            return true;
+            } else {
+                // No velocity data available for this pointer, but we do have its current
+                // position.
+                outEstimator->xCoeff[0] = x[slot][0];
+                outEstimator->yCoeff[0] = y[slot][0];
+                outEstimator->degree = 0;
+                outEstimator->confidence = 1;
+            }
         }
     }
-
-    // No velocity data available for this pointer, but we do have its current position.
-    outEstimator->xCoeff[0] = x[0];
-    outEstimator->yCoeff[0] = y[0];
-    outEstimator->time = newestMovement.eventTime;
-    outEstimator->degree = 0;
-    outEstimator->confidence = 1;
-    return true;
+    return trackedIdBits;
 }
 
 float LeastSquaresVelocityTrackerStrategy::chooseWeight(uint32_t index) const {
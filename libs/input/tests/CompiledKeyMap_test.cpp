@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android/keycodes.h>
+#include <gtest/gtest.h>
+#include <input/CompiledKeyMap.h>
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+
+namespace android {
+
+// Two key layouts of the same size that map the same scan codes differently.
+static const char* KEY_LAYOUT_AB =
+        "key 30 A\n"
+        "key 48 B VIRTUAL\n"
+        "key usage 0x0c0067 C\n"
+        "axis 0x00 X\n"
+        "axis 0x01 split 0x7f Y Z\n"
+        "led 0x00 NUM_LOCK\n";
+static const char* KEY_LAYOUT_BA =
+        "key 30 B\n"
+        "key 48 A VIRTUAL\n"
+        "key usage 0x0c0067 C\n"
+        "axis 0x00 X\n"
+        "axis 0x01 split 0x7f Y Z\n"
+        "led 0x00 NUM_LOCK\n";
+
+// Two key character maps of the same size, the second of which does not parse.
+static const char* KEY_CHARACTER_MAP =
+        "type ALPHA\n"
+        "map key 86 PLUS\n"
+        "key A {\n"
+        "    label: 'A'\n"
+        "    base: 'a'\n"
+        "    shift, capslock: 'A'\n"
+        "    ctrl: fallback DEL\n"
+        "}\n";
+static const char* KEY_CHARACTER_MAP_BROKEN =
+        "type BOGUS\n"
+        "map key 86 PLUS\n"
+        "key A {\n"
+        "    label: 'A'\n"
+        "    base: 'a'\n"
+        "    shift, capslock: 'A'\n"
+        "    ctrl: fallback DEL\n"
+        "}\n";
+
+// --- CompiledKeyMapTest ---
+
+class CompiledKeyMapTest : public testing::Test {
+protected:
+    String8 mDir;
+    Vector<String8> mPaths;
+
+    virtual void SetUp() {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/CompiledKeyMapTest.XXXXXX",
+                access("/data/local/tmp", W_OK) ? "/tmp" : "/data/local/tmp");
+        ASSERT_TRUE(mkdtemp(dir) != NULL);
+        mDir.setTo(dir);
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < mPaths.size(); i++) {
+            unlink(mPaths[i].string());
+        }
+        rmdir(mDir.string());
+    }
+
+    String8 getPath(const char* name) {
+        String8 path(mDir);
+        path.append("/");
+        path.append(name);
+        mPaths.push(path);
+        mPaths.push(CompiledKeyMap::getCompiledPath(path));
+        return path;
+    }
+
+    void writeFile(const String8& path, const char* contents) {
+        FILE* file = fopen(path.string(), "w");
+        ASSERT_TRUE(file != NULL);
+        fputs(contents, file);
+        fclose(file);
+    }
+
+    // Rewrites a file without changing its inode, size or modification time, like an
+    // edit within the granularity of the file system's timestamps.
+    void rewriteFileInPlace(const String8& path, const char* contents) {
+        struct stat st;
+        ASSERT_EQ(0, stat(path.string(), &st));
+        ASSERT_EQ(size_t(st.st_size), strlen(contents));
+        ASSERT_NO_FATAL_FAILURE(writeFile(path, contents));
+        struct timespec times[2];
+        times[0] = st.st_atim;
+        times[1] = st.st_mtim;
+        ASSERT_EQ(0, utimensat(AT_FDCWD, path.string(), times, 0));
+    }
+
+    // Installs the compiled form of otherPath as the compiled form of path, so that
+    // what is loaded from path shows whether the compiled form was used.
+    void installCompiledFormOf(const String8& otherPath, const String8& path,
+            uint32_t magic) {
+        KeyMapFileStamp otherStamp, stamp;
+        ASSERT_TRUE(otherStamp.read(otherPath));
+        ASSERT_TRUE(stamp.read(path));
+
+        CompiledKeyMapReader reader;
+        ASSERT_EQ(OK, reader.open(otherPath, otherStamp, magic));
+        CompiledKeyMapWriter writer(magic, stamp);
+        while (reader.remaining()) {
+            writer.writeInt32(reader.readInt32());
+        }
+        ASSERT_EQ(OK, writer.writeToFile(CompiledKeyMap::getCompiledPath(path)));
+    }
+};
+
+TEST_F(CompiledKeyMapTest, KeyLayoutMap_LoadsCompiledForm) {
+    String8 otherPath = getPath("other.kl");
+    writeFile(otherPath, KEY_LAYOUT_AB);
+    ASSERT_EQ(OK, KeyLayoutMap::compile(otherPath,
+            CompiledKeyMap::getCompiledPath(otherPath)));
+
+    String8 path = getPath("compiled.kl");
+    writeFile(path, KEY_LAYOUT_BA);
+    ASSERT_NO_FATAL_FAILURE(installCompiledFormOf(otherPath, path,
+            CompiledKeyMap::MAGIC_KEY_LAYOUT_MAP));
+
+    sp<KeyLayoutMap> map;
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &map));
+
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, map->mapKey(30, 0, &keyCode, &flags));
+    ASSERT_EQ(AKEYCODE_A, keyCode);
+    ASSERT_EQ(0U, flags);
+    ASSERT_EQ(OK, map->mapKey(48, 0, &keyCode, &flags));
+    ASSERT_EQ(AKEYCODE_B, keyCode);
+    ASSERT_EQ(uint32_t(POLICY_FLAG_VIRTUAL), flags);
+    ASSERT_EQ(OK, map->mapKey(0, 0x0c0067, &keyCode, &flags));
+    ASSERT_EQ(AKEYCODE_C, keyCode);
+
+    AxisInfo axisInfo;
+    ASSERT_EQ(OK, map->mapAxis(0x01, &axisInfo));
+    ASSERT_EQ(AxisInfo::MODE_SPLIT, axisInfo.mode);
+    ASSERT_EQ(AMOTION_EVENT_AXIS_Y, axisInfo.axis);
+    ASSERT_EQ(AMOTION_EVENT_AXIS_Z, axisInfo.highAxis);
+    ASSERT_EQ(0x7f, axisInfo.splitValue);
+
+    int32_t scanCode;
+    ASSERT_EQ(OK, map->findScanCodeForLed(ALED_NUM_LOCK, &scanCode));
+    ASSERT_EQ(0x00, scanCode);
+}
+
+TEST_F(CompiledKeyMapTest, KeyLayoutMap_IgnoresOutOfDateCompiledForm) {
+    String8 path = getPath("stale.kl");
+    writeFile(path, KEY_LAYOUT_AB);
+    ASSERT_EQ(OK, KeyLayoutMap::compile(path, CompiledKeyMap::getCompiledPath(path)));
+
+    ASSERT_NO_FATAL_FAILURE(rewriteFileInPlace(path, KEY_LAYOUT_BA));
+
+    sp<KeyLayoutMap> map;
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &map));
+
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, map->mapKey(30, 0, &keyCode, &flags));
+    ASSERT_EQ(AKEYCODE_B, keyCode);
+}
+
+TEST_F(CompiledKeyMapTest, KeyLayoutMap_ReturnsCachedMapUntilFileChanges) {
+    String8 path = getPath("cached.kl");
+    writeFile(path, KEY_LAYOUT_AB);
+
+    sp<KeyLayoutMap> first, second, third;
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &first));
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &second));
+    ASSERT_EQ(first.get(), second.get());
+
+    ASSERT_NO_FATAL_FAILURE(rewriteFileInPlace(path, KEY_LAYOUT_BA));
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &third));
+    ASSERT_NE(first.get(), third.get());
+
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, third->mapKey(30, 0, &keyCode, &flags));
+    ASSERT_EQ(AKEYCODE_B, keyCode);
+}
+
+TEST_F(CompiledKeyMapTest, KeyCharacterMap_LoadsCompiledForm) {
+    String8 otherPath = getPath("other.kcm");
+    writeFile(otherPath, KEY_CHARACTER_MAP);
+    ASSERT_EQ(OK, KeyCharacterMap::compile(otherPath, KeyCharacterMap::FORMAT_BASE,
+            CompiledKeyMap::getCompiledPath(otherPath)));
+
+    // The source is broken, so it can only be loaded from its compiled form.
+    String8 path = getPath("compiled.kcm");
+    writeFile(path, KEY_CHARACTER_MAP_BROKEN);
+    ASSERT_NO_FATAL_FAILURE(installCompiledFormOf(otherPath, path,
+            CompiledKeyMap::MAGIC_KEY_CHARACTER_MAP));
+
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    ASSERT_EQ(KeyCharacterMap::KEYBOARD_TYPE_ALPHA, map->getKeyboardType());
+    ASSERT_EQ(u'A', map->getDisplayLabel(AKEYCODE_A));
+    ASSERT_EQ(u'a', map->getCharacter(AKEYCODE_A, 0));
+    ASSERT_EQ(u'A', map->getCharacter(AKEYCODE_A, AMETA_SHIFT_ON));
+    ASSERT_EQ(u'A', map->getCharacter(AKEYCODE_A, AMETA_CAPS_LOCK_ON));
+
+    KeyCharacterMap::FallbackAction action;
+    ASSERT_TRUE(map->getFallbackAction(AKEYCODE_A, AMETA_CTRL_ON, &action));
+    ASSERT_EQ(AKEYCODE_DEL, action.keyCode);
+
+    int32_t keyCode;
+    ASSERT_EQ(OK, map->mapKey(86, 0, &keyCode));
+    ASSERT_EQ(AKEYCODE_PLUS, keyCode);
+}
+
+TEST_F(CompiledKeyMapTest, KeyCharacterMap_Load_ChecksFormatOfCachedMap) {
+    String8 path = getPath("format.kcm");
+    writeFile(path, KEY_CHARACTER_MAP);
+
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    ASSERT_EQ(BAD_VALUE, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_OVERLAY, &map));
+    ASSERT_TRUE(map == NULL);
+}
+
+TEST_F(CompiledKeyMapTest, CompiledKeyMapReader_RejectsOtherKindOfMap) {
+    String8 path = getPath("kind.kl");
+    writeFile(path, KEY_LAYOUT_AB);
+    ASSERT_EQ(OK, KeyLayoutMap::compile(path, CompiledKeyMap::getCompiledPath(path)));
+
+    KeyMapFileStamp stamp;
+    ASSERT_TRUE(stamp.read(path));
+    CompiledKeyMapReader reader;
+    ASSERT_EQ(NAME_NOT_FOUND, reader.open(path, stamp,
+            CompiledKeyMap::MAGIC_KEY_CHARACTER_MAP));
+    ASSERT_EQ(OK, reader.open(path, stamp, CompiledKeyMap::MAGIC_KEY_LAYOUT_MAP));
+    ASSERT_EQ(2, reader.readInt32()); // keys by scan code
+}
+
+} // namespace android
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <gtest/gtest.h>
 #include <input/InputTransport.h>
@@ -28,14 +29,19 @@
 
 namespace android {
 
-class InputChannelTest : public testing::Test {
+// Runs every test with each channel transport.
+class InputChannelTest : public testing::TestWithParam<int> {
 protected:
     virtual void SetUp() { }
     virtual void TearDown() { }
 };
 
+INSTANTIATE_TEST_CASE_P(Transports, InputChannelTest,
+        testing::Values(InputChannel::TRANSPORT_SOCKET,
+                InputChannel::TRANSPORT_SHARED_MEMORY));
 
-TEST_F(InputChannelTest, ConstructorAndDestructor_TakesOwnershipOfFileDescriptors) {
+
+TEST_P(InputChannelTest, ConstructorAndDestructor_TakesOwnershipOfFileDescriptors) {
     // Our purpose here is to verify that the input channel destructor closes the
     // file descriptor provided to it.  One easy way is to provide it with one end
     // of a pipe and to check for EPIPE on the other end after the channel is destroyed.
@@ -57,11 +63,11 @@ TEST_F(InputChannelTest, ConstructorAndDestructor_TakesOwnershipOfFileDescriptor
     pipe.sendFd = -1;
 }
 
-TEST_F(InputChannelTest, OpenInputChannelPair_ReturnsAPairOfConnectedChannels) {
+TEST_P(InputChannelTest, OpenInputChannelPair_ReturnsAPairOfConnectedChannels) {
     sp<InputChannel> serverChannel, clientChannel;
 
     status_t result = InputChannel::openInputChannelPair(String8("channel name"),
-            serverChannel, clientChannel);
+            GetParam(), serverChannel, clientChannel);
 
     ASSERT_EQ(OK, result)
             << "should have successfully opened a channel pair";
@@ -108,11 +114,11 @@ TEST_F(InputChannelTest, OpenInputChannelPair_ReturnsAPairOfConnectedChannels) {
             << "server channel should receive the correct message from client channel";
 }
 
-TEST_F(InputChannelTest, ReceiveSignal_WhenNoSignalPresent_ReturnsAnError) {
+TEST_P(InputChannelTest, ReceiveSignal_WhenNoSignalPresent_ReturnsAnError) {
     sp<InputChannel> serverChannel, clientChannel;
 
     status_t result = InputChannel::openInputChannelPair(String8("channel name"),
-            serverChannel, clientChannel);
+            GetParam(), serverChannel, clientChannel);
 
     ASSERT_EQ(OK, result)
             << "should have successfully opened a channel pair";
@@ -122,11 +128,11 @@ TEST_F(InputChannelTest, ReceiveSignal_WhenNoSignalPresent_ReturnsAnError) {
             << "receiveMessage should have returned WOULD_BLOCK";
 }
 
-TEST_F(InputChannelTest, ReceiveSignal_WhenPeerClosed_ReturnsAnError) {
+TEST_P(InputChannelTest, ReceiveSignal_WhenPeerClosed_ReturnsAnError) {
     sp<InputChannel> serverChannel, clientChannel;
 
     status_t result = InputChannel::openInputChannelPair(String8("channel name"),
-            serverChannel, clientChannel);
+            GetParam(), serverChannel, clientChannel);
 
     ASSERT_EQ(OK, result)
             << "should have successfully opened a channel pair";
@@ -138,11 +144,11 @@ TEST_F(InputChannelTest, ReceiveSignal_WhenPeerClosed_ReturnsAnError) {
             << "receiveMessage should have returned DEAD_OBJECT";
 }
 
-TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
+TEST_P(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
     sp<InputChannel> serverChannel, clientChannel;
 
     status_t result = InputChannel::openInputChannelPair(String8("channel name"),
-            serverChannel, clientChannel);
+            GetParam(), serverChannel, clientChannel);
 
     ASSERT_EQ(OK, result)
             << "should have successfully opened a channel pair";
@@ -155,5 +161,299 @@ TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
             << "sendMessage should have returned DEAD_OBJECT";
 }
 
+static void initializeKeyMessage(InputMessage* msg, uint32_t seq) {
+    memset(msg, 0, sizeof(InputMessage));
+    msg->header.type = InputMessage::TYPE_KEY;
+    msg->body.key.seq = seq;
+    msg->body.key.action = AKEY_EVENT_ACTION_DOWN;
+}
+
+static void initializeMotionMessage(InputMessage* msg, uint32_t seq, uint32_t pointerCount) {
+    memset(msg, 0, sizeof(InputMessage));
+    msg->header.type = InputMessage::TYPE_MOTION;
+    msg->body.motion.seq = seq;
+    msg->body.motion.action = AMOTION_EVENT_ACTION_MOVE;
+    msg->body.motion.pointerCount = pointerCount;
+}
+
+TEST_P(InputChannelTest, SendAndReceiveMessages_TransfersABurstInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    // Mix message sizes so that each one must keep its own packet boundary.
+    const size_t count = 10;
+    InputMessage sent[count];
+    for (size_t i = 0; i < count; i++) {
+        if (i % 3 == 0) {
+            initializeKeyMessage(&sent[i], i + 1);
+        } else {
+            initializeMotionMessage(&sent[i], i + 1, i % MAX_POINTERS + 1);
+        }
+    }
+
+    size_t sentCount;
+    EXPECT_EQ(OK, serverChannel->sendMessages(sent, count, &sentCount))
+            << "sendMessages should have sent all of the messages";
+    EXPECT_EQ(count, sentCount);
+
+    // A small capacity splits the burst across several receives.
+    InputMessage received[4];
+    size_t receivedTotal = 0;
+    for (size_t expected : { 4, 4, 2 }) {
+        size_t receivedCount;
+        ASSERT_EQ(OK, clientChannel->receiveMessages(received, 4, &receivedCount))
+                << "receiveMessages should have received the next part of the burst";
+        ASSERT_EQ(expected, receivedCount);
+        for (size_t i = 0; i < receivedCount; i++) {
+            const InputMessage& msg = sent[receivedTotal + i];
+            EXPECT_EQ(msg.header.type, received[i].header.type);
+            EXPECT_EQ(msg.size(), received[i].size());
+            if (msg.header.type == InputMessage::TYPE_KEY) {
+                EXPECT_EQ(msg.body.key.seq, received[i].body.key.seq);
+            } else {
+                EXPECT_EQ(msg.body.motion.seq, received[i].body.motion.seq);
+                EXPECT_EQ(msg.body.motion.pointerCount, received[i].body.motion.pointerCount);
+            }
+        }
+        receivedTotal += receivedCount;
+    }
+
+    size_t receivedCount;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessages(received, 4, &receivedCount))
+            << "receiveMessages should have returned WOULD_BLOCK";
+    EXPECT_EQ(0U, receivedCount);
+
+    // The vectored and single message calls interoperate.
+    EXPECT_EQ(OK, serverChannel->sendMessage(&sent[0]));
+    EXPECT_EQ(OK, clientChannel->receiveMessages(received, 4, &receivedCount));
+    EXPECT_EQ(1U, receivedCount);
+    EXPECT_EQ(OK, serverChannel->sendMessages(&sent[1], 1, &sentCount));
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&received[0]));
+    EXPECT_EQ(sent[1].body.motion.seq, received[0].body.motion.seq);
+}
+
+TEST_P(InputChannelTest, SendMessages_WhenChannelFull_ReportsWhatWasSent) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    // Far more full size motion events than the socket buffer can hold.
+    const size_t count = 200;
+    InputMessage* sent = new InputMessage[count];
+    for (size_t i = 0; i < count; i++) {
+        initializeMotionMessage(&sent[i], i + 1, MAX_POINTERS);
+    }
+
+    size_t sentCount;
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->sendMessages(sent, count, &sentCount))
+            << "sendMessages should have returned WOULD_BLOCK";
+    EXPECT_LT(0U, sentCount);
+    EXPECT_GT(count, sentCount);
+
+    // Exactly the messages reported as sent arrive, in order.
+    InputMessage received[8];
+    size_t receivedTotal = 0;
+    size_t receivedCount;
+    while (clientChannel->receiveMessages(received, 8, &receivedCount) == OK) {
+        for (size_t i = 0; i < receivedCount; i++) {
+            EXPECT_EQ(receivedTotal + i + 1, received[i].body.motion.seq);
+        }
+        receivedTotal += receivedCount;
+    }
+    EXPECT_EQ(sentCount, receivedTotal);
+    delete[] sent;
+}
+
+TEST_P(InputChannelTest, ReceiveMessages_WhenPeerClosed_ReturnsPendingMessagesFirst) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage msgs[2];
+    initializeKeyMessage(&msgs[0], 1);
+    initializeKeyMessage(&msgs[1], 2);
+    size_t count;
+    EXPECT_EQ(OK, serverChannel->sendMessages(msgs, 2, &count));
+
+    serverChannel.clear(); // close server channel
+
+    EXPECT_EQ(OK, clientChannel->receiveMessages(msgs, 2, &count))
+            << "receiveMessages should have returned the messages sent before the close";
+    EXPECT_EQ(2U, count);
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessages(msgs, 2, &count))
+            << "receiveMessages should have returned DEAD_OBJECT";
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->sendMessages(msgs, 2, &count))
+            << "sendMessages should have returned DEAD_OBJECT";
+    EXPECT_EQ(0U, count);
+}
+
+TEST_P(InputChannelTest, SendAndReceive_ManySizes_PreservesOrderAndContents) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    // Enough traffic to wrap around the channel's buffer many times.
+    uint32_t sentSeq = 0;
+    uint32_t receivedSeq = 0;
+    for (int round = 0; round < 2000; round++) {
+        for (int i = 0; i <= round % 5; i++) {
+            InputMessage msg;
+            sentSeq += 1;
+            initializeMotionMessage(&msg, sentSeq, sentSeq % MAX_POINTERS + 1);
+            msg.body.motion.pointers[0].coords.setAxisValue(AMOTION_EVENT_AXIS_X, sentSeq);
+            ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+        }
+
+        InputMessage msg;
+        while ((result = clientChannel->receiveMessage(&msg)) == OK) {
+            receivedSeq += 1;
+            ASSERT_EQ(InputMessage::TYPE_MOTION, msg.header.type);
+            ASSERT_EQ(receivedSeq, msg.body.motion.seq);
+            ASSERT_EQ(receivedSeq % MAX_POINTERS + 1, msg.body.motion.pointerCount);
+            ASSERT_EQ(float(receivedSeq),
+                    msg.body.motion.pointers[0].coords.getAxisValue(AMOTION_EVENT_AXIS_X));
+        }
+        ASSERT_EQ(WOULD_BLOCK, result);
+        ASSERT_EQ(sentSeq, receivedSeq);
+    }
+}
+
+TEST_P(InputChannelTest, SendMessage_MakesFdReadableUntilDrained) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    struct pollfd pfd;
+    pfd.fd = clientChannel->getFd();
+    pfd.events = POLLIN;
+    for (int round = 0; round < 3; round++) {
+        InputMessage msgs[3];
+        for (size_t i = 0; i < 3; i++) {
+            initializeKeyMessage(&msgs[i], i + 1);
+        }
+        size_t sentCount;
+        ASSERT_EQ(OK, serverChannel->sendMessages(msgs, 3, &sentCount));
+        EXPECT_EQ(1, poll(&pfd, 1, 0))
+                << "the client fd should be readable after a message was sent";
+
+        InputMessage msg;
+        for (size_t i = 0; i < 3; i++) {
+            ASSERT_EQ(OK, clientChannel->receiveMessage(&msg));
+        }
+        ASSERT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg));
+        EXPECT_EQ(0, poll(&pfd, 1, 0))
+                << "the client fd should not be readable once everything was received";
+    }
+}
+
+TEST_P(InputChannelTest, ClientRecreatedFromFd_ReceivesMessages) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    if (GetParam() == InputChannel::TRANSPORT_SHARED_MEMORY
+            && !InputChannel::isSharedMemoryTransportEnabled()) {
+        // Applications only look for the ring when shared memory is enabled.
+        return;
+    }
+
+    // This is what happens when the client end is passed to an application.
+    sp<InputChannel> remoteChannel = new InputChannel(String8("remote"),
+            ::dup(clientChannel->getFd()));
+    clientChannel.clear();
+
+    InputMessage msg;
+    initializeKeyMessage(&msg, 42);
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+    memset(&msg, 0, sizeof(msg));
+    ASSERT_EQ(OK, remoteChannel->receiveMessage(&msg))
+            << "the recreated client should receive the message";
+    EXPECT_EQ(42U, msg.body.key.seq);
+
+    InputMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.header.type = InputMessage::TYPE_FINISHED;
+    reply.body.finished.seq = 42;
+    ASSERT_EQ(OK, remoteChannel->sendMessage(&reply));
+    ASSERT_EQ(OK, serverChannel->receiveMessage(&msg));
+    EXPECT_EQ(InputMessage::TYPE_FINISHED, msg.header.type);
+    EXPECT_EQ(42U, msg.body.finished.seq);
+}
+
+TEST_P(InputChannelTest, DupBeforeFirstMessage_SharesTheTransport) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    // Only one of the two ends receives the message that sets up the transport.
+    sp<InputChannel> dupChannel = clientChannel->dup();
+    ASSERT_TRUE(dupChannel != NULL);
+
+    InputMessage msg;
+    initializeKeyMessage(&msg, 1);
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+    memset(&msg, 0, sizeof(msg));
+    ASSERT_EQ(OK, dupChannel->receiveMessage(&msg));
+    EXPECT_EQ(1U, msg.body.key.seq);
+
+    initializeKeyMessage(&msg, 2);
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+    memset(&msg, 0, sizeof(msg));
+    ASSERT_EQ(OK, clientChannel->receiveMessage(&msg))
+            << "the original should receive through the transport its dup set up";
+    EXPECT_EQ(2U, msg.body.key.seq);
+    EXPECT_EQ(WOULD_BLOCK, dupChannel->receiveMessage(&msg));
+}
+
+TEST_P(InputChannelTest, OpenSocketPair_QueuesNothingWithoutSharedMemory) {
+    if (GetParam() != InputChannel::TRANSPORT_SOCKET
+            || InputChannel::isSharedMemoryTransportEnabled()) {
+        return;
+    }
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            GetParam(), serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    struct pollfd pfd;
+    pfd.fd = clientChannel->getFd();
+    pfd.events = POLLIN;
+    EXPECT_EQ(0, poll(&pfd, 1, 0))
+            << "a new client end should not be readable";
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg));
+}
 
 } // namespace android
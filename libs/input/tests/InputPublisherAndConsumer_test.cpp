@@ -16,6 +16,7 @@
 
 #include "TestHelpers.h"
 
+#include <poll.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <time.h>
@@ -28,7 +29,8 @@
 
 namespace android {
 
-class InputPublisherAndConsumerTest : public testing::Test {
+// Runs every test with each channel transport.
+class InputPublisherAndConsumerTest : public testing::TestWithParam<int> {
 protected:
     sp<InputChannel> serverChannel, clientChannel;
     InputPublisher* mPublisher;
@@ -37,7 +39,7 @@ protected:
 
     virtual void SetUp() {
         status_t result = InputChannel::openInputChannelPair(String8("channel name"),
-                serverChannel, clientChannel);
+                GetParam(), serverChannel, clientChannel);
 
         mPublisher = new InputPublisher(serverChannel);
         mConsumer = new InputConsumer(clientChannel);
@@ -60,9 +62,15 @@ protected:
 
     void PublishAndConsumeKeyEvent();
     void PublishAndConsumeMotionEvent();
+    void PublishMoveEvents(uint32_t firstSeq, size_t count);
+    void ConsumeMoveBatch(uint32_t firstSeq, size_t count);
 };
 
-TEST_F(InputPublisherAndConsumerTest, GetChannel_ReturnsTheChannel) {
+INSTANTIATE_TEST_CASE_P(Transports, InputPublisherAndConsumerTest,
+        testing::Values(InputChannel::TRANSPORT_SOCKET,
+                InputChannel::TRANSPORT_SHARED_MEMORY));
+
+TEST_P(InputPublisherAndConsumerTest, GetChannel_ReturnsTheChannel) {
     EXPECT_EQ(serverChannel.get(), mPublisher->getChannel().get());
     EXPECT_EQ(clientChannel.get(), mConsumer->getChannel().get());
 }
@@ -89,8 +97,9 @@ void InputPublisherAndConsumerTest::PublishAndConsumeKeyEvent() {
 
     uint32_t consumeSeq;
     InputEvent* event;
+    int32_t consumeDisplayId;
     status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event,
-            0);
+            &consumeDisplayId);
     ASSERT_EQ(OK, status)
             << "consumer consume should return OK";
 
@@ -175,8 +184,9 @@ void InputPublisherAndConsumerTest::PublishAndConsumeMotionEvent() {
 
     uint32_t consumeSeq;
     InputEvent* event;
+    int32_t consumeDisplayId;
     status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event,
-            0);
+            &consumeDisplayId);
     ASSERT_EQ(OK, status)
             << "consumer consume should return OK";
 
@@ -245,15 +255,15 @@ void InputPublisherAndConsumerTest::PublishAndConsumeMotionEvent() {
             << "publisher receiveFinishedSignal should have set handled to consumer's reply";
 }
 
-TEST_F(InputPublisherAndConsumerTest, PublishKeyEvent_EndToEnd) {
+TEST_P(InputPublisherAndConsumerTest, PublishKeyEvent_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
 }
 
-TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_EndToEnd) {
+TEST_P(InputPublisherAndConsumerTest, PublishMotionEvent_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
 }
 
-TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountLessThan1_ReturnsError) {
+TEST_P(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountLessThan1_ReturnsError) {
     status_t status;
     const size_t pointerCount = 0;
     PointerProperties pointerProperties[pointerCount];
@@ -265,7 +275,7 @@ TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountLessTha
             << "publisher publishMotionEvent should return BAD_VALUE";
 }
 
-TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountGreaterThanMax_ReturnsError) {
+TEST_P(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountGreaterThanMax_ReturnsError) {
     status_t status;
     const size_t pointerCount = MAX_POINTERS + 1;
     PointerProperties pointerProperties[pointerCount];
@@ -281,7 +291,7 @@ TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountGreater
             << "publisher publishMotionEvent should return BAD_VALUE";
 }
 
-TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
+TEST_P(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
@@ -289,4 +299,239 @@ TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
 }
 
+void InputPublisherAndConsumerTest::PublishMoveEvents(uint32_t firstSeq, size_t count) {
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords pointerCoords;
+
+    for (size_t i = 0; i < count; i++) {
+        pointerCoords.clear();
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 10 * i);
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, 20 * i);
+        status_t status = mPublisher->publishMotionEvent(firstSeq + i, 1,
+                AINPUT_SOURCE_TOUCHSCREEN, 0, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0,
+                0, 0, 1, 1, 0, 1000 + i, 1, &pointerProperties, &pointerCoords);
+        ASSERT_EQ(OK, status)
+                << "publisher publishMotionEvent should return OK";
+    }
+}
+
+void InputPublisherAndConsumerTest::ConsumeMoveBatch(uint32_t firstSeq, size_t count) {
+    uint32_t consumeSeq;
+    InputEvent* event;
+    int32_t displayId;
+    status_t status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event, &displayId);
+    ASSERT_EQ(OK, status)
+            << "consumer consume should return OK";
+    ASSERT_TRUE(event != NULL)
+            << "consumer should have returned non-NULL event";
+    ASSERT_EQ(AINPUT_EVENT_TYPE_MOTION, event->getType())
+            << "consumer should have returned a motion event";
+
+    MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+    EXPECT_EQ(firstSeq + count - 1, consumeSeq)
+            << "consumer should have returned the sequence number of the last sample";
+    EXPECT_EQ(count - 1, motionEvent->getHistorySize())
+            << "consumer should have batched all of the samples into one event";
+    EXPECT_EQ(10.0f * (count - 1), motionEvent->getX(0));
+
+    status = mConsumer->sendFinishedSignal(consumeSeq, true);
+    ASSERT_EQ(OK, status)
+            << "consumer sendFinishedSignal should return OK";
+
+    // Finishing the batch finishes every sample in it, oldest first.
+    for (size_t i = 0; i < count; i++) {
+        uint32_t finishedSeq = 0;
+        bool handled = false;
+        status = mPublisher->receiveFinishedSignal(&finishedSeq, &handled);
+        ASSERT_EQ(OK, status)
+                << "publisher receiveFinishedSignal should return OK";
+        ASSERT_EQ(firstSeq + i, finishedSeq);
+    }
+}
+
+TEST_P(InputPublisherAndConsumerTest, PublishBatch_SendsEventsOnEndBatch) {
+    mPublisher->beginBatch();
+    ASSERT_NO_FATAL_FAILURE(PublishMoveEvents(1, 5));
+    EXPECT_EQ(5U, mPublisher->getPendingBatchSize());
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    int32_t displayId;
+    status_t status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event, &displayId);
+    ASSERT_EQ(WOULD_BLOCK, status)
+            << "nothing should have been sent before endBatch";
+
+    ASSERT_EQ(OK, mPublisher->endBatch());
+    EXPECT_EQ(0U, mPublisher->getPendingBatchSize());
+    ASSERT_NO_FATAL_FAILURE(ConsumeMoveBatch(1, 5));
+
+    // Once the batch is closed, events are sent immediately again.
+    ASSERT_NO_FATAL_FAILURE(PublishMoveEvents(10, 1));
+    EXPECT_EQ(0U, mPublisher->getPendingBatchSize());
+    ASSERT_NO_FATAL_FAILURE(ConsumeMoveBatch(10, 1));
+}
+
+TEST_P(InputPublisherAndConsumerTest, PublishBatch_WhenChannelFull_KeepsUnsentEvents) {
+    // Publish until the channel fills up.  A full batch is sent as soon as the
+    // next event is published, so the error surfaces from the publish call.
+    mPublisher->beginBatch();
+    uint32_t published = 0;
+    status_t status;
+    do {
+        PointerProperties pointerProperties;
+        pointerProperties.clear();
+        PointerCoords pointerCoords;
+        pointerCoords.clear();
+        status = mPublisher->publishMotionEvent(published + 1, 1, AINPUT_SOURCE_TOUCHSCREEN,
+                0, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0,
+                1, &pointerProperties, &pointerCoords);
+        if (!status) {
+            published += 1;
+        }
+        ASSERT_GT(1000U, published)
+                << "the channel should have filled up";
+    } while (!status);
+    ASSERT_EQ(WOULD_BLOCK, status)
+            << "publisher publishMotionEvent should return WOULD_BLOCK";
+    EXPECT_LT(0U, mPublisher->getPendingBatchSize());
+    EXPECT_EQ(WOULD_BLOCK, mPublisher->endBatch())
+            << "publisher endBatch should return WOULD_BLOCK";
+
+    // Drain what was sent, then send the rest.
+    InputMessage msg;
+    uint32_t received = 0;
+    while (clientChannel->receiveMessage(&msg) == OK) {
+        EXPECT_EQ(received + 1, msg.body.motion.seq);
+        received += 1;
+    }
+    EXPECT_EQ(OK, mPublisher->endBatch());
+    EXPECT_EQ(0U, mPublisher->getPendingBatchSize());
+    while (clientChannel->receiveMessage(&msg) == OK) {
+        EXPECT_EQ(received + 1, msg.body.motion.seq);
+        received += 1;
+    }
+    EXPECT_EQ(published, received);
+}
+
+TEST_P(InputPublisherAndConsumerTest, ConsumeWithReceiveBurst_DrainsTheChannelAtOnce) {
+    mConsumer->setReceiveBurstSize(16);
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+    ASSERT_NO_FATAL_FAILURE(PublishMoveEvents(100, 6));
+    ASSERT_NO_FATAL_FAILURE(ConsumeMoveBatch(100, 6));
+
+    // Key events are not batched, so all but the first one stay with the consumer
+    // after the first consume() drains the channel.
+    PublishAndConsumeKeyEvent();
+    for (uint32_t seq = 200; seq < 204; seq++) {
+        status_t status = mPublisher->publishKeyEvent(seq, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 0, 0, 0, 0, 0);
+        ASSERT_EQ(OK, status);
+    }
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    int32_t displayId;
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, false /*consumeBatches*/, -1,
+            &consumeSeq, &event, &displayId));
+    EXPECT_EQ(200U, consumeSeq);
+    EXPECT_TRUE(mConsumer->hasDeferredEvent())
+            << "the drained events should be reported as deferred";
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg))
+            << "the consumer should have drained the channel";
+
+    for (uint32_t seq = 201; seq < 204; seq++) {
+        ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, false /*consumeBatches*/, -1,
+                &consumeSeq, &event, &displayId));
+        EXPECT_EQ(seq, consumeSeq);
+    }
+    EXPECT_FALSE(mConsumer->hasDeferredEvent());
+    EXPECT_EQ(WOULD_BLOCK, mConsumer->consume(&mEventFactory, false /*consumeBatches*/, -1,
+            &consumeSeq, &event, &displayId));
+}
+
+
+// Consumes one event each time it is woken up, like a looper callback would.
+class DeferredEventConsumer : public MessageHandler {
+public:
+    InputConsumer* consumer;
+    PreallocatedInputEventFactory* factory;
+    Vector<uint32_t> consumedSeqs;
+
+    DeferredEventConsumer(InputConsumer* consumer, PreallocatedInputEventFactory* factory) :
+            consumer(consumer), factory(factory) {
+    }
+
+    virtual void handleMessage(const Message&) {
+        uint32_t consumeSeq;
+        InputEvent* event;
+        int32_t displayId;
+        if (consumer->consume(factory, false /*consumeBatches*/, -1,
+                &consumeSeq, &event, &displayId) == OK) {
+            consumedSeqs.push(consumeSeq);
+        }
+    }
+};
+
+TEST_P(InputPublisherAndConsumerTest, ConsumeWithReceiveBurst_WakesLooperForDeferredEvents) {
+    sp<Looper> looper = new Looper(false /*allowNonCallbacks*/);
+    sp<DeferredEventConsumer> handler = new DeferredEventConsumer(mConsumer, &mEventFactory);
+    mConsumer->setReceiveBurstSize(16);
+    mConsumer->setDeferredEventHandler(looper, handler);
+
+    for (uint32_t seq = 200; seq < 204; seq++) {
+        status_t status = mPublisher->publishKeyEvent(seq, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 0, 0, 0, 0, 0);
+        ASSERT_EQ(OK, status);
+    }
+
+    // The fd is readable, so the caller consumes the first event by itself.
+    handler->handleMessage(Message());
+    ASSERT_EQ(1U, handler->consumedSeqs.size());
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg))
+            << "the consumer should have drained the channel";
+
+    // The rest are only reachable through the looper.
+    for (int i = 0; i < 10 && looper->pollOnce(0) == Looper::POLL_CALLBACK; i++) {
+    }
+    ASSERT_EQ(4U, handler->consumedSeqs.size());
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_EQ(200 + i, handler->consumedSeqs[i]);
+    }
+    EXPECT_FALSE(mConsumer->hasDeferredEvent());
+    EXPECT_EQ(Looper::POLL_TIMEOUT, looper->pollOnce(0))
+            << "no wakeup should be left once the deferred events are consumed";
+}
+
+TEST_P(InputPublisherAndConsumerTest, Consume_LeftoverEventsAreReadableOrDeferred) {
+    for (uint32_t seq = 300; seq < 303; seq++) {
+        status_t status = mPublisher->publishKeyEvent(seq, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 0, 0, 0, 0, 0);
+        ASSERT_EQ(OK, status);
+    }
+
+    struct pollfd pfd;
+    pfd.fd = clientChannel->getFd();
+    pfd.events = POLLIN;
+    uint32_t consumeSeq;
+    InputEvent* event;
+    int32_t displayId;
+    for (uint32_t seq = 300; seq < 303; seq++) {
+        ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, false /*consumeBatches*/, -1,
+                &consumeSeq, &event, &displayId));
+        EXPECT_EQ(seq, consumeSeq);
+        if (seq < 302) {
+            EXPECT_TRUE(poll(&pfd, 1, 0) == 1 || mConsumer->hasDeferredEvent())
+                    << "the caller should learn about the events that are left";
+        }
+    }
+    EXPECT_FALSE(mConsumer->hasDeferredEvent());
+}
+
 } // namespace android
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of moving a burst of touch samples across an input channel,
+// like the samples that pile up while an application is busy drawing a frame.
+//
+// The first part moves each burst and its finished signals with one message per
+// system call and then with the vectored calls, and reports system calls and time
+// per frame.  Every channel call is exactly one system call, so the counts are
+// exact.  The second part runs a publisher and a consumer on separate threads
+// and reports the latency from publishing the last sample of a burst to the
+// consumer returning it: one message at a time, with burst receive in the
+// consumer, with burst receive plus a batching publisher, and over the shared
+// memory transport.
+//
+// usage: libinput_benchmark [frames]
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <input/InputTransport.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const size_t BURST_SIZES[] = { 1, 2, 4, 8, 16 };
+static const size_t MAX_BURST_SIZE = 16;
+static const nsecs_t FRAME_INTERVAL = 4000000; // 4 ms between bursts
+
+static void initializeMoveMessage(InputMessage* msg, uint32_t seq) {
+    memset(msg, 0, sizeof(InputMessage));
+    msg->header.type = InputMessage::TYPE_MOTION;
+    msg->body.motion.seq = seq;
+    msg->body.motion.deviceId = 1;
+    msg->body.motion.source = AINPUT_SOURCE_TOUCHSCREEN;
+    msg->body.motion.action = AMOTION_EVENT_ACTION_MOVE;
+    msg->body.motion.eventTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    msg->body.motion.pointerCount = 1;
+    msg->body.motion.pointers[0].properties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    msg->body.motion.pointers[0].coords.setAxisValue(AMOTION_EVENT_AXIS_X, seq);
+    msg->body.motion.pointers[0].coords.setAxisValue(AMOTION_EVENT_AXIS_Y, seq);
+}
+
+static void initializeFinishedMessage(InputMessage* msg, uint32_t seq) {
+    memset(msg, 0, sizeof(InputMessage));
+    msg->header.type = InputMessage::TYPE_FINISHED;
+    msg->body.finished.seq = seq;
+    msg->body.finished.handled = true;
+}
+
+// --- Channel round trips ---
+
+struct RoundTripResult {
+    double syscallsPerFrame;
+    double microsPerFrame;
+};
+
+// Sends a burst, receives it, sends a finished signal for every message and
+// receives those, one message per system call.
+static RoundTripResult runSingleMessages(size_t burstSize, size_t frames) {
+    sp<InputChannel> serverChannel, clientChannel;
+    InputChannel::openInputChannelPair(String8("benchmark"), serverChannel, clientChannel);
+
+    InputMessage msgs[MAX_BURST_SIZE];
+    InputMessage received;
+    size_t syscalls = 0;
+    uint32_t seq = 1;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t frame = 0; frame < frames; frame++) {
+        for (size_t i = 0; i < burstSize; i++) {
+            initializeMoveMessage(&msgs[i], seq++);
+            serverChannel->sendMessage(&msgs[i]);
+            syscalls += 1;
+        }
+        do {
+            syscalls += 1;
+        } while (clientChannel->receiveMessage(&received) == OK);
+
+        for (size_t i = 0; i < burstSize; i++) {
+            initializeFinishedMessage(&msgs[i], msgs[i].body.motion.seq);
+            clientChannel->sendMessage(&msgs[i]);
+            syscalls += 1;
+        }
+        do {
+            syscalls += 1;
+        } while (serverChannel->receiveMessage(&received) == OK);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    RoundTripResult result;
+    result.syscallsPerFrame = double(syscalls) / frames;
+    result.microsPerFrame = elapsed / 1000.0 / frames;
+    return result;
+}
+
+// The same round trip using sendMessages() and receiveMessages().
+static RoundTripResult runVectoredMessages(size_t burstSize, size_t frames) {
+    sp<InputChannel> serverChannel, clientChannel;
+    InputChannel::openInputChannelPair(String8("benchmark"), serverChannel, clientChannel);
+
+    InputMessage msgs[MAX_BURST_SIZE];
+    InputMessage received[MAX_BURST_SIZE * 2];
+    const size_t capacity = sizeof(received) / sizeof(received[0]);
+    size_t syscalls = 0;
+    size_t count;
+    uint32_t seq = 1;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t frame = 0; frame < frames; frame++) {
+        for (size_t i = 0; i < burstSize; i++) {
+            initializeMoveMessage(&msgs[i], seq++);
+        }
+        serverChannel->sendMessages(msgs, burstSize, &count);
+        syscalls += 1;
+        // A short read means the channel is empty, so one call is enough.
+        do {
+            syscalls += 1;
+        } while (clientChannel->receiveMessages(received, capacity, &count) == OK
+                && count == capacity);
+
+        for (size_t i = 0; i < burstSize; i++) {
+            initializeFinishedMessage(&msgs[i], msgs[i].body.motion.seq);
+        }
+        clientChannel->sendMessages(msgs, burstSize, &count);
+        syscalls += 1;
+        do {
+            syscalls += 1;
+        } while (serverChannel->receiveMessages(received, capacity, &count) == OK
+                && count == capacity);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    RoundTripResult result;
+    result.syscallsPerFrame = double(syscalls) / frames;
+    result.microsPerFrame = elapsed / 1000.0 / frames;
+    return result;
+}
+
+// --- Publisher to consumer latency ---
+
+struct LatencyResult {
+    std::vector<nsecs_t> latencies;
+    size_t wakeups;
+};
+
+enum {
+    MODE_SINGLE,
+    MODE_BURST_RECEIVE,
+    MODE_BATCHED,
+};
+
+static LatencyResult runPublisherAndConsumer(size_t burstSize, size_t frames, int mode,
+        int transport) {
+    sp<InputChannel> serverChannel, clientChannel;
+    InputChannel::openInputChannelPair(String8("benchmark"), transport,
+            serverChannel, clientChannel);
+    InputPublisher publisher(serverChannel);
+    InputConsumer consumer(clientChannel);
+    if (mode != MODE_SINGLE) {
+        consumer.setReceiveBurstSize(MAX_BURST_SIZE * 2);
+    }
+
+    LatencyResult result;
+    result.wakeups = 0;
+    std::atomic<bool> done(false);
+    std::thread consumerThread([&]() {
+        PreallocatedInputEventFactory factory;
+        struct pollfd pfd;
+        pfd.fd = clientChannel->getFd();
+        pfd.events = POLLIN;
+        while (!done) {
+            if (poll(&pfd, 1, 10) <= 0) {
+                continue;
+            }
+            result.wakeups += 1;
+            for (;;) {
+                uint32_t seq;
+                InputEvent* event;
+                int32_t displayId;
+                status_t status = consumer.consume(&factory, true /*consumeBatches*/, -1,
+                        &seq, &event, &displayId);
+                if (status) {
+                    break;
+                }
+                nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+                result.latencies.push_back(
+                        now - static_cast<MotionEvent*>(event)->getEventTime());
+                consumer.sendFinishedSignal(seq, true);
+            }
+        }
+    });
+
+    PointerProperties properties;
+    properties.clear();
+    properties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords coords;
+    uint32_t seq = 1;
+    struct pollfd pfd;
+    pfd.fd = serverChannel->getFd();
+    pfd.events = POLLIN;
+    for (size_t frame = 0; frame < frames; frame++) {
+        nsecs_t frameStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (mode == MODE_BATCHED) {
+            publisher.beginBatch();
+        }
+        for (size_t i = 0; i < burstSize; i++) {
+            coords.clear();
+            coords.setAxisValue(AMOTION_EVENT_AXIS_X, seq);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_Y, seq);
+            nsecs_t eventTime = systemTime(SYSTEM_TIME_MONOTONIC);
+            publisher.publishMotionEvent(seq++, 1, AINPUT_SOURCE_TOUCHSCREEN, 0,
+                    AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                    eventTime, eventTime, 1, &properties, &coords);
+        }
+        if (mode == MODE_BATCHED) {
+            publisher.endBatch();
+        }
+
+        // Wait for every sample to be finished before starting the next burst.
+        size_t finished = 0;
+        while (finished < burstSize) {
+            if (poll(&pfd, 1, 1000) <= 0) {
+                fprintf(stderr, "Timed out waiting for finished signals\n");
+                break;
+            }
+            uint32_t finishedSeq;
+            bool handled;
+            while (publisher.receiveFinishedSignal(&finishedSeq, &handled) == OK) {
+                finished += 1;
+            }
+        }
+
+        nsecs_t remaining = frameStart + FRAME_INTERVAL - systemTime(SYSTEM_TIME_MONOTONIC);
+        if (remaining > 0) {
+            usleep(remaining / 1000);
+        }
+    }
+
+    done = true;
+    consumerThread.join();
+    return result;
+}
+
+static void report(size_t burstSize, const char* name, const LatencyResult& result,
+        size_t frames) {
+    std::vector<nsecs_t> latencies(result.latencies);
+    if (latencies.empty()) {
+        printf("  burst=%-3zu %-14s no events consumed\n", burstSize, name);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    printf("  burst=%-3zu %-14s wakeups/frame=%.2f p50=%.1fus p90=%.1fus p99=%.1fus\n",
+            burstSize, name, double(result.wakeups) / frames,
+            latencies[count / 2] / 1000.0,
+            latencies[count * 90 / 100] / 1000.0,
+            latencies[count * 99 / 100] / 1000.0);
+}
+
+} // namespace android
+
+using namespace android;
+
+int main(int argc, char** argv) {
+    size_t frames = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    if (frames == 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    printf("channel round trip (burst and its finished signals):\n");
+    for (size_t burstSize : BURST_SIZES) {
+        RoundTripResult single = runSingleMessages(burstSize, frames * 10);
+        RoundTripResult vectored = runVectoredMessages(burstSize, frames * 10);
+        printf("  burst=%-3zu single   syscalls/frame=%5.1f %7.2fus/frame\n",
+                burstSize, single.syscallsPerFrame, single.microsPerFrame);
+        printf("  burst=%-3zu vectored syscalls/frame=%5.1f %7.2fus/frame\n",
+                burstSize, vectored.syscallsPerFrame, vectored.microsPerFrame);
+    }
+
+    printf("publisher to consumer latency of the last sample in a burst:\n");
+    for (size_t burstSize : BURST_SIZES) {
+        report(burstSize, "single",
+                runPublisherAndConsumer(burstSize, frames, MODE_SINGLE,
+                        InputChannel::TRANSPORT_SOCKET), frames);
+        report(burstSize, "burst receive",
+                runPublisherAndConsumer(burstSize, frames, MODE_BURST_RECEIVE,
+                        InputChannel::TRANSPORT_SOCKET), frames);
+        report(burstSize, "batched",
+                runPublisherAndConsumer(burstSize, frames, MODE_BATCHED,
+                        InputChannel::TRANSPORT_SOCKET), frames);
+        report(burstSize, "shared memory",
+                runPublisherAndConsumer(burstSize, frames, MODE_BURST_RECEIVE,
+                        InputChannel::TRANSPORT_SHARED_MEMORY), frames);
+    }
+    return 0;
+}
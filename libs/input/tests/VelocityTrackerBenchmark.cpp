@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of velocity estimates for touches sampled at high rates.
+//
+// For every strategy, pointer count and sample rate, a tracker is fed a full
+// history of samples and is then asked for the estimators of all pointers, one
+// pointer at a time with getEstimator() and all at once with getEstimators().
+//
+// usage: libinput_velocity_benchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <input/VelocityTracker.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const char* STRATEGIES[] = { "lsq2", "wlsq2-delta", "int1", "legacy" };
+static const uint32_t POINTER_COUNTS[] = { 1, 2, 5, 10 };
+static const uint32_t SAMPLE_RATES[] = { 60, 240, 1000 };
+
+// Enough samples to fill the history of every strategy.
+static const uint32_t SAMPLE_COUNT = 40;
+
+static void addMovements(VelocityTracker& tracker, uint32_t pointerCount, uint32_t sampleRate) {
+    const nsecs_t interval = 1000000000LL / sampleRate;
+    BitSet32 idBits;
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        idBits.markBit(i);
+    }
+
+    VelocityTracker::Position positions[MAX_POINTERS];
+    for (uint32_t sample = 0; sample < SAMPLE_COUNT; sample++) {
+        float t = sample * interval * 0.000000001f;
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            positions[i].x = 100 * i + 900 * t + 2000 * t * t + (sample % 3);
+            positions[i].y = 50 * i - 400 * t + 500 * t * t + (sample % 2);
+        }
+        tracker.addMovement(sample * interval, idBits, positions);
+    }
+}
+
+// Returns the average time in microseconds to estimate all pointers.
+static double run(const VelocityTracker& tracker, uint32_t pointerCount, bool batched,
+        size_t iterations) {
+    BitSet32 idBits;
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        idBits.markBit(i);
+    }
+
+    VelocityTracker::Estimator estimators[MAX_POINTERS];
+    float checksum = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        if (batched) {
+            tracker.getEstimators(idBits, estimators);
+        } else {
+            for (uint32_t i = 0; i < pointerCount; i++) {
+                tracker.getEstimator(i, &estimators[i]);
+            }
+        }
+        checksum += estimators[pointerCount - 1].xCoeff[1];
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    // Keep the estimates alive.
+    if (checksum == 0.12345f) {
+        printf("\n");
+    }
+    return elapsed / 1000.0 / iterations;
+}
+
+} // namespace android
+
+using namespace android;
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    if (iterations == 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("time to estimate every pointer:\n");
+    for (const char* strategy : STRATEGIES) {
+        for (uint32_t sampleRate : SAMPLE_RATES) {
+            for (uint32_t pointerCount : POINTER_COUNTS) {
+                VelocityTracker tracker(strategy);
+                addMovements(tracker, pointerCount, sampleRate);
+                double single = run(tracker, pointerCount, false, iterations);
+                double batched = run(tracker, pointerCount, true, iterations);
+                printf("  %-12s %4uHz pointers=%-3u getEstimator %7.2fus  "
+                        "getEstimators %7.2fus\n",
+                        strategy, sampleRate, pointerCount, single, batched);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <gtest/gtest.h>
+#include <input/VelocityTracker.h>
+
+namespace android {
+
+enum Scenario {
+    // One pointer, accelerating, with uneven sample times and some jitter.
+    SCENARIO_FLING,
+    // Three pointers that go down one after the other.
+    SCENARIO_MULTI_TOUCH,
+};
+
+static const char* STRATEGIES[] = {
+    "lsq1", "lsq2", "lsq3", "wlsq2-delta", "wlsq2-central", "wlsq2-recent",
+    "int1", "int2", "legacy",
+};
+
+struct GoldenEstimate {
+    const char* strategy;
+    Scenario scenario;
+    uint32_t id;
+    uint32_t degree;
+    float xCoeff[4];
+    float yCoeff[4];
+    float confidence;
+};
+
+// The estimates of every strategy at the end of each scenario.
+static const GoldenEstimate GOLDEN_ESTIMATES[] = {
+    { "lsq1", SCENARIO_FLING, 0, 1,
+            { 629.651062, 2648.39404, 0, 0 },
+            { 486.76297, -1427.87952, 0, 0 }, 0.996665657 },
+    { "lsq1", SCENARIO_MULTI_TOUCH, 0, 1,
+            { 202.399948, 799.999512, 0, 0 },
+            { 138.938446, 299.999786, 0, 0 }, 0.996927619 },
+    { "lsq1", SCENARIO_MULTI_TOUCH, 1, 1,
+            { 261.610687, -1032.00024, 0, 0 },
+            { 576.800049, 599.999207, 0, 0 }, 0.999439478 },
+    { "lsq1", SCENARIO_MULTI_TOUCH, 2, 1,
+            { 664, 500.000488, 0, 0 },
+            { 354.293396, -5159.99854, 0, 0 }, 0.99948746 },
+    { "lsq2", SCENARIO_FLING, 0, 2,
+            { 635.455505, 3035.97705, 3999.77661, 0 },
+            { 489.761658, -1227.64783, 2066.34985, 0 }, 0.999741793 },
+    { "lsq2", SCENARIO_MULTI_TOUCH, 0, 2,
+            { 202.399796, 799.987976, -0.119892195, 0 },
+            { 139.092178, 310.481262, 109.181824, 0 }, 0.997020721 },
+    { "lsq2", SCENARIO_MULTI_TOUCH, 1, 2,
+            { 262.783752, -944.021301, 999.761108, 0 },
+            { 576.7995, 599.956726, -0.48293224, 0 }, 1 },
+    { "lsq2", SCENARIO_MULTI_TOUCH, 2, 2,
+            { 664.000427, 500.084778, 2.107095, 0 },
+            { 352.160431, -5559.93115, -9998.32227, 0 }, 1 },
+    { "lsq3", SCENARIO_FLING, 0, 3,
+            { 635.454773, 3035.86914, 3996.86938, -20.1196346 },
+            { 489.622711, -1249.03455, 1489.71191, -3990.32495 }, 0.999745369 },
+    { "lsq3", SCENARIO_MULTI_TOUCH, 0, 3,
+            { 202.398911, 799.852051, -3.80586767, -25.5970383 },
+            { 139.091553, 310.385254, 106.579956, -18.0684986 }, 0.997020721 },
+    { "lsq3", SCENARIO_MULTI_TOUCH, 1, 3,
+            { 262.782257, -944.286072, 991.902649, -59.5338135 },
+            { 576.796753, 599.473877, -14.8109331, -108.545372 }, 1 },
+    { "lsq3", SCENARIO_MULTI_TOUCH, 2, 3,
+            { 664.001221, 500.52948, 32.5396919, 507.210602 },
+            { 352.160919, -5559.62646, -9977.44141, 348.013123 }, 1 },
+    { "wlsq2-delta", SCENARIO_FLING, 0, 2,
+            { 635.456421, 3036.01904, 4000.15845, 0 },
+            { 489.767395, -1227.81006, 2060.97656, 0 }, 0.999750614 },
+    { "wlsq2-delta", SCENARIO_MULTI_TOUCH, 0, 2,
+            { 202.400223, 800.009033, 0.0677848607, 0 },
+            { 139.125687, 311.82132, 120.361389, 0 }, 0.997142673 },
+    { "wlsq2-delta", SCENARIO_MULTI_TOUCH, 1, 2,
+            { 262.784241, -943.985962, 1000.15302, 0 },
+            { 576.800537, 600.02771, 0.28235364, 0 }, 1 },
+    { "wlsq2-delta", SCENARIO_MULTI_TOUCH, 2, 2,
+            { 663.999817, 499.981445, -0.336543947, 0 },
+            { 352.159882, -5560.01514, -10000.3193, 0 }, 1 },
+    { "wlsq2-central", SCENARIO_FLING, 0, 2,
+            { 635.455688, 3035.98511, 3999.87988, 0 },
+            { 489.952148, -1223.19983, 2103.92285, 0 }, 0.999637008 },
+    { "wlsq2-central", SCENARIO_MULTI_TOUCH, 0, 2,
+            { 202.40036, 800.015259, 0.1266983, 0 },
+            { 138.89978, 300.796814, 21.6745319, 0 }, 0.995881617 },
+    { "wlsq2-central", SCENARIO_MULTI_TOUCH, 1, 2,
+            { 262.783966, -944.005249, 999.911499, 0 },
+            { 576.799866, 599.983154, -0.246715069, 0 }, 1 },
+    { "wlsq2-central", SCENARIO_MULTI_TOUCH, 2, 2,
+            { 663.999695, 499.954712, -1.08343506, 0 },
+            { 352.15976, -5560.03027, -10000.6963, 0 }, 1 },
+    { "wlsq2-recent", SCENARIO_FLING, 0, 2,
+            { 635.456299, 3036.01099, 4000.10889, 0 },
+            { 489.726196, -1231.25708, 2022.69543, 0 }, 0.999688506 },
+    { "wlsq2-recent", SCENARIO_MULTI_TOUCH, 0, 2,
+            { 202.400162, 800.010864, 0.120682523, 0 },
+            { 139.077026, 309.200592, 95.4468307, 0 }, 0.996600807 },
+    { "wlsq2-recent", SCENARIO_MULTI_TOUCH, 1, 2,
+            { 262.783875, -944.007629, 999.933594, 0 },
+            { 576.799744, 599.986755, -0.0988914818, 0 }, 1 },
+    { "wlsq2-recent", SCENARIO_MULTI_TOUCH, 2, 2,
+            { 664.000427, 500.084778, 2.107095, 0 },
+            { 352.160431, -5559.93115, -9998.32227, 0 }, 1 },
+    { "int1", SCENARIO_FLING, 0, 1,
+            { 635.455994, 2922.29346, 0, 0 },
+            { 489.227997, -1332.54102, 0, 0 }, 1 },
+    { "int1", SCENARIO_MULTI_TOUCH, 0, 1,
+            { 202.399994, 799.999512, 0, 0 },
+            { 139.399994, 335.737701, 0, 0 }, 1 },
+    { "int1", SCENARIO_MULTI_TOUCH, 1, 1,
+            { 262.783997, -971.94397, 0, 0 },
+            { 576.799988, 599.999146, 0, 0 }, 1 },
+    { "int1", SCENARIO_MULTI_TOUCH, 2, 1,
+            { 664, 500.000031, 0, 0 },
+            { 352.160004, -5299.05176, 0, 0 }, 1 },
+    { "int2", SCENARIO_FLING, 0, 2,
+            { 635.455994, 2925.93384, 8709.74902, 0 },
+            { 489.227997, -1281.02356, 2286.66748, 0 }, 1 },
+    { "int2", SCENARIO_MULTI_TOUCH, 0, 2,
+            { 202.399994, 799.999756, -0.0399519131, 0 },
+            { 139.399994, 311.255829, 2122.84473, 0 }, 1 },
+    { "int2", SCENARIO_MULTI_TOUCH, 1, 2,
+            { 262.783997, -972.090576, 2341.29126, 0 },
+            { 576.799988, 599.999817, -0.0777247027, 0 }, 1 },
+    { "int2", SCENARIO_MULTI_TOUCH, 2, 2,
+            { 664, 500.000031, 0, 0 },
+            { 352.160004, -5247.43799, -19004.168, 0 }, 1 },
+    { "legacy", SCENARIO_FLING, 0, 1,
+            { 635.455994, 2392.19775, 0, 0 },
+            { 489.227997, -1557.67639, 0, 0 }, 1 },
+    { "legacy", SCENARIO_MULTI_TOUCH, 0, 1,
+            { 202.399994, 799.999939, 0, 0 },
+            { 139.399994, 305.914398, 0, 0 }, 1 },
+    { "legacy", SCENARIO_MULTI_TOUCH, 1, 1,
+            { 262.783997, -1039.18481, 0, 0 },
+            { 576.799988, 599.999939, 0, 0 }, 1 },
+    { "legacy", SCENARIO_MULTI_TOUCH, 2, 1,
+            { 664, 499.999969, 0, 0 },
+            { 352.160004, -5103.11133, 0, 0 }, 1 },
+};
+
+// Tolerances for coefficients of increasing degree.  Fits over the 100ms horizon
+// amplify rounding differences, like those of fused multiply-adds, in the higher
+// coefficients.  The cubic terms of lsq3 are mostly noise.
+static const float COEFFICIENT_TOLERANCES[] = { 0.01f, 1.0f, 50.0f, 1000.0f };
+
+static void addFlingMovements(VelocityTracker& tracker) {
+    nsecs_t eventTime = 0;
+    for (int i = 0; i < 24; i++) {
+        eventTime += 8000000 + ((i % 3) - 1) * 1000000;
+        float ms = eventTime / 1000000.0f;
+        VelocityTracker::Position position;
+        position.x = 200 + 1.5f * ms + 0.004f * ms * ms;
+        position.y = 800 - 2.0f * ms + 0.002f * ms * ms + ((i * 7) % 5 - 2) * 0.5f;
+        tracker.addMovement(eventTime, BitSet32(BitSet32::valueForBit(0)), &position);
+    }
+}
+
+static void addMultiTouchMovements(VelocityTracker& tracker) {
+    nsecs_t eventTime = 0;
+    for (int i = 0; i < 16; i++) {
+        eventTime += 8000000;
+        float ms = eventTime / 1000000.0f;
+        BitSet32 idBits;
+        VelocityTracker::Position positions[3];
+        size_t count = 0;
+        idBits.markBit(0);
+        positions[count].x = 100 + 0.8f * ms;
+        positions[count++].y = 100 + 0.3f * ms + (i % 2);
+        if (i >= 4) {
+            idBits.markBit(1);
+            positions[count].x = 400 - 1.2f * ms + 0.001f * ms * ms;
+            positions[count++].y = 500 + 0.6f * ms;
+        }
+        if (i >= 10) {
+            idBits.markBit(2);
+            positions[count].x = 600 + 0.5f * ms;
+            positions[count++].y = 900 - 3.0f * ms - 0.01f * ms * ms;
+        }
+        tracker.addMovement(eventTime, idBits, positions);
+    }
+}
+
+static void addMovements(VelocityTracker& tracker, Scenario scenario) {
+    switch (scenario) {
+    case SCENARIO_FLING:
+        addFlingMovements(tracker);
+        break;
+    case SCENARIO_MULTI_TOUCH:
+        addMultiTouchMovements(tracker);
+        break;
+    }
+}
+
+
+// --- VelocityTrackerTest ---
+
+class VelocityTrackerTest : public testing::Test {
+protected:
+    void assertEstimatorEqual(const VelocityTracker::Estimator& expected,
+            const VelocityTracker::Estimator& actual) {
+        ASSERT_EQ(expected.time, actual.time);
+        ASSERT_EQ(expected.degree, actual.degree);
+        for (uint32_t i = 0; i <= expected.degree; i++) {
+            ASSERT_EQ(expected.xCoeff[i], actual.xCoeff[i]);
+            ASSERT_EQ(expected.yCoeff[i], actual.yCoeff[i]);
+        }
+        ASSERT_EQ(expected.confidence, actual.confidence);
+    }
+};
+
+TEST_F(VelocityTrackerTest, GetEstimator_MatchesGoldenEstimates) {
+    for (const GoldenEstimate& golden : GOLDEN_ESTIMATES) {
+        SCOPED_TRACE(testing::Message() << golden.strategy << ", scenario " << golden.scenario
+                << ", pointer " << golden.id);
+        VelocityTracker tracker(golden.strategy);
+        addMovements(tracker, golden.scenario);
+
+        VelocityTracker::Estimator estimator;
+        ASSERT_TRUE(tracker.getEstimator(golden.id, &estimator));
+        ASSERT_EQ(golden.degree, estimator.degree);
+        for (uint32_t i = 0; i <= golden.degree; i++) {
+            EXPECT_NEAR(golden.xCoeff[i], estimator.xCoeff[i], COEFFICIENT_TOLERANCES[i]);
+            EXPECT_NEAR(golden.yCoeff[i], estimator.yCoeff[i], COEFFICIENT_TOLERANCES[i]);
+        }
+        EXPECT_NEAR(golden.confidence, estimator.confidence, 0.0001f);
+    }
+}
+
+TEST_F(VelocityTrackerTest, GetEstimators_MatchesGetEstimator) {
+    // Pointer 3 was never down.
+    const BitSet32 idBits(BitSet32::valueForBit(0) | BitSet32::valueForBit(1)
+            | BitSet32::valueForBit(2) | BitSet32::valueForBit(3));
+
+    for (const char* strategy : STRATEGIES) {
+        SCOPED_TRACE(strategy);
+        VelocityTracker tracker(strategy);
+        addMultiTouchMovements(tracker);
+
+        VelocityTracker::Estimator estimators[4];
+        BitSet32 validIdBits = tracker.getEstimators(idBits, estimators);
+        ASSERT_EQ(BitSet32::valueForBit(0) | BitSet32::valueForBit(1) | BitSet32::valueForBit(2),
+                validIdBits.value);
+        for (uint32_t id = 0; id < 4; id++) {
+            VelocityTracker::Estimator estimator;
+            ASSERT_EQ(validIdBits.hasBit(id), tracker.getEstimator(id, &estimator));
+            assertEstimatorEqual(estimator, estimators[id]);
+        }
+    }
+}
+
+TEST_F(VelocityTrackerTest, GetEstimators_PointerWithOneSample) {
+    for (const char* strategy : STRATEGIES) {
+        SCOPED_TRACE(strategy);
+        VelocityTracker tracker(strategy);
+        addMultiTouchMovements(tracker);
+
+        // Pointer 1 goes up and pointer 4 goes down.
+        const uint32_t ids[3] = { 0, 2, 4 };
+        VelocityTracker::Position positions[3] = { { 1, 2 }, { 3, 4 }, { 5, 6 } };
+        BitSet32 idBits(BitSet32::valueForBit(0) | BitSet32::valueForBit(2)
+                | BitSet32::valueForBit(4));
+        tracker.clearPointers(BitSet32(BitSet32::valueForBit(1)));
+        tracker.addMovement(136000000, idBits, positions);
+
+        VelocityTracker::Estimator estimators[3];
+        ASSERT_EQ(idBits.value, tracker.getEstimators(idBits, estimators).value);
+        ASSERT_EQ(0U, estimators[2].degree);
+        ASSERT_EQ(5, estimators[2].xCoeff[0]);
+        ASSERT_EQ(6, estimators[2].yCoeff[0]);
+        for (uint32_t i = 0; i < 3; i++) {
+            VelocityTracker::Estimator estimator;
+            ASSERT_TRUE(tracker.getEstimator(ids[i], &estimator));
+            assertEstimatorEqual(estimator, estimators[i]);
+        }
+    }
+}
+
+} // namespace android
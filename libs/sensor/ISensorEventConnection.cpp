@@ -27,6 +27,7 @@
 #include <binder/IInterface.h>
 
 #include <sensor/BitTube.h>
+#include <sensor/SensorEventRing.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -38,6 +39,7 @@ enum {
     FLUSH_SENSOR,
     CONFIGURE_CHANNEL,
     DESTROY,
+    GET_SENSOR_EVENT_RING,
 };
 
 class BpSensorEventConnection : public BpInterface<ISensorEventConnection>
@@ -58,6 +60,17 @@ public:
         return new BitTube(reply);
     }
 
+    virtual sp<SensorEventRing> getSensorEventRing()
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_SENSOR_EVENT_RING, data, &reply);
+        if (result != NO_ERROR || reply.readInt32() != NO_ERROR) {
+            return NULL;
+        }
+        return new SensorEventRing(reply);
+    }
+
     virtual status_t enableDisable(int handle, bool enabled, nsecs_t samplingPeriodNs,
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags)
     {
@@ -128,6 +141,16 @@ status_t BnSensorEventConnection::onTransact(
             channel->writeToParcel(reply);
             return NO_ERROR;
         }
+        case GET_SENSOR_EVENT_RING: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            sp<SensorEventRing> ring(getSensorEventRing());
+            if (ring == NULL) {
+                reply->writeInt32(INVALID_OPERATION);
+                return NO_ERROR;
+            }
+            reply->writeInt32(NO_ERROR);
+            return ring->writeToParcel(reply);
+        }
         case ENABLE_DISABLE: {
             CHECK_INTERFACE(ISensorEventConnection, data, reply);
             int handle = data.readInt32();
@@ -49,10 +49,19 @@ SensorEventQueue::~SensorEventQueue() {
 void SensorEventQueue::onFirstRef()
 {
     mSensorChannel = mSensorEventConnection->getSensorChannel();
+    mEventRing = mSensorEventConnection->getSensorEventRing();
+    if (mEventRing != NULL && mEventRing->initCheck() != NO_ERROR) {
+        // The service has already switched to the ring, so events will be lost.
+        ALOGE("SensorEventQueue: can't map the event ring");
+        mEventRing.clear();
+    }
 }
 
 int SensorEventQueue::getFd() const
 {
+    if (mEventRing != NULL) {
+        return mEventRing->getFd();
+    }
     return mSensorChannel->getFd();
 }
 
@@ -63,6 +72,11 @@ ssize_t SensorEventQueue::write(const sp<BitTube>& tube,
 }
 
 ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
+    if (mEventRing != NULL) {
+        // Events are copied straight out of shared memory, without a system call unless the
+        // ring runs empty.
+        return mEventRing->read(events, numEvents);
+    }
     if (mAvailable == 0) {
         ssize_t err = BitTube::recvObjects(mSensorChannel,
                 mRecBuffer, MAX_RECEIVE_BUFFER_EVENT_COUNT);
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Sensors"
+
+#include <sensor/SensorEventRing.h>
+
+#include <atomic>
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <android/sensor.h>
+#include <binder/Parcel.h>
+#include <cutils/ashmem.h>
+#include <log/log.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+static const uint32_t SENSOR_EVENT_RING_MAGIC = 0x47524553; // 'SERG'
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The ring needs lock-free atomics in shared memory.");
+
+struct SensorEventRing::Header {
+    uint32_t magic;
+    uint32_t capacity;
+    uint32_t eventSize;
+    uint32_t reserved;
+    // The two ends write these from different cpus, so each one gets its own cache line.
+    alignas(64) std::atomic<uint32_t> writeIndex;
+    std::atomic<uint32_t> droppedEvents;
+    alignas(64) std::atomic<uint32_t> readIndex;
+    // Set by the reader when it found the ring empty, cleared by the writer when it signals.
+    std::atomic<uint32_t> readerWaiting;
+};
+
+SensorEventRing::SensorEventRing()
+    : mMemoryFd(-1), mEventFd(-1), mBase(NULL), mMapSize(0), mHeader(NULL), mEvents(NULL),
+      mCapacity(0)
+{
+}
+
+SensorEventRing::SensorEventRing(const Parcel& data)
+    : SensorEventRing()
+{
+    int memoryFd = dup(data.readFileDescriptor());
+    mEventFd = dup(data.readFileDescriptor());
+    if (memoryFd < 0 || mEventFd < 0) {
+        ALOGE("SensorEventRing(Parcel): can't dup filedescriptor (%s)", strerror(errno));
+        if (memoryFd >= 0) {
+            close(memoryFd);
+        }
+        return;
+    }
+    if (map(memoryFd) != NO_ERROR) {
+        close(memoryFd);
+    }
+}
+
+SensorEventRing::~SensorEventRing()
+{
+    if (mBase) {
+        munmap(mBase, mMapSize);
+    }
+    if (mMemoryFd >= 0) {
+        close(mMemoryFd);
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+}
+
+sp<SensorEventRing> SensorEventRing::create(size_t minCapacity)
+{
+    uint32_t capacity = 1;
+    while (capacity < minCapacity) {
+        capacity <<= 1;
+    }
+
+    sp<SensorEventRing> ring = new SensorEventRing();
+    size_t mapSize = sizeof(Header) + capacity * sizeof(ASensorEvent);
+    int memoryFd = ashmem_create_region("SensorEventRing", mapSize);
+    ring->mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (memoryFd < 0 || ring->mEventFd < 0) {
+        ALOGE("SensorEventRing: can't create (%s)", strerror(errno));
+        if (memoryFd >= 0) {
+            close(memoryFd);
+        }
+        return ring;
+    }
+
+    void* base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("SensorEventRing: can't map (%s)", strerror(errno));
+        close(memoryFd);
+        return ring;
+    }
+    Header* header = new (base) Header;
+    header->magic = SENSOR_EVENT_RING_MAGIC;
+    header->capacity = capacity;
+    header->eventSize = sizeof(ASensorEvent);
+    header->reserved = 0;
+    header->writeIndex.store(0);
+    header->droppedEvents.store(0);
+    header->readIndex.store(0);
+    // The ring starts empty, so the first write wakes the reader.
+    header->readerWaiting.store(1);
+    ring->attach(memoryFd, base, mapSize);
+    return ring;
+}
+
+status_t SensorEventRing::map(int memoryFd)
+{
+    int size = ashmem_get_size_region(memoryFd);
+    if (size < int(sizeof(Header))) {
+        ALOGE("SensorEventRing: shared memory is too small (%d bytes)", size);
+        return BAD_VALUE;
+    }
+
+    size_t mapSize = size_t(size);
+    void* base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("SensorEventRing: can't map (%s)", strerror(errno));
+        return -errno;
+    }
+
+    Header* header = static_cast<Header*>(base);
+    uint32_t capacity = header->capacity;
+    if (header->magic != SENSOR_EVENT_RING_MAGIC || header->eventSize != sizeof(ASensorEvent)
+            || capacity == 0 || (capacity & (capacity - 1))
+            || mapSize != sizeof(Header) + capacity * sizeof(ASensorEvent)) {
+        ALOGE("SensorEventRing: shared memory is not a valid ring");
+        munmap(base, mapSize);
+        return BAD_VALUE;
+    }
+
+    attach(memoryFd, base, mapSize);
+    return NO_ERROR;
+}
+
+void SensorEventRing::attach(int memoryFd, void* base, size_t mapSize)
+{
+    mMemoryFd = memoryFd;
+    mBase = base;
+    mMapSize = mapSize;
+    mHeader = static_cast<Header*>(base);
+    mEvents = reinterpret_cast<ASensorEvent*>(mHeader + 1);
+    mCapacity = mHeader->capacity;
+}
+
+status_t SensorEventRing::initCheck() const
+{
+    return mHeader != NULL && mEventFd >= 0 ? status_t(NO_ERROR) : status_t(NO_INIT);
+}
+
+int SensorEventRing::getFd() const
+{
+    return mEventFd;
+}
+
+status_t SensorEventRing::writeToParcel(Parcel* reply) const
+{
+    if (initCheck() != NO_ERROR) {
+        return -EINVAL;
+    }
+    status_t result = reply->writeDupFileDescriptor(mMemoryFd);
+    if (result == NO_ERROR) {
+        result = reply->writeDupFileDescriptor(mEventFd);
+    }
+    return result;
+}
+
+size_t SensorEventRing::getWritableCount() const
+{
+    uint32_t readIndex = mHeader->readIndex.load(std::memory_order_acquire);
+    uint32_t used = mHeader->writeIndex.load(std::memory_order_relaxed) - readIndex;
+    // A reader that moved its index past the writer's is treated as having a full ring.
+    return used < mCapacity ? mCapacity - used : 0;
+}
+
+size_t SensorEventRing::write(ASensorEvent const* events, size_t count)
+{
+    uint32_t writeIndex = mHeader->writeIndex.load(std::memory_order_relaxed);
+    size_t writable = getWritableCount();
+    if (count > writable) {
+        count = writable;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint32_t position = writeIndex & (mCapacity - 1);
+    size_t first = count < mCapacity - position ? count : mCapacity - position;
+    memcpy(mEvents + position, events, first * sizeof(ASensorEvent));
+    memcpy(mEvents, events + first, (count - first) * sizeof(ASensorEvent));
+
+    // Publishing the events and then checking whether the reader is waiting pairs with the
+    // reader asking to be woken and then checking for new events, so that one of the two
+    // always notices the other.
+    mHeader->writeIndex.store(writeIndex + uint32_t(count), std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mHeader->readerWaiting.load(std::memory_order_relaxed)
+            && mHeader->readerWaiting.exchange(0, std::memory_order_relaxed)) {
+        signal();
+    }
+    return count;
+}
+
+void SensorEventRing::addDroppedEvents(uint32_t count)
+{
+    mHeader->droppedEvents.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint32_t SensorEventRing::getDroppedEventCount() const
+{
+    return mHeader->droppedEvents.load(std::memory_order_relaxed);
+}
+
+ssize_t SensorEventRing::read(ASensorEvent* events, size_t count)
+{
+    size_t numRead = 0;
+    bool drained = false;
+    uint32_t readIndex = mHeader->readIndex.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t available = mHeader->writeIndex.load(std::memory_order_acquire) - readIndex;
+        if (available > mCapacity) {
+            ALOGE("SensorEventRing: ring was corrupted by the writer");
+            return BAD_VALUE;
+        }
+        size_t n = count - numRead < available ? count - numRead : available;
+        uint32_t position = readIndex & (mCapacity - 1);
+        size_t first = n < mCapacity - position ? n : mCapacity - position;
+        memcpy(events + numRead, mEvents + position, first * sizeof(ASensorEvent));
+        memcpy(events + numRead + first, mEvents, (n - first) * sizeof(ASensorEvent));
+        readIndex += uint32_t(n);
+        numRead += n;
+        mHeader->readIndex.store(readIndex, std::memory_order_release);
+
+        if (numRead == count) {
+            // There may be more events. If the signal for them was consumed below, put it
+            // back so that the wakeup fd stays readable.
+            if (drained) {
+                signal();
+            }
+            break;
+        }
+
+        // The ring is empty. Consume the signal, then ask the writer for a new one and check
+        // again for events written in between.
+        drainSignals();
+        drained = true;
+        mHeader->readerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mHeader->writeIndex.load(std::memory_order_relaxed) == readIndex) {
+            break;
+        }
+    }
+    return numRead ? ssize_t(numRead) : ssize_t(WOULD_BLOCK);
+}
+
+void SensorEventRing::signal() const
+{
+    uint64_t value = 1;
+    ssize_t size;
+    do {
+        size = ::write(mEventFd, &value, sizeof(value));
+    } while (size < 0 && errno == EINTR);
+}
+
+void SensorEventRing::drainSignals() const
+{
+    uint64_t value;
+    ssize_t size;
+    do {
+        size = ::read(mEventFd, &value, sizeof(value));
+    } while (size < 0 && errno == EINTR);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
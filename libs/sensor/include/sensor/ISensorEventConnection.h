@@ -30,6 +30,7 @@ namespace android {
 
 class BitTube;
 class Parcel;
+class SensorEventRing;
 
 class ISensorEventConnection : public IInterface
 {
@@ -37,6 +38,9 @@ public:
     DECLARE_META_INTERFACE(SensorEventConnection)
 
     virtual sp<BitTube> getSensorChannel() const = 0;
+    // Switches the delivery of events to a ring in shared memory and returns it, or returns
+    // NULL if the connection does not support it. The channel still carries acknowledgements.
+    virtual sp<SensorEventRing> getSensorEventRing() = 0;
     virtual status_t enableDisable(int handle, bool enabled, nsecs_t samplingPeriodNs,
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags) = 0;
     virtual status_t setEventRate(int handle, nsecs_t ns) = 0;
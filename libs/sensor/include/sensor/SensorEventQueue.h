@@ -25,6 +25,7 @@
 #include <utils/Mutex.h>
 
 #include <sensor/BitTube.h>
+#include <sensor/SensorEventRing.h>
 
 // ----------------------------------------------------------------------------
 #define WAKE_UP_SENSOR_EVENT_NEEDS_ACK (1U << 31)
@@ -96,6 +97,8 @@ private:
     sp<Looper> getLooper() const;
     sp<ISensorEventConnection> mSensorEventConnection;
     sp<BitTube> mSensorChannel;
+    // Carries the events instead of mSensorChannel, if the service supports it.
+    sp<SensorEventRing> mEventRing;
     mutable Mutex mLock;
     mutable sp<Looper> mLooper;
     ASensorEvent* mRecBuffer;
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+struct ASensorEvent;
+
+namespace android {
+// ----------------------------------------------------------------------------
+class Parcel;
+
+/*
+ * A ring of sensor events in shared memory, written by SensorService and read by a single
+ * SensorEventQueue.
+ *
+ * Neither side makes a system call while the reader keeps up with the writer. The writer
+ * only signals the wakeup fd when the reader has found the ring empty and asked to be woken,
+ * and the reader only consumes that signal when it finds the ring empty. The wakeup fd is
+ * therefore readable whenever there are events to read, like a socket would be.
+ *
+ * The writer never blocks. Events that do not fit are dropped and counted in shared memory,
+ * where the reader can see them. Flush complete events are ordinary events in the ring.
+ */
+class SensorEventRing : public RefBase
+{
+public:
+    // creates a ring that holds at least minCapacity events
+    static sp<SensorEventRing> create(size_t minCapacity);
+
+    // maps a ring received from the writer
+    explicit SensorEventRing(const Parcel& data);
+
+    // check state after construction
+    status_t initCheck() const;
+
+    // get the wakeup file-descriptor, readable when there are events to read
+    int getFd() const;
+
+    // parcels this ring, to be read by the other end
+    status_t writeToParcel(Parcel* reply) const;
+
+    // number of events that can be written without dropping any
+    size_t getWritableCount() const;
+
+    // writes as many of the events as fit and returns how many were written
+    size_t write(ASensorEvent const* events, size_t count);
+
+    // counts events that the writer could not write
+    void addDroppedEvents(uint32_t count);
+
+    // number of events dropped since the ring was created
+    uint32_t getDroppedEventCount() const;
+
+    // reads up to count events. Returns WOULD_BLOCK if there were none.
+    ssize_t read(ASensorEvent* events, size_t count);
+
+    size_t getCapacity() const { return mCapacity; }
+
+private:
+    struct Header;
+
+    SensorEventRing();
+    virtual ~SensorEventRing();
+
+    status_t map(int memoryFd);
+    void attach(int memoryFd, void* base, size_t mapSize);
+    void signal() const;
+    void drainSignals() const;
+
+    int mMemoryFd;
+    int mEventFd;
+    void* mBase;
+    size_t mMapSize;
+    Header* mHeader;
+    ASensorEvent* mEvents;
+    uint32_t mCapacity;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
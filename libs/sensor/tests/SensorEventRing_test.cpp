@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorEventRing_test"
+
+#include <poll.h>
+#include <string.h>
+
+#include <thread>
+
+#include <android/sensor.h>
+#include <binder/Parcel.h>
+#include <gtest/gtest.h>
+#include <sensor/SensorEventRing.h>
+
+namespace android {
+
+static ASensorEvent makeEvent(int32_t sequence) {
+    ASensorEvent event;
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(event);
+    event.sensor = 1;
+    event.type = ASENSOR_TYPE_ACCELEROMETER;
+    event.timestamp = sequence;
+    return event;
+}
+
+static bool isReadable(int fd) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+// Maps the ring from a parcel like a client does.
+static sp<SensorEventRing> openReader(const sp<SensorEventRing>& writer) {
+    Parcel parcel;
+    if (writer->writeToParcel(&parcel) != NO_ERROR) {
+        return NULL;
+    }
+    parcel.setDataPosition(0);
+    return new SensorEventRing(parcel);
+}
+
+class SensorEventRingTest : public testing::Test {
+protected:
+    sp<SensorEventRing> mWriter;
+    sp<SensorEventRing> mReader;
+
+    virtual void SetUp() {
+        mWriter = SensorEventRing::create(12);
+        ASSERT_EQ(NO_ERROR, mWriter->initCheck());
+        mReader = openReader(mWriter);
+        ASSERT_TRUE(mReader != NULL);
+        ASSERT_EQ(NO_ERROR, mReader->initCheck());
+    }
+};
+
+TEST_F(SensorEventRingTest, Create_RoundsCapacityUpToPowerOfTwo) {
+    EXPECT_EQ(16U, mWriter->getCapacity());
+    EXPECT_EQ(16U, mReader->getCapacity());
+    EXPECT_EQ(16U, mWriter->getWritableCount());
+}
+
+TEST_F(SensorEventRingTest, Read_WhenEmpty_ReturnsWouldBlock) {
+    ASensorEvent event;
+    EXPECT_EQ(ssize_t(WOULD_BLOCK), mReader->read(&event, 1));
+    EXPECT_FALSE(isReadable(mReader->getFd()));
+}
+
+TEST_F(SensorEventRingTest, Read_ReturnsEventsInOrderAcrossWrapAround) {
+    ASensorEvent events[10];
+    ASensorEvent received[10];
+    int32_t sequence = 0;
+    int32_t expected = 0;
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = 0; i < 10; i++) {
+            events[i] = makeEvent(sequence++);
+        }
+        ASSERT_EQ(10U, mWriter->write(events, 10));
+        ASSERT_EQ(10, mReader->read(received, 10));
+        for (size_t i = 0; i < 10; i++) {
+            ASSERT_EQ(expected++, received[i].timestamp);
+        }
+    }
+}
+
+TEST_F(SensorEventRingTest, Write_WhenFull_WritesWhatFits) {
+    ASensorEvent events[20];
+    for (int32_t i = 0; i < 20; i++) {
+        events[i] = makeEvent(i);
+    }
+    EXPECT_EQ(16U, mWriter->write(events, 20));
+    EXPECT_EQ(0U, mWriter->getWritableCount());
+    EXPECT_EQ(0U, mWriter->write(events, 1));
+
+    mWriter->addDroppedEvents(4);
+    EXPECT_EQ(4U, mReader->getDroppedEventCount());
+
+    ASensorEvent received[20];
+    ASSERT_EQ(16, mReader->read(received, 20));
+    EXPECT_EQ(15, received[15].timestamp);
+    EXPECT_EQ(16U, mWriter->getWritableCount());
+}
+
+TEST_F(SensorEventRingTest, Fd_IsReadableWhileEventsRemain) {
+    ASensorEvent events[4] = { makeEvent(0), makeEvent(1), makeEvent(2), makeEvent(3) };
+    ASSERT_EQ(4U, mWriter->write(events, 4));
+    EXPECT_TRUE(isReadable(mReader->getFd()));
+
+    // A partial read leaves events behind, so the fd must stay readable.
+    ASensorEvent received[4];
+    ASSERT_EQ(3, mReader->read(received, 3));
+    EXPECT_TRUE(isReadable(mReader->getFd()));
+
+    // Emptying the ring consumes the wakeup.
+    ASSERT_EQ(1, mReader->read(received, 4));
+    EXPECT_FALSE(isReadable(mReader->getFd()));
+
+    // The next write wakes the reader again, but only once.
+    ASSERT_EQ(1U, mWriter->write(events, 1));
+    EXPECT_TRUE(isReadable(mReader->getFd()));
+    ASSERT_EQ(1, mReader->read(received, 1));
+    EXPECT_TRUE(isReadable(mReader->getFd())); // the reader has not seen the ring empty yet
+    EXPECT_EQ(ssize_t(WOULD_BLOCK), mReader->read(received, 1));
+    EXPECT_FALSE(isReadable(mReader->getFd()));
+}
+
+TEST_F(SensorEventRingTest, ConcurrentWriterAndReader_LoseNoEvents) {
+    const int32_t eventCount = 200000;
+    std::thread writer([this, eventCount]() {
+        ASensorEvent events[7];
+        int32_t sequence = 0;
+        while (sequence < eventCount) {
+            size_t count = 0;
+            while (count < 7 && sequence + int32_t(count) < eventCount) {
+                events[count] = makeEvent(sequence + int32_t(count));
+                count++;
+            }
+            // Retry the events that did not fit, the reader catches up.
+            sequence += int32_t(mWriter->write(events, count));
+        }
+    });
+
+    ASensorEvent received[5];
+    int32_t expected = 0;
+    while (expected < eventCount) {
+        struct pollfd pfd = { mReader->getFd(), POLLIN, 0 };
+        ASSERT_EQ(1, poll(&pfd, 1, 5000)) << "reader was not woken, next=" << expected;
+        ssize_t n = mReader->read(received, 5);
+        if (n == WOULD_BLOCK) {
+            continue;
+        }
+        ASSERT_GT(n, 0);
+        for (ssize_t i = 0; i < n; i++) {
+            ASSERT_EQ(expected++, received[i].timestamp);
+        }
+    }
+    writer.join();
+}
+
+} // namespace android
@@ -53,6 +53,14 @@ enum {
     direction_RTL
 };
 
+// results of Region::trivial_operation()
+enum {
+    result_full,
+    result_empty,
+    result_lhs,
+    result_rhs
+};
+
 const Region Region::INVALID_REGION(Rect::INVALID_RECT);
 
 // ----------------------------------------------------------------------------
@@ -231,14 +239,93 @@ bool Region::contains(const Point& point) const {
     return contains(point.x, point.y);
 }
 
+/*
+ * The rects of a region are sorted in bands: all the rects of a band share
+ * the same top and bottom, bands don't overlap vertically, and the rects
+ * within a band are sorted left to right. Bottoms are therefore
+ * non-decreasing across the whole array, which lets the array itself be
+ * binary searched as a band index.
+ */
+
+// returns the first rect in [first, last) whose bottom is below y, that is
+// the first rect of the band containing y, or of the band after it.
+static Region::const_iterator findBand(Region::const_iterator first,
+        Region::const_iterator last, int y) {
+    while (first != last) {
+        Region::const_iterator mid = first + (last - first) / 2;
+        if (mid->bottom <= y) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+// returns the end of the band starting at first.
+static Region::const_iterator findBandEnd(Region::const_iterator first,
+        Region::const_iterator last) {
+    const int top = first->top;
+    while (first != last) {
+        Region::const_iterator mid = first + (last - first) / 2;
+        if (mid->top <= top) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+// returns the first rect in the band [first, last) whose right edge is past x.
+static Region::const_iterator findInBand(Region::const_iterator first,
+        Region::const_iterator last, int x) {
+    while (first != last) {
+        Region::const_iterator mid = first + (last - first) / 2;
+        if (mid->right <= x) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
 bool Region::contains(int x, int y) const {
-    const_iterator cur = begin();
+    const Rect bounds(getBounds());
+    if (x < bounds.left || x >= bounds.right || y < bounds.top || y >= bounds.bottom) {
+        return false;
+    }
+    if (isRect()) {
+        return true;
+    }
     const_iterator const tail = end();
-    while (cur != tail) {
-        if (y >= cur->top && y < cur->bottom && x >= cur->left && x < cur->right) {
+    const_iterator band = findBand(begin(), tail, y);
+    if (band == tail || y < band->top) {
+        return false;
+    }
+    const_iterator const bandEnd = findBandEnd(band, tail);
+    const_iterator cur = findInBand(band, bandEnd, x);
+    return cur != bandEnd && x >= cur->left;
+}
+
+bool Region::intersects(const Rect& rect) const {
+    Rect overlap;
+    if (!getBounds().intersect(rect, &overlap)) {
+        return false;
+    }
+    if (isRect()) {
+        return true;
+    }
+    const_iterator const tail = end();
+    const_iterator band = findBand(begin(), tail, overlap.top);
+    while (band != tail && band->top < overlap.bottom) {
+        const_iterator const bandEnd = findBandEnd(band, tail);
+        const_iterator cur = findInBand(band, bandEnd, overlap.left);
+        if (cur != bandEnd && cur->left < overlap.right) {
             return true;
         }
-        cur++;
+        band = bandEnd;
     }
     return false;
 }
@@ -583,6 +670,53 @@ bool Region::validate(const Region& reg, const char* name, bool silent)
     return result;
 }
 
+/*
+ * Most boolean operations SurfaceFlinger does per layer and per frame are
+ * trivial: the operands don't overlap, one of them is empty, or a rect
+ * covers the other operand entirely. The result is then empty or one of
+ * the operands, and can be produced by sharing its storage instead of
+ * running the rasterizer. Operands with invalid bounds, such as
+ * INVALID_REGION, always take the full path.
+ */
+int Region::trivial_operation(uint32_t op, const Region& lhs,
+        const Rect& rhsBounds, bool rhsIsRect)
+{
+    const Rect lhsBounds(lhs.getBounds());
+    if (!lhsBounds.isValid() || !rhsBounds.isValid()) {
+        return result_full;
+    }
+    const bool lhsEmpty = lhsBounds.isEmpty();
+    const bool rhsEmpty = rhsBounds.isEmpty();
+    Rect overlap;
+    const bool disjoint = !lhsBounds.intersect(rhsBounds, &overlap);
+    const bool rhsCoversLhs = rhsIsRect && overlap == lhsBounds;
+    const bool lhsCoversRhs = lhs.isRect() && overlap == rhsBounds;
+
+    switch (op) {
+        case op_and:
+            if (disjoint) return result_empty;
+            if (rhsCoversLhs) return result_lhs;
+            if (lhsCoversRhs) return result_rhs;
+            break;
+        case op_nand:
+            if (lhsEmpty) return result_empty;
+            if (disjoint) return result_lhs;
+            if (rhsCoversLhs) return result_empty;
+            break;
+        case op_or:
+            if (rhsEmpty) return lhsEmpty ? result_empty : result_lhs;
+            if (lhsEmpty) return result_rhs;
+            if (rhsCoversLhs) return result_rhs;
+            if (lhsCoversRhs) return result_lhs;
+            break;
+        case op_xor:
+            if (rhsEmpty) return lhsEmpty ? result_empty : result_lhs;
+            if (lhsEmpty) return result_rhs;
+            break;
+    }
+    return result_full;
+}
+
 void Region::boolean_operation(uint32_t op, Region& dst,
         const Region& lhs,
         const Region& rhs, int dx, int dy)
@@ -593,6 +727,22 @@ void Region::boolean_operation(uint32_t op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !VALIDATE_WITH_CORECG
+    Rect rhsBounds(rhs.getBounds());
+    rhsBounds.offsetBy(dx, dy);
+    switch (trivial_operation(op, lhs, rhsBounds, rhs.isRect())) {
+        case result_empty:
+            dst.clear();
+            return;
+        case result_lhs:
+            dst = lhs;
+            return;
+        case result_rhs:
+            translate(dst, rhs, dx, dy);
+            return;
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -708,6 +858,20 @@ void Region::boolean_operation(uint32_t op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    Rect rhsBounds(rhs);
+    rhsBounds.offsetBy(dx, dy);
+    switch (trivial_operation(op, lhs, rhsBounds, true)) {
+        case result_empty:
+            dst.clear();
+            return;
+        case result_lhs:
+            dst = lhs;
+            return;
+        case result_rhs:
+            dst.set(rhsBounds);
+            return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -51,9 +51,15 @@ public:
     inline  Rect        getBounds() const   { return mStorage[mStorage.size() - 1]; }
     inline  Rect        bounds() const      { return getBounds(); }
 
+            // hit tests binary search the bands, so they are O(log n) in
+            // the number of rects and never allocate.
             bool        contains(const Point& point) const;
             bool        contains(int x, int y) const;
 
+            // returns true if the region and the rect overlap. This is much
+            // cheaper than !intersect(rect).isEmpty().
+            bool        intersects(const Rect& rect) const;
+
             // the region becomes its bounds
             Region&     makeBoundsSelf();
 
@@ -154,6 +160,9 @@ private:
     const Region operation(const Region& rhs, uint32_t op) const;
     const Region operation(const Region& rhs, int dx, int dy, uint32_t op) const;
 
+    static int trivial_operation(uint32_t op, const Region& lhs,
+            const Rect& rhsBounds, bool rhsIsRect);
+
     static void boolean_operation(uint32_t op, Region& dst,
             const Region& lhs, const Region& rhs, int dx, int dy);
     static void boolean_operation(uint32_t op, Region& dst,
@@ -174,6 +183,8 @@ private:
     // with an extra Rect as the last element which is set to the
     // bounds of the region. However, if the region is
     // a simple Rect then mStorage contains only that rect.
+    // The array is shared between copies until one of them is modified,
+    // which boolean operations with a trivial result preserve.
     Vector<Rect> mStorage;
 };
 
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures Region hit tests and boolean operations on region shapes that
+// SurfaceFlinger sees every frame.
+//
+// usage: Region_benchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+namespace {
+
+const int kWidth = 1440;
+const int kHeight = 2560;
+
+// A soft keyboard: rows of keys with gaps between them.
+Region makeKeyboard() {
+    Region r;
+    const int top = kHeight - 1000;
+    for (int row = 0; row < 5; row++) {
+        int keys = row == 4 ? 5 : 10;
+        int keyWidth = kWidth / keys;
+        for (int key = 0; key < keys; key++) {
+            int left = key * keyWidth + 8;
+            int y = top + row * 200 + 12;
+            r.orSelf(Rect(left, y, left + keyWidth - 16, y + 176));
+        }
+    }
+    return r;
+}
+
+// A stack of notifications with rounded corners, approximated by stair
+// steps the way a rasterized corner would be.
+Region makeNotifications() {
+    Region r;
+    const int radius = 32;
+    for (int card = 0; card < 6; card++) {
+        int top = 200 + card * 320;
+        int bottom = top + 300;
+        r.orSelf(Rect(24, top + radius, kWidth - 24, bottom - radius));
+        for (int step = 0; step < radius; step += 2) {
+            int inset = radius - step;
+            inset = inset * inset / radius;
+            r.orSelf(Rect(24 + inset, top + step, kWidth - 24 - inset, top + step + 2));
+            r.orSelf(Rect(24 + inset, bottom - step - 2, kWidth - 24 - inset, bottom - step));
+        }
+    }
+    return r;
+}
+
+// Scattered damage, like a frame where several small views redrew.
+Region makeScatteredDamage() {
+    Region r;
+    srandom(42);
+    for (int i = 0; i < 64; i++) {
+        int x = random() % (kWidth - 200);
+        int y = random() % (kHeight - 200);
+        r.orSelf(Rect(x, y, x + 20 + random() % 180, y + 20 + random() % 180));
+    }
+    return r;
+}
+
+// The original linear hit test, for comparison.
+bool linearContains(const Region& region, int x, int y) {
+    for (const Rect& r : region) {
+        if (y >= r.top && y < r.bottom && x >= r.left && x < r.right) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void report(const char* shape, const char* what, nsecs_t elapsed, int count) {
+    printf("  %-14s %-28s %10.1f ns/op\n", shape, what, double(elapsed) / count);
+}
+
+volatile int gSink;
+
+void benchmarkShape(const char* name, const Region& region, int iterations) {
+    size_t rects = 0;
+    region.getArray(&rects);
+    printf("%s: %zu rects\n", name, rects);
+
+    const int kGrid = 64;
+    const int probes = iterations * kGrid * kGrid;
+    int hits = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; i++) {
+        for (int gy = 0; gy < kGrid; gy++) {
+            for (int gx = 0; gx < kGrid; gx++) {
+                hits += linearContains(region, gx * kWidth / kGrid, gy * kHeight / kGrid);
+            }
+        }
+    }
+    report(name, "contains (linear scan)", systemTime() - start, probes);
+
+    start = systemTime();
+    for (int i = 0; i < iterations; i++) {
+        for (int gy = 0; gy < kGrid; gy++) {
+            for (int gx = 0; gx < kGrid; gx++) {
+                hits += region.contains(gx * kWidth / kGrid, gy * kHeight / kGrid);
+            }
+        }
+    }
+    report(name, "contains", systemTime() - start, probes);
+
+    const Rect probe(kWidth / 3, kHeight / 3, kWidth / 3 + 64, kHeight / 3 + 64);
+    start = systemTime();
+    for (int i = 0; i < iterations * 100; i++) {
+        hits += !region.intersect(probe).isEmpty();
+    }
+    report(name, "!intersect(rect).isEmpty()", systemTime() - start, iterations * 100);
+
+    start = systemTime();
+    for (int i = 0; i < iterations * 100; i++) {
+        hits += region.intersects(probe);
+    }
+    report(name, "intersects(rect)", systemTime() - start, iterations * 100);
+
+    // What SurfaceFlinger does per layer in computeVisibleRegions().
+    const Rect screen(kWidth, kHeight);
+    const Region opaqueAbove(Rect(0, 0, kWidth, 160));
+    Region dirty;
+    start = systemTime();
+    for (int i = 0; i < iterations * 10; i++) {
+        Region visible(region);
+        visible.andSelf(screen);
+        Region covered = visible.intersect(opaqueAbove);
+        visible.subtractSelf(opaqueAbove);
+        dirty.orSelf(visible.subtract(covered));
+        hits += visible.isEmpty();
+    }
+    report(name, "visible region pass", systemTime() - start, iterations * 10);
+
+    const Region damage(makeScatteredDamage());
+    start = systemTime();
+    for (int i = 0; i < iterations * 10; i++) {
+        hits += region.merge(damage).isRect();
+    }
+    report(name, "merge with scattered damage", systemTime() - start, iterations * 10);
+
+    gSink = hits;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    benchmarkShape("fullscreen", Region(Rect(kWidth, kHeight)), iterations);
+    benchmarkShape("keyboard", makeKeyboard(), iterations);
+    benchmarkShape("notifications", makeNotifications(), iterations);
+    benchmarkShape("damage", makeScatteredDamage(), iterations);
+    return 0;
+}
@@ -152,5 +152,103 @@ TEST_F(RegionTest, Random_TJunction) {
     }
 }
 
+TEST_F(RegionTest, Contains) {
+    Region r;
+    EXPECT_FALSE(r.contains(0, 0));
+
+    // |xx  xx|
+    // |  xx  |
+    r.orSelf(Rect(0, 0, 2, 1));
+    r.orSelf(Rect(4, 0, 6, 1));
+    r.orSelf(Rect(2, 1, 4, 2));
+    for (int y = -1; y < 3; y++) {
+        for (int x = -1; x < 7; x++) {
+            bool expected = (y == 0 && ((x >= 0 && x < 2) || (x >= 4 && x < 6))) ||
+                    (y == 1 && x >= 2 && x < 4);
+            EXPECT_EQ(expected, r.contains(x, y)) << x << "," << y;
+            EXPECT_EQ(expected, r.contains(Point(x, y)));
+        }
+    }
+}
+
+TEST_F(RegionTest, Random_Contains) {
+    Region r;
+    srandom(4321);
+
+    for (int iter = 0; iter < ITER_MAX; iter++) {
+        r.clear();
+        for (int i = 0; i < 16; i++) {
+            int x = random() % (4 * X_MAX);
+            int y = random() % (4 * Y_MAX);
+            r.xorSelf(Rect(x, y, x + 1 + random() % X_MAX, y + 1 + random() % Y_MAX));
+        }
+        for (int y = -1; y <= 5 * Y_MAX; y++) {
+            for (int x = -1; x <= 5 * X_MAX; x++) {
+                bool expected = false;
+                for (const Rect& rect : r) {
+                    expected |= x >= rect.left && x < rect.right &&
+                            y >= rect.top && y < rect.bottom;
+                }
+                ASSERT_EQ(expected, r.contains(x, y)) << x << "," << y;
+            }
+        }
+    }
+}
+
+TEST_F(RegionTest, Random_Intersects) {
+    Region r;
+    srandom(5678);
+
+    for (int iter = 0; iter < ITER_MAX; iter++) {
+        r.clear();
+        for (int i = 0; i < 16; i++) {
+            int x = random() % (4 * X_MAX);
+            int y = random() % (4 * Y_MAX);
+            r.xorSelf(Rect(x, y, x + 1 + random() % X_MAX, y + 1 + random() % Y_MAX));
+        }
+        for (int i = 0; i < 64; i++) {
+            int x = random() % (5 * X_MAX) - 4;
+            int y = random() % (5 * Y_MAX) - 4;
+            Rect rect(x, y, x + random() % 6, y + random() % 6);
+            ASSERT_EQ(!r.intersect(rect).isEmpty(), r.intersects(rect));
+        }
+    }
+
+    EXPECT_FALSE(Region().intersects(Rect(0, 0, 10, 10)));
+    EXPECT_FALSE(Region(Rect(0, 0, 10, 10)).intersects(Rect(10, 0, 20, 10)));
+    EXPECT_TRUE(Region(Rect(0, 0, 10, 10)).intersects(Rect(9, 9, 20, 20)));
+}
+
+TEST_F(RegionTest, TrivialOperationsShareStorage) {
+    Region r(Rect(0, 0, 10, 10));
+    r.orSelf(Rect(20, 20, 30, 30));
+
+    // the result is one of the operands
+    EXPECT_TRUE(r.isTriviallyEqual(r.subtract(Rect(40, 40, 50, 50))));
+    EXPECT_TRUE(r.isTriviallyEqual(r.intersect(Rect(0, 0, 30, 30))));
+    EXPECT_TRUE(r.isTriviallyEqual(r.merge(Region())));
+    EXPECT_TRUE(r.isTriviallyEqual(Region().merge(r)));
+
+    // the result is empty
+    EXPECT_TRUE(r.intersect(Rect(40, 40, 50, 50)).isEmpty());
+    EXPECT_TRUE(r.subtract(Rect(0, 0, 30, 30)).isEmpty());
+
+    // copies share storage until one of them changes
+    Region copy(r);
+    EXPECT_TRUE(copy.isTriviallyEqual(r));
+    copy.subtractSelf(Rect(100, 100, 200, 200));
+    EXPECT_TRUE(copy.isTriviallyEqual(r));
+    copy.subtractSelf(Rect(0, 0, 5, 5));
+    EXPECT_FALSE(copy.isTriviallyEqual(r));
+    EXPECT_TRUE(r.contains(0, 0));
+    EXPECT_FALSE(copy.contains(0, 0));
+
+    // translated operands
+    Region moved = Region().merge(r, 5, 5);
+    EXPECT_TRUE(moved.contains(5, 5));
+    EXPECT_FALSE(moved.contains(0, 0));
+    EXPECT_TRUE((moved ^ (r + Point(5, 5))).isEmpty());
+}
+
 }; // namespace android
 
@@ -79,6 +79,25 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride);
 
+// Same as etc1_encode_image, but the image is split into bands of block rows
+// that are encoded on up to threadCount threads. A threadCount of 0 uses one
+// thread per online CPU. The output is identical to etc1_encode_image.
+// returns non-zero if there is an error.
+
+int etc1_encode_image_parallel(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        etc1_uint32 threadCount);
+
+// Same as etc1_decode_image, but the image is split into bands of block rows
+// that are decoded on up to threadCount threads. A threadCount of 0 uses one
+// thread per online CPU. The output is identical to etc1_decode_image.
+// returns non-zero if there is an error.
+
+int etc1_decode_image_parallel(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_uint32 threadCount);
+
 // Size of a PKM header, in bytes.
 
 #define ETC_PKM_HEADER_SIZE 16
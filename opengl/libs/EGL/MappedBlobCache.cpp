@@ -0,0 +1,701 @@
+/*
+ ** Copyright 2017, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+
+#include "MappedBlobCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+
+namespace android {
+
+// MappedBlobCache::FileHeader::mMagicNumber value
+static const uint32_t fileMagic = ('_' << 24) + ('B' << 16) + ('l' << 8) + 'g';
+
+// MappedBlobCache::FileHeader::mVersion value
+static const uint32_t fileVersion = 2;
+
+// MappedBlobCache::FileHeader::mDeviceVersion value
+static const uint32_t fileDeviceVersion = 1;
+
+// MappedBlobCache::RecordHeader::mMagicNumber value
+static const uint32_t recordMagic = ('_' << 24) + ('R' << 16) + ('e' << 8) + 'c';
+
+static inline size_t align4(size_t size) {
+    return (size + 3) & ~3;
+}
+
+// Table-driven CRC32C, compatible with the bitwise version egl_cache used to
+// checksum whole cache files.
+static uint32_t crc32c(const uint8_t* buf, size_t len) {
+    struct Table {
+        uint32_t mEntries[256];
+        Table() {
+            const uint32_t polyBits = 0x82F63B78;
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t r = i;
+                for (int j = 0; j < 8; j++) {
+                    r = (r & 1) ? (r >> 1) ^ polyBits : r >> 1;
+                }
+                mEntries[i] = r;
+            }
+        }
+    };
+    static const Table table;
+
+    uint32_t r = 0;
+    for (size_t i = 0; i < len; i++) {
+        r = table.mEntries[(r ^ buf[i]) & 0xff] ^ (r >> 8);
+    }
+    return r;
+}
+
+// A FileLock holds an exclusive flock() on a file for as long as it exists.
+class FileLock {
+public:
+    explicit FileLock(int fd): mFd(fd), mError(0) {
+        if (TEMP_FAILURE_RETRY(flock(mFd, LOCK_EX)) == -1) {
+            mError = -errno;
+            ALOGE("error locking cache file: %s (%d)", strerror(errno), errno);
+        }
+    }
+    ~FileLock() {
+        if (mError == 0) {
+            flock(mFd, LOCK_UN);
+        }
+    }
+
+    // getError returns 0 if the lock is held, or a negative errno value.
+    int getError() const {
+        return mError;
+    }
+
+private:
+    FileLock(const FileLock&);
+    void operator=(const FileLock&);
+
+    const int mFd;
+    int mError;
+};
+
+MappedBlobCache::MappedBlobCache(size_t maxKeySize, size_t maxValueSize,
+        size_t maxTotalSize):
+        mMaxKeySize(maxKeySize),
+        mMaxValueSize(maxValueSize),
+        mMaxTotalSize(maxTotalSize),
+        mTotalSize(0),
+        mLockFd(-1),
+        mMapping(NULL),
+        mMappingSize(0),
+        mGeneration(0),
+        mDirty(false),
+        mNeedsRewrite(false) {
+    static_assert(sizeof(FileHeader::mBuildId) >= PROPERTY_VALUE_MAX,
+            "FileHeader::mBuildId cannot hold a property value");
+}
+
+MappedBlobCache::~MappedBlobCache() {
+    clear();
+}
+
+int MappedBlobCache::open(const std::string& filename) {
+    clear();
+    std::string lockName = filename + ".lock";
+    int lockFd = ::open(lockName.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (lockFd == -1) {
+        int err = -errno;
+        ALOGE("error opening cache lock file %s: %s (%d)", lockName.c_str(),
+                strerror(errno), errno);
+        return err;
+    }
+    mFilename = filename;
+    mLockFd = lockFd;
+
+    {
+        FileLock lock(mLockFd);
+        if (lock.getError() != 0) {
+            int err = lock.getError();
+            clear();
+            return err;
+        }
+        loadLocked();
+    }
+
+    while (mTotalSize > mMaxTotalSize) {
+        evict(std::prev(mLru.end()));
+    }
+
+    ALOGV("open: loaded %zu entries (%zu bytes) from %s", mLru.size(), mTotalSize,
+            mFilename.c_str());
+    return 0;
+}
+
+void MappedBlobCache::set(const void* key, size_t keySize, const void* value,
+        size_t valueSize) {
+    if (mMaxKeySize < keySize) {
+        ALOGV("set: not caching because the key is too large: %zu (limit: %zu)",
+                keySize, mMaxKeySize);
+        return;
+    }
+    if (mMaxValueSize < valueSize) {
+        ALOGV("set: not caching because the value is too large: %zu (limit: %zu)",
+                valueSize, mMaxValueSize);
+        return;
+    }
+    if (mMaxTotalSize < keySize + valueSize) {
+        ALOGV("set: not caching because the combined key/value size is too "
+                "large: %zu (limit: %zu)", keySize + valueSize, mMaxTotalSize);
+        return;
+    }
+    if (keySize == 0) {
+        ALOGW("set: not caching because keySize is 0");
+        return;
+    }
+    if (valueSize == 0) {
+        ALOGW("set: not caching because valueSize is 0");
+        return;
+    }
+
+    KeyRef ref = { static_cast<const uint8_t*>(key), keySize };
+    auto found = mIndex.find(ref);
+    if (found != mIndex.end()) {
+        remove(found->second);
+    }
+
+    while (mTotalSize + keySize + valueSize > mMaxTotalSize) {
+        evict(std::prev(mLru.end()));
+    }
+
+    Entry entry;
+    entry.mStorage.reset(new uint8_t[keySize + valueSize]);
+    memcpy(entry.mStorage.get(), key, keySize);
+    memcpy(entry.mStorage.get() + keySize, value, valueSize);
+    entry.mData = entry.mStorage.get();
+    entry.mKeySize = keySize;
+    entry.mValueSize = valueSize;
+    entry.mCrc = crc32c(entry.mData, keySize + valueSize);
+    entry.mVerified = true;
+
+    insert(std::move(entry));
+    mDirty = true;
+    ALOGV("set: cached %zu byte key and %zu byte value", keySize, valueSize);
+}
+
+size_t MappedBlobCache::get(const void* key, size_t keySize, void* value,
+        size_t valueSize) {
+    if (mMaxKeySize < keySize) {
+        ALOGV("get: not searching because the key is too large: %zu (limit %zu)",
+                keySize, mMaxKeySize);
+        return 0;
+    }
+    KeyRef ref = { static_cast<const uint8_t*>(key), keySize };
+    auto found = mIndex.find(ref);
+    if (found == mIndex.end()) {
+        ALOGV("get: no cache entry found for key of size %zu", keySize);
+        return 0;
+    }
+
+    LruList::iterator it = found->second;
+    if (!it->mVerified) {
+        if (crc32c(it->mData, it->mKeySize + it->mValueSize) != it->mCrc) {
+            ALOGE("get: dropping cache entry that failed its CRC check");
+            evict(it);
+            mDirty = true;
+            mNeedsRewrite = true;
+            return 0;
+        }
+        it->mVerified = true;
+    }
+    mLru.splice(mLru.begin(), mLru, it);
+
+    // The key was found. Return the value if the caller's buffer is large
+    // enough.
+    size_t valueBlobSize = it->mValueSize;
+    if (valueBlobSize <= valueSize) {
+        ALOGV("get: copying %zu bytes to caller's buffer", valueBlobSize);
+        memcpy(value, it->mData + it->mKeySize, valueBlobSize);
+    } else {
+        ALOGV("get: caller's buffer is too small for value: %zu (needs %zu)",
+                valueSize, valueBlobSize);
+    }
+    return valueBlobSize;
+}
+
+int MappedBlobCache::sync() {
+    if (mLockFd == -1 || !mDirty) {
+        return 0;
+    }
+    FileLock lock(mLockFd);
+    if (lock.getError() != 0) {
+        return lock.getError();
+    }
+
+    size_t fileSize = 0;
+    uint32_t generation = readGenerationLocked(&fileSize);
+    if (generation != 0 && (generation != mGeneration || fileSize != mMappingSize)) {
+        // Another process has replaced the file or appended to it since it
+        // was mapped.  The file holds the entries of the mapped one that it
+        // kept, so only the entries set since the last sync are carried over
+        // onto it, as the most recently used ones.
+        ALOGV("sync: merging generation %u of the cache file (%zu bytes)", generation,
+                fileSize);
+        LruList pending;
+        for (auto it = mLru.begin(); it != mLru.end();) {
+            auto next = std::next(it);
+            if (it->mStorage != nullptr) {
+                pending.splice(pending.end(), mLru, it);
+            } else {
+                remove(it);
+            }
+            it = next;
+        }
+        unmap();
+        loadLocked();
+        mLru.splice(mLru.begin(), pending);
+        while (mTotalSize > mMaxTotalSize) {
+            evict(std::prev(mLru.end()));
+        }
+    }
+
+    // Dead records are only dropped when the file is replaced, so it is
+    // compacted once they would take more room than the live entries.
+    if (mNeedsRewrite || generation == 0 || mMapping == NULL) {
+        return writeLocked();
+    }
+    size_t appendSize = 0;
+    for (const Entry& entry : mLru) {
+        if (entry.mStorage != nullptr) {
+            appendSize += align4(sizeof(RecordHeader) + entry.mKeySize + entry.mValueSize);
+        }
+    }
+    if (mMappingSize + appendSize > 2 * getFileSize()) {
+        return writeLocked();
+    }
+    return appendLocked();
+}
+
+size_t MappedBlobCache::getTotalSize() const {
+    return mTotalSize;
+}
+
+size_t MappedBlobCache::getEntryCount() const {
+    return mLru.size();
+}
+
+size_t MappedBlobCache::getFileSize() const {
+    size_t fileSize = sizeof(FileHeader);
+    for (const Entry& entry : mLru) {
+        fileSize += align4(sizeof(RecordHeader) + entry.mKeySize + entry.mValueSize);
+    }
+    return fileSize;
+}
+
+void MappedBlobCache::insert(Entry&& entry) {
+    KeyRef ref = { entry.mData, entry.mKeySize };
+    auto found = mIndex.find(ref);
+    if (found != mIndex.end()) {
+        remove(found->second);
+    }
+
+    mTotalSize += entry.mKeySize + entry.mValueSize;
+    mLru.push_front(std::move(entry));
+    const Entry& front = mLru.front();
+    KeyRef frontRef = { front.mData, front.mKeySize };
+    mIndex.emplace(frontRef, mLru.begin());
+}
+
+void MappedBlobCache::remove(LruList::iterator it) {
+    KeyRef ref = { it->mData, it->mKeySize };
+    mIndex.erase(ref);
+    mTotalSize -= it->mKeySize + it->mValueSize;
+    mLru.erase(it);
+}
+
+void MappedBlobCache::evict(LruList::iterator it) {
+    remove(it);
+}
+
+void MappedBlobCache::appendRecord(std::vector<uint8_t>* log, const void* key,
+        size_t keySize, const void* value, size_t valueSize, uint32_t crc) {
+    size_t offset = log->size();
+    size_t entrySize = sizeof(RecordHeader) + keySize + valueSize;
+    // Zero-filled, so the padding bytes are reproducible.
+    log->resize(offset + align4(entrySize), 0);
+
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(log->data() + offset);
+    header->mMagicNumber = recordMagic;
+    header->mFlags = 0;
+    header->mKeySize = keySize;
+    header->mValueSize = valueSize;
+    header->mCrc = crc;
+    memcpy(header->mData, key, keySize);
+    memcpy(header->mData + keySize, value, valueSize);
+}
+
+void MappedBlobCache::loadLocked() {
+    // Whatever goes wrong, the next sync replaces the file.
+    const char* fname = mFilename.c_str();
+    int fd = ::open(fname, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", fname, strerror(errno), errno);
+            mDirty = true;
+            mNeedsRewrite = true;
+        }
+        return;
+    }
+
+    FileHeader header;
+    struct stat statBuf;
+    size_t fileSize = 0;
+    uint8_t* mapping = NULL;
+    if (fstat(fd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
+    } else if (size_t(statBuf.st_size) > getMaxFileSize()) {
+        // Sanity check the size before trying to mmap it.
+        ALOGE("cache file is too large: %zu", size_t(statBuf.st_size));
+    } else if (TEMP_FAILURE_RETRY(pread(fd, &header, sizeof(header), 0)) !=
+            ssize_t(sizeof(header)) || !isHeaderValid(header)) {
+        // We treat version mismatches, and caches in the old whole-file
+        // format, as an empty cache.
+        ALOGV("load: discarding stale cache file %s", fname);
+    } else {
+        fileSize = statBuf.st_size;
+        mapping = mapFile(fd, fileSize);
+    }
+    close(fd);
+    if (mapping == NULL) {
+        mDirty = true;
+        mNeedsRewrite = true;
+        return;
+    }
+
+    // Files are only replaced or appended to under the lock, but check that
+    // the mapping holds the version that was read before trusting it.
+    if (memcmp(mapping, &header, sizeof(header)) != 0) {
+        ALOGE("cache file %s changed while it was being mapped", fname);
+        munmap(mapping, fileSize);
+        mDirty = true;
+        mNeedsRewrite = true;
+        return;
+    }
+    mMapping = mapping;
+    mMappingSize = fileSize;
+    mGeneration = header.mGeneration;
+
+    size_t end = indexMapping();
+    if (end < fileSize) {
+        ALOGW("cache file %s: ignoring %zu bytes after the last valid record",
+                fname, fileSize - end);
+        mDirty = true;
+        mNeedsRewrite = true;
+    }
+}
+
+size_t MappedBlobCache::indexMapping() {
+    size_t offset = sizeof(FileHeader);
+    while (mMappingSize - offset >= sizeof(RecordHeader)) {
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>(
+                mMapping + offset);
+        if (header->mMagicNumber != recordMagic || header->mFlags != 0) {
+            break;
+        }
+        size_t keySize = header->mKeySize;
+        size_t valueSize = header->mValueSize;
+        if (keySize == 0 || keySize > mMaxKeySize || valueSize == 0 ||
+                valueSize > mMaxValueSize) {
+            break;
+        }
+        size_t recordSize = align4(sizeof(RecordHeader) + keySize + valueSize);
+        if (recordSize > mMappingSize - offset) {
+            break;
+        }
+
+        // Entries set since the last sync are newer than the file's.  A later
+        // record for the same key replaces an earlier one.
+        KeyRef ref = { header->mData, keySize };
+        auto found = mIndex.find(ref);
+        if (found == mIndex.end() || found->second->mStorage == nullptr) {
+            Entry entry;
+            entry.mData = header->mData;
+            entry.mKeySize = keySize;
+            entry.mValueSize = valueSize;
+            entry.mCrc = header->mCrc;
+            entry.mVerified = false;
+            insert(std::move(entry));
+        }
+
+        offset += recordSize;
+    }
+    return offset;
+}
+
+uint32_t MappedBlobCache::readGenerationLocked(size_t* outFileSize) const {
+    int fd = ::open(mFilename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    FileHeader header;
+    struct stat statBuf;
+    ssize_t size = TEMP_FAILURE_RETRY(pread(fd, &header, sizeof(header), 0));
+    int statResult = fstat(fd, &statBuf);
+    close(fd);
+    if (size != ssize_t(sizeof(header)) || !isHeaderValid(header) || statResult == -1) {
+        return 0;
+    }
+    *outFileSize = statBuf.st_size;
+    return header.mGeneration;
+}
+
+int MappedBlobCache::appendLocked() {
+    // Append the new entries least recently used first, after the records
+    // of the mapped file.
+    std::vector<uint8_t> log;
+    std::vector<size_t> offsets;
+    for (auto it = mLru.rbegin(); it != mLru.rend(); ++it) {
+        if (it->mStorage != nullptr) {
+            offsets.push_back(mMappingSize + log.size());
+            appendRecord(&log, it->mData, it->mKeySize, it->mData + it->mKeySize,
+                    it->mValueSize, it->mCrc);
+        } else {
+            offsets.push_back(it->mData - mMapping - offsetof(RecordHeader, mData));
+        }
+    }
+    if (log.empty()) {
+        mDirty = false;
+        return 0;
+    }
+
+    const char* fname = mFilename.c_str();
+    int fd = ::open(fname, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        int err = -errno;
+        ALOGE("error opening cache file %s: %s (%d)", fname, strerror(errno), errno);
+        return err;
+    }
+    const uint8_t* data = log.data();
+    size_t remaining = log.size();
+    off_t offset = mMappingSize;
+    while (remaining > 0) {
+        ssize_t written = pwrite(fd, data, remaining, offset);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // A partial record is ignored by readers, and makes the next
+            // sync replace the file.
+            int err = -errno;
+            ALOGE("error appending to cache file %s: %s (%d)", fname, strerror(errno), errno);
+            close(fd);
+            mNeedsRewrite = true;
+            return err;
+        }
+        data += written;
+        remaining -= written;
+        offset += written;
+    }
+
+    size_t fileSize = mMappingSize + log.size();
+    uint8_t* mapping = mapFile(fd, fileSize);
+    close(fd);
+    mDirty = false;
+    if (mapping == NULL) {
+        // The entries keep being served from the old mapping and the heap.
+        return -ENOMEM;
+    }
+    if (memcmp(mapping, mMapping, sizeof(FileHeader)) != 0) {
+        ALOGE("cache file %s changed while it was being mapped", fname);
+        munmap(mapping, fileSize);
+        return -EIO;
+    }
+
+    adoptMapping(mapping, fileSize, offsets);
+    ALOGV("sync: appended %zu bytes, file is %zu bytes", log.size(), mMappingSize);
+    return 0;
+}
+
+int MappedBlobCache::writeLocked() {
+    std::string tmpName = mFilename + ".tmp";
+    const char* fname = tmpName.c_str();
+    uint32_t generation = mGeneration + 1;
+    if (generation == 0) {
+        generation = 1;
+    }
+
+    // Write the live entries least recently used first, so that reloading
+    // the file reproduces the current LRU order.
+    std::vector<uint8_t> log;
+    std::vector<size_t> offsets;
+    log.resize(sizeof(FileHeader));
+    fillFileHeader(reinterpret_cast<FileHeader*>(log.data()), generation);
+    for (auto it = mLru.rbegin(); it != mLru.rend(); ++it) {
+        offsets.push_back(log.size());
+        appendRecord(&log, it->mData, it->mKeySize, it->mData + it->mKeySize,
+                it->mValueSize, it->mCrc);
+    }
+
+    unlink(fname);
+    int fd = ::open(fname, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        int err = -errno;
+        ALOGE("error creating cache file %s: %s (%d)", fname, strerror(errno), errno);
+        return err;
+    }
+    const uint8_t* data = log.data();
+    size_t remaining = log.size();
+    int err = 0;
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = -errno;
+            break;
+        }
+        data += written;
+        remaining -= written;
+    }
+    if (err == 0 && rename(fname, mFilename.c_str()) == -1) {
+        err = -errno;
+    }
+    if (err != 0) {
+        ALOGE("error writing cache file: %s (%d)", strerror(-err), -err);
+        close(fd);
+        unlink(fname);
+        return err;
+    }
+
+    uint8_t* mapping = mapFile(fd, log.size());
+    close(fd);
+    mGeneration = generation;
+    mDirty = false;
+    mNeedsRewrite = false;
+    if (mapping == NULL) {
+        // The entries keep being served from the old mapping and the heap.
+        return -ENOMEM;
+    }
+    if (memcmp(mapping, log.data(), sizeof(FileHeader)) != 0) {
+        ALOGE("cache file %s changed while it was being mapped", mFilename.c_str());
+        munmap(mapping, log.size());
+        return -EIO;
+    }
+
+    adoptMapping(mapping, log.size(), offsets);
+    ALOGV("sync: wrote %zu entries in %zu bytes, generation %u", mLru.size(),
+            mMappingSize, mGeneration);
+    return 0;
+}
+
+void MappedBlobCache::adoptMapping(uint8_t* mapping, size_t size,
+        const std::vector<size_t>& offsets) {
+    // The index keys point at the entries' data, so it is rebuilt as well.
+    mIndex.clear();
+    size_t i = 0;
+    for (auto it = mLru.rbegin(); it != mLru.rend(); ++it, ++i) {
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>(
+                mapping + offsets[i]);
+        it->mData = header->mData;
+        it->mStorage.reset();
+    }
+    for (auto it = mLru.begin(); it != mLru.end(); ++it) {
+        KeyRef ref = { it->mData, it->mKeySize };
+        mIndex.emplace(ref, it);
+    }
+
+    unmap();
+    mMapping = mapping;
+    mMappingSize = size;
+}
+
+size_t MappedBlobCache::getMaxFileSize() const {
+    // Records cost at most a RecordHeader per two bytes of data, and sync()
+    // compacts the file before it grows past twice the size of the live ones.
+    return 2 * (sizeof(FileHeader) + mMaxTotalSize / 2 * align4(sizeof(RecordHeader) + 2));
+}
+
+uint8_t* MappedBlobCache::mapFile(int fd, size_t size) {
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ALOGE("error mmaping cache file: %s (%d)", strerror(errno), errno);
+        return NULL;
+    }
+    return static_cast<uint8_t*>(mapping);
+}
+
+void MappedBlobCache::unmap() {
+    if (mMapping != NULL) {
+        munmap(mMapping, mMappingSize);
+        mMapping = NULL;
+        mMappingSize = 0;
+    }
+}
+
+void MappedBlobCache::clear() {
+    mIndex.clear();
+    mLru.clear();
+    mTotalSize = 0;
+    unmap();
+    if (mLockFd != -1) {
+        close(mLockFd);
+        mLockFd = -1;
+    }
+    mGeneration = 0;
+    mDirty = false;
+    mNeedsRewrite = false;
+    mFilename.clear();
+}
+
+void MappedBlobCache::fillFileHeader(FileHeader* header, uint32_t generation) {
+    memset(header, 0, sizeof(*header));
+    header->mMagicNumber = fileMagic;
+    header->mVersion = fileVersion;
+    header->mDeviceVersion = fileDeviceVersion;
+    header->mGeneration = generation;
+    char buildId[PROPERTY_VALUE_MAX];
+    header->mBuildIdLength = property_get("ro.build.id", buildId, "");
+    memcpy(header->mBuildId, buildId, header->mBuildIdLength);
+}
+
+bool MappedBlobCache::isHeaderValid(const FileHeader& header) {
+    FileHeader expected;
+    fillFileHeader(&expected, header.mGeneration);
+    return header.mGeneration != 0 && memcmp(&header, &expected, sizeof(expected)) == 0;
+}
+
+bool MappedBlobCache::KeyRef::operator==(const KeyRef& rhs) const {
+    return mSize == rhs.mSize && memcmp(mData, rhs.mData, mSize) == 0;
+}
+
+size_t MappedBlobCache::KeyHash::operator()(const KeyRef& key) const {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < key.mSize; i++) {
+        hash = (hash ^ key.mData[i]) * 0x100000001b3ull;
+    }
+    return size_t(hash ^ (hash >> 32));
+}
+
+} // namespace android
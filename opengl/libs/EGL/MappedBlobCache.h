@@ -0,0 +1,289 @@
+/*
+ ** Copyright 2017, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#ifndef ANDROID_MAPPED_BLOB_CACHE_H
+#define ANDROID_MAPPED_BLOB_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+// A MappedBlobCache is a key/value cache for binary blobs that is backed by
+// a file of records.  Like BlobCache, it does NOT provide any thread-safety
+// guarantees.
+//
+// Opening a cache file maps it read-only and indexes the records in place:
+// keys and values are served straight from the mapping and are never copied
+// into the heap.  Each value is CRC-checked the first time it is read rather
+// than when the file is opened, so start-up cost only depends on the number
+// of entries.
+//
+// New entries are kept in memory until sync(), which appends them to the
+// file.  When the cache is full the least recently used entries are evicted;
+// their records stay in the file until it is compacted.
+//
+// Every process of an app uses the same cache file, and may have it mapped.
+// Bytes that have been written to a file are therefore never modified: sync()
+// only appends records past the end of the file, and mappings of its first
+// part stay valid.  When the file is damaged, or holds more dead records than
+// live ones, sync() instead writes the live entries to a temporary file and
+// renames it over the cache file.  open() and sync() hold an exclusive flock()
+// on a lock file next to the cache file, and each version of the file carries
+// a generation number, so that sync() first merges in the entries another
+// process has written since this one last read the file.
+//
+// The file format is non-portable and the data should only be used by the
+// device that generated it.
+class MappedBlobCache {
+public:
+    // Create an empty blob cache. The blob cache will cache key/value pairs
+    // with key and value sizes less than or equal to maxKeySize and
+    // maxValueSize, respectively. The total combined size of ALL live cache
+    // entries (key sizes plus value sizes) will not exceed maxTotalSize.
+    MappedBlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize);
+    ~MappedBlobCache();
+
+    // open attaches the cache to the given file, replacing the current
+    // contents of the cache with the entries stored in it.  A missing, stale
+    // or unreadable file is loaded as an empty cache, and replaced by the
+    // next sync.  A damaged record ends the file; the records after it are
+    // ignored.  Returns 0 on success or a negative errno value, in which case
+    // the cache keeps working in memory only.
+    int open(const std::string& filename);
+
+    // set inserts a new binary value into the cache and associates it with
+    // the given binary key, replacing any previous value.  If the key or
+    // value are too large for the cache then the cache remains unchanged.
+    // Least recently used entries are evicted as needed to make room.
+    //
+    // Preconditions:
+    //   key != NULL
+    //   0 < keySize
+    //   value != NULL
+    //   0 < valueSize
+    void set(const void* key, size_t keySize, const void* value,
+            size_t valueSize);
+
+    // get retrieves from the cache the binary value associated with a given
+    // binary key, with the same semantics as BlobCache::get.  A successful
+    // lookup marks the entry as most recently used.  An entry whose data
+    // fails its CRC check is dropped and reported as missing.
+    size_t get(const void* key, size_t keySize, void* value, size_t valueSize);
+
+    // sync appends the entries set since the last sync to the backing file,
+    // after merging in the entries that other processes have written to it
+    // since.  The file is replaced with the live entries instead if it is
+    // unusable or needs compacting.  Returns 0 on success or a negative errno
+    // value.  Does nothing if no file is attached.
+    int sync();
+
+    // getTotalSize returns the combined size of all live keys and values.
+    size_t getTotalSize() const;
+
+    // getEntryCount returns the number of live entries.
+    size_t getEntryCount() const;
+
+    // getFileSize returns the size of the file that sync() writes when it
+    // replaces the file with the live entries.
+    size_t getFileSize() const;
+
+private:
+    // Copying is disallowed.
+    MappedBlobCache(const MappedBlobCache&);
+    void operator=(const MappedBlobCache&);
+
+    // A FileHeader starts every cache file. No need to make this portable,
+    // so we simply write the struct out.
+    struct FileHeader {
+        // mMagicNumber identifies the file as a MappedBlobCache log.
+        uint32_t mMagicNumber;
+
+        // mVersion is the file format version.
+        uint32_t mVersion;
+
+        // mDeviceVersion is the device-specific version of the cache.  This
+        // can be used to invalidate the cache.
+        uint32_t mDeviceVersion;
+
+        // mGeneration is incremented each time a process replaces the file.
+        // Appending records leaves it unchanged.
+        uint32_t mGeneration;
+
+        // mBuildId is the build id of the device when the cache was created.
+        // When an update to the build happens (via an OTA or other update)
+        // this is used to invalidate the cache.
+        uint32_t mBuildIdLength;
+        char mBuildId[92];
+    };
+
+    // A RecordHeader precedes each record in the file.  It is followed
+    // immediately by the key and then the value.  Records are 4-byte
+    // aligned, so the number of bytes that a record occupies is:
+    //
+    //   ((sizeof(RecordHeader) + keySize + valueSize) + 3) & ~3
+    //
+    struct RecordHeader {
+        // mMagicNumber marks the start of a record, to catch torn writes.
+        uint32_t mMagicNumber;
+
+        // mFlags is reserved and must be 0.
+        uint32_t mFlags;
+
+        uint32_t mKeySize;
+        uint32_t mValueSize;
+
+        // mCrc is the CRC32C of the key and value data.
+        uint32_t mCrc;
+
+        uint8_t mData[];
+    };
+
+    // An Entry is a single live key/value pair.  Its key and value are
+    // stored back to back at mData, which points either into the file
+    // mapping or, until the next sync, into mStorage.
+    struct Entry {
+        const uint8_t* mData;
+        size_t mKeySize;
+        size_t mValueSize;
+        uint32_t mCrc;
+
+        // mVerified is set once the CRC of a mapped entry has been checked.
+        // Checking once is enough because written records are never modified.
+        bool mVerified;
+
+        std::unique_ptr<uint8_t[]> mStorage;
+    };
+
+    // A KeyRef identifies an entry in mIndex.  It points at the key data of
+    // the entry itself, which never moves while the entry is live.
+    struct KeyRef {
+        const uint8_t* mData;
+        size_t mSize;
+
+        bool operator==(const KeyRef& rhs) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const KeyRef& key) const;
+    };
+
+    typedef std::list<Entry> LruList;
+
+    // insert adds an entry, most recently used, replacing any existing entry
+    // with the same key.
+    void insert(Entry&& entry);
+
+    // remove drops an entry from the cache.
+    void remove(LruList::iterator it);
+
+    // evict drops an entry to make room.  Its record, if any, stays in the
+    // file until the file is replaced.
+    void evict(LruList::iterator it);
+
+    // loadLocked maps the current version of the backing file and adds its
+    // entries to the cache, least recently used.  Entries already in the
+    // cache take precedence.  A missing or unusable file loads nothing.
+    // The file lock must be held.
+    void loadLocked();
+
+    // indexMapping indexes the records of the currently mapped file and
+    // returns the offset at which the valid part of the file ends.
+    size_t indexMapping();
+
+    // readGenerationLocked returns the generation of the current version of
+    // the backing file and stores its size in outFileSize, or returns 0 if
+    // there is no usable file.  The file lock must be held.
+    uint32_t readGenerationLocked(size_t* outFileSize) const;
+
+    // appendLocked appends the entries set since the last sync to the mapped
+    // version of the backing file, and moves the entries onto a mapping of
+    // the whole file.  The file lock must be held.
+    int appendLocked();
+
+    // writeLocked writes the live entries to a new version of the backing
+    // file, and moves the entries onto its mapping.  The file lock must be
+    // held.
+    int writeLocked();
+
+    // adoptMapping points each entry at its record in mapping, given the
+    // offsets of the records least recently used first, and replaces the
+    // current mapping with it.
+    void adoptMapping(uint8_t* mapping, size_t size, const std::vector<size_t>& offsets);
+
+    // getMaxFileSize returns the largest file that sync() can produce.
+    size_t getMaxFileSize() const;
+
+    // mapFile maps the first size bytes of fd read-only.
+    static uint8_t* mapFile(int fd, size_t size);
+
+    // unmap drops the current mapping.  No entry may point into it.
+    void unmap();
+
+    // clear drops all entries and detaches the backing file.
+    void clear();
+
+    // fillFileHeader fills in the header of a file of the given generation.
+    static void fillFileHeader(FileHeader* header, uint32_t generation);
+
+    // isHeaderValid returns true if header is the header of a file written
+    // by this version of the cache on this build, whatever its generation.
+    static bool isHeaderValid(const FileHeader& header);
+
+    static void appendRecord(std::vector<uint8_t>* log, const void* key,
+            size_t keySize, const void* value, size_t valueSize, uint32_t crc);
+
+    const size_t mMaxKeySize;
+    const size_t mMaxValueSize;
+    const size_t mMaxTotalSize;
+
+    // mTotalSize is the combined size of all live keys and values.
+    size_t mTotalSize;
+
+    // mLru holds the live entries, most recently used first.
+    LruList mLru;
+
+    std::unordered_map<KeyRef, LruList::iterator, KeyHash> mIndex;
+
+    // mFilename is the backing file, if any, and mLockFd the file that
+    // open() and sync() lock to access it.
+    std::string mFilename;
+    int mLockFd;
+
+    // mMapping is a read-only mapping of the first mMappingSize bytes of
+    // the version of the backing file with generation mGeneration.
+    uint8_t* mMapping;
+    size_t mMappingSize;
+    uint32_t mGeneration;
+
+    // mDirty is set when there are entries that aren't in the file yet, or
+    // when mNeedsRewrite is set.
+    bool mDirty;
+
+    // mNeedsRewrite is set when the file can't be appended to, because it is
+    // missing, stale or damaged, or holds a record that failed its CRC check.
+    bool mNeedsRewrite;
+};
+
+}
+
+#endif // ANDROID_MAPPED_BLOB_CACHE_H
@@ -0,0 +1,344 @@
+/*
+ ** Copyright 2017, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "MappedBlobCache.h"
+
+namespace android {
+
+#if defined(__ANDROID__)
+static const char* kTempDir = "/data/local/tmp";
+#else
+static const char* kTempDir = "/tmp";
+#endif
+
+class MappedBlobCacheTest : public ::testing::Test {
+protected:
+
+    enum {
+        MAX_KEY_SIZE = 6,
+        MAX_VALUE_SIZE = 8,
+        MAX_TOTAL_SIZE = 13,
+    };
+
+    virtual void SetUp() {
+        mFilename = std::string(kTempDir) + "/MappedBlobCacheTest." +
+                std::to_string(getpid());
+        unlink(mFilename.c_str());
+        mBC.reset(new MappedBlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE));
+    }
+
+    virtual void TearDown() {
+        mBC.reset();
+        unlink(mFilename.c_str());
+        unlink((mFilename + ".tmp").c_str());
+        unlink((mFilename + ".lock").c_str());
+    }
+
+    // reopen syncs the cache and loads its file into a fresh instance.
+    void reopen() {
+        ASSERT_EQ(0, mBC->sync());
+        mBC.reset(new MappedBlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE));
+        ASSERT_EQ(0, mBC->open(mFilename));
+    }
+
+    size_t fileSize() {
+        struct stat statBuf;
+        EXPECT_EQ(0, stat(mFilename.c_str(), &statBuf));
+        return statBuf.st_size;
+    }
+
+    ino_t fileInode() {
+        struct stat statBuf;
+        EXPECT_EQ(0, stat(mFilename.c_str(), &statBuf));
+        return statBuf.st_ino;
+    }
+
+    MappedBlobCache* openSecondCache() {
+        MappedBlobCache* bc = new MappedBlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE,
+                MAX_TOTAL_SIZE);
+        EXPECT_EQ(0, bc->open(mFilename));
+        return bc;
+    }
+
+    std::string mFilename;
+    std::unique_ptr<MappedBlobCache> mBC;
+};
+
+TEST_F(MappedBlobCacheTest, CacheSingleValueSucceeds) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('f', buf[1]);
+    ASSERT_EQ('g', buf[2]);
+    ASSERT_EQ('h', buf[3]);
+}
+
+TEST_F(MappedBlobCacheTest, ReplaceValueSucceeds) {
+    unsigned char buf[2] = { 0xee, 0xee };
+    mBC->set("ab", 2, "cd", 2);
+    mBC->set("ab", 2, "ef", 2);
+    ASSERT_EQ(size_t(2), mBC->get("ab", 2, buf, 2));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('f', buf[1]);
+    ASSERT_EQ(size_t(1), mBC->getEntryCount());
+    ASSERT_EQ(size_t(4), mBC->getTotalSize());
+}
+
+TEST_F(MappedBlobCacheTest, GetSmallBufferDoesNotWrite) {
+    unsigned char buf[2] = { 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 2));
+    ASSERT_EQ(0xee, buf[0]);
+    ASSERT_EQ(0xee, buf[1]);
+}
+
+TEST_F(MappedBlobCacheTest, EvictsLeastRecentlyUsed) {
+    unsigned char buf[2];
+    // Each entry is 4 bytes, so three of them fit.
+    mBC->set("aa", 2, "11", 2);
+    mBC->set("bb", 2, "22", 2);
+    mBC->set("cc", 2, "33", 2);
+    ASSERT_EQ(size_t(2), mBC->get("aa", 2, buf, 2));
+
+    mBC->set("dd", 2, "44", 2);
+    ASSERT_EQ(size_t(2), mBC->get("aa", 2, buf, 2));
+    ASSERT_EQ(size_t(0), mBC->get("bb", 2, buf, 2));
+    ASSERT_EQ(size_t(2), mBC->get("cc", 2, buf, 2));
+    ASSERT_EQ(size_t(2), mBC->get("dd", 2, buf, 2));
+    ASSERT_EQ(size_t(12), mBC->getTotalSize());
+}
+
+TEST_F(MappedBlobCacheTest, EntriesPersistAcrossOpen) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("abcd", 4, "efgh", 4);
+    reopen();
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('h', buf[3]);
+}
+
+TEST_F(MappedBlobCacheTest, SyncOnlyWritesChanges) {
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("ab", 2, "cd", 2);
+    ASSERT_EQ(0, mBC->sync());
+    ino_t inode = fileInode();
+
+    // Nothing new, nothing written.
+    ASSERT_EQ(0, mBC->sync());
+    ASSERT_EQ(inode, fileInode());
+
+    // New entries are appended to the same file.
+    mBC->set("ef", 2, "gh", 2);
+    ASSERT_EQ(0, mBC->sync());
+    ASSERT_EQ(inode, fileInode());
+    ASSERT_EQ(mBC->getFileSize(), fileSize());
+}
+
+TEST_F(MappedBlobCacheTest, AppendedValueReplacesEarlierOne) {
+    unsigned char buf[2];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("ab", 2, "cd", 2);
+    ASSERT_EQ(0, mBC->sync());
+    mBC->set("ab", 2, "ef", 2);
+    reopen();
+    ASSERT_EQ(size_t(1), mBC->getEntryCount());
+    ASSERT_EQ(size_t(2), mBC->get("ab", 2, buf, 2));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('f', buf[1]);
+}
+
+TEST_F(MappedBlobCacheTest, EvictionsPersistAcrossOpen) {
+    unsigned char buf[2];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("aa", 2, "11", 2);
+    mBC->set("bb", 2, "22", 2);
+    mBC->set("cc", 2, "33", 2);
+    mBC->set("dd", 2, "44", 2);
+    reopen();
+    ASSERT_EQ(size_t(0), mBC->get("aa", 2, buf, 2));
+    ASSERT_EQ(size_t(2), mBC->get("bb", 2, buf, 2));
+    ASSERT_EQ(size_t(2), mBC->get("dd", 2, buf, 2));
+    ASSERT_EQ(size_t(3), mBC->getEntryCount());
+}
+
+TEST_F(MappedBlobCacheTest, TruncatedRecordIsDiscarded) {
+    unsigned char buf[2];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("ab", 2, "cd", 2);
+    ASSERT_EQ(0, mBC->sync());
+    size_t goodSize = fileSize();
+
+    // Simulate a write that was cut short.
+    int fd = open(mFilename.c_str(), O_WRONLY | O_APPEND);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(3, write(fd, "_Re", 3));
+    close(fd);
+
+    reopen();
+    ASSERT_EQ(size_t(2), mBC->get("ab", 2, buf, 2));
+
+    // The file isn't truncated in place, it's replaced by the next sync.
+    ASSERT_EQ(goodSize + 3, fileSize());
+    ASSERT_EQ(0, mBC->sync());
+    ASSERT_EQ(goodSize, fileSize());
+}
+
+TEST_F(MappedBlobCacheTest, CorruptValueIsDropped) {
+    unsigned char buf[4];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(0, mBC->sync());
+
+    // The value is the last thing in the file.
+    int fd = open(mFilename.c_str(), O_WRONLY);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(1, pwrite(fd, "x", 1, fileSize() - 1));
+    close(fd);
+
+    reopen();
+    ASSERT_EQ(size_t(1), mBC->getEntryCount());
+    ASSERT_EQ(size_t(0), mBC->get("abcd", 4, buf, 4));
+    ASSERT_EQ(size_t(0), mBC->getEntryCount());
+}
+
+TEST_F(MappedBlobCacheTest, StaleFileIsReplaced) {
+    int fd = open(mFilename.c_str(), O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+    ASSERT_NE(-1, fd);
+    char garbage[256];
+    memset(garbage, 'x', sizeof(garbage));
+    ASSERT_EQ(ssize_t(sizeof(garbage)), write(fd, garbage, sizeof(garbage)));
+    close(fd);
+
+    ASSERT_EQ(0, mBC->open(mFilename));
+    ASSERT_EQ(size_t(0), mBC->getEntryCount());
+    ASSERT_EQ(0, mBC->sync());
+    ASSERT_LT(fileSize(), sizeof(garbage));
+}
+
+TEST_F(MappedBlobCacheTest, FileIsCompacted) {
+    unsigned char buf[2];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    size_t rewrites = 0;
+    ino_t inode = 0;
+    for (int i = 0; i < 100; i++) {
+        char value[2] = { char('0' + i % 10), char('0' + i / 10 % 10) };
+        mBC->set("ab", 2, value, 2);
+        mBC->set("cd", 2, value, 2);
+        ASSERT_EQ(0, mBC->sync());
+        ASSERT_LE(fileSize(), 2 * mBC->getFileSize());
+        if (fileInode() != inode) {
+            inode = fileInode();
+            rewrites++;
+        }
+    }
+    // Most syncs append, and the dead records are dropped now and then.
+    ASSERT_GT(rewrites, size_t(1));
+    ASSERT_LT(rewrites, size_t(50));
+    reopen();
+    ASSERT_EQ(size_t(2), mBC->get("ab", 2, buf, 2));
+    ASSERT_EQ('9', buf[0]);
+    ASSERT_EQ('9', buf[1]);
+    ASSERT_EQ(size_t(2), mBC->get("cd", 2, buf, 2));
+}
+
+TEST_F(MappedBlobCacheTest, SyncMergesEntriesOfOtherCaches) {
+    unsigned char buf[2];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    std::unique_ptr<MappedBlobCache> other(openSecondCache());
+
+    mBC->set("aa", 2, "11", 2);
+    ASSERT_EQ(0, mBC->sync());
+    other->set("bb", 2, "22", 2);
+    ASSERT_EQ(0, other->sync());
+    mBC->set("cc", 2, "33", 2);
+    ASSERT_EQ(0, mBC->sync());
+
+    reopen();
+    ASSERT_EQ(size_t(3), mBC->getEntryCount());
+    ASSERT_EQ(size_t(2), mBC->get("aa", 2, buf, 2));
+    ASSERT_EQ(size_t(2), mBC->get("bb", 2, buf, 2));
+    ASSERT_EQ('2', buf[0]);
+    ASSERT_EQ(size_t(2), mBC->get("cc", 2, buf, 2));
+}
+
+TEST_F(MappedBlobCacheTest, MappedFileIsNotModifiedByOtherCaches) {
+    unsigned char buf[4];
+    ASSERT_EQ(0, mBC->open(mFilename));
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(0, mBC->sync());
+
+    // The second cache maps the file, then the first one replaces it with
+    // smaller and larger versions.
+    std::unique_ptr<MappedBlobCache> other(openSecondCache());
+    for (int i = 0; i < 10; i++) {
+        mBC->set("ab", 2, "cd", 2);
+        mBC->set("abcd", 4, i % 2 ? "wxyz" : "1234", 4);
+        ASSERT_EQ(0, mBC->sync());
+    }
+
+    ASSERT_EQ(size_t(4), other->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('h', buf[3]);
+}
+
+TEST_F(MappedBlobCacheTest, ConcurrentProcessesKeepFileValid) {
+    ASSERT_EQ(0, mBC->open(mFilename));
+    pid_t pid = fork();
+    ASSERT_NE(-1, pid);
+    MappedBlobCache bc(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE);
+    bool failed = bc.open(mFilename) != 0;
+    const char* key = pid == 0 ? "child" : "parent";
+    for (int i = 0; i < 500 && !failed; i++) {
+        char value[4] = { char('0' + i % 10), char('0' + i / 10 % 10), 'v', 'v' };
+        unsigned char buf[4];
+        bc.set(key, strlen(key), value, 2 + i % 3);
+        failed = bc.sync() != 0 || bc.get(key, strlen(key), buf, sizeof(buf)) != 2 + i % 3u;
+    }
+    if (pid == 0) {
+        _exit(failed ? 1 : 0);
+    }
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+    ASSERT_FALSE(failed);
+
+    // Every record of the final file passes its CRC check.
+    unsigned char buf[4];
+    mBC.reset(new MappedBlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE));
+    ASSERT_EQ(0, mBC->open(mFilename));
+    size_t entries = mBC->getEntryCount();
+    ASSERT_GE(entries, size_t(1));
+    EXPECT_NE(size_t(0), mBC->get("child", 5, buf, sizeof(buf)) +
+            mBC->get("parent", 6, buf, sizeof(buf)));
+    ASSERT_EQ(entries, mBC->getEntryCount());
+}
+
+} // namespace android
@@ -20,7 +20,7 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
-#include "BlobCache.h"
+#include "MappedBlobCache.h"
 
 #include <memory>
 #include <mutex>
@@ -76,20 +76,15 @@ private:
     egl_cache_t(const egl_cache_t&); // not implemented
     void operator=(const egl_cache_t&); // not implemented
 
-    // getBlobCacheLocked returns the BlobCache object being used to store the
-    // key/value blob pairs.  If the BlobCache object has not yet been created,
-    // this will do so, loading the serialized cache contents from disk if
-    // possible.
-    BlobCache* getBlobCacheLocked();
+    // getBlobCacheLocked returns the MappedBlobCache object being used to
+    // store the key/value blob pairs.  If the MappedBlobCache object has not
+    // yet been created, this will do so, mapping the cache file if possible.
+    MappedBlobCache* getBlobCacheLocked();
 
-    // saveBlobCache attempts to save the current contents of mBlobCache to
-    // disk.
+    // saveBlobCache writes the contents of mBlobCache to disk if they changed
+    // since the last save.
     void saveBlobCacheLocked();
 
-    // loadBlobCache attempts to load the saved cache contents from disk into
-    // mBlobCache.
-    void loadBlobCacheLocked();
-
     // mInitialized indicates whether the egl_cache_t is in the initialized
     // state.  It is initialized to false at construction time, and gets set to
     // true when initialize is called.  It is set back to false when terminate
@@ -101,7 +96,7 @@ private:
     // mBlobCache is the cache in which the key/value blob pairs are stored.  It
     // is initially NULL, and will be initialized by getBlobCacheLocked the
     // first time it's needed.
-    std::unique_ptr<BlobCache> mBlobCache;
+    std::unique_ptr<MappedBlobCache> mBlobCache;
 
     // mFilename is the name of the file for storing cache contents in between
     // program invocations.  It is initialized to an empty string at
@@ -113,8 +108,8 @@ private:
     // mSavePending indicates whether or not a deferred save operation is
     // pending.  Each time a key/value pair is inserted into the cache via
     // setBlob, a deferred save is initiated if one is not already pending.
-    // This will wait some amount of time and then trigger a save of the cache
-    // contents to disk.
+    // This will wait some amount of time and then append the new entries to
+    // the cache file, so that a burst of insertions costs a single write.
     bool mSavePending;
 
     // mMutex is the mutex used to prevent concurrent access to the member
@@ -14,8 +14,25 @@
 
 #include <ETC1/etc1.h>
 
+#include "etc1_reference.h"
+
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ETC1_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ETC1_SIMD_NEON 1
+#endif
+
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
 
  The number of bits that represent a 4x4 texel block is 64 bits if
@@ -163,6 +180,7 @@ inline int convertDiff(int base, int diff) {
     return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
 }
 
+// Reference decoder, kept for etc1_decode_block_reference().
 static
 void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
         etc1_uint32 low, bool second, bool flipped) {
@@ -194,12 +212,8 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
     }
 }
 
-// Input is an ETC1 compressed version of the data.
-// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
-
-void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
-    etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
-    etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
+static
+void decode_base_colors(etc1_uint32 high, int* pColors) {
     int r1, r2, g1, g2, b1, b2;
     if (high & 2) {
         // differential
@@ -221,13 +235,69 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
         b1 = convert4To8(high >> 12);
         b2 = convert4To8(high >> 8);
     }
-    int tableIndexA = 7 & (high >> 5);
-    int tableIndexB = 7 & (high >> 2);
-    const int* tableA = kModifierTable + tableIndexA * 4;
-    const int* tableB = kModifierTable + tableIndexB * 4;
+    pColors[0] = r1;
+    pColors[1] = g1;
+    pColors[2] = b1;
+    pColors[3] = r2;
+    pColors[4] = g2;
+    pColors[5] = b2;
+}
+
+// Input is an ETC1 compressed version of the data.
+// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+//
+// Each sub-block only has four distinct colors, so they are computed once
+// and the pixels are filled in from that palette.
+
+void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+    etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
+    etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
+    int colors[6];
+    decode_base_colors(high, colors);
+
+    etc1_byte palette[2][4][3];
+    const int* tables[2] = {
+        kModifierTable + (7 & (high >> 5)) * 4,
+        kModifierTable + (7 & (high >> 2)) * 4,
+    };
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < 4; i++) {
+            int delta = tables[s][i];
+            palette[s][i][0] = clamp(colors[3 * s] + delta);
+            palette[s][i][1] = clamp(colors[3 * s + 1] + delta);
+            palette[s][i][2] = clamp(colors[3 * s + 2] + delta);
+        }
+    }
+
+    // Sub-block 1 is the right half, or the bottom half when flipped.
+    bool flipped = (high & 1) != 0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int k = y + (x * 4);
+            int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
+            int s = flipped ? (y >> 1) : (x >> 1);
+            const etc1_byte* c = palette[s][offset];
+            etc1_byte* q = pOut + 3 * (x + 4 * y);
+            q[0] = c[0];
+            q[1] = c[1];
+            q[2] = c[2];
+        }
+    }
+}
+
+// The original per-pixel decoder, which etc1_decode_block must match bit
+// for bit.
+
+void etc1_decode_block_reference(const etc1_byte* pIn, etc1_byte* pOut) {
+    etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
+    etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
+    int colors[6];
+    decode_base_colors(high, colors);
+    const int* tableA = kModifierTable + (7 & (high >> 5)) * 4;
+    const int* tableB = kModifierTable + (7 & (high >> 2)) * 4;
     bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+    decode_subblock(pOut, colors[0], colors[1], colors[2], tableA, low, false, flipped);
+    decode_subblock(pOut, colors[3], colors[4], colors[5], tableB, low, true, flipped);
 }
 
 typedef struct {
@@ -429,6 +499,185 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
     pBaseColors[5] = b2;
 }
 
+// Scores one sub-block against a modifier table with the original scalar
+// loops. This is what etc1_encode_block_reference() uses.
+class ScalarSubblockEncoder {
+public:
+    ScalarSubblockEncoder(const etc1_byte* pIn, etc1_uint32 inMask,
+            bool flipped, bool second) :
+            mIn(pIn), mMask(inMask), mFlipped(flipped), mSecond(second) {
+    }
+
+    void encode(etc_compressed* pCompressed, const etc1_byte* pBaseColors,
+            const int* pModifierTable) const {
+        etc_encode_subblock_helper(mIn, mMask, pCompressed, mFlipped, mSecond,
+                pBaseColors, pModifierTable);
+    }
+
+private:
+    const etc1_byte* mIn;
+    etc1_uint32 mMask;
+    bool mFlipped;
+    bool mSecond;
+};
+
+#if defined(ETC1_SIMD_SSE2) || defined(ETC1_SIMD_NEON)
+
+// Scores one sub-block against a modifier table eight pixels at a time.
+//
+// The eight pixels of the sub-block are gathered once into one vector per
+// channel. For each of the four modifiers the weighted error of every pixel
+// is computed in 32-bit lanes, and each lane keeps the first modifier with
+// the strictly lowest error. That is exactly the choice chooseModifier()
+// makes, whose early exits only skip modifiers that cannot win.
+class SimdSubblockEncoder {
+public:
+    SimdSubblockEncoder(const etc1_byte* pIn, etc1_uint32 inMask,
+            bool flipped, bool second) {
+        int lane = 0;
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                bool inSubblock = flipped ? ((y >> 1) == (second ? 1 : 0))
+                        : ((x >> 1) == (second ? 1 : 0));
+                if (!inSubblock) {
+                    continue;
+                }
+                int i = x + 4 * y;
+                bool valid = (inMask & (1 << i)) != 0;
+                mR[lane] = valid ? pIn[i * 3] : 0;
+                mG[lane] = valid ? pIn[i * 3 + 1] : 0;
+                mB[lane] = valid ? pIn[i * 3 + 2] : 0;
+                mValid[lane] = valid ? -1 : 0;
+                mBitIndex[lane] = y + x * 4;
+                lane++;
+            }
+        }
+    }
+
+    void encode(etc_compressed* pCompressed, const etc1_byte* pBaseColors,
+            const int* pModifierTable) const {
+        int32_t errors[8];
+        int32_t indices[8];
+        scoreModifiers(pBaseColors, pModifierTable, errors, indices);
+
+        etc1_uint32 score = 0;
+        etc1_uint32 low = 0;
+        for (int lane = 0; lane < 8; lane++) {
+            if (mValid[lane]) {
+                int bestIndex = indices[lane];
+                score += errors[lane];
+                low |= (((bestIndex >> 1) << 16) | (bestIndex & 1)) << mBitIndex[lane];
+            }
+        }
+        pCompressed->score += score;
+        pCompressed->low |= low;
+    }
+
+private:
+    void scoreModifiers(const etc1_byte* pBaseColors, const int* pModifierTable,
+            int32_t* pErrors, int32_t* pIndices) const;
+
+    int16_t mR[8];
+    int16_t mG[8];
+    int16_t mB[8];
+    int32_t mValid[8];
+    int mBitIndex[8];
+};
+
+#if defined(ETC1_SIMD_SSE2)
+
+void SimdSubblockEncoder::scoreModifiers(const etc1_byte* pBaseColors,
+        const int* pModifierTable, int32_t* pErrors, int32_t* pIndices) const {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mR));
+    const __m128i pg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mG));
+    const __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mB));
+    __m128i bestLo = _mm_set1_epi32(INT_MAX);
+    __m128i bestHi = bestLo;
+    __m128i indexLo = zero;
+    __m128i indexHi = zero;
+    for (int i = 0; i < 4; i++) {
+        int modifier = pModifierTable[i];
+        __m128i dr = _mm_sub_epi16(_mm_set1_epi16(clamp(pBaseColors[0] + modifier)), pr);
+        __m128i dg = _mm_sub_epi16(_mm_set1_epi16(clamp(pBaseColors[1] + modifier)), pg);
+        __m128i db = _mm_sub_epi16(_mm_set1_epi16(clamp(pBaseColors[2] + modifier)), pb);
+        __m128i dg6 = _mm_mullo_epi16(dg, _mm_set1_epi16(6));
+        __m128i dr3 = _mm_mullo_epi16(dr, _mm_set1_epi16(3));
+
+        // madd of (g, r) pairs with (6g, 3r) gives 6g^2 + 3r^2 per pixel,
+        // and of (b, 0) pairs with themselves gives b^2.
+        __m128i errLo = _mm_add_epi32(
+                _mm_madd_epi16(_mm_unpacklo_epi16(dg, dr), _mm_unpacklo_epi16(dg6, dr3)),
+                _mm_madd_epi16(_mm_unpacklo_epi16(db, zero), _mm_unpacklo_epi16(db, zero)));
+        __m128i errHi = _mm_add_epi32(
+                _mm_madd_epi16(_mm_unpackhi_epi16(dg, dr), _mm_unpackhi_epi16(dg6, dr3)),
+                _mm_madd_epi16(_mm_unpackhi_epi16(db, zero), _mm_unpackhi_epi16(db, zero)));
+
+        __m128i index = _mm_set1_epi32(i);
+        __m128i ltLo = _mm_cmplt_epi32(errLo, bestLo);
+        __m128i ltHi = _mm_cmplt_epi32(errHi, bestHi);
+        bestLo = _mm_or_si128(_mm_and_si128(ltLo, errLo), _mm_andnot_si128(ltLo, bestLo));
+        bestHi = _mm_or_si128(_mm_and_si128(ltHi, errHi), _mm_andnot_si128(ltHi, bestHi));
+        indexLo = _mm_or_si128(_mm_and_si128(ltLo, index), _mm_andnot_si128(ltLo, indexLo));
+        indexHi = _mm_or_si128(_mm_and_si128(ltHi, index), _mm_andnot_si128(ltHi, indexHi));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pErrors), bestLo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pErrors + 4), bestHi);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pIndices), indexLo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pIndices + 4), indexHi);
+}
+
+#else // ETC1_SIMD_NEON
+
+void SimdSubblockEncoder::scoreModifiers(const etc1_byte* pBaseColors,
+        const int* pModifierTable, int32_t* pErrors, int32_t* pIndices) const {
+    const int16x8_t pr = vld1q_s16(mR);
+    const int16x8_t pg = vld1q_s16(mG);
+    const int16x8_t pb = vld1q_s16(mB);
+    int32x4_t bestLo = vdupq_n_s32(INT_MAX);
+    int32x4_t bestHi = bestLo;
+    int32x4_t indexLo = vdupq_n_s32(0);
+    int32x4_t indexHi = indexLo;
+    for (int i = 0; i < 4; i++) {
+        int modifier = pModifierTable[i];
+        int16x8_t dr = vsubq_s16(vdupq_n_s16(clamp(pBaseColors[0] + modifier)), pr);
+        int16x8_t dg = vsubq_s16(vdupq_n_s16(clamp(pBaseColors[1] + modifier)), pg);
+        int16x8_t db = vsubq_s16(vdupq_n_s16(clamp(pBaseColors[2] + modifier)), pb);
+        int16x8_t dg6 = vmulq_n_s16(dg, 6);
+        int16x8_t dr3 = vmulq_n_s16(dr, 3);
+
+        int32x4_t errLo = vmull_s16(vget_low_s16(dg), vget_low_s16(dg6));
+        errLo = vmlal_s16(errLo, vget_low_s16(dr), vget_low_s16(dr3));
+        errLo = vmlal_s16(errLo, vget_low_s16(db), vget_low_s16(db));
+        int32x4_t errHi = vmull_s16(vget_high_s16(dg), vget_high_s16(dg6));
+        errHi = vmlal_s16(errHi, vget_high_s16(dr), vget_high_s16(dr3));
+        errHi = vmlal_s16(errHi, vget_high_s16(db), vget_high_s16(db));
+
+        int32x4_t index = vdupq_n_s32(i);
+        uint32x4_t ltLo = vcltq_s32(errLo, bestLo);
+        uint32x4_t ltHi = vcltq_s32(errHi, bestHi);
+        bestLo = vbslq_s32(ltLo, errLo, bestLo);
+        bestHi = vbslq_s32(ltHi, errHi, bestHi);
+        indexLo = vbslq_s32(ltLo, index, indexLo);
+        indexHi = vbslq_s32(ltHi, index, indexHi);
+    }
+    vst1q_s32(pErrors, bestLo);
+    vst1q_s32(pErrors + 4, bestHi);
+    vst1q_s32(pIndices, indexLo);
+    vst1q_s32(pIndices + 4, indexHi);
+}
+
+#endif
+
+typedef SimdSubblockEncoder SubblockEncoder;
+
+#else
+
+typedef ScalarSubblockEncoder SubblockEncoder;
+
+#endif
+
+template<typename Encoder>
 static
 void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
         const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped) {
@@ -442,14 +691,16 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
 
     int originalHigh = pCompressed->high;
 
+    const Encoder firstEncoder(pIn, inMask, flipped, false);
+    const Encoder secondEncoder(pIn, inMask, flipped, true);
+
     const int* pModifierTable = kModifierTable;
     for (int i = 0; i < 8; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = 0;
         temp.high = originalHigh | (i << 5);
         temp.low = 0;
-        etc_encode_subblock_helper(pIn, inMask, &temp, flipped, false,
-                pBaseColors, pModifierTable);
+        firstEncoder.encode(&temp, pBaseColors, pModifierTable);
         take_best(pCompressed, &temp);
     }
     pModifierTable = kModifierTable;
@@ -459,8 +710,7 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
         temp.score = firstHalf.score;
         temp.high = firstHalf.high | (i << 2);
         temp.low = firstHalf.low;
-        etc_encode_subblock_helper(pIn, inMask, &temp, flipped, true,
-                pBaseColors + 3, pModifierTable);
+        secondEncoder.encode(&temp, pBaseColors + 3, pModifierTable);
         if (i == 0) {
             *pCompressed = temp;
         } else {
@@ -481,7 +731,9 @@ static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
 // pixel is valid or not. Invalid pixel color values are ignored when compressing.
 // Output is an ETC1 compressed version of the data.
 
-void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+template<typename Encoder>
+static
+void etc_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
         etc1_byte* pOut) {
     etc1_byte colors[6];
     etc1_byte flippedColors[6];
@@ -491,29 +743,39 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
     etc_average_colors_subblock(pIn, inMask, flippedColors + 3, true, true);
 
     etc_compressed a, b;
-    etc_encode_block_helper(pIn, inMask, colors, &a, false);
-    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true);
+    etc_encode_block_helper<Encoder>(pIn, inMask, colors, &a, false);
+    etc_encode_block_helper<Encoder>(pIn, inMask, flippedColors, &b, true);
     take_best(&a, &b);
     writeBigEndian(pOut, a.high);
     writeBigEndian(pOut + 4, a.low);
 }
 
+void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut) {
+    etc_encode_block<SubblockEncoder>(pIn, inMask, pOut);
+}
+
+// The original scalar encoder, which etc1_encode_block must match bit for
+// bit.
+
+void etc1_encode_block_reference(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut) {
+    etc_encode_block<ScalarSubblockEncoder>(pIn, inMask, pOut);
+}
+
 // Return the size of the encoded image data (does not include size of PKM header).
 
 etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
     return (((width + 3) & ~3) * ((height + 3) & ~3)) >> 1;
 }
 
-// Encode an entire image.
-// pIn - pointer to the image data. Formatted such that the Red component of
-//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
-// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+// Encode block rows [yBlockBegin, yBlockEnd) of an image. Each block row
+// is written to its own place in pOut, so disjoint ranges can be encoded
+// concurrently.
 
-int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
-    }
+static void etc_encode_block_rows(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, etc1_uint32 yBlockBegin, etc1_uint32 yBlockEnd) {
     static const unsigned short kYMask[] = { 0x0, 0xf, 0xff, 0xfff, 0xffff };
     static const unsigned short kXMask[] = { 0x0, 0x1111, 0x3333, 0x7777,
             0xffff };
@@ -521,9 +783,9 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
     etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
+    pOut += (encodedWidth >> 2) * yBlockBegin * ETC1_ENCODED_BLOCK_SIZE;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
+    for (etc1_uint32 y = yBlockBegin * 4; y < yBlockEnd * 4; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
             yEnd = 4;
@@ -555,28 +817,21 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
             pOut += sizeof(encoded);
         }
     }
-    return 0;
 }
 
-// Decode an entire image.
-// pIn - pointer to encoded data.
-// pOut - pointer to the image data. Will be written such that the Red component of
-//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset. Must be
-//        large enough to store entire image.
-
+// Decode block rows [yBlockBegin, yBlockEnd) of an image. Each block row
+// only writes its own four pixel rows of pOut.
 
-int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
+static void etc_decode_block_rows(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 pixelSize, etc1_uint32 stride) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
-    }
+        etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_uint32 yBlockBegin, etc1_uint32 yBlockEnd) {
     etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
+    pIn += (encodedWidth >> 2) * yBlockBegin * ETC1_ENCODED_BLOCK_SIZE;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
+    for (etc1_uint32 y = yBlockBegin * 4; y < yBlockEnd * 4; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
             yEnd = 4;
@@ -606,6 +861,160 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
             }
         }
     }
+}
+
+// A band of block rows handed to one worker thread.
+
+typedef struct {
+    const etc1_byte* pIn;
+    etc1_byte* pOut;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 pixelSize;
+    etc1_uint32 stride;
+    etc1_uint32 yBlockBegin;
+    etc1_uint32 yBlockEnd;
+    bool encode;
+} etc_band;
+
+static void etc_process_band(const etc_band* pBand) {
+    if (pBand->encode) {
+        etc_encode_block_rows(pBand->pIn, pBand->width, pBand->height,
+                pBand->pixelSize, pBand->stride, pBand->pOut,
+                pBand->yBlockBegin, pBand->yBlockEnd);
+    } else {
+        etc_decode_block_rows(pBand->pIn, pBand->pOut, pBand->width,
+                pBand->height, pBand->pixelSize, pBand->stride,
+                pBand->yBlockBegin, pBand->yBlockEnd);
+    }
+}
+
+#if !defined(_WIN32)
+
+static void* etc_band_thread(void* arg) {
+    etc_process_band(static_cast<const etc_band*>(arg));
+    return NULL;
+}
+
+#endif
+
+// Upper bound on the number of threads used for one image.
+static const etc1_uint32 ETC1_MAX_THREADS = 32;
+
+// Split the block rows of an image into contiguous bands and process them
+// on up to threadCount threads. The calling thread takes the first band.
+// If a thread cannot be created its band is processed on the calling thread,
+// so the output never depends on how many threads actually ran.
+
+static void etc_process_image_parallel(const etc_band& image, etc1_uint32 threadCount) {
+    etc1_uint32 blockRows = image.yBlockEnd;
+    if (threadCount == 0) {
+#if !defined(_WIN32)
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = cpus > 0 ? (etc1_uint32) cpus : 1;
+#else
+        threadCount = 1;
+#endif
+    }
+    if (threadCount > ETC1_MAX_THREADS) {
+        threadCount = ETC1_MAX_THREADS;
+    }
+    if (threadCount > blockRows) {
+        threadCount = blockRows;
+    }
+#if defined(_WIN32)
+    threadCount = 1;
+#endif
+    if (threadCount <= 1) {
+        etc_process_band(&image);
+        return;
+    }
+
+    etc_band bands[ETC1_MAX_THREADS];
+    for (etc1_uint32 i = 0; i < threadCount; i++) {
+        bands[i] = image;
+        bands[i].yBlockBegin = (etc1_uint32) ((uint64_t) blockRows * i / threadCount);
+        bands[i].yBlockEnd = (etc1_uint32) ((uint64_t) blockRows * (i + 1) / threadCount);
+    }
+
+#if !defined(_WIN32)
+    pthread_t threads[ETC1_MAX_THREADS];
+    bool started[ETC1_MAX_THREADS];
+    for (etc1_uint32 i = 1; i < threadCount; i++) {
+        started[i] = pthread_create(&threads[i], NULL, etc_band_thread, &bands[i]) == 0;
+    }
+    etc_process_band(&bands[0]);
+    for (etc1_uint32 i = 1; i < threadCount; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            etc_process_band(&bands[i]);
+        }
+    }
+#endif
+}
+
+// Encode an entire image.
+// pIn - pointer to the image data. Formatted such that the Red component of
+//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
+// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+
+int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    etc_encode_block_rows(pIn, width, height, pixelSize, stride, pOut,
+            0, (height + 3) >> 2);
+    return 0;
+}
+
+// Encode an entire image, splitting it into bands of block rows that are
+// encoded concurrently. The output is identical to etc1_encode_image.
+
+int etc1_encode_image_parallel(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        etc1_uint32 threadCount) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    etc_band image = { pIn, pOut, width, height, pixelSize, stride,
+            0, (height + 3) >> 2, true };
+    etc_process_image_parallel(image, threadCount);
+    return 0;
+}
+
+// Decode an entire image.
+// pIn - pointer to encoded data.
+// pOut - pointer to the image data. Will be written such that the Red component of
+//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset. Must be
+//        large enough to store entire image.
+
+
+int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    etc_decode_block_rows(pIn, pOut, width, height, pixelSize, stride,
+            0, (height + 3) >> 2);
+    return 0;
+}
+
+// Decode an entire image, splitting it into bands of block rows that are
+// decoded concurrently. The output is identical to etc1_decode_image.
+
+int etc1_decode_image_parallel(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_uint32 threadCount) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    etc_band image = { pIn, pOut, width, height, pixelSize, stride,
+            0, (height + 3) >> 2, false };
+    etc_process_image_parallel(image, threadCount);
     return 0;
 }
 
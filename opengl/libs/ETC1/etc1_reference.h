@@ -0,0 +1,29 @@
+// Copyright 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __etc1_reference_h__
+#define __etc1_reference_h__
+
+// Private to libETC1 and its tests: the original scalar codec, kept as the
+// reference that etc1_encode_block and etc1_decode_block must match bit for
+// bit.
+
+#include <ETC1/etc1.h>
+
+void etc1_encode_block_reference(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut);
+
+void etc1_decode_block_reference(const etc1_byte* pIn, etc1_byte* pOut);
+
+#endif
@@ -0,0 +1,253 @@
+// Copyright 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <ETC1/etc1.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "etc1_reference.h"
+
+namespace {
+
+class ETC1Test : public ::testing::Test {
+protected:
+    ETC1Test() : mRandom(0x45544331) {
+    }
+
+    etc1_byte randomByte() {
+        return etc1_byte(mRandom());
+    }
+
+    void randomBytes(etc1_byte* p, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            p[i] = randomByte();
+        }
+    }
+
+    void expectSameEncoding(const etc1_byte* pIn, etc1_uint32 mask) {
+        etc1_byte expected[ETC1_ENCODED_BLOCK_SIZE];
+        etc1_byte actual[ETC1_ENCODED_BLOCK_SIZE];
+        etc1_encode_block_reference(pIn, mask, expected);
+        etc1_encode_block(pIn, mask, actual);
+        ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected)))
+                << "mask 0x" << std::hex << mask;
+    }
+
+    void expectSameDecoding(const etc1_byte* pIn) {
+        etc1_byte expected[ETC1_DECODED_BLOCK_SIZE];
+        etc1_byte actual[ETC1_DECODED_BLOCK_SIZE];
+        etc1_decode_block_reference(pIn, expected);
+        etc1_decode_block(pIn, actual);
+        ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected)));
+    }
+
+    std::mt19937 mRandom;
+};
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+TEST_F(ETC1Test, EncodeRandomBlocksMatchesReference) {
+    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
+    for (int i = 0; i < 20000; i++) {
+        randomBytes(block, sizeof(block));
+        etc1_uint32 mask = (i % 4 == 0) ? (mRandom() & 0xffff) : 0xffff;
+        ASSERT_NO_FATAL_FAILURE(expectSameEncoding(block, mask));
+    }
+}
+
+TEST_F(ETC1Test, EncodeStructuredBlocksMatchesReference) {
+    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
+
+    // Flat colors, including the extremes that exercise clamping.
+    static const etc1_byte kLevels[] = { 0, 1, 7, 8, 127, 128, 247, 248, 254, 255 };
+    for (etc1_byte r : kLevels) {
+        for (etc1_byte g : kLevels) {
+            for (etc1_byte b : kLevels) {
+                for (int i = 0; i < 16; i++) {
+                    block[i * 3] = r;
+                    block[i * 3 + 1] = g;
+                    block[i * 3 + 2] = b;
+                }
+                ASSERT_NO_FATAL_FAILURE(expectSameEncoding(block, 0xffff));
+            }
+        }
+    }
+
+    // Two flat halves, split both ways, so each orientation wins sometimes.
+    for (int i = 0; i < 2000; i++) {
+        etc1_byte colors[2][3];
+        randomBytes(&colors[0][0], sizeof(colors));
+        bool horizontal = i & 1;
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                int half = horizontal ? (y >> 1) : (x >> 1);
+                memcpy(block + 3 * (x + 4 * y), colors[half], 3);
+            }
+        }
+        ASSERT_NO_FATAL_FAILURE(expectSameEncoding(block, 0xffff));
+    }
+
+    // Small noise around a base color, which makes modifier ties likely.
+    for (int i = 0; i < 2000; i++) {
+        etc1_byte base[3];
+        randomBytes(base, sizeof(base));
+        for (int p = 0; p < 48; p++) {
+            int value = base[p % 3] + int(mRandom() % 9) - 4;
+            block[p] = etc1_byte(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
+        ASSERT_NO_FATAL_FAILURE(expectSameEncoding(block, 0xffff));
+    }
+
+    // Every partial mask that etc1_encode_image produces for edge blocks.
+    static const etc1_uint32 kYMask[] = { 0xf, 0xff, 0xfff, 0xffff };
+    static const etc1_uint32 kXMask[] = { 0x1111, 0x3333, 0x7777, 0xffff };
+    for (int i = 0; i < 200; i++) {
+        randomBytes(block, sizeof(block));
+        for (etc1_uint32 ymask : kYMask) {
+            for (etc1_uint32 xmask : kXMask) {
+                ASSERT_NO_FATAL_FAILURE(expectSameEncoding(block, ymask & xmask));
+            }
+        }
+    }
+}
+
+TEST_F(ETC1Test, DecodeMatchesReference) {
+    etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
+    for (int i = 0; i < 100000; i++) {
+        randomBytes(encoded, sizeof(encoded));
+        ASSERT_NO_FATAL_FAILURE(expectSameDecoding(encoded));
+    }
+
+    // Saturated base colors in both modes, with every table and flip.
+    for (int table = 0; table < 64; table++) {
+        for (int mode = 0; mode < 4; mode++) {
+            etc1_byte value = (mode & 2) ? 0xff : 0x00;
+            memset(encoded, value, 3);
+            encoded[3] = etc1_byte((table << 2) | mode);
+            randomBytes(encoded + 4, 4);
+            ASSERT_NO_FATAL_FAILURE(expectSameDecoding(encoded));
+        }
+    }
+}
+
+TEST_F(ETC1Test, ParallelImageMatchesSerial) {
+    static const etc1_uint32 kSizes[][2] = {
+        { 1, 1 }, { 3, 5 }, { 4, 4 }, { 17, 9 }, { 64, 3 }, { 33, 130 },
+    };
+    for (const etc1_uint32* size : kSizes) {
+        etc1_uint32 width = size[0];
+        etc1_uint32 height = size[1];
+        for (etc1_uint32 pixelSize = 2; pixelSize <= 3; pixelSize++) {
+            etc1_uint32 stride = width * pixelSize + 3;
+            std::vector<etc1_byte> image(stride * height);
+            randomBytes(image.data(), image.size());
+
+            etc1_uint32 encodedSize = etc1_get_encoded_data_size(width, height);
+            std::vector<etc1_byte> serial(encodedSize);
+            ASSERT_EQ(0, etc1_encode_image(image.data(), width, height, pixelSize,
+                    stride, serial.data()));
+
+            std::vector<etc1_byte> serialDecoded(image.size(), 0);
+            ASSERT_EQ(0, etc1_decode_image(serial.data(), serialDecoded.data(), width,
+                    height, pixelSize, stride));
+
+            for (etc1_uint32 threads : { 0u, 1u, 2u, 3u, 64u }) {
+                std::vector<etc1_byte> parallel(encodedSize, 0xcd);
+                ASSERT_EQ(0, etc1_encode_image_parallel(image.data(), width, height,
+                        pixelSize, stride, parallel.data(), threads));
+                ASSERT_EQ(serial, parallel) << width << "x" << height
+                        << " pixelSize " << pixelSize << " threads " << threads;
+
+                std::vector<etc1_byte> decoded(image.size(), 0);
+                ASSERT_EQ(0, etc1_decode_image_parallel(parallel.data(), decoded.data(),
+                        width, height, pixelSize, stride, threads));
+                ASSERT_EQ(serialDecoded, decoded) << width << "x" << height
+                        << " pixelSize " << pixelSize << " threads " << threads;
+            }
+        }
+    }
+
+    etc1_byte dummy[ETC1_ENCODED_BLOCK_SIZE];
+    ASSERT_NE(0, etc1_encode_image_parallel(dummy, 1, 1, 4, 4, dummy, 1));
+    ASSERT_NE(0, etc1_decode_image_parallel(dummy, dummy, 1, 1, 1, 1, 1));
+}
+
+// Not a correctness test: prints the throughput of the reference encoder,
+// the optimized encoder and the parallel image paths on a 1024x1024 image.
+TEST_F(ETC1Test, Benchmark) {
+    const etc1_uint32 width = 1024;
+    const etc1_uint32 height = 1024;
+    const etc1_uint32 stride = width * 3;
+    std::vector<etc1_byte> image(stride * height);
+    // A smooth gradient with some noise looks more like real textures than
+    // pure noise does.
+    for (etc1_uint32 y = 0; y < height; y++) {
+        for (etc1_uint32 x = 0; x < width; x++) {
+            etc1_byte* p = &image[y * stride + x * 3];
+            p[0] = etc1_byte(x / 4 + (mRandom() & 7));
+            p[1] = etc1_byte(y / 4 + (mRandom() & 7));
+            p[2] = etc1_byte((x + y) / 8 + (mRandom() & 7));
+        }
+    }
+    const double mpixels = width * height / 1e6;
+    std::vector<etc1_byte> encoded(etc1_get_encoded_data_size(width, height));
+    std::vector<etc1_byte> decoded(image.size());
+
+    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
+    double start = nowSeconds();
+    for (etc1_uint32 y = 0; y < height; y += 4) {
+        for (etc1_uint32 x = 0; x < width; x += 4) {
+            for (int cy = 0; cy < 4; cy++) {
+                memcpy(block + cy * 12, &image[(y + cy) * stride + x * 3], 12);
+            }
+            etc1_encode_block_reference(block, 0xffff,
+                    &encoded[((y / 4) * (width / 4) + x / 4) * ETC1_ENCODED_BLOCK_SIZE]);
+        }
+    }
+    printf("encode (reference): %8.2f MPixel/s\n", mpixels / (nowSeconds() - start));
+
+    start = nowSeconds();
+    etc1_encode_image(image.data(), width, height, 3, stride, encoded.data());
+    printf("encode:             %8.2f MPixel/s\n", mpixels / (nowSeconds() - start));
+
+    start = nowSeconds();
+    etc1_encode_image_parallel(image.data(), width, height, 3, stride, encoded.data(), 0);
+    printf("encode (parallel):  %8.2f MPixel/s\n", mpixels / (nowSeconds() - start));
+
+    start = nowSeconds();
+    for (int i = 0; i < 10; i++) {
+        etc1_decode_image(encoded.data(), decoded.data(), width, height, 3, stride);
+    }
+    printf("decode:             %8.2f MPixel/s\n", 10 * mpixels / (nowSeconds() - start));
+
+    start = nowSeconds();
+    for (int i = 0; i < 10; i++) {
+        etc1_decode_image_parallel(encoded.data(), decoded.data(), width, height, 3,
+                stride, 0);
+    }
+    printf("decode (parallel):  %8.2f MPixel/s\n", 10 * mpixels / (nowSeconds() - start));
+}
+
+} // namespace
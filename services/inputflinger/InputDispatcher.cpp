@@ -46,6 +46,7 @@
 #include "InputDispatcher.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stddef.h>
 #include <time.h>
@@ -410,6 +411,12 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
     mInboundQueue.enqueueAtTail(entry);
     traceInboundQueueLengthLocked();
 
+    int32_t deviceId;
+    if (isLatencySampledLocked(entry, &deviceId)) {
+        entry->enqueueTime = now();
+        mLatencyTracker->notifyEventEnqueued(deviceId, entry->eventTime, entry->enqueueTime);
+    }
+
     switch (entry->type) {
     case EventEntry::TYPE_KEY: {
         // Optimize app switch latency.
@@ -475,27 +482,7 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
-    // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
-        const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        if (windowInfo->displayId == displayId) {
-            int32_t flags = windowInfo->layoutParamsFlags;
-
-            if (windowInfo->visible) {
-                if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
-                            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        // Found window.
-                        return windowHandle;
-                    }
-                }
-            }
-        }
-    }
-    return NULL;
+    return mWindowIndex.findTouchedWindow(displayId, x, y);
 }
 
 void InputDispatcher::dropInboundEventLocked(EventEntry* entry, DropReason dropReason) {
@@ -1204,35 +1191,16 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
                 getAxisValue(AMOTION_EVENT_AXIS_X));
         int32_t y = int32_t(entry->pointerCoords[pointerIndex].
                 getAxisValue(AMOTION_EVENT_AXIS_Y));
-        sp<InputWindowHandle> newTouchedWindowHandle;
-        bool isTouchModal = false;
 
-        // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
-            const InputWindowInfo* windowInfo = windowHandle->getInfo();
-            if (windowInfo->displayId != displayId) {
-                continue; // wrong display
-            }
-
-            int32_t flags = windowInfo->layoutParamsFlags;
-            if (windowInfo->visible) {
-                if (! (flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
-                            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        newTouchedWindowHandle = windowHandle;
-                        break; // found touched window, exit window loop
-                    }
-                }
-
-                if (maskedAction == AMOTION_EVENT_ACTION_DOWN
-                        && (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)) {
-                    mTempTouchState.addOrUpdateWindow(
-                            windowHandle, InputTarget::FLAG_DISPATCH_AS_OUTSIDE, BitSet32(0));
-                }
-            }
+        // Find the touched window and, for a down, the windows in front of it that
+        // watch outside touches.
+        Vector<sp<InputWindowHandle> > outsideTouchWindowHandles;
+        sp<InputWindowHandle> newTouchedWindowHandle = mWindowIndex.findTouchedWindow(
+                displayId, x, y, maskedAction == AMOTION_EVENT_ACTION_DOWN
+                        ? &outsideTouchWindowHandles : NULL);
+        for (size_t i = 0; i < outsideTouchWindowHandles.size(); i++) {
+            mTempTouchState.addOrUpdateWindow(outsideTouchWindowHandles.itemAt(i),
+                    InputTarget::FLAG_DISPATCH_AS_OUTSIDE, BitSet32(0));
         }
 
         // Figure out whether splitting will be allowed for this window.
@@ -2066,6 +2034,12 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             return;
         }
 
+        int32_t deviceId;
+        if (eventEntry->enqueueTime && isLatencySampledLocked(eventEntry, &deviceId)) {
+            mLatencyTracker->notifyEventPublished(deviceId, String8(connection->getWindowName()),
+                    eventEntry->enqueueTime, currentTime);
+        }
+
         // Re-enqueue the event on the wait queue.
         connection->outboundQueue.dequeue(dispatchEntry);
         traceOutboundQueueLengthLocked(connection);
@@ -2874,6 +2848,7 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
                 foundHoveredWindow = true;
             }
         }
+        mWindowIndex.update(mWindowHandles);
 
         if (!foundHoveredWindow) {
             mLastHoverWindowHandle = NULL;
@@ -3336,6 +3311,11 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             mConfig.keyRepeatDelay * 0.000001f);
     dump.appendFormat(INDENT2 "KeyRepeatTimeout: %0.1fms\n",
             mConfig.keyRepeatTimeout * 0.000001f);
+
+    dump.append(INDENT "EntryPools:\n");
+    getKeyEntryPool().dump(dump);
+    getMotionEntryPool().dump(dump);
+    getDispatchEntryPool().dump(dump);
 }
 
 status_t InputDispatcher::registerInputChannel(const sp<InputChannel>& inputChannel,
@@ -3572,6 +3552,13 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
             ALOGI("%s", msg.string());
         }
 
+        int32_t deviceId;
+        if (dispatchEntry->eventEntry->enqueueTime
+                && isLatencySampledLocked(dispatchEntry->eventEntry, &deviceId)) {
+            mLatencyTracker->notifyEventFinished(deviceId, String8(connection->getWindowName()),
+                    dispatchEntry->deliveryTime, finishTime);
+        }
+
         bool restartEvent;
         if (dispatchEntry->eventEntry->type == EventEntry::TYPE_KEY) {
             KeyEntry* keyEntry = static_cast<KeyEntry*>(dispatchEntry->eventEntry);
@@ -3829,12 +3816,46 @@ void InputDispatcher::dump(String8& dump) {
     dump.append("Input Dispatcher State:\n");
     dumpDispatchStateLocked(dump);
 
+    if (mLatencyTracker != NULL) {
+        dump.append("\n");
+        mLatencyTracker->dump(dump);
+    }
+
     if (!mLastANRState.isEmpty()) {
         dump.append("\nInput Dispatcher State at time of last ANR:\n");
         dump.append(mLastANRState);
     }
 }
 
+void InputDispatcher::setLatencyTracker(const sp<InputLatencyTracker>& latencyTracker) {
+    AutoMutex _l(mLock);
+    mLatencyTracker = latencyTracker;
+}
+
+bool InputDispatcher::isLatencySampledLocked(const EventEntry* entry,
+        int32_t* outDeviceId) const {
+    if (mLatencyTracker == NULL || entry->isInjected()) {
+        return false;
+    }
+
+    int32_t deviceId;
+    switch (entry->type) {
+    case EventEntry::TYPE_KEY:
+        deviceId = static_cast<const KeyEntry*>(entry)->deviceId;
+        break;
+    case EventEntry::TYPE_MOTION:
+        deviceId = static_cast<const MotionEntry*>(entry)->deviceId;
+        break;
+    default:
+        return false;
+    }
+    if (!mLatencyTracker->isSampled(deviceId, entry->eventTime)) {
+        return false;
+    }
+    *outDeviceId = deviceId;
+    return true;
+}
+
 void InputDispatcher::monitor() {
     // Acquire and release the lock to ensure that the dispatcher has not deadlocked.
     mLock.lock();
@@ -3844,6 +3865,85 @@ void InputDispatcher::monitor() {
 }
 
 
+// --- InputEntryPool ---
+
+volatile int32_t InputEntryPool::sCachingEnabled = 1;
+
+InputEntryPool::InputEntryPool(const char* name, size_t blockSize, size_t maxCachedBlocks) :
+        mName(name), mBlockSize(blockSize), mMaxCachedBlocks(maxCachedBlocks),
+        mFreeList(NULL), mCachedBlocks(0), mLiveBlocks(0), mPeakLiveBlocks(0),
+        mAllocations(0), mHeapAllocations(0) {
+}
+
+void* InputEntryPool::allocate(size_t size) {
+    LOG_ALWAYS_FATAL_IF(size != mBlockSize, "%s pool cannot allocate %zu bytes, block size is %zu",
+            mName, size, mBlockSize);
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mAllocations += 1;
+        mLiveBlocks += 1;
+        if (mLiveBlocks > mPeakLiveBlocks) {
+            mPeakLiveBlocks = mLiveBlocks;
+        }
+        if (mFreeList && android_atomic_acquire_load(&sCachingEnabled)) {
+            FreeBlock* block = mFreeList;
+            mFreeList = block->next;
+            mCachedBlocks -= 1;
+            return block;
+        }
+        mHeapAllocations += 1;
+    } // release lock
+    return ::operator new(mBlockSize);
+}
+
+void InputEntryPool::free(void* block) {
+    if (!block) {
+        return;
+    }
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mLiveBlocks -= 1;
+        if (mCachedBlocks < mMaxCachedBlocks && android_atomic_acquire_load(&sCachingEnabled)) {
+            FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+            freeBlock->next = mFreeList;
+            mFreeList = freeBlock;
+            mCachedBlocks += 1;
+            return;
+        }
+    } // release lock
+    ::operator delete(block);
+}
+
+void InputEntryPool::dump(String8& dump) const {
+    AutoMutex _l(mLock);
+    dump.appendFormat(INDENT2 "%s: live=%zu, peakLive=%zu, cached=%zu/%zu, "
+            "allocations=%" PRIu64 ", heapAllocations=%" PRIu64 "\n",
+            mName, mLiveBlocks, mPeakLiveBlocks, mCachedBlocks, mMaxCachedBlocks,
+            mAllocations, mHeapAllocations);
+}
+
+void InputEntryPool::setCachingEnabled(bool enabled) {
+    android_atomic_release_store(enabled ? 1 : 0, &sCachingEnabled);
+}
+
+// The pools are never destroyed so that entries still referenced during
+// process teardown can be released safely.
+InputEntryPool& InputDispatcher::getKeyEntryPool() {
+    static InputEntryPool* pool = new InputEntryPool("KeyEntry", sizeof(KeyEntry), 32);
+    return *pool;
+}
+
+InputEntryPool& InputDispatcher::getMotionEntryPool() {
+    static InputEntryPool* pool = new InputEntryPool("MotionEntry", sizeof(MotionEntry), 64);
+    return *pool;
+}
+
+InputEntryPool& InputDispatcher::getDispatchEntryPool() {
+    static InputEntryPool* pool = new InputEntryPool("DispatchEntry", sizeof(DispatchEntry), 256);
+    return *pool;
+}
+
+
 // --- InputDispatcher::InjectionState ---
 
 InputDispatcher::InjectionState::InjectionState(int32_t injectorPid, int32_t injectorUid) :
@@ -3870,7 +3970,7 @@ void InputDispatcher::InjectionState::release() {
 
 InputDispatcher::EventEntry::EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags) :
         refCount(1), type(type), eventTime(eventTime), policyFlags(policyFlags),
-        injectionState(NULL), dispatchInProgress(false) {
+        injectionState(NULL), enqueueTime(0), dispatchInProgress(false) {
 }
 
 InputDispatcher::EventEntry::~EventEntry() {
@@ -3950,6 +4050,14 @@ void InputDispatcher::KeyEntry::appendDescription(String8& msg) const {
             repeatCount, policyFlags);
 }
 
+void* InputDispatcher::KeyEntry::operator new(size_t size) {
+    return getKeyEntryPool().allocate(size);
+}
+
+void InputDispatcher::KeyEntry::operator delete(void* ptr) {
+    getKeyEntryPool().free(ptr);
+}
+
 void InputDispatcher::KeyEntry::recycle() {
     releaseInjectionState();
 
@@ -3987,6 +4095,14 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime, int32_t deviceId,
 InputDispatcher::MotionEntry::~MotionEntry() {
 }
 
+void* InputDispatcher::MotionEntry::operator new(size_t size) {
+    return getMotionEntryPool().allocate(size);
+}
+
+void InputDispatcher::MotionEntry::operator delete(void* ptr) {
+    getMotionEntryPool().free(ptr);
+}
+
 void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
     msg.appendFormat("MotionEvent(deviceId=%d, source=0x%08x, action=%d, actionButton=0x%08x, "
             "flags=0x%08x, metaState=0x%08x, buttonState=0x%08x, "
@@ -4021,6 +4137,14 @@ InputDispatcher::DispatchEntry::~DispatchEntry() {
     eventEntry->release();
 }
 
+void* InputDispatcher::DispatchEntry::operator new(size_t size) {
+    return getDispatchEntryPool().allocate(size);
+}
+
+void InputDispatcher::DispatchEntry::operator delete(void* ptr) {
+    getDispatchEntryPool().free(ptr);
+}
+
 uint32_t InputDispatcher::DispatchEntry::nextSeq() {
     // Sequence number 0 is reserved and will never be returned.
     uint32_t seq;
@@ -35,6 +35,7 @@
 
 #include "InputWindow.h"
 #include "InputApplication.h"
+#include "InputLatencyTracker.h"
 #include "InputListener.h"
 
 
@@ -349,6 +350,48 @@ public:
     virtual status_t unregisterInputChannel(const sp<InputChannel>& inputChannel) = 0;
 };
 
+/*
+ * A free list of fixed-size blocks that the dispatcher allocates its most frequent
+ * entries from, so that steady-state dispatch does not go through the heap.
+ *
+ * Freed blocks are kept for reuse up to a limit and only then returned to the heap.
+ * Pools have their own lock because injected events are allocated on binder threads,
+ * outside of the dispatcher lock.
+ */
+class InputEntryPool {
+public:
+    InputEntryPool(const char* name, size_t blockSize, size_t maxCachedBlocks);
+
+    void* allocate(size_t size);
+    void free(void* block);
+
+    void dump(String8& dump) const;
+
+    /* Enables or disables block reuse in all pools.  Enabled by default.
+     * Disabling it makes every allocation go to the heap, which is only useful
+     * to measure the unpooled baseline. */
+    static void setCachingEnabled(bool enabled);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    const char* const mName;
+    const size_t mBlockSize;
+    const size_t mMaxCachedBlocks;
+
+    mutable Mutex mLock;
+    FreeBlock* mFreeList;
+    size_t mCachedBlocks;
+    size_t mLiveBlocks;
+    size_t mPeakLiveBlocks;
+    uint64_t mAllocations;
+    uint64_t mHeapAllocations;
+
+    static volatile int32_t sCachingEnabled;
+};
+
 /* Dispatches events to input targets.  Some functions of the input dispatcher, such as
  * identifying input targets, are controlled by a separate policy object.
  *
@@ -400,6 +443,9 @@ public:
             const sp<InputWindowHandle>& inputWindowHandle, bool monitor);
     virtual status_t unregisterInputChannel(const sp<InputChannel>& inputChannel);
 
+    /* Sets the tracker that collects the latency of sampled events, or NULL. */
+    void setLatencyTracker(const sp<InputLatencyTracker>& latencyTracker);
+
 private:
     template <typename T>
     struct Link {
@@ -439,6 +485,7 @@ private:
         nsecs_t eventTime;
         uint32_t policyFlags;
         InjectionState* injectionState;
+        nsecs_t enqueueTime; // time when a latency sampled event entered the inbound queue, or 0
 
         bool dispatchInProgress; // initially false, set to true while dispatching
 
@@ -501,6 +548,9 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
     protected:
         virtual ~KeyEntry();
     };
@@ -533,6 +583,9 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(String8& msg) const;
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
     protected:
         virtual ~MotionEntry();
     };
@@ -556,6 +609,9 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -954,6 +1010,7 @@ private:
     bool mInputFilterEnabled;
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowIndex mWindowIndex;
 
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
@@ -1099,6 +1156,11 @@ private:
     void dumpDispatchStateLocked(String8& dump);
     void logDispatchStateLocked();
 
+    // Pools for the entries that are allocated for every input event.
+    static InputEntryPool& getKeyEntryPool();
+    static InputEntryPool& getMotionEntryPool();
+    static InputEntryPool& getDispatchEntryPool();
+
     // Registration.
     void removeMonitorChannelLocked(const sp<InputChannel>& inputChannel);
     status_t unregisterInputChannelLocked(const sp<InputChannel>& inputChannel, bool notify);
@@ -1136,6 +1198,11 @@ private:
     void traceInboundQueueLengthLocked();
     void traceOutboundQueueLengthLocked(const sp<Connection>& connection);
     void traceWaitQueueLengthLocked(const sp<Connection>& connection);
+
+    // Latency tracking.
+    sp<InputLatencyTracker> mLatencyTracker;
+
+    bool isLatencySampledLocked(const EventEntry* entry, int32_t* outDeviceId) const;
 };
 
 /* Enqueues and dispatches input events, endlessly. */
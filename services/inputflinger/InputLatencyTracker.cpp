@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputLatencyTracker"
+
+#include "InputLatencyTracker.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <log/log.h>
+
+#define INDENT "  "
+#define INDENT2 "    "
+#define INDENT3 "      "
+
+namespace android {
+
+// The upper bound of the first histogram bucket.
+static const nsecs_t FIRST_BUCKET_UPPER_BOUND = 125000; // 125us
+
+static const char* const STAGE_NAMES[InputLatencyTracker::STAGE_COUNT] = {
+    "read", "cook", "queue", "consume",
+};
+
+static uint32_t hashEvent(int32_t deviceId, nsecs_t eventTime) {
+    // Mix the bits so that periodic timestamps do not alias with the sample rate.
+    uint64_t h = uint64_t(eventTime) ^ (uint64_t(uint32_t(deviceId)) << 32);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return uint32_t(h);
+}
+
+static void appendMillis(String8& dump, nsecs_t time) {
+    if (time == LLONG_MAX) {
+        dump.append("inf");
+    } else {
+        dump.appendFormat("%0.3fms", time * 0.000001f);
+    }
+}
+
+
+// --- InputLatencyTracker::Histogram ---
+
+InputLatencyTracker::Histogram::Histogram() :
+        count(0), total(0), max(0) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+nsecs_t InputLatencyTracker::Histogram::getBucketUpperBound(size_t bucket) {
+    return bucket + 1 < BUCKET_COUNT ? FIRST_BUCKET_UPPER_BOUND << bucket : LLONG_MAX;
+}
+
+void InputLatencyTracker::Histogram::record(nsecs_t latency) {
+    if (latency < 0) {
+        latency = 0;
+    }
+    size_t bucket = 0;
+    while (bucket + 1 < BUCKET_COUNT && latency >= getBucketUpperBound(bucket)) {
+        bucket += 1;
+    }
+    buckets[bucket] += 1;
+    count += 1;
+    total += latency;
+    if (latency > max) {
+        max = latency;
+    }
+}
+
+nsecs_t InputLatencyTracker::Histogram::getPercentile(uint32_t percent) const {
+    uint64_t target = (uint64_t(count) * percent + 99) / 100;
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return getBucketUpperBound(i);
+        }
+    }
+    return LLONG_MAX;
+}
+
+
+// --- InputLatencyTracker::StageHistograms ---
+
+InputLatencyTracker::StageHistograms::StageHistograms() :
+        lastRecordTime(0) {
+}
+
+
+// --- InputLatencyTracker ---
+
+InputLatencyTracker::InputLatencyTracker(uint32_t sampleRate) :
+        mSampleRate(sampleRate) {
+}
+
+InputLatencyTracker::~InputLatencyTracker() {
+}
+
+bool InputLatencyTracker::isSampled(int32_t deviceId, nsecs_t eventTime) const {
+    return mSampleRate && hashEvent(deviceId, eventTime) % mSampleRate == 0;
+}
+
+void InputLatencyTracker::notifyEventsRead(const RawEvent* rawEvents, size_t count,
+        nsecs_t readTime) {
+    if (!mSampleRate) {
+        return;
+    }
+
+    // Every event of an evdev report carries the same timestamp, so the report is
+    // accounted for once, at its SYN_REPORT.
+    for (size_t i = 0; i < count; i++) {
+        const RawEvent& rawEvent = rawEvents[i];
+        if (rawEvent.type != EV_SYN || rawEvent.code != SYN_REPORT
+                || !isSampled(rawEvent.deviceId, rawEvent.when)) {
+            continue;
+        }
+
+        AutoMutex _l(mLock);
+        getDeviceLocked(rawEvent.deviceId, readTime).stages[STAGE_READ].record(
+                readTime - rawEvent.when);
+
+        PendingRead pendingRead;
+        pendingRead.eventTime = rawEvent.when;
+        pendingRead.readTime = readTime;
+        mPendingReads.add(rawEvent.deviceId, pendingRead);
+    }
+}
+
+void InputLatencyTracker::notifyEventEnqueued(int32_t deviceId, nsecs_t eventTime,
+        nsecs_t enqueueTime) {
+    AutoMutex _l(mLock);
+
+    // A report may be cooked into several events, only the first one is counted.
+    ssize_t index = mPendingReads.indexOfKey(deviceId);
+    if (index >= 0 && mPendingReads.valueAt(index).eventTime == eventTime) {
+        getDeviceLocked(deviceId, enqueueTime).stages[STAGE_COOK].record(
+                enqueueTime - mPendingReads.valueAt(index).readTime);
+        mPendingReads.removeItemsAt(index);
+    }
+}
+
+void InputLatencyTracker::notifyEventPublished(int32_t deviceId, const String8& windowName,
+        nsecs_t enqueueTime, nsecs_t publishTime) {
+    AutoMutex _l(mLock);
+
+    nsecs_t latency = publishTime - enqueueTime;
+    getDeviceLocked(deviceId, publishTime).stages[STAGE_QUEUE].record(latency);
+    getWindowLocked(windowName, publishTime).stages[STAGE_QUEUE].record(latency);
+}
+
+void InputLatencyTracker::notifyEventFinished(int32_t deviceId, const String8& windowName,
+        nsecs_t publishTime, nsecs_t finishTime) {
+    AutoMutex _l(mLock);
+
+    nsecs_t latency = finishTime - publishTime;
+    getDeviceLocked(deviceId, finishTime).stages[STAGE_CONSUME].record(latency);
+    getWindowLocked(windowName, finishTime).stages[STAGE_CONSUME].record(latency);
+}
+
+InputLatencyTracker::StageHistograms& InputLatencyTracker::getDeviceLocked(
+        int32_t deviceId, nsecs_t now) {
+    ssize_t index = mDevices.indexOfKey(deviceId);
+    if (index < 0) {
+        index = mDevices.add(deviceId, StageHistograms());
+    }
+    StageHistograms& histograms = mDevices.editValueAt(index);
+    histograms.lastRecordTime = now;
+    return histograms;
+}
+
+InputLatencyTracker::StageHistograms& InputLatencyTracker::getWindowLocked(
+        const String8& windowName, nsecs_t now) {
+    ssize_t index = mWindows.indexOfKey(windowName);
+    if (index < 0) {
+        if (mWindows.size() >= MAX_TRACKED_WINDOWS) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < mWindows.size(); i++) {
+                if (mWindows.valueAt(i).lastRecordTime
+                        < mWindows.valueAt(oldest).lastRecordTime) {
+                    oldest = i;
+                }
+            }
+            mWindows.removeItemsAt(oldest);
+        }
+        index = mWindows.add(windowName, StageHistograms());
+    }
+    StageHistograms& histograms = mWindows.editValueAt(index);
+    histograms.lastRecordTime = now;
+    return histograms;
+}
+
+void InputLatencyTracker::dump(String8& dump) {
+    AutoMutex _l(mLock);
+
+    dump.append("Input Latency:\n");
+    if (!mSampleRate) {
+        dump.append(INDENT "Disabled\n");
+        return;
+    }
+    dump.appendFormat(INDENT "SampleRate: 1 in %u\n", mSampleRate);
+
+    if (mDevices.isEmpty()) {
+        dump.append(INDENT "Devices: <none>\n");
+    } else {
+        dump.append(INDENT "Devices:\n");
+        for (size_t i = 0; i < mDevices.size(); i++) {
+            dump.appendFormat(INDENT2 "%d:\n", mDevices.keyAt(i));
+            dumpHistograms(dump, mDevices.valueAt(i));
+        }
+    }
+
+    if (mWindows.isEmpty()) {
+        dump.append(INDENT "Windows: <none>\n");
+    } else {
+        dump.append(INDENT "Windows:\n");
+        for (size_t i = 0; i < mWindows.size(); i++) {
+            dump.appendFormat(INDENT2 "'%s':\n", mWindows.keyAt(i).string());
+            dumpHistograms(dump, mWindows.valueAt(i));
+        }
+    }
+}
+
+void InputLatencyTracker::dumpHistograms(String8& dump, const StageHistograms& histograms) {
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        const Histogram& histogram = histograms.stages[i];
+        if (!histogram.count) {
+            continue;
+        }
+        dump.appendFormat(INDENT3 "%s: count=%u, mean=", STAGE_NAMES[i], histogram.count);
+        appendMillis(dump, histogram.total / histogram.count);
+        dump.append(", p50<=");
+        appendMillis(dump, histogram.getPercentile(50));
+        dump.append(", p90<=");
+        appendMillis(dump, histogram.getPercentile(90));
+        dump.append(", p99<=");
+        appendMillis(dump, histogram.getPercentile(99));
+        dump.append(", max=");
+        appendMillis(dump, histogram.max);
+        dump.append("\n");
+    }
+}
+
+} // namespace android
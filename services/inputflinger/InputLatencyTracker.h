@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_LATENCY_TRACKER_H
+#define _UI_INPUT_LATENCY_TRACKER_H
+
+#include "EventHub.h"
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Tracks the latency of input events through each stage of the input pipeline.
+ *
+ * An event is followed from the kernel timestamp of its evdev report to the time its
+ * target finishes handling it:
+ *
+ *   read:    kernel timestamp to EventHub::getEvents() returning the report
+ *   cook:    read to InputDispatcher::enqueueInboundEventLocked()
+ *   queue:   enqueued to published on the target's input channel
+ *   consume: published to the finished signal arriving from the consumer
+ *
+ * Only one in every sampleRate reports is tracked.  The choice is a hash of the device
+ * id and the report timestamp, so every stage agrees on which events are sampled
+ * without any per event bookkeeping.  Latencies are aggregated into histograms per
+ * device and per window, which are printed by dump().
+ *
+ * The tracker is shared by the reader and dispatcher threads and is thread-safe.
+ */
+class InputLatencyTracker : public RefBase {
+public:
+    enum Stage {
+        STAGE_READ,
+        STAGE_COOK,
+        STAGE_QUEUE,
+        STAGE_CONSUME,
+
+        STAGE_COUNT
+    };
+
+    /* A histogram with power of two buckets from 125us up to 128ms. */
+    struct Histogram {
+        enum { BUCKET_COUNT = 12 };
+
+        uint32_t buckets[BUCKET_COUNT];
+        uint32_t count;
+        nsecs_t total;
+        nsecs_t max;
+
+        Histogram();
+
+        void record(nsecs_t latency);
+
+        /* Returns the upper bound of the bucket that holds the given percentile,
+         * or LLONG_MAX if it is in the last, unbounded bucket. */
+        nsecs_t getPercentile(uint32_t percent) const;
+
+        static nsecs_t getBucketUpperBound(size_t bucket);
+    };
+
+    /* Tracks one in every sampleRate events.  Zero disables tracking. */
+    explicit InputLatencyTracker(uint32_t sampleRate);
+
+    inline uint32_t getSampleRate() const { return mSampleRate; }
+
+    /* Returns true if the event with the given device and timestamp is tracked. */
+    bool isSampled(int32_t deviceId, nsecs_t eventTime) const;
+
+    /* Called by the reader with each buffer of raw events read from the event hub. */
+    void notifyEventsRead(const RawEvent* rawEvents, size_t count, nsecs_t readTime);
+
+    /* Called by the dispatcher when a sampled event enters the inbound queue. */
+    void notifyEventEnqueued(int32_t deviceId, nsecs_t eventTime, nsecs_t enqueueTime);
+
+    /* Called by the dispatcher when a sampled event is published to a window. */
+    void notifyEventPublished(int32_t deviceId, const String8& windowName,
+            nsecs_t enqueueTime, nsecs_t publishTime);
+
+    /* Called by the dispatcher when a window finishes handling a sampled event. */
+    void notifyEventFinished(int32_t deviceId, const String8& windowName,
+            nsecs_t publishTime, nsecs_t finishTime);
+
+    void dump(String8& dump);
+
+protected:
+    virtual ~InputLatencyTracker();
+
+private:
+    // The most windows tracked at once.  The least recently used one makes room for a new one.
+    static const size_t MAX_TRACKED_WINDOWS = 32;
+
+    struct StageHistograms {
+        Histogram stages[STAGE_COUNT];
+        nsecs_t lastRecordTime;
+
+        StageHistograms();
+    };
+
+    // The last sampled report read from a device, waiting for its cooked event.
+    struct PendingRead {
+        nsecs_t eventTime;
+        nsecs_t readTime;
+    };
+
+    const uint32_t mSampleRate;
+
+    Mutex mLock;
+    KeyedVector<int32_t, StageHistograms> mDevices;
+    KeyedVector<String8, StageHistograms> mWindows;
+    KeyedVector<int32_t, PendingRead> mPendingReads;
+
+    StageHistograms& getDeviceLocked(int32_t deviceId, nsecs_t now);
+    StageHistograms& getWindowLocked(const String8& windowName, nsecs_t now);
+
+    static void dumpHistograms(String8& dump, const StageHistograms& histograms);
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_LATENCY_TRACKER_H
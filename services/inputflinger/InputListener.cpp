@@ -178,5 +178,35 @@ void QueuedInputListener::flush() {
     mArgsQueue.clear();
 }
 
+void QueuedInputListener::mergeFrom(const Vector<sp<QueuedInputListener> >& listeners) {
+    size_t numListeners = listeners.size();
+    Vector<size_t> positions;
+    positions.insertAt(0, 0, numListeners);
+    for (;;) {
+        // There are only a few listeners, so a linear scan for the earliest head is fine.
+        ssize_t earliest = -1;
+        nsecs_t earliestTime = 0;
+        for (size_t i = 0; i < numListeners; i++) {
+            const Vector<NotifyArgs*>& queue = listeners.itemAt(i)->mArgsQueue;
+            if (positions[i] < queue.size()) {
+                nsecs_t eventTime = queue.itemAt(positions[i])->getEventTime();
+                if (earliest < 0 || eventTime < earliestTime) {
+                    earliest = i;
+                    earliestTime = eventTime;
+                }
+            }
+        }
+        if (earliest < 0) {
+            break;
+        }
+        mArgsQueue.push(listeners.itemAt(earliest)->mArgsQueue.itemAt(positions[earliest]));
+        positions.editItemAt(earliest) += 1;
+    }
+
+    for (size_t i = 0; i < numListeners; i++) {
+        listeners.itemAt(i)->mArgsQueue.clear();
+    }
+}
+
 
 } // namespace android
@@ -30,6 +30,8 @@ class InputListenerInterface;
 struct NotifyArgs {
     virtual ~NotifyArgs() { }
 
+    virtual nsecs_t getEventTime() const = 0;
+
     virtual void notify(const sp<InputListenerInterface>& listener) const = 0;
 };
 
@@ -46,6 +48,8 @@ struct NotifyConfigurationChangedArgs : public NotifyArgs {
 
     virtual ~NotifyConfigurationChangedArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
+
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -73,6 +77,8 @@ struct NotifyKeyArgs : public NotifyArgs {
 
     virtual ~NotifyKeyArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
+
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -110,6 +116,8 @@ struct NotifyMotionArgs : public NotifyArgs {
 
     virtual ~NotifyMotionArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
+
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -130,6 +138,8 @@ struct NotifySwitchArgs : public NotifyArgs {
 
     virtual ~NotifySwitchArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
+
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -148,6 +158,8 @@ struct NotifyDeviceResetArgs : public NotifyArgs {
 
     virtual ~NotifyDeviceResetArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
+
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -188,6 +200,11 @@ public:
 
     void flush();
 
+    /* Moves the arguments queued by the given listeners to the end of this queue,
+     * merged in event time order.  The arguments queued by each listener keep their
+     * relative order, and ties go to the listener that comes first. */
+    void mergeFrom(const Vector<sp<QueuedInputListener> >& listeners);
+
 private:
     sp<InputListenerInterface> mInnerListener;
     Vector<NotifyArgs*> mArgsQueue;
@@ -21,16 +21,30 @@
 #include "InputManager.h"
 
 #include <bfqio/bfqio.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 
 namespace android {
 
+// By default, track the latency of one in this many input events.
+static const int32_t DEFAULT_LATENCY_SAMPLE_RATE = 64;
+
 InputManager::InputManager(
         const sp<EventHubInterface>& eventHub,
         const sp<InputReaderPolicyInterface>& readerPolicy,
         const sp<InputDispatcherPolicyInterface>& dispatcherPolicy) {
-    mDispatcher = new InputDispatcher(dispatcherPolicy);
-    mReader = new InputReader(eventHub, readerPolicy, mDispatcher);
+    int32_t latencySampleRate = property_get_int32("ro.input.latency_sample_rate",
+            DEFAULT_LATENCY_SAMPLE_RATE);
+    sp<InputLatencyTracker> latencyTracker = new InputLatencyTracker(
+            latencySampleRate > 0 ? uint32_t(latencySampleRate) : 0);
+
+    sp<InputDispatcher> dispatcher = new InputDispatcher(dispatcherPolicy);
+    dispatcher->setLatencyTracker(latencyTracker);
+    sp<InputReader> reader = new InputReader(eventHub, readerPolicy, dispatcher);
+    reader->setLatencyTracker(latencyTracker);
+
+    mDispatcher = dispatcher;
+    mReader = reader;
     initialize();
 }
 
@@ -52,6 +52,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <cutils/properties.h>
 #include <log/log.h>
 
 #include <input/Keyboard.h>
@@ -81,6 +82,13 @@ static const nsecs_t TOUCH_DATA_TIMEOUT = ms2ns(20);
 // data.
 static const nsecs_t STYLUS_DATA_LATENCY = ms2ns(10);
 
+// Maximum number of worker threads that process devices in parallel.
+static const size_t MAX_WORKER_THREADS = 8;
+
+// The listener that collects the events of the task running on this thread while
+// devices are processed in parallel, or NULL.
+static thread_local QueuedInputListener* gTaskListener = NULL;
+
 // --- Static Functions ---
 
 template<typename T>
@@ -332,6 +340,7 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         const sp<InputReaderPolicyInterface>& policy,
         const sp<InputListenerInterface>& listener) :
         mContext(this), mEventHub(eventHub), mPolicy(policy),
+        mTaskCount(0), mNextTask(0), mTasksRemaining(0), mWorkersExiting(false),
         mGlobalMetaState(0), mGeneration(1),
         mDisableVirtualKeysTimeout(LLONG_MIN), mNextTimeout(LLONG_MAX),
         mConfigurationChangesToRefresh(0) {
@@ -343,9 +352,16 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         refreshConfigurationLocked(0);
         updateGlobalMetaStateLocked();
     } // release lock
+
+    int32_t workerThreads = property_get_int32("ro.input.reader_worker_threads", 0);
+    if (workerThreads > 0) {
+        setWorkerThreadCount(size_t(workerThreads));
+    }
 }
 
 InputReader::~InputReader() {
+    stopWorkerThreads();
+
     for (size_t i = 0; i < mDevices.size(); i++) {
         delete mDevices.valueAt(i);
     }
@@ -374,12 +390,16 @@ void InputReader::loopOnce() {
     } // release lock
 
     size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, EVENT_BUFFER_SIZE);
+    nsecs_t readTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     { // acquire lock
         AutoMutex _l(mLock);
         mReaderIsAliveCondition.broadcast();
 
         if (count) {
+            if (mLatencyTracker != NULL) {
+                mLatencyTracker->notifyEventsRead(mEventBuffer, count, readTime);
+            }
             processEventsLocked(mEventBuffer, count);
         }
 
@@ -419,7 +439,14 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
     for (const RawEvent* rawEvent = rawEvents; count;) {
         int32_t type = rawEvent->type;
         size_t batchSize = 1;
-        if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+        if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT && !mWorkerThreads.isEmpty()) {
+            // Process all device events up to the next synthetic event in one go.
+            while (batchSize < count
+                    && rawEvent[batchSize].type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+                batchSize += 1;
+            }
+            processEventsInParallelLocked(rawEvent, batchSize);
+        } else if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
             int32_t deviceId = rawEvent->deviceId;
             while (batchSize < count) {
                 if (rawEvent[batchSize].type >= EventHubInterface::FIRST_SYNTHETIC_EVENT
@@ -604,6 +631,180 @@ void InputReader::processEventsForDeviceLocked(int32_t deviceId,
     device->process(rawEvents, count);
 }
 
+void InputReader::processEventsInParallelLocked(const RawEvent* rawEvents, size_t count) {
+    // Split the events into per device batches and group them into tasks.  Devices that
+    // share state through the reader go into one task so that they never run concurrently.
+    Vector<DeviceBatch> batches;
+    KeyedVector<int32_t, size_t> taskByDevice;
+    ssize_t sharedTask = -1;
+    bool processSerially = false;
+    mTasks.clear();
+    for (size_t start = 0; start < count; ) {
+        DeviceBatch batch;
+        batch.deviceId = rawEvents[start].deviceId;
+        batch.rawEvents = rawEvents + start;
+        batch.count = 1;
+        while (start + batch.count < count
+                && rawEvents[start + batch.count].deviceId == batch.deviceId) {
+            batch.count += 1;
+        }
+        start += batch.count;
+        batches.push(batch);
+
+        ssize_t deviceIndex = mDevices.indexOfKey(batch.deviceId);
+        InputDevice* device = deviceIndex >= 0 ? mDevices.valueAt(deviceIndex) : NULL;
+        if (device && (device->getClasses() & INPUT_DEVICE_CLASS_EXTERNAL_STYLUS)) {
+            // Stylus state is pushed into other devices while it is processed.
+            processSerially = true;
+        }
+        bool isShared = !device
+                || (device->getClasses() & (INPUT_DEVICE_CLASS_KEYBOARD
+                        | INPUT_DEVICE_CLASS_CURSOR))
+                || (device->getSources() & AINPUT_SOURCE_MOUSE) == AINPUT_SOURCE_MOUSE;
+
+        ssize_t taskIndex;
+        if (isShared) {
+            if (sharedTask < 0) {
+                sharedTask = mTasks.add();
+            }
+            taskIndex = sharedTask;
+        } else {
+            ssize_t index = taskByDevice.indexOfKey(batch.deviceId);
+            if (index >= 0) {
+                taskIndex = taskByDevice.valueAt(index);
+            } else {
+                taskIndex = mTasks.add();
+                taskByDevice.add(batch.deviceId, taskIndex);
+            }
+        }
+        mTasks.editItemAt(taskIndex).batches.push(batch);
+    }
+
+    size_t numTasks = mTasks.size();
+    if (processSerially || numTasks < 2) {
+        mTasks.clear();
+        for (size_t i = 0; i < batches.size(); i++) {
+            const DeviceBatch& batch = batches.itemAt(i);
+            processEventsForDeviceLocked(batch.deviceId, batch.rawEvents, batch.count);
+        }
+        return;
+    }
+
+    while (mTaskListeners.size() < numTasks) {
+        mTaskListeners.push(new QueuedInputListener(NULL));
+    }
+    Vector<sp<QueuedInputListener> > listeners;
+    for (size_t i = 0; i < numTasks; i++) {
+        mTasks.editItemAt(i).listener = mTaskListeners.itemAt(i);
+        listeners.push(mTaskListeners.itemAt(i));
+    }
+
+    { // acquire lock
+        AutoMutex _l(mTaskLock);
+        mTaskCount = numTasks;
+        mNextTask = 0;
+        mTasksRemaining = numTasks;
+        mTaskAvailableCondition.broadcast();
+    } // release lock
+
+    // Help out, then wait for the tasks that the workers picked up.
+    while (runNextTask(false)) {
+    }
+
+    { // acquire lock
+        AutoMutex _l(mTaskLock);
+        while (mTasksRemaining) {
+            mTasksFinishedCondition.wait(mTaskLock);
+        }
+        mTaskCount = 0;
+        mNextTask = 0;
+    } // release lock
+
+    mQueuedListener->mergeFrom(listeners);
+    mTasks.clear();
+}
+
+bool InputReader::runNextTask(bool wait) {
+    DeviceTask* task;
+    { // acquire lock
+        AutoMutex _l(mTaskLock);
+        while (mNextTask >= mTaskCount) {
+            if (!wait || mWorkersExiting) {
+                return false;
+            }
+            mTaskAvailableCondition.wait(mTaskLock);
+        }
+        task = &mTasks.editItemAt(mNextTask++);
+    } // release lock
+
+    processTask(*task);
+
+    { // acquire lock
+        AutoMutex _l(mTaskLock);
+        mTasksRemaining -= 1;
+        if (!mTasksRemaining) {
+            mTasksFinishedCondition.signal();
+        }
+    } // release lock
+    return true;
+}
+
+void InputReader::processTask(DeviceTask& task) {
+    // The reader thread holds mLock for the workers until every task has finished.
+    gTaskListener = task.listener.get();
+    for (size_t i = 0; i < task.batches.size(); i++) {
+        const DeviceBatch& batch = task.batches.itemAt(i);
+        processEventsForDeviceLocked(batch.deviceId, batch.rawEvents, batch.count);
+    }
+    gTaskListener = NULL;
+}
+
+void InputReader::setWorkerThreadCount(size_t count) {
+    AutoMutex _l(mLock);
+
+    if (count > MAX_WORKER_THREADS) {
+        count = MAX_WORKER_THREADS;
+    }
+    if (count == mWorkerThreads.size()) {
+        return;
+    }
+
+    stopWorkerThreads();
+    for (size_t i = 0; i < count; i++) {
+        sp<WorkerThread> thread = new WorkerThread(this);
+        status_t result = thread->run(String8::format("InputReaderWorker%zu", i).string(),
+                PRIORITY_URGENT_DISPLAY);
+        if (result) {
+            ALOGE("Could not start input reader worker thread due to error %d.", result);
+            break;
+        }
+        mWorkerThreads.push(thread);
+    }
+}
+
+void InputReader::setLatencyTracker(const sp<InputLatencyTracker>& latencyTracker) {
+    AutoMutex _l(mLock);
+    mLatencyTracker = latencyTracker;
+}
+
+void InputReader::stopWorkerThreads() {
+    { // acquire lock
+        AutoMutex _l(mTaskLock);
+        mWorkersExiting = true;
+        mTaskAvailableCondition.broadcast();
+    } // release lock
+
+    for (size_t i = 0; i < mWorkerThreads.size(); i++) {
+        mWorkerThreads.itemAt(i)->requestExitAndWait();
+    }
+    mWorkerThreads.clear();
+
+    { // acquire lock
+        AutoMutex _l(mTaskLock);
+        mWorkersExiting = false;
+    } // release lock
+}
+
 void InputReader::timeoutExpiredLocked(nsecs_t when) {
     for (size_t i = 0; i < mDevices.size(); i++) {
         InputDevice* device = mDevices.valueAt(i);
@@ -885,6 +1086,8 @@ void InputReader::dump(String8& dump) {
         mDevices.valueAt(i)->dump(dump);
     }
 
+    dump.appendFormat(INDENT "WorkerThreads: %zu\n", mWorkerThreads.size());
+
     dump.append(INDENT "Configuration:\n");
     dump.append(INDENT2 "ExcludedDeviceNames: [");
     for (size_t i = 0; i < mConfig.excludedDeviceNames.size(); i++) {
@@ -961,37 +1164,44 @@ InputReader::ContextImpl::ContextImpl(InputReader* reader) :
 
 void InputReader::ContextImpl::updateGlobalMetaState() {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     mReader->updateGlobalMetaStateLocked();
 }
 
 int32_t InputReader::ContextImpl::getGlobalMetaState() {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     return mReader->getGlobalMetaStateLocked();
 }
 
 void InputReader::ContextImpl::disableVirtualKeysUntil(nsecs_t time) {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     mReader->disableVirtualKeysUntilLocked(time);
 }
 
 bool InputReader::ContextImpl::shouldDropVirtualKey(nsecs_t now,
         InputDevice* device, int32_t keyCode, int32_t scanCode) {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     return mReader->shouldDropVirtualKeyLocked(now, device, keyCode, scanCode);
 }
 
 void InputReader::ContextImpl::fadePointer() {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     mReader->fadePointerLocked();
 }
 
 void InputReader::ContextImpl::requestTimeoutAtTime(nsecs_t when) {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     mReader->requestTimeoutAtTimeLocked(when);
 }
 
 int32_t InputReader::ContextImpl::bumpGeneration() {
     // lock is already held by the input loop
+    AutoMutex _l(mReader->mContextLock);
     return mReader->bumpGenerationLocked();
 }
 
@@ -1009,6 +1219,10 @@ InputReaderPolicyInterface* InputReader::ContextImpl::getPolicy() {
 }
 
 InputListenerInterface* InputReader::ContextImpl::getListener() {
+    // Devices that are processed in parallel queue their events per task.
+    if (gTaskListener) {
+        return gTaskListener;
+    }
     return mReader->mQueuedListener.get();
 }
 
@@ -1032,6 +1246,20 @@ bool InputReaderThread::threadLoop() {
 }
 
 
+// --- InputReader::WorkerThread ---
+
+InputReader::WorkerThread::WorkerThread(InputReader* reader) :
+        Thread(/*canCallJava*/ false), mReader(reader) {
+}
+
+InputReader::WorkerThread::~WorkerThread() {
+}
+
+bool InputReader::WorkerThread::threadLoop() {
+    return mReader->runNextTask(true);
+}
+
+
 // --- InputDevice ---
 
 InputDevice::InputDevice(InputReaderContext* context, int32_t id, int32_t generation,
@@ -5603,11 +5831,15 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
         if (activeTouchId >= 0 && currentFingerCount > 1) {
             int32_t bestId = -1;
             float bestSpeed = mConfig.pointerGestureDragMinSwitchSpeed;
-            for (BitSet32 idBits(mCurrentCookedState.fingerIdBits); !idBits.isEmpty(); ) {
+            VelocityTracker::Estimator estimators[MAX_POINTERS];
+            mPointerGesture.velocityTracker.getEstimators(mCurrentCookedState.fingerIdBits,
+                    estimators);
+            uint32_t index = 0;
+            for (BitSet32 idBits(mCurrentCookedState.fingerIdBits); !idBits.isEmpty(); index++) {
                 uint32_t id = idBits.clearFirstMarkedBit();
-                float vx, vy;
-                if (mPointerGesture.velocityTracker.getVelocity(id, &vx, &vy)) {
-                    float speed = hypotf(vx, vy);
+                const VelocityTracker::Estimator& estimator = estimators[index];
+                if (estimator.degree >= 1) {
+                    float speed = hypotf(estimator.xCoeff[1], estimator.yCoeff[1]);
                     if (speed > bestSpeed) {
                         bestId = id;
                         bestSpeed = speed;
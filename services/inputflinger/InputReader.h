@@ -19,6 +19,7 @@
 
 #include "EventHub.h"
 #include "PointerControllerInterface.h"
+#include "InputLatencyTracker.h"
 #include "InputListener.h"
 
 #include <input/DisplayViewport.h>
@@ -439,6 +440,21 @@ public:
             ssize_t repeat, int32_t token);
     virtual void cancelVibrate(int32_t deviceId, int32_t token);
 
+    /* Sets the number of worker threads that process the raw events of independent
+     * devices in parallel with the reader thread.  Zero, the default, processes every
+     * device on the reader thread.  The initial value comes from the
+     * ro.input.reader_worker_threads system property.
+     *
+     * Events of one device are always processed in order, and the resulting events
+     * are queued for the listener in event time order.  Devices that share state
+     * through the reader, such as keyboards and mice, are processed one after the
+     * other in a single task.
+     */
+    void setWorkerThreadCount(size_t count);
+
+    /* Sets the tracker that collects the latency of sampled events, or NULL. */
+    void setLatencyTracker(const sp<InputLatencyTracker>& latencyTracker);
+
 protected:
     // These members are protected so they can be instrumented by test cases.
     virtual InputDevice* createDeviceLocked(int32_t deviceId, int32_t controllerNumber,
@@ -467,15 +483,34 @@ protected:
 
     friend class ContextImpl;
 
+    class WorkerThread : public Thread {
+    public:
+        explicit WorkerThread(InputReader* reader);
+        virtual ~WorkerThread();
+
+    private:
+        InputReader* mReader;
+
+        virtual bool threadLoop();
+    };
+
+    friend class WorkerThread;
+
 private:
     Mutex mLock;
 
+    // Guards the reader state that devices reach through the context while they are
+    // processed in parallel.  Always acquired after mLock.
+    Mutex mContextLock;
+
     Condition mReaderIsAliveCondition;
 
     sp<EventHubInterface> mEventHub;
     sp<InputReaderPolicyInterface> mPolicy;
     sp<QueuedInputListener> mQueuedListener;
 
+    sp<InputLatencyTracker> mLatencyTracker;
+
     InputReaderConfiguration mConfig;
 
     // The event queue.
@@ -490,6 +525,36 @@ private:
     void addDeviceLocked(nsecs_t when, int32_t deviceId);
     void removeDeviceLocked(nsecs_t when, int32_t deviceId);
     void processEventsForDeviceLocked(int32_t deviceId, const RawEvent* rawEvents, size_t count);
+
+    // Parallel processing of device events.
+    struct DeviceBatch {
+        int32_t deviceId;
+        const RawEvent* rawEvents;
+        size_t count;
+    };
+
+    // The batches of one or more devices that are processed in order on one thread, and
+    // the listener that collects the resulting events.
+    struct DeviceTask {
+        Vector<DeviceBatch> batches;
+        sp<QueuedInputListener> listener;
+    };
+
+    Vector<sp<WorkerThread> > mWorkerThreads;
+    Vector<DeviceTask> mTasks;
+    Vector<sp<QueuedInputListener> > mTaskListeners;
+    Mutex mTaskLock;
+    Condition mTaskAvailableCondition;
+    Condition mTasksFinishedCondition;
+    size_t mTaskCount;      // guarded by mTaskLock
+    size_t mNextTask;       // guarded by mTaskLock
+    size_t mTasksRemaining; // guarded by mTaskLock
+    bool mWorkersExiting;   // guarded by mTaskLock
+
+    void processEventsInParallelLocked(const RawEvent* rawEvents, size_t count);
+    bool runNextTask(bool wait);
+    void processTask(DeviceTask& task);
+    void stopWorkerThreads();
     void timeoutExpiredLocked(nsecs_t when);
 
     void handleConfigurationChangedLocked(nsecs_t when);
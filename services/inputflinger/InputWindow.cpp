@@ -19,6 +19,8 @@
 
 #include "InputWindow.h"
 
+#include <algorithm>
+
 #include <log/log.h>
 
 #include <ui/Rect.h>
@@ -80,4 +82,229 @@ void InputWindowHandle::releaseInfo() {
     }
 }
 
+
+// --- InputWindowIndex ---
+
+static inline bool rectContainsPoint(const Rect& r, int32_t x, int32_t y) {
+    return x >= r.left && x < r.right && y >= r.top && y < r.bottom;
+}
+
+static bool regionsEqual(const Region& a, const Region& b) {
+    if (a.isTriviallyEqual(b)) {
+        return true;
+    }
+    size_t countA, countB;
+    const Rect* rectsA = a.getArray(&countA);
+    const Rect* rectsB = b.getArray(&countB);
+    if (countA != countB) {
+        return false;
+    }
+    for (size_t i = 0; i < countA; i++) {
+        if (rectsA[i] != rectsB[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InputWindowIndex::WindowState::operator==(const WindowState& other) const {
+    return handle == other.handle
+            && flags == other.flags
+            && visible == other.visible
+            && regionsEqual(touchableRegion, other.touchableRegion);
+}
+
+InputWindowIndex::InputWindowIndex() {
+}
+
+InputWindowIndex::~InputWindowIndex() {
+}
+
+size_t InputWindowIndex::update(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    KeyedVector<int32_t, Vector<WindowState> > windowsByDisplay;
+    size_t numWindows = windowHandles.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        const sp<InputWindowHandle>& windowHandle = windowHandles.itemAt(i);
+        const InputWindowInfo* info = windowHandle->getInfo();
+        if (!info) {
+            continue;
+        }
+
+        WindowState state;
+        state.handle = windowHandle;
+        state.flags = info->layoutParamsFlags;
+        state.visible = info->visible;
+        state.touchableRegion = info->touchableRegion;
+
+        ssize_t index = windowsByDisplay.indexOfKey(info->displayId);
+        if (index < 0) {
+            index = windowsByDisplay.add(info->displayId, Vector<WindowState>());
+        }
+        windowsByDisplay.editValueAt(index).push(state);
+    }
+
+    for (size_t i = mDisplays.size(); i-- > 0; ) {
+        if (windowsByDisplay.indexOfKey(mDisplays.keyAt(i)) < 0) {
+            mDisplays.removeItemsAt(i);
+        }
+    }
+
+    size_t reindexed = 0;
+    for (size_t i = 0; i < windowsByDisplay.size(); i++) {
+        const Vector<WindowState>& windows = windowsByDisplay.valueAt(i);
+        ssize_t index = mDisplays.indexOfKey(windowsByDisplay.keyAt(i));
+        if (index >= 0) {
+            const Vector<WindowState>& oldWindows = mDisplays.valueAt(index).windows;
+            bool changed = oldWindows.size() != windows.size();
+            for (size_t j = 0; !changed && j < windows.size(); j++) {
+                changed = !(oldWindows.itemAt(j) == windows.itemAt(j));
+            }
+            if (!changed) {
+                continue;
+            }
+        }
+
+        DisplayIndex display;
+        display.windows = windows;
+        buildDisplayIndex(display);
+        mDisplays.add(windowsByDisplay.keyAt(i), display);
+        reindexed += 1;
+    }
+    return reindexed;
+}
+
+void InputWindowIndex::clear() {
+    mDisplays.clear();
+}
+
+void InputWindowIndex::buildDisplayIndex(DisplayIndex& display) {
+    display.endsWithModalWindow = false;
+    Rect bounds(Rect::EMPTY_RECT);
+    size_t numWindows = display.windows.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        const WindowState& window = display.windows.itemAt(i);
+        if (!window.visible) {
+            continue;
+        }
+
+        IndexedWindow indexed;
+        indexed.handle = window.handle;
+        indexed.order = i;
+        if (window.flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+            display.outsideTouchWindows.push(indexed);
+        }
+        if (window.flags & InputWindowInfo::FLAG_NOT_TOUCHABLE) {
+            continue;
+        }
+
+        bool isTouchModal = (window.flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+        if (isTouchModal) {
+            // Nothing behind this window can be touched.
+            indexed.bounds = Rect::EMPTY_RECT;
+            display.touchableWindows.push(indexed);
+            display.endsWithModalWindow = true;
+            break;
+        }
+
+        indexed.bounds = window.touchableRegion.getBounds();
+        if (!indexed.bounds.isEmpty()) {
+            display.touchableWindows.push(indexed);
+            if (bounds.isEmpty()) {
+                bounds = indexed.bounds;
+            } else {
+                bounds.left = std::min(bounds.left, indexed.bounds.left);
+                bounds.top = std::min(bounds.top, indexed.bounds.top);
+                bounds.right = std::max(bounds.right, indexed.bounds.right);
+                bounds.bottom = std::max(bounds.bottom, indexed.bounds.bottom);
+            }
+        }
+    }
+
+    // Lay a grid over the bounds and bucket the windows into the cells they overlap.
+    const size_t numCells = GRID_SIZE * GRID_SIZE;
+    display.gridBounds = bounds;
+    display.cellWidth = (int64_t(bounds.right) - bounds.left + GRID_SIZE - 1) / GRID_SIZE;
+    display.cellHeight = (int64_t(bounds.bottom) - bounds.top + GRID_SIZE - 1) / GRID_SIZE;
+    display.cellStarts.insertAt(0u, 0, numCells + 1);
+    if (bounds.isEmpty()) {
+        return;
+    }
+
+    size_t numIndexed = display.touchableWindows.size() - (display.endsWithModalWindow ? 1 : 0);
+    uint32_t* cellStarts = display.cellStarts.editArray();
+    for (int pass = 0; pass < 2; pass++) {
+        // The first pass counts the windows in each cell, the second one fills them in.
+        for (size_t i = 0; i < numIndexed; i++) {
+            const Rect& r = display.touchableWindows.itemAt(i).bounds;
+            int64_t left = (int64_t(r.left) - bounds.left) / display.cellWidth;
+            int64_t right = (int64_t(r.right) - 1 - bounds.left) / display.cellWidth;
+            int64_t top = (int64_t(r.top) - bounds.top) / display.cellHeight;
+            int64_t bottom = (int64_t(r.bottom) - 1 - bounds.top) / display.cellHeight;
+            for (int64_t row = top; row <= bottom; row++) {
+                for (int64_t column = left; column <= right; column++) {
+                    size_t cell = size_t(row * GRID_SIZE + column);
+                    if (pass == 0) {
+                        cellStarts[cell + 1] += 1;
+                    } else {
+                        display.cellWindows.editItemAt(cellStarts[cell]++) = uint32_t(i);
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (size_t cell = 0; cell < numCells; cell++) {
+                cellStarts[cell + 1] += cellStarts[cell];
+            }
+            display.cellWindows.insertAt(0u, 0, cellStarts[numCells]);
+        } else {
+            // Filling in advanced each start to the start of the next cell.
+            for (size_t cell = numCells; cell > 0; cell--) {
+                cellStarts[cell] = cellStarts[cell - 1];
+            }
+            cellStarts[0] = 0;
+        }
+    }
+}
+
+sp<InputWindowHandle> InputWindowIndex::findTouchedWindow(int32_t displayId,
+        int32_t x, int32_t y, Vector<sp<InputWindowHandle> >* outOutsideTouchWindows) const {
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index < 0) {
+        return NULL;
+    }
+    const DisplayIndex& display = mDisplays.valueAt(index);
+
+    const IndexedWindow* touchedWindow = NULL;
+    if (rectContainsPoint(display.gridBounds, x, y)) {
+        size_t cell = size_t((int64_t(y) - display.gridBounds.top) / display.cellHeight
+                * GRID_SIZE + (int64_t(x) - display.gridBounds.left) / display.cellWidth);
+        for (uint32_t i = display.cellStarts.itemAt(cell);
+                i < display.cellStarts.itemAt(cell + 1); i++) {
+            const IndexedWindow& window =
+                    display.touchableWindows.itemAt(display.cellWindows.itemAt(i));
+            if (rectContainsPoint(window.bounds, x, y)
+                    && window.handle->getInfo()->touchableRegionContainsPoint(x, y)) {
+                touchedWindow = &window;
+                break;
+            }
+        }
+    }
+    if (!touchedWindow && display.endsWithModalWindow) {
+        touchedWindow = &display.touchableWindows.top();
+    }
+
+    if (outOutsideTouchWindows) {
+        for (size_t i = 0; i < display.outsideTouchWindows.size(); i++) {
+            const IndexedWindow& window = display.outsideTouchWindows.itemAt(i);
+            if (touchedWindow && window.order >= touchedWindow->order) {
+                break;
+            }
+            outOutsideTouchWindows->push(window.handle);
+        }
+    }
+    return touchedWindow ? touchedWindow->handle : NULL;
+}
+
 } // namespace android
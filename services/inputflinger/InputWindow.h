@@ -21,9 +21,11 @@
 #include <input/InputTransport.h>
 #include <ui/Rect.h>
 #include <ui/Region.h>
+#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include "InputApplication.h"
 
@@ -205,6 +207,88 @@ protected:
     InputWindowInfo* mInfo;
 };
 
+
+/*
+ * Spatial index of the windows that can be touched on each display.
+ *
+ * Finds the window a touch lands on without testing the touchable region of every
+ * window.  The windows of a display are bucketed by a coarse grid over their touchable
+ * bounds, so a lookup only tests the windows whose bounds cover the grid cell of the
+ * point, front to back.  A touch modal window catches every touch that reaches it, so
+ * nothing behind it is indexed.
+ *
+ * The index holds a snapshot of the window state it depends on.  It must be updated
+ * whenever the window list or the information of a window changes.
+ */
+class InputWindowIndex {
+public:
+    InputWindowIndex();
+    ~InputWindowIndex();
+
+    /* Updates the index to the given windows, ordered front to back.
+     * Only displays whose windows changed since the last update are reindexed.
+     *
+     * Returns the number of displays that were reindexed.
+     */
+    size_t update(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    /* Removes all windows from the index. */
+    void clear();
+
+    /* Returns the frontmost visible and touchable window on the display that is either
+     * touch modal or whose touchable region contains the point, or NULL if there is none.
+     *
+     * If outOutsideTouchWindows is not NULL, the visible windows in front of the touched
+     * window that asked to watch outside touches are appended to it, front to back.
+     */
+    sp<InputWindowHandle> findTouchedWindow(int32_t displayId, int32_t x, int32_t y,
+            Vector<sp<InputWindowHandle> >* outOutsideTouchWindows = NULL) const;
+
+private:
+    enum { GRID_SIZE = 16 };
+
+    // The state of a window that the index depends on.
+    struct WindowState {
+        sp<InputWindowHandle> handle;
+        int32_t flags;
+        bool visible;
+        Region touchableRegion;
+
+        bool operator==(const WindowState& other) const;
+    };
+
+    struct IndexedWindow {
+        sp<InputWindowHandle> handle;
+        Rect bounds;
+        size_t order; // position among the windows of the display, front to back
+    };
+
+    struct DisplayIndex {
+        Vector<WindowState> windows;
+
+        // Touchable windows front to back, ending with the first touch modal window
+        // when there is one.
+        Vector<IndexedWindow> touchableWindows;
+        bool endsWithModalWindow;
+
+        // Visible windows that watch outside touches, front to back.
+        Vector<IndexedWindow> outsideTouchWindows;
+
+        // The grid covers the bounds of the touchable windows that are not touch modal.
+        // The windows whose bounds overlap cell i are cellWindows[cellStarts[i]] up to
+        // cellWindows[cellStarts[i + 1]], as indices into touchableWindows in ascending order.
+        Rect gridBounds;
+        int64_t cellWidth;
+        int64_t cellHeight;
+        Vector<uint32_t> cellStarts;
+        Vector<uint32_t> cellWindows;
+    };
+
+    static void buildDisplayIndex(DisplayIndex& display);
+
+    KeyedVector<int32_t, DisplayIndex> mDisplays;
+};
+
 } // namespace android
 
 #endif // _UI_INPUT_WINDOW_H
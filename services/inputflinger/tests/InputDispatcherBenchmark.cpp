@@ -0,0 +1,506 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the latency from InputDispatcher::notifyMotion() to delivery on the
+// client side of the input channels, for a three finger gesture split across
+// three windows plus a monitor, paced like a 1000 Hz touch panel.  The run is
+// done once with entry pooling disabled and once with it enabled.
+//
+// It also measures finding the touched window among many overlapping windows,
+// which the dispatcher does for every down, with the window index and with the
+// linear search it replaced.
+//
+// usage: inputflinger_benchmark [events]
+
+#include "../InputDispatcher.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+static const int32_t DEVICE_ID = 1;
+static const size_t WINDOW_COUNT = 3;
+static const int32_t WINDOW_WIDTH = 400;
+static const int32_t WINDOW_HEIGHT = 1000;
+static const nsecs_t EVENT_INTERVAL = 1000000; // 1000 Hz
+static const nsecs_t DISPATCHING_TIMEOUT = 5000000000LL;
+
+// --- FakeInputDispatcherPolicy ---
+
+class FakeInputDispatcherPolicy : public InputDispatcherPolicyInterface {
+    InputDispatcherConfiguration mConfig;
+
+protected:
+    virtual ~FakeInputDispatcherPolicy() {
+    }
+
+public:
+    FakeInputDispatcherPolicy() {
+    }
+
+private:
+    virtual void notifyConfigurationChanged(nsecs_t) {
+    }
+
+    virtual nsecs_t notifyANR(const sp<InputApplicationHandle>&,
+            const sp<InputWindowHandle>&, const String8&) {
+        return 0;
+    }
+
+    virtual void notifyInputChannelBroken(const sp<InputWindowHandle>&) {
+    }
+
+    virtual void getDispatcherConfiguration(InputDispatcherConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    virtual bool filterInputEvent(const InputEvent*, uint32_t) {
+        return true;
+    }
+
+    virtual void interceptKeyBeforeQueueing(const KeyEvent*, uint32_t&) {
+    }
+
+    virtual void interceptMotionBeforeQueueing(nsecs_t, uint32_t&) {
+    }
+
+    virtual nsecs_t interceptKeyBeforeDispatching(const sp<InputWindowHandle>&,
+            const KeyEvent*, uint32_t) {
+        return 0;
+    }
+
+    virtual bool dispatchUnhandledKey(const sp<InputWindowHandle>&,
+            const KeyEvent*, uint32_t, KeyEvent*) {
+        return false;
+    }
+
+    virtual void notifySwitch(nsecs_t, uint32_t, uint32_t, uint32_t) {
+    }
+
+    virtual void pokeUserActivity(nsecs_t, int32_t) {
+    }
+
+    virtual bool checkInjectEventsPermissionNonReentrant(int32_t, int32_t) {
+        return false;
+    }
+};
+
+// --- FakeApplicationHandle ---
+
+class FakeApplicationHandle : public InputApplicationHandle {
+public:
+    virtual bool updateInfo() {
+        if (!mInfo) {
+            mInfo = new InputApplicationInfo();
+        }
+        mInfo->name = "Fake Application";
+        mInfo->dispatchingTimeout = DISPATCHING_TIMEOUT;
+        return true;
+    }
+};
+
+// --- FakeWindowHandle ---
+
+class FakeWindowHandle : public InputWindowHandle {
+public:
+    FakeWindowHandle(const sp<InputApplicationHandle>& application,
+            const sp<InputChannel>& channel, int32_t left) :
+            InputWindowHandle(application), mChannel(channel), mLeft(left) {
+    }
+
+    virtual bool updateInfo() {
+        if (!mInfo) {
+            mInfo = new InputWindowInfo();
+        }
+        mInfo->inputChannel = mChannel;
+        mInfo->name = mChannel->getName();
+        mInfo->layoutParamsFlags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+                | InputWindowInfo::FLAG_SPLIT_TOUCH;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->dispatchingTimeout = DISPATCHING_TIMEOUT;
+        mInfo->frameLeft = mLeft;
+        mInfo->frameTop = 0;
+        mInfo->frameRight = mLeft + WINDOW_WIDTH;
+        mInfo->frameBottom = WINDOW_HEIGHT;
+        mInfo->scaleFactor = 1.0f;
+        mInfo->touchableRegion.clear();
+        mInfo->addTouchableRegion(Rect(mLeft, 0, mLeft + WINDOW_WIDTH, WINDOW_HEIGHT));
+        mInfo->visible = true;
+        mInfo->canReceiveKeys = true;
+        mInfo->hasFocus = mLeft == 0;
+        mInfo->hasWallpaper = false;
+        mInfo->paused = false;
+        mInfo->layer = 0;
+        mInfo->ownerPid = getpid();
+        mInfo->ownerUid = getuid();
+        mInfo->inputFeatures = 0;
+        mInfo->displayId = ADISPLAY_ID_DEFAULT;
+        return true;
+    }
+
+private:
+    sp<InputChannel> mChannel;
+    int32_t mLeft;
+};
+
+// --- FakeOverlayWindowHandle ---
+
+class FakeOverlayWindowHandle : public InputWindowHandle {
+public:
+    explicit FakeOverlayWindowHandle(int32_t flags) : InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->layoutParamsFlags = flags;
+        mInfo->visible = true;
+        mInfo->displayId = ADISPLAY_ID_DEFAULT;
+    }
+
+    InputWindowInfo* editInfo() {
+        return mInfo;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+};
+
+// --- Hit test benchmark ---
+
+// The front to back search that findTouchedWindowTargetsLocked() used to do.
+static sp<InputWindowHandle> findTouchedWindowLinear(
+        const Vector<sp<InputWindowHandle> >& windowHandles, int32_t displayId,
+        int32_t x, int32_t y, Vector<sp<InputWindowHandle> >* outOutsideTouchWindows) {
+    for (size_t i = 0; i < windowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = windowHandles.itemAt(i);
+        const InputWindowInfo* windowInfo = windowHandle->getInfo();
+        if (windowInfo->displayId != displayId || !windowInfo->visible) {
+            continue;
+        }
+        int32_t flags = windowInfo->layoutParamsFlags;
+        if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+            bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                    | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+            if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
+                return windowHandle;
+            }
+        }
+        if (outOutsideTouchWindows && (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)) {
+            outOutsideTouchWindows->push(windowHandle);
+        }
+    }
+    return NULL;
+}
+
+// Builds a window stack like a busy phone: small overlays and accessibility
+// windows with rounded corners in front of a few fullscreen application windows.
+static Vector<sp<InputWindowHandle> > makeWindowStack(size_t overlays) {
+    static const int32_t kWidth = 1440;
+    static const int32_t kHeight = 2560;
+    Vector<sp<InputWindowHandle> > windows;
+    srandom(42);
+    for (size_t i = 0; i < overlays; i++) {
+        int32_t flags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+                | InputWindowInfo::FLAG_NOT_FOCUSABLE;
+        if (i % 8 == 0) {
+            flags |= InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH;
+        }
+        sp<FakeOverlayWindowHandle> window = new FakeOverlayWindowHandle(flags);
+        int32_t width = 60 + random() % 300;
+        int32_t height = 60 + random() % 300;
+        int32_t left = random() % (kWidth - width);
+        int32_t top = random() % (kHeight - height);
+        const int32_t radius = 16;
+        window->editInfo()->addTouchableRegion(
+                Rect(left, top + radius, left + width, top + height - radius));
+        for (int32_t step = 0; step < radius; step += 4) {
+            int32_t inset = radius - step;
+            window->editInfo()->addTouchableRegion(Rect(left + inset, top + step,
+                    left + width - inset, top + step + 4));
+            window->editInfo()->addTouchableRegion(Rect(left + inset, top + height - step - 4,
+                    left + width - inset, top + height - step));
+        }
+        windows.push(window);
+    }
+    for (size_t i = 0; i < 4; i++) {
+        sp<FakeOverlayWindowHandle> window = new FakeOverlayWindowHandle(
+                InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+        window->editInfo()->addTouchableRegion(Rect(0, 0, kWidth, kHeight));
+        windows.push(window);
+    }
+    return windows;
+}
+
+static void benchmarkHitTest(size_t overlays, size_t probes) {
+    Vector<sp<InputWindowHandle> > windows = makeWindowStack(overlays);
+    std::vector<std::pair<int32_t, int32_t> > points;
+    for (size_t i = 0; i < 4096; i++) {
+        points.push_back(std::make_pair(int32_t(random() % 1440), int32_t(random() % 2560)));
+    }
+
+    size_t found = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < probes; i++) {
+        const std::pair<int32_t, int32_t>& point = points[i % points.size()];
+        found += findTouchedWindowLinear(windows, ADISPLAY_ID_DEFAULT,
+                point.first, point.second, NULL) != NULL;
+    }
+    nsecs_t linear = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    InputWindowIndex index;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    index.update(windows);
+    nsecs_t build = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < 100; i++) {
+        index.update(windows);
+    }
+    nsecs_t unchanged = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / 100;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < probes; i++) {
+        const std::pair<int32_t, int32_t>& point = points[i % points.size()];
+        found += index.findTouchedWindow(ADISPLAY_ID_DEFAULT,
+                point.first, point.second) != NULL;
+    }
+    nsecs_t indexed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    printf("windows=%-4zu linear=%.0fns/lookup indexed=%.0fns/lookup "
+            "build=%.1fus update(unchanged)=%.1fus (found %zu)\n",
+            windows.size(), double(linear) / probes, double(indexed) / probes,
+            build / 1000.0, unchanged / 1000.0, found);
+}
+
+// --- Benchmark ---
+
+class Benchmark {
+public:
+    Benchmark() {
+        mPolicy = new FakeInputDispatcherPolicy();
+        mDispatcher = new InputDispatcher(mPolicy);
+        mDispatcher->setInputDispatchMode(/*enabled*/ true, /*frozen*/ false);
+
+        sp<InputApplicationHandle> application = new FakeApplicationHandle();
+        Vector<sp<InputWindowHandle> > windows;
+        for (size_t i = 0; i < WINDOW_COUNT; i++) {
+            sp<InputChannel> serverChannel, clientChannel;
+            InputChannel::openInputChannelPair(String8::format("window %zu", i),
+                    serverChannel, clientChannel);
+            sp<InputWindowHandle> window = new FakeWindowHandle(application, serverChannel,
+                    int32_t(i) * WINDOW_WIDTH);
+            mDispatcher->registerInputChannel(serverChannel, window, /*monitor*/ false);
+            windows.push(window);
+            mClientChannels.push_back(clientChannel);
+        }
+        sp<InputChannel> serverChannel, clientChannel;
+        InputChannel::openInputChannelPair(String8("monitor"), serverChannel, clientChannel);
+        mDispatcher->registerInputChannel(serverChannel, NULL, /*monitor*/ true);
+        mClientChannels.push_back(clientChannel);
+
+        mDispatcher->setFocusedApplication(application);
+        mDispatcher->setInputWindows(windows);
+
+        mThread = new InputDispatcherThread(mDispatcher);
+        mThread->run("InputDispatcher", PRIORITY_URGENT_DISPLAY);
+    }
+
+    ~Benchmark() {
+        mThread->requestExit();
+        // Changing the dispatch mode wakes the dispatcher thread up.
+        mDispatcher->setInputDispatchMode(/*enabled*/ false, /*frozen*/ false);
+        mThread->requestExitAndWait();
+    }
+
+    // Sends the given number of move events of a three finger gesture and
+    // returns the notify-to-delivery latency of each.
+    std::vector<nsecs_t> run(size_t events) {
+        std::vector<nsecs_t> latencies;
+        latencies.reserve(events);
+
+        nsecs_t downTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < WINDOW_COUNT; i++) {
+            int32_t action = i == 0 ? AMOTION_EVENT_ACTION_DOWN
+                    : AMOTION_EVENT_ACTION_POINTER_DOWN
+                            | int32_t(i << AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT);
+            notifyMotion(action, i + 1, downTime, 0);
+            drain(ms2ns(50));
+        }
+
+        nsecs_t next = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t event = 0; event < events; event++) {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            notifyMotion(AMOTION_EVENT_ACTION_MOVE, WINDOW_COUNT, downTime, event);
+            nsecs_t delivered = receiveOneFromEach(start);
+            if (delivered < 0) {
+                fprintf(stderr, "Timed out waiting for event %zu\n", event);
+                break;
+            }
+            latencies.push_back(delivered - start);
+
+            next += EVENT_INTERVAL;
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (next > now) {
+                usleep(uint32_t(ns2us(next - now)));
+            } else {
+                next = now;
+            }
+        }
+
+        notifyMotion(AMOTION_EVENT_ACTION_CANCEL, WINDOW_COUNT, downTime, events);
+        drain(ms2ns(50));
+        return latencies;
+    }
+
+    void dumpPools() {
+        String8 dump;
+        mDispatcher->dump(dump);
+        const char* pools = strstr(dump.string(), "EntryPools:");
+        if (pools) {
+            printf("%s", pools);
+        }
+    }
+
+private:
+    void notifyMotion(int32_t action, size_t pointerCount, nsecs_t downTime, size_t step) {
+        PointerProperties properties[WINDOW_COUNT];
+        PointerCoords coords[WINDOW_COUNT];
+        for (size_t i = 0; i < pointerCount; i++) {
+            properties[i].clear();
+            properties[i].id = int32_t(i);
+            properties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+            coords[i].clear();
+            coords[i].setAxisValue(AMOTION_EVENT_AXIS_X, i * WINDOW_WIDTH + WINDOW_WIDTH / 2);
+            coords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 100 + (step % 800));
+            coords[i].setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 1.0f);
+        }
+        NotifyMotionArgs args(systemTime(SYSTEM_TIME_MONOTONIC), DEVICE_ID,
+                AINPUT_SOURCE_TOUCHSCREEN, POLICY_FLAG_PASS_TO_USER, action,
+                /*actionButton*/ 0, /*flags*/ 0, AMETA_NONE, /*buttonState*/ 0,
+                AMOTION_EVENT_EDGE_FLAG_NONE, ADISPLAY_ID_DEFAULT, uint32_t(pointerCount),
+                properties, coords, 1.0f, 1.0f, downTime);
+        mDispatcher->notifyMotion(&args);
+    }
+
+    // Reads and finishes every message that shows up within the timeout.
+    void drain(nsecs_t timeout) {
+        nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
+        while (systemTime(SYSTEM_TIME_MONOTONIC) < deadline) {
+            for (size_t i = 0; i < mClientChannels.size(); i++) {
+                while (receiveAndFinish(mClientChannels[i])) {
+                }
+            }
+            usleep(1000);
+        }
+    }
+
+    // Waits until every channel has received a message and returns the time
+    // the last one arrived, or -1 on timeout.
+    nsecs_t receiveOneFromEach(nsecs_t start) {
+        std::vector<bool> received(mClientChannels.size(), false);
+        size_t remaining = mClientChannels.size();
+        nsecs_t last = start;
+        while (remaining) {
+            std::vector<struct pollfd> fds;
+            for (size_t i = 0; i < mClientChannels.size(); i++) {
+                if (!received[i]) {
+                    struct pollfd fd = { mClientChannels[i]->getFd(), POLLIN, 0 };
+                    fds.push_back(fd);
+                }
+            }
+            if (poll(fds.data(), fds.size(), 1000) <= 0) {
+                return -1;
+            }
+            for (size_t i = 0; i < mClientChannels.size(); i++) {
+                if (!received[i] && receiveAndFinish(mClientChannels[i])) {
+                    last = systemTime(SYSTEM_TIME_MONOTONIC);
+                    received[i] = true;
+                    remaining -= 1;
+                }
+            }
+        }
+        return last;
+    }
+
+    static bool receiveAndFinish(const sp<InputChannel>& channel) {
+        InputMessage msg;
+        if (channel->receiveMessage(&msg) != OK) {
+            return false;
+        }
+        InputMessage finished;
+        finished.header.type = InputMessage::TYPE_FINISHED;
+        finished.body.finished.seq = msg.header.type == InputMessage::TYPE_KEY
+                ? msg.body.key.seq : msg.body.motion.seq;
+        finished.body.finished.handled = true;
+        channel->sendMessage(&finished);
+        return true;
+    }
+
+    sp<FakeInputDispatcherPolicy> mPolicy;
+    sp<InputDispatcher> mDispatcher;
+    sp<InputDispatcherThread> mThread;
+    std::vector<sp<InputChannel> > mClientChannels;
+};
+
+static void report(const char* name, std::vector<nsecs_t> latencies) {
+    if (latencies.empty()) {
+        printf("%-10s no events delivered\n", name);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    printf("%-10s events=%zu p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus\n", name, count,
+            latencies[count / 2] / 1000.0,
+            latencies[count * 90 / 100] / 1000.0,
+            latencies[count * 99 / 100] / 1000.0,
+            latencies[count - 1] / 1000.0);
+}
+
+} // namespace android
+
+using namespace android;
+
+int main(int argc, char** argv) {
+    size_t events = argc > 1 ? strtoul(argv[1], NULL, 10) : 5000;
+    if (events == 0) {
+        fprintf(stderr, "usage: %s [events]\n", argv[0]);
+        return 1;
+    }
+
+    Benchmark benchmark;
+
+    InputEntryPool::setCachingEnabled(false);
+    std::vector<nsecs_t> unpooled = benchmark.run(events);
+
+    InputEntryPool::setCachingEnabled(true);
+    benchmark.run(events / 10); // warm up the pools
+    std::vector<nsecs_t> pooled = benchmark.run(events);
+
+    report("unpooled", unpooled);
+    report("pooled", pooled);
+    benchmark.dumpPools();
+
+    for (size_t overlays : { 16, 64, 128, 256 }) {
+        benchmarkHitTest(overlays, events * 20);
+    }
+    return 0;
+}
@@ -253,4 +253,190 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
             << "Should reject motion events with duplicate pointer ids.";
 }
 
+
+// --- FakeInputWindowHandle ---
+
+class FakeInputWindowHandle : public InputWindowHandle {
+public:
+    FakeInputWindowHandle() : InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->layoutParamsFlags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+        mInfo->visible = true;
+        mInfo->displayId = DISPLAY_ID;
+    }
+
+    InputWindowInfo* editInfo() {
+        return mInfo;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+};
+
+
+// --- InputWindowIndexTest ---
+
+class InputWindowIndexTest : public testing::Test {
+protected:
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowIndex mIndex;
+
+    sp<FakeInputWindowHandle> addWindow(const Rect& touchableRegion, int32_t flags) {
+        sp<FakeInputWindowHandle> windowHandle = new FakeInputWindowHandle();
+        windowHandle->editInfo()->layoutParamsFlags = flags;
+        windowHandle->editInfo()->addTouchableRegion(touchableRegion);
+        mWindowHandles.push(windowHandle);
+        return windowHandle;
+    }
+
+    // The linear search that the index replaces.
+    sp<InputWindowHandle> findTouchedWindowLinear(int32_t displayId, int32_t x, int32_t y,
+            Vector<sp<InputWindowHandle> >* outOutsideTouchWindows) {
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
+            const InputWindowInfo* windowInfo = windowHandle->getInfo();
+            if (windowInfo->displayId != displayId || !windowInfo->visible) {
+                continue;
+            }
+            int32_t flags = windowInfo->layoutParamsFlags;
+            if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+                bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                        | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+                if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
+                    return windowHandle;
+                }
+            }
+            if (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+                outOutsideTouchWindows->push(windowHandle);
+            }
+        }
+        return NULL;
+    }
+};
+
+TEST_F(InputWindowIndexTest, FindTouchedWindow_ReturnsFrontmostWindowContainingPoint) {
+    sp<InputWindowHandle> top = addWindow(Rect(100, 100, 200, 200),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    sp<FakeInputWindowHandle> hidden = addWindow(Rect(0, 0, 1000, 1000),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    hidden->editInfo()->visible = false;
+    sp<InputWindowHandle> bottom = addWindow(Rect(0, 0, 500, 500),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    mIndex.update(mWindowHandles);
+
+    EXPECT_EQ(top, mIndex.findTouchedWindow(DISPLAY_ID, 150, 150));
+    EXPECT_EQ(bottom, mIndex.findTouchedWindow(DISPLAY_ID, 50, 50));
+    EXPECT_EQ(NULL, mIndex.findTouchedWindow(DISPLAY_ID, 600, 600).get());
+    EXPECT_EQ(NULL, mIndex.findTouchedWindow(DISPLAY_ID + 1, 150, 150).get());
+}
+
+TEST_F(InputWindowIndexTest, FindTouchedWindow_TouchModalWindowCatchesEverythingBehindIt) {
+    sp<InputWindowHandle> watcher = addWindow(Rect(0, 0, 10, 10),
+            InputWindowInfo::FLAG_NOT_TOUCHABLE | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    sp<InputWindowHandle> front = addWindow(Rect(100, 100, 200, 200),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    sp<InputWindowHandle> modal = addWindow(Rect(300, 300, 400, 400), 0);
+    addWindow(Rect(0, 0, 1000, 1000),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    mIndex.update(mWindowHandles);
+
+    Vector<sp<InputWindowHandle> > outside;
+    EXPECT_EQ(front, mIndex.findTouchedWindow(DISPLAY_ID, 150, 150, &outside));
+    ASSERT_EQ(1U, outside.size());
+    EXPECT_EQ(watcher, outside[0]);
+
+    EXPECT_EQ(modal, mIndex.findTouchedWindow(DISPLAY_ID, 500, 500));
+    EXPECT_EQ(modal, mIndex.findTouchedWindow(DISPLAY_ID, -5000, 5000));
+}
+
+TEST_F(InputWindowIndexTest, FindTouchedWindow_MatchesLinearSearch) {
+    static const int32_t kFlags[] = {
+        InputWindowInfo::FLAG_NOT_TOUCH_MODAL,
+        InputWindowInfo::FLAG_NOT_FOCUSABLE,
+        InputWindowInfo::FLAG_NOT_TOUCH_MODAL | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH,
+        InputWindowInfo::FLAG_NOT_TOUCHABLE | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH,
+        InputWindowInfo::FLAG_NOT_TOUCHABLE,
+    };
+    srandom(1234);
+
+    for (int iteration = 0; iteration < 50; iteration++) {
+        mWindowHandles.clear();
+        size_t numWindows = 1 + random() % 150;
+        for (size_t i = 0; i < numWindows; i++) {
+            // Keep touch modal windows rare so that many iterations index every window.
+            int32_t flags = random() % 100 == 0 ? 0
+                    : kFlags[random() % (sizeof(kFlags) / sizeof(kFlags[0]))];
+            int32_t left = random() % 1400 - 100;
+            int32_t top = random() % 2500 - 100;
+            sp<FakeInputWindowHandle> windowHandle = addWindow(Rect(left, top,
+                    left + 1 + random() % 600, top + 1 + random() % 600), flags);
+            InputWindowInfo* info = windowHandle->editInfo();
+            for (int r = random() % 3; r > 0; r--) {
+                left = random() % 1400;
+                top = random() % 2500;
+                info->addTouchableRegion(Rect(left, top, left + 1 + random() % 200,
+                        top + 1 + random() % 200));
+            }
+            info->visible = random() % 8 != 0;
+            info->displayId = DISPLAY_ID + random() % 2;
+        }
+        if (iteration % 10 == 9) {
+            // Windows without a touchable region.
+            static_cast<FakeInputWindowHandle*>(mWindowHandles[0].get())
+                    ->editInfo()->touchableRegion.clear();
+        }
+        mIndex.update(mWindowHandles);
+
+        for (int probe = 0; probe < 2000; probe++) {
+            int32_t displayId = DISPLAY_ID + random() % 2;
+            int32_t x = random() % 1700 - 150;
+            int32_t y = random() % 2800 - 150;
+            Vector<sp<InputWindowHandle> > expectedOutside, actualOutside;
+            sp<InputWindowHandle> expected = findTouchedWindowLinear(displayId, x, y,
+                    &expectedOutside);
+            sp<InputWindowHandle> actual = mIndex.findTouchedWindow(displayId, x, y,
+                    &actualOutside);
+            ASSERT_EQ(expected, actual) << "at " << x << "," << y;
+            ASSERT_EQ(expectedOutside.size(), actualOutside.size()) << "at " << x << "," << y;
+            for (size_t i = 0; i < expectedOutside.size(); i++) {
+                ASSERT_EQ(expectedOutside[i], actualOutside[i]);
+            }
+        }
+    }
+}
+
+TEST_F(InputWindowIndexTest, Update_ReindexesOnlyChangedDisplays) {
+    sp<FakeInputWindowHandle> first = addWindow(Rect(0, 0, 100, 100),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    sp<FakeInputWindowHandle> second = addWindow(Rect(0, 0, 100, 100),
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    second->editInfo()->displayId = DISPLAY_ID + 1;
+    EXPECT_EQ(2U, mIndex.update(mWindowHandles));
+    EXPECT_EQ(0U, mIndex.update(mWindowHandles));
+
+    // An equal region that was rebuilt from scratch is not a change.
+    first->editInfo()->touchableRegion.clear();
+    first->editInfo()->addTouchableRegion(Rect(0, 0, 100, 100));
+    EXPECT_EQ(0U, mIndex.update(mWindowHandles));
+
+    first->editInfo()->touchableRegion.clear();
+    first->editInfo()->addTouchableRegion(Rect(0, 0, 50, 50));
+    EXPECT_EQ(1U, mIndex.update(mWindowHandles));
+    EXPECT_EQ(NULL, mIndex.findTouchedWindow(DISPLAY_ID, 75, 75).get());
+    EXPECT_EQ(second, mIndex.findTouchedWindow(DISPLAY_ID + 1, 75, 75));
+
+    second->editInfo()->visible = false;
+    EXPECT_EQ(1U, mIndex.update(mWindowHandles));
+    EXPECT_EQ(NULL, mIndex.findTouchedWindow(DISPLAY_ID + 1, 75, 75).get());
+
+    mWindowHandles.removeAt(1);
+    EXPECT_EQ(0U, mIndex.update(mWindowHandles));
+    EXPECT_EQ(first, mIndex.findTouchedWindow(DISPLAY_ID, 25, 25));
+    EXPECT_EQ(NULL, mIndex.findTouchedWindow(DISPLAY_ID + 1, 75, 75).get());
+
+    mIndex.clear();
+    EXPECT_EQ(NULL, mIndex.findTouchedWindow(DISPLAY_ID, 25, 25).get());
+}
+
 } // namespace android
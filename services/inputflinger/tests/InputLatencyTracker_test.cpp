@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputLatencyTracker.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+#include <linux/input.h>
+
+namespace android {
+
+// An arbitrary device id.
+static const int32_t DEVICE_ID = 1;
+
+// An arbitrary time value.
+static const nsecs_t ARBITRARY_TIME = 1000000000;
+
+static RawEvent makeRawEvent(nsecs_t when, int32_t deviceId, int32_t type, int32_t code,
+        int32_t value) {
+    RawEvent event;
+    event.when = when;
+    event.deviceId = deviceId;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    return event;
+}
+
+static bool contains(const String8& dump, const char* text) {
+    return strstr(dump.string(), text) != NULL;
+}
+
+
+// --- InputLatencyTrackerTest ---
+
+class InputLatencyTrackerTest : public testing::Test {
+protected:
+    void readReport(const sp<InputLatencyTracker>& tracker, int32_t deviceId,
+            nsecs_t when, nsecs_t readTime) {
+        RawEvent events[] = {
+            makeRawEvent(when, deviceId, EV_KEY, KEY_A, 1),
+            makeRawEvent(when, deviceId, EV_SYN, SYN_REPORT, 0),
+        };
+        tracker->notifyEventsRead(events, 2, readTime);
+    }
+
+    String8 dump(const sp<InputLatencyTracker>& tracker) {
+        String8 dump;
+        tracker->dump(dump);
+        return dump;
+    }
+};
+
+TEST_F(InputLatencyTrackerTest, Histogram_RecordsIntoPowerOfTwoBuckets) {
+    InputLatencyTracker::Histogram histogram;
+    histogram.record(-5);
+    histogram.record(100000);
+    histogram.record(125000);
+    histogram.record(3000000);
+    histogram.record(LLONG_MAX / 2);
+
+    ASSERT_EQ(5U, histogram.count);
+    ASSERT_EQ(2U, histogram.buckets[0]);
+    ASSERT_EQ(1U, histogram.buckets[1]);
+    ASSERT_EQ(1U, histogram.buckets[5]);
+    ASSERT_EQ(1U, histogram.buckets[InputLatencyTracker::Histogram::BUCKET_COUNT - 1]);
+    ASSERT_EQ(LLONG_MAX / 2, histogram.max);
+
+    ASSERT_EQ(125000, histogram.getPercentile(0));
+    ASSERT_EQ(125000, histogram.getPercentile(40));
+    ASSERT_EQ(250000, histogram.getPercentile(60));
+    ASSERT_EQ(4000000, histogram.getPercentile(80));
+    ASSERT_EQ(LLONG_MAX, histogram.getPercentile(100));
+}
+
+TEST_F(InputLatencyTrackerTest, IsSampled_HonorsSampleRate) {
+    sp<InputLatencyTracker> disabled = new InputLatencyTracker(0);
+    sp<InputLatencyTracker> all = new InputLatencyTracker(1);
+    sp<InputLatencyTracker> some = new InputLatencyTracker(16);
+
+    // Reports from a 120Hz touch screen.
+    size_t sampled = 0;
+    const size_t reports = 16000;
+    for (size_t i = 0; i < reports; i++) {
+        nsecs_t when = ARBITRARY_TIME + i * 8333333;
+        ASSERT_FALSE(disabled->isSampled(DEVICE_ID, when));
+        ASSERT_TRUE(all->isSampled(DEVICE_ID, when));
+        if (some->isSampled(DEVICE_ID, when)) {
+            sampled += 1;
+        }
+    }
+    ASSERT_GT(sampled, reports / 16 / 2);
+    ASSERT_LT(sampled, reports / 16 * 2);
+}
+
+TEST_F(InputLatencyTrackerTest, TracksEveryStage) {
+    sp<InputLatencyTracker> tracker = new InputLatencyTracker(1);
+    const String8 windowName("Fake Window");
+
+    readReport(tracker, DEVICE_ID, ARBITRARY_TIME, ARBITRARY_TIME + 200000);
+    tracker->notifyEventEnqueued(DEVICE_ID, ARBITRARY_TIME, ARBITRARY_TIME + 700000);
+    tracker->notifyEventPublished(DEVICE_ID, windowName,
+            ARBITRARY_TIME + 700000, ARBITRARY_TIME + 1000000);
+    tracker->notifyEventFinished(DEVICE_ID, windowName,
+            ARBITRARY_TIME + 1000000, ARBITRARY_TIME + 6000000);
+
+    String8 result = dump(tracker);
+    ASSERT_TRUE(contains(result, "SampleRate: 1 in 1")) << result.string();
+    ASSERT_TRUE(contains(result, "read: count=1, mean=0.200ms")) << result.string();
+    ASSERT_TRUE(contains(result, "cook: count=1, mean=0.500ms")) << result.string();
+    ASSERT_TRUE(contains(result, "queue: count=1, mean=0.300ms")) << result.string();
+    ASSERT_TRUE(contains(result, "consume: count=1, mean=5.000ms")) << result.string();
+    ASSERT_TRUE(contains(result, "'Fake Window':")) << result.string();
+}
+
+TEST_F(InputLatencyTrackerTest, NotifyEventEnqueued_CountsEachReportOnce) {
+    sp<InputLatencyTracker> tracker = new InputLatencyTracker(1);
+
+    readReport(tracker, DEVICE_ID, ARBITRARY_TIME, ARBITRARY_TIME + 100000);
+
+    // An event that was not cooked from the last report, like a timeout, is not counted.
+    tracker->notifyEventEnqueued(DEVICE_ID, ARBITRARY_TIME + 1, ARBITRARY_TIME + 200000);
+    tracker->notifyEventEnqueued(DEVICE_ID + 1, ARBITRARY_TIME, ARBITRARY_TIME + 200000);
+
+    tracker->notifyEventEnqueued(DEVICE_ID, ARBITRARY_TIME, ARBITRARY_TIME + 200000);
+    tracker->notifyEventEnqueued(DEVICE_ID, ARBITRARY_TIME, ARBITRARY_TIME + 300000);
+
+    String8 result = dump(tracker);
+    ASSERT_TRUE(contains(result, "cook: count=1, mean=0.100ms")) << result.string();
+}
+
+TEST_F(InputLatencyTrackerTest, Windows_DropsLeastRecentlyUsedWindow) {
+    sp<InputLatencyTracker> tracker = new InputLatencyTracker(1);
+
+    for (int32_t i = 0; i < 40; i++) {
+        String8 windowName = String8::format("Window %d", i);
+        tracker->notifyEventPublished(DEVICE_ID, windowName,
+                ARBITRARY_TIME + i, ARBITRARY_TIME + i + 1000);
+        if (i == 1) {
+            // Keep the first window busy until after all the others.
+            tracker->notifyEventFinished(DEVICE_ID, String8("Window 0"),
+                    ARBITRARY_TIME, ARBITRARY_TIME + 5000);
+        }
+    }
+
+    String8 result = dump(tracker);
+    ASSERT_TRUE(contains(result, "'Window 0':")) << result.string();
+    ASSERT_FALSE(contains(result, "'Window 1':")) << result.string();
+    ASSERT_TRUE(contains(result, "'Window 39':")) << result.string();
+}
+
+TEST_F(InputLatencyTrackerTest, Dump_WhenDisabled) {
+    sp<InputLatencyTracker> tracker = new InputLatencyTracker(0);
+    readReport(tracker, DEVICE_ID, ARBITRARY_TIME, ARBITRARY_TIME + 100000);
+
+    String8 result = dump(tracker);
+    ASSERT_TRUE(contains(result, "Disabled")) << result.string();
+    ASSERT_FALSE(contains(result, "read:")) << result.string();
+}
+
+} // namespace android
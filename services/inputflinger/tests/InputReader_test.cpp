@@ -329,6 +329,11 @@ public:
         mNotifySwitchArgsQueue.erase(mNotifySwitchArgsQueue.begin());
     }
 
+    void assertNotifySwitchWasNotCalled() {
+        ASSERT_TRUE(mNotifySwitchArgsQueue.empty())
+                << "Expected notifySwitch() to not have been called.";
+    }
+
 private:
     virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args) {
         mNotifyConfigurationChangedArgsQueue.push_back(*args);
@@ -394,6 +399,7 @@ class FakeEventHub : public EventHubInterface {
     KeyedVector<int32_t, Device*> mDevices;
     Vector<String8> mExcludedDevices;
     List<RawEvent> mEvents;
+    size_t mMaxEventsPerRead;
 
 protected:
     virtual ~FakeEventHub() {
@@ -403,7 +409,13 @@ protected:
     }
 
 public:
-    FakeEventHub() { }
+    FakeEventHub() : mMaxEventsPerRead(1) { }
+
+    // Lets getEvents() return up to this many queued events at once, like the real
+    // event hub does when several devices have pending input.
+    void setMaxEventsPerRead(size_t maxEvents) {
+        mMaxEventsPerRead = maxEvents;
+    }
 
     void addDevice(int32_t deviceId, const String8& name, uint32_t classes) {
         Device* device = new Device(classes);
@@ -662,14 +674,13 @@ private:
         mExcludedDevices = devices;
     }
 
-    virtual size_t getEvents(int, RawEvent* buffer, size_t) {
-        if (mEvents.empty()) {
-            return 0;
+    virtual size_t getEvents(int, RawEvent* buffer, size_t bufferSize) {
+        size_t count = 0;
+        while (!mEvents.empty() && count < bufferSize && count < mMaxEventsPerRead) {
+            buffer[count++] = *mEvents.begin();
+            mEvents.erase(mEvents.begin());
         }
-
-        *buffer = *mEvents.begin();
-        mEvents.erase(mEvents.begin());
-        return 1;
+        return count;
     }
 
     virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const {
@@ -1349,6 +1360,41 @@ TEST_F(InputReaderTest, LoopOnce_ForwardsRawEventsToMappers) {
     ASSERT_EQ(1, event.value);
 }
 
+TEST_F(InputReaderTest, LoopOnce_WithWorkerThreads_NotifiesInEventTimeOrder) {
+    const int32_t deviceCount = 4;
+    const int32_t reportsPerDevice = 8;
+    for (int32_t deviceId = 1; deviceId <= deviceCount; deviceId++) {
+        ASSERT_NO_FATAL_FAILURE(addDevice(deviceId, String8::format("switch%d", deviceId),
+                INPUT_DEVICE_CLASS_SWITCH, NULL));
+    }
+    mReader->setWorkerThreadCount(2);
+
+    // Interleave the reports of all devices, and read them all at once.
+    mFakeEventHub->setMaxEventsPerRead(256);
+    nsecs_t when = 0;
+    for (int32_t report = 0; report < reportsPerDevice; report++) {
+        for (int32_t deviceId = 1; deviceId <= deviceCount; deviceId++) {
+            when += 1;
+            mFakeEventHub->enqueueEvent(when, deviceId, EV_SW, SW_LID, (report + 1) % 2);
+            mFakeEventHub->enqueueEvent(when, deviceId, EV_SYN, SYN_REPORT, 0);
+        }
+    }
+    mReader->loopOnce();
+    ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+
+    for (nsecs_t expectedTime = 1; expectedTime <= when; expectedTime++) {
+        int32_t report = (expectedTime - 1) / deviceCount;
+        NotifySwitchArgs args;
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifySwitchWasCalled(&args));
+        ASSERT_EQ(expectedTime, args.eventTime);
+        ASSERT_EQ(uint32_t((report + 1) % 2) << SW_LID, args.switchValues);
+        ASSERT_EQ(1U << SW_LID, args.switchMask);
+    }
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifySwitchWasNotCalled());
+
+    mReader->setWorkerThreadCount(0);
+}
+
 
 // --- InputDeviceTest ---
 
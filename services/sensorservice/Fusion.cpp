@@ -128,6 +128,33 @@ static mat<TYPE, R, R> scaleCovariance(
     return APAt;
 }
 
+/*
+ * P = Phi*P*transpose(Phi) + GQGt, without the generic 6x6 products:
+ *
+ *  Phi = | Phi00 Phi10 |       P = | P00  P10 |
+ *        |   0     1   |           | P01  P11 |
+ *
+ *  Phi*P*transpose(Phi) = | (Phi00*P00 + Phi10*P01)*Phi00t + M*Phi10t    M   |
+ *                         |                  Mt                         P11 |
+ *
+ *  with M = Phi00*P10 + Phi10*P11, which is 6 3x3 products instead of 16.
+ *  P01 is kept as the transpose of P10, like update() does.
+ */
+template <typename TYPE>
+static void propagateCovariance(
+        mat<mat<TYPE, 3, 3>, 2, 2>& P,
+        const mat<mat<TYPE, 3, 3>, 2, 2>& Phi,
+        const mat<mat<TYPE, 3, 3>, 2, 2>& GQGt) {
+    const mat<TYPE, 3, 3>& Phi00(Phi[0][0]);
+    const mat<TYPE, 3, 3>& Phi10(Phi[1][0]);
+    const mat<TYPE, 3, 3> M(Phi00*P[1][0] + Phi10*P[1][1]);
+    P[0][0] = (Phi00*P[0][0] + Phi10*P[0][1])*transpose(Phi00)
+            + M*transpose(Phi10) + GQGt[0][0];
+    P[1][0] = M + GQGt[1][0];
+    P[0][1] = transpose(P[1][0]);
+    P[1][1] += GQGt[1][1];
+}
+
 template <typename TYPE, typename OTHER_TYPE>
 static mat<TYPE, 3, 3> crossMatrix(const vec<TYPE, 3>& p, OTHER_TYPE diag) {
     mat<TYPE, 3, 3> r;
@@ -487,7 +514,7 @@ void Fusion::predict(const vec3_t& w, float dT) {
     if (x0.w < 0)
         x0 = -x0;
 
-    P = Phi*P*transpose(Phi) + GQGt;
+    propagateCovariance(P, Phi, GQGt);
 
     checkState();
 }
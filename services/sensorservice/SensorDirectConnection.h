@@ -58,6 +58,7 @@ protected:
     // ISensorEventConnection functions
     virtual void onFirstRef();
     virtual sp<BitTube> getSensorChannel() const;
+    virtual sp<SensorEventRing> getSensorEventRing();
     virtual status_t enableDisable(int handle, bool enabled, nsecs_t samplingPeriodNs,
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags);
     virtual status_t setEventRate(int handle, nsecs_t samplingPeriodNs);
@@ -17,6 +17,10 @@
 #include <sys/socket.h>
 #include <utils/threads.h>
 
+#include <algorithm>
+
+#include <cutils/properties.h>
+
 #include <sensor/SensorEventQueue.h>
 
 #include "vec.h"
@@ -81,6 +85,10 @@ void SensorService::SensorEventConnection::dump(String8& result) {
     result.appendFormat("\t %s | WakeLockRefCount %d | uid %d | cache size %d | "
             "max cache size %d\n", mPackageName.string(), mWakeLockRefCount, mUid, mCacheSize,
             mMaxCacheSize);
+    if (mEventRing != nullptr) {
+        result.appendFormat("\t event ring capacity %zu | dropped events %u\n",
+                mEventRing->getCapacity(), mEventRing->getDroppedEventCount());
+    }
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const FlushInfo& flushInfo = mSensorInfo.valueAt(i);
         result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d \n",
@@ -221,67 +229,42 @@ void SensorService::SensorEventConnection::incrementPendingFlushCount(int32_t ha
 status_t SensorService::SensorEventConnection::sendEvents(
         sensors_event_t const* buffer, size_t numEvents,
         sensors_event_t* scratch,
-        wp<const SensorEventConnection> const * mapFlushEventsToConnections) {
+        wp<const SensorEventConnection> const * mapFlushEventsToConnections,
+        SensorEventRun const* runs, size_t runCount) {
     // filter out events not for this connection
     int count = 0;
     Mutex::Autolock _l(mConnectionLock);
     if (scratch) {
-        size_t i=0;
-        while (i<numEvents) {
-            int32_t sensor_handle = buffer[i].sensor;
-            if (buffer[i].type == SENSOR_TYPE_META_DATA) {
-                ALOGD_IF(DEBUG_CONNECTIONS, "flush complete event sensor==%d ",
-                        buffer[i].meta_data.sensor);
-                // Setting sensor_handle to the correct sensor to ensure the sensor events per
-                // connection are filtered correctly.  buffer[i].sensor is zero for meta_data
-                // events.
-                sensor_handle = buffer[i].meta_data.sensor;
-            }
-
-            ssize_t index = mSensorInfo.indexOfKey(sensor_handle);
+        for (size_t r = 0; r < runCount; r++) {
+            const SensorEventRun& run = runs[r];
+            ssize_t index = mSensorInfo.indexOfKey(run.handle);
             // Check if this connection has registered for this sensor. If not continue to the
-            // next sensor_event.
+            // next run of sensor_events.
             if (index < 0) {
-                ++i;
                 continue;
             }
 
             FlushInfo& flushInfo = mSensorInfo.editValueAt(index);
-            // Check if there is a pending flush_complete event for this sensor on this connection.
-            if (buffer[i].type == SENSOR_TYPE_META_DATA && flushInfo.mFirstFlushPending == true &&
-                    mapFlushEventsToConnections[i] == this) {
-                flushInfo.mFirstFlushPending = false;
-                ALOGD_IF(DEBUG_CONNECTIONS, "First flush event for sensor==%d ",
-                        buffer[i].meta_data.sensor);
-                ++i;
-                continue;
-            }
-
-            // If there is a pending flush complete event for this sensor on this connection,
-            // ignore the event and proceed to the next.
-            if (flushInfo.mFirstFlushPending) {
-                ++i;
-                continue;
-            }
-
-            do {
-                // Keep copying events into the scratch buffer as long as they are regular
-                // sensor_events are from the same sensor_handle OR they are flush_complete_events
-                // from the same sensor_handle AND the current connection is mapped to the
-                // corresponding flush_complete_event.
+            for (size_t i = run.start; i < run.start + run.count; i++) {
                 if (buffer[i].type == SENSOR_TYPE_META_DATA) {
-                    if (mapFlushEventsToConnections[i] == this) {
-                        scratch[count++] = buffer[i];
+                    // Only send flush_complete_events to the connection they are mapped to.
+                    if (mapFlushEventsToConnections[i] != this) {
+                        continue;
                     }
-                    ++i;
-                } else {
+                    // The first flush complete event after activation is not sent, it only
+                    // marks the point from which events are sent on this connection.
+                    if (flushInfo.mFirstFlushPending) {
+                        flushInfo.mFirstFlushPending = false;
+                        ALOGD_IF(DEBUG_CONNECTIONS, "First flush event for sensor==%d ",
+                                buffer[i].meta_data.sensor);
+                        continue;
+                    }
+                    scratch[count++] = buffer[i];
+                } else if (!flushInfo.mFirstFlushPending) {
                     // Regular sensor event, just copy it to the scratch buffer.
-                    scratch[count++] = buffer[i++];
+                    scratch[count++] = buffer[i];
                 }
-            } while ((i<numEvents) && ((buffer[i].sensor == sensor_handle &&
-                                        buffer[i].type != SENSOR_TYPE_META_DATA) ||
-                                       (buffer[i].type == SENSOR_TYPE_META_DATA  &&
-                                        buffer[i].meta_data.sensor == sensor_handle)));
+            }
         }
     } else {
         scratch = const_cast<sensors_event_t *>(buffer);
@@ -297,6 +280,10 @@ status_t SensorService::SensorEventConnection::sendEvents(
 #if DEBUG_CONNECTIONS
      mEventsReceived += count;
 #endif
+    if (mEventRing != nullptr) {
+        return writeToRingLocked(scratch, count);
+    }
+
     if (mCacheSize != 0) {
         // There are some events in the cache which need to be sent first. Copy this buffer to
         // the end of cache.
@@ -415,7 +402,12 @@ void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
                ++mWakeLockRefCount;
                flushCompleteEvent.flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
             }
-            ssize_t size = SensorEventQueue::write(mChannel, &flushCompleteEvent, 1);
+            ssize_t size;
+            if (mEventRing != nullptr) {
+                size = mEventRing->write(&flushCompleteEvent, 1) ? 1 : WOULD_BLOCK;
+            } else {
+                size = SensorEventQueue::write(mChannel, &flushCompleteEvent, 1);
+            }
             if (size < 0) {
                 if (wakeUpSensor) --mWakeLockRefCount;
                 return;
@@ -483,11 +475,12 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
     updateLooperRegistrationLocked(mService->getLooper());
 }
 
-void SensorService::SensorEventConnection::countFlushCompleteEventsLocked(
+int SensorService::SensorEventConnection::countFlushCompleteEventsLocked(
                 sensors_event_t const* scratch, const int numEventsDropped) {
     ALOGD_IF(DEBUG_CONNECTIONS, "dropping %d events ", numEventsDropped);
     // Count flushComplete events in the events that are about to the dropped. These will be sent
     // separately before the next batch of events.
+    int numFlushCompleteEvents = 0;
     for (int j = 0; j < numEventsDropped; ++j) {
         if (scratch[j].type == SENSOR_TYPE_META_DATA) {
             ssize_t index = mSensorInfo.indexOfKey(scratch[j].meta_data.sensor);
@@ -499,11 +492,39 @@ void SensorService::SensorEventConnection::countFlushCompleteEventsLocked(
 
             FlushInfo& flushInfo = mSensorInfo.editValueAt(index);
             flushInfo.mPendingFlushEventsToSend++;
+            numFlushCompleteEvents++;
             ALOGD_IF(DEBUG_CONNECTIONS, "increment pendingFlushCount %d",
                      flushInfo.mPendingFlushEventsToSend);
         }
     }
-    return;
+    return numFlushCompleteEvents;
+}
+
+status_t SensorService::SensorEventConnection::writeToRingLocked(sensors_event_t* scratch,
+                                                                 int count) {
+    const int numEventsToWrite = std::min(count, int(mEventRing->getWritableCount()));
+    if (numEventsToWrite < count) {
+        const int numEventsDropped = count - numEventsToWrite;
+        const int numFlushCompleteEvents = countFlushCompleteEventsLocked(
+                scratch + numEventsToWrite, numEventsDropped);
+        mEventRing->addDroppedEvents(numEventsDropped - numFlushCompleteEvents);
+    }
+
+    int index_wake_up_event = findWakeUpSensorEventLocked(scratch, numEventsToWrite);
+    if (index_wake_up_event >= 0) {
+        scratch[index_wake_up_event].flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
+        ++mWakeLockRefCount;
+#if DEBUG_CONNECTIONS
+        ++mTotalAcksNeeded;
+#endif
+    }
+
+    // NOTE: ASensorEvent and sensors_event_t are the same type.
+    mEventRing->write(reinterpret_cast<ASensorEvent const*>(scratch), numEventsToWrite);
+#if DEBUG_CONNECTIONS
+    mEventsSent += numEventsToWrite;
+#endif
+    return status_t(NO_ERROR);
 }
 
 int SensorService::SensorEventConnection::findWakeUpSensorEventLocked(
@@ -521,6 +542,29 @@ sp<BitTube> SensorService::SensorEventConnection::getSensorChannel() const
     return mChannel;
 }
 
+sp<SensorEventRing> SensorService::SensorEventConnection::getSensorEventRing()
+{
+    if (!property_get_bool("ro.sensors.event_ring", false)) {
+        return nullptr;
+    }
+
+    Mutex::Autolock _l(mConnectionLock);
+    if (mEventRing == nullptr) {
+        // Switching after events were sent through the socket could reorder them.
+        if (mSensorInfo.size() != 0 || mCacheSize != 0) {
+            return nullptr;
+        }
+        // Hold as many events as the socket would have.
+        sp<SensorEventRing> ring = SensorEventRing::create(
+                mService->mSocketBufferSize / sizeof(sensors_event_t));
+        if (ring->initCheck() != NO_ERROR) {
+            return nullptr;
+        }
+        mEventRing = ring;
+    }
+    return mEventRing;
+}
+
 status_t SensorService::SensorEventConnection::enableDisable(
         int handle, bool enabled, nsecs_t samplingPeriodNs, nsecs_t maxBatchReportLatencyNs,
         int reservedFlags)
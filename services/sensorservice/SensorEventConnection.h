@@ -35,6 +35,7 @@
 #include <sensor/BitTube.h>
 #include <sensor/ISensorServer.h>
 #include <sensor/ISensorEventConnection.h>
+#include <sensor/SensorEventRing.h>
 
 #include "SensorService.h"
 
@@ -51,8 +52,13 @@ public:
     SensorEventConnection(const sp<SensorService>& service, uid_t uid, String8 packageName,
                           bool isDataInjectionMode, const String16& opPackageName);
 
+    // Sends the events this connection registered for. When scratch is given, the events are
+    // filtered into it and runs must describe the buffer, as computed by
+    // SensorService::findEventRuns. Must not be called with SensorService::mLock held by the
+    // sensor thread.
     status_t sendEvents(sensors_event_t const* buffer, size_t count, sensors_event_t* scratch,
-                        wp<const SensorEventConnection> const * mapFlushEventsToConnections = NULL);
+                        wp<const SensorEventConnection> const * mapFlushEventsToConnections = NULL,
+                        SensorEventRun const* runs = NULL, size_t runCount = 0);
     bool hasSensor(int32_t handle) const;
     bool hasAnySensor() const;
     bool hasOneShotSensors() const;
@@ -70,6 +76,7 @@ private:
     virtual ~SensorEventConnection();
     virtual void onFirstRef();
     virtual sp<BitTube> getSensorChannel() const;
+    virtual sp<SensorEventRing> getSensorEventRing();
     virtual status_t enableDisable(int handle, bool enabled, nsecs_t samplingPeriodNs,
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags);
     virtual status_t setEventRate(int handle, nsecs_t samplingPeriodNs);
@@ -79,8 +86,12 @@ private:
 
     // Count the number of flush complete events which are about to be dropped in the buffer.
     // Increment mPendingFlushEventsToSend in mSensorInfo. These flush complete events will be sent
-    // separately before the next batch of events.
-    void countFlushCompleteEventsLocked(sensors_event_t const* scratch, int numEventsDropped);
+    // separately before the next batch of events. Returns the number of flush complete events.
+    int countFlushCompleteEventsLocked(sensors_event_t const* scratch, int numEventsDropped);
+
+    // Writes events to mEventRing. Events that do not fit are dropped without blocking, except
+    // for flush complete events, which are sent again before the next batch of events.
+    status_t writeToRingLocked(sensors_event_t* scratch, int count);
 
     // Check if there are any wake up events in the buffer. If yes, return the index of the first
     // wake_up sensor event in the buffer else return -1.  This wake_up sensor event will have the
@@ -125,6 +136,9 @@ private:
 
     sp<SensorService> const mService;
     sp<BitTube> mChannel;
+    // If the client asked for it, events are written to this ring instead of mChannel. mChannel
+    // still carries acknowledgements and injected events from the client.
+    sp<SensorEventRing> mEventRing;
     uid_t mUid;
     mutable Mutex mConnectionLock;
     // Number of events from wake up sensors which are still pending and haven't been delivered to
@@ -153,7 +167,7 @@ private:
 
         FlushInfo() : mPendingFlushEventsToSend(0), mFirstFlushPending(false) {}
     };
-    // protected by SensorService::mLock. Key for this vector is the sensor handle.
+    // protected by mConnectionLock. Key for this vector is the sensor handle.
     KeyedVector<int, FlushInfo> mSensorInfo;
 
     sensors_event_t *mEventCache;
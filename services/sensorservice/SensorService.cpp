@@ -78,7 +78,7 @@ static const String16 sLocationHardwarePermission("android.permission.LOCATION_H
 
 SensorService::SensorService()
     : mInitCheck(NO_INIT), mSocketBufferSize(SOCKET_BUFFER_SIZE_NON_BATCHED),
-      mWakeLockAcquired(false) {
+      mWakeLockAcquired(false), mDispatchingEvents(false) {
 }
 
 bool SensorService::initializeHmacKey() {
@@ -259,6 +259,7 @@ void SensorService::onFirstRef() {
             const size_t minBufferSize = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
             mSensorEventBuffer = new sensors_event_t[minBufferSize];
             mSensorEventScratch = new sensors_event_t[minBufferSize];
+            mSensorEventRuns = new SensorEventRun[minBufferSize];
             mMapFlushEventsToConnections = new wp<const SensorEventConnection> [minBufferSize];
             mCurrentOperatingMode = NORMAL;
 
@@ -523,6 +524,7 @@ bool SensorService::threadLoop() {
     SensorDevice& device(SensorDevice::getInstance());
 
     const int halVersion = device.getHalDeviceVersion();
+    Vector< sp<SensorEventConnection> > activeConnections;
     do {
         ssize_t count = device.poll(mSensorEventBuffer, numEventMax);
         if (count < 0) {
@@ -535,170 +537,185 @@ bool SensorService::threadLoop() {
              mSensorEventBuffer[i].flags = 0;
         }
 
-        // Make a copy of the connection vector as some connections may be removed during the course
-        // of this loop (especially when one-shot sensor events are present in the sensor_event
-        // buffer). Promote all connections to StrongPointers before the lock is acquired. If the
-        // destructor of the sp gets called when the lock is acquired, it may result in a deadlock
-        // as ~SensorEventConnection() needs to acquire mLock again for cleanup. So copy all the
-        // strongPointers to a vector before the lock is acquired.
-        SortedVector< sp<SensorEventConnection> > activeConnections;
+        // Take the latest snapshot of the connection vector as some connections may be removed
+        // during the course of this loop (especially when one-shot sensor events are present in the
+        // sensor_event buffer). Promote all connections to StrongPointers before the lock is
+        // acquired. If the destructor of the sp gets called when the lock is acquired, it may
+        // result in a deadlock as ~SensorEventConnection() needs to acquire mLock again for
+        // cleanup. So the strongPointers are only released at the end of the loop, when the lock
+        // is no longer held.
         populateActiveConnections(&activeConnections);
 
-        Mutex::Autolock _l(mLock);
-        // Poll has returned. Hold a wakelock if one of the events is from a wake up sensor. The
-        // rest of this loop is under a critical section protected by mLock. Acquiring a wakeLock,
-        // sending events to clients (incrementing SensorEventConnection::mWakeLockRefCount) should
-        // not be interleaved with decrementing SensorEventConnection::mWakeLockRefCount and
-        // releasing the wakelock.
-        bool bufferHasWakeUpEvent = false;
-        for (int i = 0; i < count; i++) {
-            if (isWakeUpSensorEvent(mSensorEventBuffer[i])) {
-                bufferHasWakeUpEvent = true;
-                break;
+        {
+            Mutex::Autolock _l(mLock);
+            // Poll has returned. Hold a wakelock if one of the events is from a wake up sensor.
+            // Acquiring a wakeLock, sending events to clients (incrementing
+            // SensorEventConnection::mWakeLockRefCount) should not be interleaved with decrementing
+            // SensorEventConnection::mWakeLockRefCount and releasing the wakelock, which is why
+            // the wakelock is not released while mDispatchingEvents is set.
+            bool bufferHasWakeUpEvent = false;
+            for (int i = 0; i < count; i++) {
+                if (isWakeUpSensorEvent(mSensorEventBuffer[i])) {
+                    bufferHasWakeUpEvent = true;
+                    break;
+                }
             }
-        }
 
-        if (bufferHasWakeUpEvent && !mWakeLockAcquired) {
-            setWakeLockAcquiredLocked(true);
-        }
-        recordLastValueLocked(mSensorEventBuffer, count);
-
-        // handle virtual sensors
-        if (count && vcount) {
-            sensors_event_t const * const event = mSensorEventBuffer;
-            if (!mActiveVirtualSensors.empty()) {
-                size_t k = 0;
-                SensorFusion& fusion(SensorFusion::getInstance());
-                if (fusion.isEnabled()) {
-                    for (size_t i=0 ; i<size_t(count) ; i++) {
-                        fusion.process(event[i]);
-                    }
-                }
-                for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
-                    for (int handle : mActiveVirtualSensors) {
-                        if (count + k >= minBufferSize) {
-                            ALOGE("buffer too small to hold all events: "
-                                    "count=%zd, k=%zu, size=%zu",
-                                    count, k, minBufferSize);
-                            break;
-                        }
-                        sensors_event_t out;
-                        sp<SensorInterface> si = mSensors.getInterface(handle);
-                        if (si == nullptr) {
-                            ALOGE("handle %d is not an valid virtual sensor", handle);
-                            continue;
+            if (bufferHasWakeUpEvent && !mWakeLockAcquired) {
+                setWakeLockAcquiredLocked(true);
+            }
+            recordLastValueLocked(mSensorEventBuffer, count);
+
+            // handle virtual sensors
+            if (count && vcount) {
+                sensors_event_t const * const event = mSensorEventBuffer;
+                if (!mActiveVirtualSensors.empty()) {
+                    size_t k = 0;
+                    SensorFusion& fusion(SensorFusion::getInstance());
+                    if (fusion.isEnabled()) {
+                        for (size_t i=0 ; i<size_t(count) ; i++) {
+                            fusion.process(event[i]);
                         }
+                    }
+                    for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
+                        for (int handle : mActiveVirtualSensors) {
+                            if (count + k >= minBufferSize) {
+                                ALOGE("buffer too small to hold all events: "
+                                        "count=%zd, k=%zu, size=%zu",
+                                        count, k, minBufferSize);
+                                break;
+                            }
+                            sensors_event_t out;
+                            sp<SensorInterface> si = mSensors.getInterface(handle);
+                            if (si == nullptr) {
+                                ALOGE("handle %d is not an valid virtual sensor", handle);
+                                continue;
+                            }
 
-                        if (si->process(&out, event[i])) {
-                            mSensorEventBuffer[count + k] = out;
-                            k++;
+                            if (si->process(&out, event[i])) {
+                                mSensorEventBuffer[count + k] = out;
+                                k++;
+                            }
                         }
                     }
-                }
-                if (k) {
-                    // record the last synthesized values
-                    recordLastValueLocked(&mSensorEventBuffer[count], k);
-                    count += k;
-                    // sort the buffer by time-stamps
-                    sortEventBuffer(mSensorEventBuffer, count);
+                    if (k) {
+                        // record the last synthesized values
+                        recordLastValueLocked(&mSensorEventBuffer[count], k);
+                        count += k;
+                        // sort the buffer by time-stamps
+                        sortEventBuffer(mSensorEventBuffer, count);
+                    }
                 }
             }
-        }
 
-        // handle backward compatibility for RotationVector sensor
-        if (halVersion < SENSORS_DEVICE_API_VERSION_1_0) {
-            for (int i = 0; i < count; i++) {
-                if (mSensorEventBuffer[i].type == SENSOR_TYPE_ROTATION_VECTOR) {
-                    // All the 4 components of the quaternion should be available
-                    // No heading accuracy. Set it to -1
-                    mSensorEventBuffer[i].data[4] = -1;
+            // handle backward compatibility for RotationVector sensor
+            if (halVersion < SENSORS_DEVICE_API_VERSION_1_0) {
+                for (int i = 0; i < count; i++) {
+                    if (mSensorEventBuffer[i].type == SENSOR_TYPE_ROTATION_VECTOR) {
+                        // All the 4 components of the quaternion should be available
+                        // No heading accuracy. Set it to -1
+                        mSensorEventBuffer[i].data[4] = -1;
+                    }
                 }
             }
-        }
 
-        for (int i = 0; i < count; ++i) {
-            // Map flush_complete_events in the buffer to SensorEventConnections which called flush
-            // on the hardware sensor. mapFlushEventsToConnections[i] will be the
-            // SensorEventConnection mapped to the corresponding flush_complete_event in
-            // mSensorEventBuffer[i] if such a mapping exists (NULL otherwise).
-            mMapFlushEventsToConnections[i] = NULL;
-            if (mSensorEventBuffer[i].type == SENSOR_TYPE_META_DATA) {
-                const int sensor_handle = mSensorEventBuffer[i].meta_data.sensor;
-                SensorRecord* rec = mActiveSensors.valueFor(sensor_handle);
-                if (rec != NULL) {
-                    mMapFlushEventsToConnections[i] = rec->getFirstPendingFlushConnection();
-                    rec->removeFirstPendingFlushConnection();
+            for (int i = 0; i < count; ++i) {
+                // Map flush_complete_events in the buffer to SensorEventConnections which called
+                // flush on the hardware sensor. mapFlushEventsToConnections[i] will be the
+                // SensorEventConnection mapped to the corresponding flush_complete_event in
+                // mSensorEventBuffer[i] if such a mapping exists (NULL otherwise).
+                mMapFlushEventsToConnections[i] = NULL;
+                if (mSensorEventBuffer[i].type == SENSOR_TYPE_META_DATA) {
+                    const int sensor_handle = mSensorEventBuffer[i].meta_data.sensor;
+                    SensorRecord* rec = mActiveSensors.valueFor(sensor_handle);
+                    if (rec != NULL) {
+                        mMapFlushEventsToConnections[i] = rec->getFirstPendingFlushConnection();
+                        rec->removeFirstPendingFlushConnection();
+                    }
                 }
-            }
 
-            // handle dynamic sensor meta events, process registration and unregistration of dynamic
-            // sensor based on content of event.
-            if (mSensorEventBuffer[i].type == SENSOR_TYPE_DYNAMIC_SENSOR_META) {
-                if (mSensorEventBuffer[i].dynamic_sensor_meta.connected) {
-                    int handle = mSensorEventBuffer[i].dynamic_sensor_meta.handle;
-                    const sensor_t& dynamicSensor =
-                            *(mSensorEventBuffer[i].dynamic_sensor_meta.sensor);
-                    ALOGI("Dynamic sensor handle 0x%x connected, type %d, name %s",
-                          handle, dynamicSensor.type, dynamicSensor.name);
-
-                    if (mSensors.isNewHandle(handle)) {
-                        const auto& uuid = mSensorEventBuffer[i].dynamic_sensor_meta.uuid;
-                        sensor_t s = dynamicSensor;
-                        // make sure the dynamic sensor flag is set
-                        s.flags |= DYNAMIC_SENSOR_MASK;
-                        // force the handle to be consistent
-                        s.handle = handle;
-
-                        SensorInterface *si = new HardwareSensor(s, uuid);
-
-                        // This will release hold on dynamic sensor meta, so it should be called
-                        // after Sensor object is created.
-                        device.handleDynamicSensorConnection(handle, true /*connected*/);
-                        registerDynamicSensorLocked(si);
+                // handle dynamic sensor meta events, process registration and unregistration of
+                // dynamic sensor based on content of event.
+                if (mSensorEventBuffer[i].type == SENSOR_TYPE_DYNAMIC_SENSOR_META) {
+                    if (mSensorEventBuffer[i].dynamic_sensor_meta.connected) {
+                        int handle = mSensorEventBuffer[i].dynamic_sensor_meta.handle;
+                        const sensor_t& dynamicSensor =
+                                *(mSensorEventBuffer[i].dynamic_sensor_meta.sensor);
+                        ALOGI("Dynamic sensor handle 0x%x connected, type %d, name %s",
+                              handle, dynamicSensor.type, dynamicSensor.name);
+
+                        if (mSensors.isNewHandle(handle)) {
+                            const auto& uuid = mSensorEventBuffer[i].dynamic_sensor_meta.uuid;
+                            sensor_t s = dynamicSensor;
+                            // make sure the dynamic sensor flag is set
+                            s.flags |= DYNAMIC_SENSOR_MASK;
+                            // force the handle to be consistent
+                            s.handle = handle;
+
+                            SensorInterface *si = new HardwareSensor(s, uuid);
+
+                            // This will release hold on dynamic sensor meta, so it should be
+                            // called after Sensor object is created.
+                            device.handleDynamicSensorConnection(handle, true /*connected*/);
+                            registerDynamicSensorLocked(si);
+                        } else {
+                            ALOGE("Handle %d has been used, cannot use again before reboot.",
+                                    handle);
+                        }
                     } else {
-                        ALOGE("Handle %d has been used, cannot use again before reboot.", handle);
-                    }
-                } else {
-                    int handle = mSensorEventBuffer[i].dynamic_sensor_meta.handle;
-                    ALOGI("Dynamic sensor handle 0x%x disconnected", handle);
+                        int handle = mSensorEventBuffer[i].dynamic_sensor_meta.handle;
+                        ALOGI("Dynamic sensor handle 0x%x disconnected", handle);
 
-                    device.handleDynamicSensorConnection(handle, false /*connected*/);
-                    if (!unregisterDynamicSensorLocked(handle)) {
-                        ALOGE("Dynamic sensor release error.");
-                    }
+                        device.handleDynamicSensorConnection(handle, false /*connected*/);
+                        if (!unregisterDynamicSensorLocked(handle)) {
+                            ALOGE("Dynamic sensor release error.");
+                        }
 
-                    size_t numConnections = activeConnections.size();
-                    for (size_t i=0 ; i < numConnections; ++i) {
-                        if (activeConnections[i] != NULL) {
-                            activeConnections[i]->removeSensor(handle);
+                        size_t numConnections = activeConnections.size();
+                        for (size_t i=0 ; i < numConnections; ++i) {
+                            if (activeConnections[i] != NULL) {
+                                activeConnections[i]->removeSensor(handle);
+                            }
                         }
                     }
                 }
             }
-        }
 
+            // Events are sent to clients without holding mLock, so that enable and disable calls
+            // are not blocked by slow clients. Keep the wake lock until it is checked below.
+            mDispatchingEvents = true;
+        }
 
-        // Send our events to clients. Check the state of wake lock for each client and release the
-        // lock if none of the clients need it.
-        bool needsWakeLock = false;
+        // Send our events to clients. The buffer is split into runs of events from the same
+        // sensor once, rather than by every connection.
+        const size_t runCount = findEventRuns(mSensorEventBuffer, count, mSensorEventRuns);
+        bool hasOneShotSensors = false;
         size_t numConnections = activeConnections.size();
         for (size_t i=0 ; i < numConnections; ++i) {
-            if (activeConnections[i] != 0) {
-                activeConnections[i]->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
-                        mMapFlushEventsToConnections);
-                needsWakeLock |= activeConnections[i]->needsWakeLock();
-                // If the connection has one-shot sensors, it may be cleaned up after first trigger.
-                // Early check for one-shot sensors.
-                if (activeConnections[i]->hasOneShotSensors()) {
-                    cleanupAutoDisabledSensorLocked(activeConnections[i], mSensorEventBuffer,
-                            count);
+            activeConnections[i]->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
+                    mMapFlushEventsToConnections, mSensorEventRuns, runCount);
+            hasOneShotSensors |= activeConnections[i]->hasOneShotSensors();
+        }
+
+        {
+            Mutex::Autolock _l(mLock);
+            mDispatchingEvents = false;
+            // If a connection has one-shot sensors, it may be cleaned up after first trigger.
+            if (hasOneShotSensors) {
+                for (size_t i=0 ; i < numConnections; ++i) {
+                    if (activeConnections[i]->hasOneShotSensors()) {
+                        cleanupAutoDisabledSensorLocked(activeConnections[i], mSensorEventBuffer,
+                                count);
+                    }
                 }
             }
-        }
 
-        if (mWakeLockAcquired && !needsWakeLock) {
-            setWakeLockAcquiredLocked(false);
+            // Check the state of wake lock for each client and release the lock if none of the
+            // clients need it.
+            checkWakeLockStateLocked();
         }
+
+        activeConnections.clear();
     } while (!Thread::exitPending());
 
     ALOGW("Exiting SensorService::threadLoop => aborting...");
@@ -711,7 +728,7 @@ sp<Looper> SensorService::getLooper() const {
 }
 
 void SensorService::resetAllWakeLockRefCounts() {
-    SortedVector< sp<SensorEventConnection> > activeConnections;
+    Vector< sp<SensorEventConnection> > activeConnections;
     populateActiveConnections(&activeConnections);
     {
         Mutex::Autolock _l(mLock);
@@ -775,6 +792,24 @@ void SensorService::recordLastValueLocked(
     }
 }
 
+size_t SensorService::findEventRuns(sensors_event_t const* buffer, size_t count,
+        SensorEventRun* outRuns) {
+    size_t runCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        // buffer[i].sensor is zero for flush complete events.
+        int32_t handle = buffer[i].type == SENSOR_TYPE_META_DATA ?
+                buffer[i].meta_data.sensor : buffer[i].sensor;
+        if (runCount == 0 || outRuns[runCount - 1].handle != handle) {
+            SensorEventRun& run = outRuns[runCount++];
+            run.handle = handle;
+            run.start = i;
+            run.count = 0;
+        }
+        outRuns[runCount - 1].count++;
+    }
+    return runCount;
+}
+
 void SensorService::sortEventBuffer(sensors_event_t* buffer, size_t count) {
     struct compar {
         static int cmp(void const* lhs, void const* rhs) {
@@ -942,9 +977,7 @@ sp<ISensorEventConnection> SensorService::createSensorEventConnection(const Stri
     sp<SensorEventConnection> result(new SensorEventConnection(this, uid, connPackageName,
             requestedMode == DATA_INJECTION, connOpPackageName));
     if (requestedMode == DATA_INJECTION) {
-        if (mActiveConnections.indexOf(result) < 0) {
-            mActiveConnections.add(result);
-        }
+        addActiveConnectionLocked(result);
         // Add the associated file descriptor to the Looper for polling whenever there is data to
         // be injected.
         result->updateLooperRegistration(mLooper);
@@ -1178,7 +1211,7 @@ void SensorService::cleanupConnection(SensorEventConnection* c) {
         }
     }
     c->updateLooperRegistration(mLooper);
-    mActiveConnections.remove(connection);
+    removeActiveConnectionLocked(connection);
     BatteryService::cleanup(c->getUid());
     if (c->needsWakeLock()) {
         checkWakeLockStateLocked();
@@ -1261,9 +1294,7 @@ status_t SensorService::enable(const sp<SensorEventConnection>& connection,
         BatteryService::enableSensor(connection->getUid(), handle);
         // the sensor was added (which means it wasn't already there)
         // so, see if this connection becomes active
-        if (mActiveConnections.indexOf(connection) < 0) {
-            mActiveConnections.add(connection);
-        }
+        addActiveConnectionLocked(connection);
     } else {
         ALOGW("sensor %08x already enabled in connection %p (ignoring)",
             handle, connection.get());
@@ -1362,7 +1393,7 @@ status_t SensorService::cleanupWithoutDisableLocked(
         }
         if (connection->hasAnySensor() == false) {
             connection->updateLooperRegistration(mLooper);
-            mActiveConnections.remove(connection);
+            removeActiveConnectionLocked(connection);
         }
         // see if this sensor becomes inactive
         if (rec->removeConnection(connection)) {
@@ -1480,7 +1511,8 @@ void SensorService::checkWakeLockState() {
 }
 
 void SensorService::checkWakeLockStateLocked() {
-    if (!mWakeLockAcquired) {
+    // The sensor thread checks the wake lock itself once it has sent its events.
+    if (!mWakeLockAcquired || mDispatchingEvents) {
         return;
     }
     bool releaseLock = true;
@@ -1507,16 +1539,40 @@ void SensorService::sendEventsFromCache(const sp<SensorEventConnection>& connect
 }
 
 void SensorService::populateActiveConnections(
-        SortedVector< sp<SensorEventConnection> >* activeConnections) {
-    Mutex::Autolock _l(mLock);
-    for (size_t i=0 ; i < mActiveConnections.size(); ++i) {
-        sp<SensorEventConnection> connection(mActiveConnections[i].promote());
+        Vector< sp<SensorEventConnection> >* activeConnections) {
+    std::shared_ptr<const ConnectionSnapshot> snapshot = std::atomic_load(&mConnectionSnapshot);
+    if (snapshot == nullptr) {
+        return;
+    }
+    for (const wp<SensorEventConnection>& weakConnection : *snapshot) {
+        sp<SensorEventConnection> connection(weakConnection.promote());
         if (connection != 0) {
-            activeConnections->add(connection);
+            activeConnections->push(connection);
         }
     }
 }
 
+void SensorService::addActiveConnectionLocked(const wp<SensorEventConnection>& connection) {
+    if (mActiveConnections.indexOf(connection) >= 0) {
+        return;
+    }
+    mActiveConnections.add(connection);
+    publishConnectionSnapshotLocked();
+}
+
+void SensorService::removeActiveConnectionLocked(const wp<SensorEventConnection>& connection) {
+    if (mActiveConnections.remove(connection) < 0) {
+        return;
+    }
+    publishConnectionSnapshotLocked();
+}
+
+void SensorService::publishConnectionSnapshotLocked() {
+    std::shared_ptr<const ConnectionSnapshot> snapshot = std::make_shared<ConnectionSnapshot>(
+            mActiveConnections.array(), mActiveConnections.array() + mActiveConnections.size());
+    std::atomic_store(&mConnectionSnapshot, snapshot);
+}
+
 bool SensorService::isWhiteListedPackage(const String8& packageName) {
     return (packageName.contains(mWhiteListedPackage.string()));
 }
@@ -36,8 +36,10 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #if __clang__
 // Clang warns about SensorEventConnection::dump hiding BBinder::dump. The cause isn't fixable
@@ -93,6 +95,17 @@ private:
     class SensorEventAckReceiver;
     class SensorRegistrationInfo;
 
+    // A run of consecutive events in the sensor event buffer from the same sensor. Flush
+    // complete events count as events from the sensor that was flushed.
+    struct SensorEventRun {
+        int32_t handle;
+        size_t start;
+        size_t count;
+    };
+
+    // An immutable copy of mActiveConnections that the sensor thread reads without mLock.
+    typedef std::vector< wp<SensorEventConnection> > ConnectionSnapshot;
+
     enum Mode {
        // The regular operating mode where any application can register/unregister/call flush on
        // sensors.
@@ -168,6 +181,10 @@ private:
     bool isWakeUpSensor(int type) const;
     void recordLastValueLocked(sensors_event_t const* buffer, size_t count);
     static void sortEventBuffer(sensors_event_t* buffer, size_t count);
+    // Splits the buffer into runs of events from the same sensor, so that each connection only
+    // looks up its registration once per run. Returns the number of runs.
+    static size_t findEventRuns(sensors_event_t const* buffer, size_t count,
+            SensorEventRun* outRuns);
     const Sensor& registerSensor(SensorInterface* sensor,
                                  bool isDebug = false, bool isVirtual = false);
     const Sensor& registerVirtualSensor(SensorInterface* sensor, bool isDebug = false);
@@ -201,9 +218,14 @@ private:
     // Send events from the event cache for this particular connection.
     void sendEventsFromCache(const sp<SensorEventConnection>& connection);
 
-    // Promote all weak referecences in mActiveConnections vector to strong references and add them
-    // to the output vector.
-    void populateActiveConnections( SortedVector< sp<SensorEventConnection> >* activeConnections);
+    // Promote all weak references in the latest snapshot of mActiveConnections to strong
+    // references and add them to the output vector. Does not acquire mLock.
+    void populateActiveConnections(Vector< sp<SensorEventConnection> >* activeConnections);
+
+    // Add or remove a connection from mActiveConnections and publish a new snapshot of it.
+    void addActiveConnectionLocked(const wp<SensorEventConnection>& connection);
+    void removeActiveConnectionLocked(const wp<SensorEventConnection>& connection);
+    void publishConnectionSnapshotLocked();
 
     // If SensorService is operating in RESTRICTED mode, only select whitelisted packages are
     // allowed to register for or call flush on sensors. Typically only cts test packages are
@@ -243,12 +265,22 @@ private:
     std::unordered_set<int> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
     bool mWakeLockAcquired;
-    sensors_event_t *mSensorEventBuffer, *mSensorEventScratch;
-    wp<const SensorEventConnection> * mMapFlushEventsToConnections;
+    // Set while the sensor thread sends events to clients without holding mLock. The wake lock
+    // is not released meanwhile; the sensor thread checks whether it is still needed afterwards.
+    bool mDispatchingEvents;
     std::unordered_map<int, RecentEventLogger*> mRecentEvent;
     SortedVector< wp<SensorDirectConnection> > mDirectConnections;
     Mode mCurrentOperatingMode;
 
+    // Published under mLock whenever mActiveConnections changes, and read with std::atomic_load
+    // by the sensor thread.
+    std::shared_ptr<const ConnectionSnapshot> mConnectionSnapshot;
+
+    // only used by the sensor thread
+    sensors_event_t *mSensorEventBuffer, *mSensorEventScratch;
+    SensorEventRun* mSensorEventRuns;
+    wp<const SensorEventConnection> * mMapFlushEventsToConnections;
+
     // This packagaName is set when SensorService is in RESTRICTED or DATA_INJECTION mode. Only
     // applications with this packageName are allowed to activate/deactivate or call flush on
     // sensors. To run CTS this is can be set to ".cts." and only CTS tests will get access to
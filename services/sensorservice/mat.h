@@ -20,6 +20,14 @@
 #include "vec.h"
 #include "traits.h"
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#define MAT_SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MAT_SIMD_NEON 1
+#endif
+
 // -----------------------------------------------------------------------
 
 namespace android {
@@ -115,6 +123,19 @@ mat<TYPE, C, R> PURE doMul(
     return res;
 }
 
+// Fixed-size kernels for the float matrices used by sensor fusion. They are exact matches
+// for the operators below, so they are picked over the templates above. They are defined
+// at the end of this file, once mat<> is complete.
+inline mat<float, 3, 3> PURE doMul(
+        const mat<float, 3, 3>& lhs, const mat<float, 3, 3>& rhs);
+inline vec<float, 3> PURE doMul(
+        const mat<float, 3, 3>& lhs, const vec<float, 3>& rhs);
+inline mat<float, 4, 4> PURE doMul(
+        const mat<float, 4, 4>& lhs, const mat<float, 4, 4>& rhs);
+inline vec<float, 4> PURE doMul(
+        const mat<float, 4, 4>& lhs, const vec<float, 4>& rhs);
+inline vec<float, 4> PURE doMul(
+        const mat<float, 3, 4>& lhs, const vec<float, 3>& rhs);
 
 }; // namespace helpers
 
@@ -380,6 +401,93 @@ mat<T, N, N> PURE invert(const mat<T, N, N>& src) {
     return inverse;
 }
 
+// inversion of a 3x3 matrix from its cofactors. the rows of the inverse are
+// the cross products of the columns, divided by the determinant.
+inline mat<float, 3, 3> PURE invert(const mat<float, 3, 3>& src) {
+    const vec<float, 3> r0(cross_product(src[1], src[2]));
+    const vec<float, 3> r1(cross_product(src[2], src[0]));
+    const vec<float, 3> r2(cross_product(src[0], src[1]));
+    const float invDet = 1 / dot_product(src[0], r0);
+    mat<float, 3, 3> inverse;
+    for (size_t c=0 ; c<3 ; c++) {
+        inverse[c][0] = r0[c] * invDet;
+        inverse[c][1] = r1[c] * invDet;
+        inverse[c][2] = r2[c] * invDet;
+    }
+    return inverse;
+}
+
+// -----------------------------------------------------------------------
+// fixed-size kernels
+
+namespace helpers {
+
+// out = sum of columns[k] * v[k], for matrices with 4 rows
+template <size_t N>
+inline void mulColumns4(float* out, const vec<float, 4>* columns, const float* v) {
+#if defined(MAT_SIMD_SSE)
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(columns[0].v), _mm_set1_ps(v[0]));
+    for (size_t k=1 ; k<N ; k++)
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(columns[k].v), _mm_set1_ps(v[k])));
+    _mm_storeu_ps(out, r);
+#elif defined(MAT_SIMD_NEON)
+    float32x4_t r = vmulq_n_f32(vld1q_f32(columns[0].v), v[0]);
+    for (size_t k=1 ; k<N ; k++)
+        r = vmlaq_n_f32(r, vld1q_f32(columns[k].v), v[k]);
+    vst1q_f32(out, r);
+#else
+    for (size_t r=0 ; r<4 ; r++) {
+        float s = columns[0][r] * v[0];
+        for (size_t k=1 ; k<N ; k++)
+            s += columns[k][r] * v[k];
+        out[r] = s;
+    }
+#endif
+}
+
+// 3x3 columns don't fill a vector register, these are unrolled instead
+inline vec<float, 3> PURE doMul(
+        const mat<float, 3, 3>& lhs, const vec<float, 3>& rhs) {
+    vec<float, 3> res;
+    res[0] = lhs[0][0]*rhs[0] + lhs[1][0]*rhs[1] + lhs[2][0]*rhs[2];
+    res[1] = lhs[0][1]*rhs[0] + lhs[1][1]*rhs[1] + lhs[2][1]*rhs[2];
+    res[2] = lhs[0][2]*rhs[0] + lhs[1][2]*rhs[1] + lhs[2][2]*rhs[2];
+    return res;
+}
+
+inline mat<float, 3, 3> PURE doMul(
+        const mat<float, 3, 3>& lhs, const mat<float, 3, 3>& rhs) {
+    mat<float, 3, 3> res;
+    res[0] = doMul(lhs, rhs[0]);
+    res[1] = doMul(lhs, rhs[1]);
+    res[2] = doMul(lhs, rhs[2]);
+    return res;
+}
+
+inline vec<float, 4> PURE doMul(
+        const mat<float, 4, 4>& lhs, const vec<float, 4>& rhs) {
+    vec<float, 4> res;
+    mulColumns4<4>(res.v, &lhs[0], rhs.v);
+    return res;
+}
+
+inline mat<float, 4, 4> PURE doMul(
+        const mat<float, 4, 4>& lhs, const mat<float, 4, 4>& rhs) {
+    mat<float, 4, 4> res;
+    for (size_t c=0 ; c<4 ; c++)
+        mulColumns4<4>(res[c].v, &lhs[0], rhs[c].v);
+    return res;
+}
+
+inline vec<float, 4> PURE doMul(
+        const mat<float, 3, 4>& lhs, const vec<float, 3>& rhs) {
+    vec<float, 4> res;
+    mulColumns4<3>(res.v, &lhs[0], rhs.v);
+    return res;
+}
+
+}; // namespace helpers
+
 // -----------------------------------------------------------------------
 
 typedef mat<float, 2, 2> mat22_t;
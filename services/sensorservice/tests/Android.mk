@@ -12,3 +12,17 @@ LOCAL_MODULE:= test-sensorservice
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	sensorservicestress.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils libsensor libandroid
+
+LOCAL_MODULE:= stress-sensorservice
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../Fusion.h"
+
+namespace android {
+
+// The fixed-size kernels in mat.h overload the generic templates, which can still be called
+// with explicit template arguments. The kernels are checked against them.
+
+static std::mt19937 sRandom(42);
+
+template <size_t C, size_t R>
+static mat<float, C, R> randomMatrix() {
+    std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+    mat<float, C, R> m;
+    for (size_t c = 0; c < C; c++) {
+        for (size_t r = 0; r < R; r++) {
+            m[c][r] = dist(sRandom);
+        }
+    }
+    return m;
+}
+
+template <size_t S>
+static vec<float, S> randomVector() {
+    std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+    vec<float, S> v;
+    for (size_t i = 0; i < S; i++) {
+        v[i] = dist(sRandom);
+    }
+    return v;
+}
+
+template <size_t C, size_t R>
+static void expectNear(const mat<float, C, R>& expected, const mat<float, C, R>& actual,
+        float tolerance) {
+    for (size_t c = 0; c < C; c++) {
+        for (size_t r = 0; r < R; r++) {
+            EXPECT_NEAR(expected[c][r], actual[c][r], tolerance) << "[" << c << "][" << r << "]";
+        }
+    }
+}
+
+template <size_t S>
+static void expectNear(const vec<float, S>& expected, const vec<float, S>& actual,
+        float tolerance) {
+    for (size_t i = 0; i < S; i++) {
+        EXPECT_NEAR(expected[i], actual[i], tolerance) << "[" << i << "]";
+    }
+}
+
+TEST(FusionMathTest, Mat33Kernels_MatchGenericTemplates) {
+    for (int i = 0; i < 100; i++) {
+        const mat33_t a(randomMatrix<3, 3>());
+        const mat33_t b(randomMatrix<3, 3>());
+        const vec3_t v(randomVector<3>());
+        expectNear(helpers::doMul<float, 3, 3, 3>(a, b), mat33_t(a*b), 1e-5f);
+        expectNear(helpers::doMul<float, 3, 3>(a, v), vec3_t(a*v), 1e-5f);
+    }
+}
+
+TEST(FusionMathTest, Mat44Kernels_MatchGenericTemplates) {
+    for (int i = 0; i < 100; i++) {
+        const mat44_t a(randomMatrix<4, 4>());
+        const mat44_t b(randomMatrix<4, 4>());
+        const mat34_t f(randomMatrix<3, 4>());
+        const vec4_t v(randomVector<4>());
+        const vec3_t u(randomVector<3>());
+        expectNear(helpers::doMul<float, 4, 4, 4>(a, b), mat44_t(a*b), 1e-5f);
+        expectNear(helpers::doMul<float, 4, 4>(a, v), vec4_t(a*v), 1e-5f);
+        expectNear(helpers::doMul<float, 4, 3>(f, u), vec4_t(f*u), 1e-5f);
+    }
+}
+
+TEST(FusionMathTest, Invert33_MatchesGenericTemplate) {
+    for (int i = 0; i < 100; i++) {
+        // like the innovation covariance in Fusion::update(): L*P*Lt + R
+        const mat33_t l(randomMatrix<3, 3>());
+        const mat33_t s(l*transpose(l) + mat33_t(0.1f));
+        const mat33_t inverse(invert(s));
+        expectNear(invert<float, 3>(s), inverse, 1e-3f);
+        expectNear(mat33_t(1), mat33_t(s*inverse), 1e-4f);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Synthetic IMU trace: the device tumbles with a slowly varying angular rate while the
+// gyro has a constant bias, and all sensors are noisy.
+
+static const float GYRO_PERIOD = 0.005f; // 200 Hz
+static const size_t ACC_DIVIDER = 2;     // 100 Hz
+static const size_t MAG_DIVIDER = 4;     // 50 Hz
+static const float GRAVITY = 9.81f;
+
+struct ImuSample {
+    vec3_t gyro;
+    vec3_t acc;
+    vec3_t mag;
+    mat33_t R; // true rotation, from the world frame to the device frame
+};
+
+// Rotates R by the device frame rotation vector w.
+static mat33_t rotate(const mat33_t& R, const vec3_t& w) {
+    const float angle = length(w);
+    if (angle == 0) {
+        return R;
+    }
+    // Rodrigues' formula for the rotation of the frame, i.e. the vectors rotate by -w
+    const vec3_t u(w * (1 / angle));
+    mat33_t K(0.0f);
+    K[1][0] = -u.z; K[2][0] = u.y;
+    K[0][1] = u.z;  K[2][1] = -u.x;
+    K[0][2] = -u.y; K[1][2] = u.x;
+    const mat33_t dR(mat33_t(1) - K * sinf(angle) + K * K * (1 - cosf(angle)));
+    return dR * R;
+}
+
+static std::vector<ImuSample> makeTrace(float seconds, const vec3_t& gyroBias) {
+    std::mt19937 random(1);
+    std::normal_distribution<float> gyroNoise(0.0f, 0.002f);
+    std::normal_distribution<float> accNoise(0.0f, 0.03f);
+    std::normal_distribution<float> magNoise(0.0f, 0.3f);
+    vec3_t up(0.0f);
+    up.z = GRAVITY;
+    vec3_t field(0.0f);
+    field.y = 22;
+    field.z = -40;
+
+    std::vector<ImuSample> trace;
+    mat33_t R(1);
+    const size_t count = size_t(seconds / GYRO_PERIOD);
+    for (size_t i = 0; i < count; i++) {
+        const float t = i * GYRO_PERIOD;
+        vec3_t w;
+        w.x = 0.8f * sinf(0.7f * t);
+        w.y = 0.6f * sinf(1.1f * t + 1);
+        w.z = 0.5f * sinf(0.5f * t + 2);
+        R = rotate(R, w * GYRO_PERIOD);
+
+        ImuSample sample;
+        sample.R = R;
+        sample.gyro = w + gyroBias;
+        sample.acc = R * up;
+        sample.mag = R * field;
+        for (size_t k = 0; k < 3; k++) {
+            sample.gyro[k] += gyroNoise(random);
+            sample.acc[k] += accNoise(random);
+            sample.mag[k] += magNoise(random);
+        }
+        trace.push_back(sample);
+    }
+    return trace;
+}
+
+static void feed(Fusion& fusion, int mode, const ImuSample& sample, size_t i) {
+    if (mode != FUSION_NOGYRO) {
+        fusion.handleGyro(sample.gyro, GYRO_PERIOD);
+    }
+    if (i % ACC_DIVIDER == 0) {
+        fusion.handleAcc(sample.acc, GYRO_PERIOD * ACC_DIVIDER);
+    }
+    if (mode != FUSION_NOMAG && i % MAG_DIVIDER == 0) {
+        fusion.handleMag(sample.mag);
+    }
+}
+
+// Angle of the rotation between two rotation matrices, in degrees.
+static float angleBetween(const mat33_t& a, const mat33_t& b) {
+    const mat33_t d(transpose(a) * b);
+    const float c = (d[0][0] + d[1][1] + d[2][2] - 1) * 0.5f;
+    return acosf(c > 1 ? 1 : (c < -1 ? -1 : c)) * float(180 / M_PI);
+}
+
+static void checkFusion(int mode, float maxErrorDegrees) {
+    const vec3_t bias(randomVector<3>() * 0.01f);
+    const std::vector<ImuSample> trace(makeTrace(60, bias));
+    Fusion fusion;
+    fusion.init(mode);
+    float maxError = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        feed(fusion, mode, trace[i], i);
+        // skip the first 10s while the filter converges
+        if (fusion.hasEstimate() && i * GYRO_PERIOD > 10) {
+            float error = angleBetween(trace[i].R, fusion.getRotationMatrix());
+            if (mode == FUSION_NOMAG) {
+                // without a magnetometer the heading is free, only compare the up vector
+                const vec3_t up(trace[i].R[2]);
+                const vec3_t estimatedUp(fusion.getRotationMatrix()[2]);
+                error = acosf(fminf(1, dot_product(up, estimatedUp))) * float(180 / M_PI);
+            }
+            maxError = fmaxf(maxError, error);
+        }
+    }
+    ASSERT_TRUE(fusion.hasEstimate());
+    EXPECT_LT(maxError, maxErrorDegrees);
+}
+
+TEST(FusionTest, NineAxis_TracksAttitude) {
+    checkFusion(FUSION_9AXIS, 3.0f);
+}
+
+TEST(FusionTest, NoMag_TracksUpVector) {
+    checkFusion(FUSION_NOMAG, 3.0f);
+}
+
+TEST(FusionTest, NoGyro_TracksAttitude) {
+    checkFusion(FUSION_NOGYRO, 10.0f);
+}
+
+// -----------------------------------------------------------------------
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+TEST(FusionTest, Benchmark) {
+    const std::vector<ImuSample> trace(makeTrace(60, vec3_t(0.005f)));
+    static const char* const names[] = { "9-axis", "no mag", "no gyro" };
+    for (int mode = 0; mode < NUM_FUSION_MODE; mode++) {
+        Fusion fusion;
+        fusion.init(mode);
+        const double start = now();
+        for (size_t i = 0; i < trace.size(); i++) {
+            feed(fusion, mode, trace[i], i);
+        }
+        const double elapsed = now() - start;
+        printf("%-8s %7.1f ns per gyro period\n", names[mode], elapsed * 1e9 / trace.size());
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stresses the dispatch of sensor events to many connections.
+//
+// Opens a number of event queues on the accelerometer and gyroscope at a high rate, reads
+// every queue from one looper thread and measures the delay from the event timestamp to
+// its arrival. Meanwhile another thread keeps disabling and enabling sensors on the queues,
+// and measures how long these calls take while the service is busy sending events.
+//
+// usage: stress-sensorservice [connections] [seconds] [rate_hz]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <android/sensor.h>
+#include <sensor/Sensor.h>
+#include <sensor/SensorManager.h>
+#include <sensor/SensorEventQueue.h>
+#include <utils/Looper.h>
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+struct Connection {
+    sp<SensorEventQueue> queue;
+    Sensor const* sensor;
+    size_t events;
+};
+
+static Mutex sStatsLock;
+static std::vector<nsecs_t> sDeliveryLatencies;
+static std::vector<nsecs_t> sEnableLatencies;
+static std::vector<nsecs_t> sDisableLatencies;
+
+static int receiver(__unused int fd, __unused int events, void* data) {
+    Connection* connection = static_cast<Connection*>(data);
+    ASensorEvent buffer[16];
+    ssize_t n;
+    while ((n = connection->queue->read(buffer, 16)) > 0) {
+        // Sensor timestamps are in the elapsed realtime base.
+        nsecs_t now = systemTime(SYSTEM_TIME_BOOTTIME);
+        connection->events += n;
+        Mutex::Autolock _l(sStatsLock);
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i].type != SENSOR_TYPE_META_DATA) {
+                sDeliveryLatencies.push_back(now - buffer[i].timestamp);
+            }
+        }
+    }
+    return 1;
+}
+
+static void printLatencies(const char* name, std::vector<nsecs_t>& latencies) {
+    if (latencies.empty()) {
+        printf("%-10s no samples\n", name);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    size_t size = latencies.size();
+    printf("%-10s samples=%-8zu p50=%8.3fms p90=%8.3fms p99=%8.3fms max=%8.3fms\n", name, size,
+            latencies[size / 2] / 1000000.0, latencies[size * 9 / 10] / 1000000.0,
+            latencies[size * 99 / 100] / 1000000.0, latencies[size - 1] / 1000000.0);
+}
+
+int main(int argc, char** argv) {
+    int connectionCount = argc > 1 ? atoi(argv[1]) : 64;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    int rateHz = argc > 3 ? atoi(argv[3]) : 400;
+    if (connectionCount <= 0 || seconds <= 0 || rateHz <= 0) {
+        fprintf(stderr, "usage: %s [connections] [seconds] [rate_hz]\n", argv[0]);
+        return 1;
+    }
+    const int32_t samplingPeriodUs = 1000000 / rateHz;
+
+    SensorManager& mgr = SensorManager::getInstanceForPackage(
+            String16("Sensor Service Stress"));
+    Sensor const* sensors[] = {
+        mgr.getDefaultSensor(Sensor::TYPE_ACCELEROMETER),
+        mgr.getDefaultSensor(Sensor::TYPE_GYROSCOPE),
+    };
+    if (sensors[0] == NULL) {
+        fprintf(stderr, "no accelerometer\n");
+        return 1;
+    }
+    if (sensors[1] == NULL) {
+        sensors[1] = sensors[0];
+    }
+
+    std::vector<Connection> connections(connectionCount);
+    sp<Looper> looper = new Looper(false);
+    for (int i = 0; i < connectionCount; i++) {
+        Connection& connection = connections[i];
+        connection.queue = mgr.createEventQueue();
+        connection.sensor = sensors[i % 2];
+        connection.events = 0;
+        if (connection.queue == NULL
+                || connection.queue->enableSensor(connection.sensor, samplingPeriodUs)) {
+            fprintf(stderr, "could not enable sensor on connection %d\n", i);
+            return 1;
+        }
+        looper->addFd(connection.queue->getFd(), 0, ALOOPER_EVENT_INPUT, receiver, &connection);
+    }
+    printf("%d connections, %d Hz, %d s\n", connectionCount, rateHz, seconds);
+
+    std::atomic<bool> done(false);
+    std::thread toggler([&]() {
+        for (size_t i = 0; !done; i++) {
+            Connection& connection = connections[i % connections.size()];
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            connection.queue->disableSensor(connection.sensor);
+            nsecs_t disabled = systemTime(SYSTEM_TIME_MONOTONIC);
+            connection.queue->enableSensor(connection.sensor, samplingPeriodUs);
+            nsecs_t enabled = systemTime(SYSTEM_TIME_MONOTONIC);
+            {
+                Mutex::Autolock _l(sStatsLock);
+                sDisableLatencies.push_back(disabled - start);
+                sEnableLatencies.push_back(enabled - disabled);
+            }
+            usleep(10000);
+        }
+    });
+
+    nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC) + seconds_to_nanoseconds(seconds);
+    nsecs_t now;
+    while ((now = systemTime(SYSTEM_TIME_MONOTONIC)) < end) {
+        looper->pollOnce(int(ns2ms(end - now)) + 1);
+    }
+    done = true;
+    toggler.join();
+
+    size_t events = 0;
+    for (Connection& connection : connections) {
+        connection.queue->disableSensor(connection.sensor);
+        events += connection.events;
+    }
+    printf("events=%zu (%.1f per connection per second)\n", events,
+            double(events) / connectionCount / seconds);
+    Mutex::Autolock _l(sStatsLock);
+    printLatencies("delivery", sDeliveryLatencies);
+    printLatencies("enable", sEnableLatencies);
+    printLatencies("disable", sDisableLatencies);
+    return 0;
+}
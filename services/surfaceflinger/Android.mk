@@ -6,6 +6,7 @@ LOCAL_CLANG := true
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES := \
     Client.cpp \
+    CompositionWorkers.cpp \
     DisplayDevice.cpp \
     DispSync.cpp \
     EventControlThread.cpp \
@@ -15,13 +16,16 @@ LOCAL_SRC_FILES := \
     GpuService.cpp \
     Layer.cpp \
     LayerDim.cpp \
+    LayerGeometry.cpp \
     LayerRejecter.cpp \
     LayerVector.cpp \
     MessageQueue.cpp \
     MonitoredProducer.cpp \
     SurfaceFlingerConsumer.cpp \
     SurfaceInterceptor.cpp \
+    TraceRingBuffer.cpp \
     Transform.cpp \
+    VisibleRegionTracker.cpp \
     DisplayHardware/ComposerHal.cpp \
     DisplayHardware/FramebufferSurface.cpp \
     DisplayHardware/HWC2.cpp \
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "CompositionWorkers.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+CompositionWorkers::CompositionWorkers(size_t threadCount) {
+    for (size_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back(&CompositionWorkers::threadMain, this);
+        char name[32];
+        snprintf(name, sizeof(name), "sfCompose%zu", i + 1);
+        pthread_setname_np(mThreads.back().native_handle(), name);
+    }
+}
+
+CompositionWorkers::~CompositionWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mTasksAvailable.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void CompositionWorkers::run(const std::vector<std::function<void()>>& tasks) {
+    if (tasks.empty()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks = &tasks;
+    mNextTask = 0;
+    mPendingTasks = tasks.size();
+    mTasksAvailable.notify_all();
+
+    // mMutex is still held, so the calling thread starts the first task
+    runTasksLocked(lock);
+    mTasksDone.wait(lock, [this] { return mPendingTasks == 0; });
+    mTasks = nullptr;
+}
+
+void CompositionWorkers::runTasksLocked(std::unique_lock<std::mutex>& lock) {
+    while (mTasks != nullptr && mNextTask < mTasks->size()) {
+        const std::function<void()>& task((*mTasks)[mNextTask++]);
+        lock.unlock();
+        task();
+        lock.lock();
+        if (--mPendingTasks == 0) {
+            mTasksDone.notify_all();
+        }
+    }
+}
+
+void CompositionWorkers::threadMain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mTasksAvailable.wait(lock, [this] {
+            return mExit || (mTasks != nullptr && mNextTask < mTasks->size());
+        });
+        if (mExit) {
+            return;
+        }
+        runTasksLocked(lock);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
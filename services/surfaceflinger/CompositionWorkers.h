@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_COMPOSITION_WORKERS_H
+#define ANDROID_SF_COMPOSITION_WORKERS_H
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+/*
+ * A small pool of threads running the per-display stages of a refresh next to the
+ * main thread. The threads inherit the scheduling policy of the thread creating the
+ * pool, so it must be created on the SurfaceFlinger main thread.
+ */
+class CompositionWorkers {
+public:
+    explicit CompositionWorkers(size_t threadCount);
+    ~CompositionWorkers();
+
+    // Runs the tasks, the first one on the calling thread, and returns once all of
+    // them have completed. Only one thread may call run() at a time.
+    void run(const std::vector<std::function<void()>>& tasks);
+
+    size_t getThreadCount() const { return mThreads.size(); }
+
+private:
+    void threadMain();
+    // Runs tasks until none is left to start. Called and returns with mMutex held.
+    void runTasksLocked(std::unique_lock<std::mutex>& lock);
+
+    std::mutex mMutex;
+    std::condition_variable mTasksAvailable;
+    std::condition_variable mTasksDone;
+    const std::vector<std::function<void()>>* mTasks = nullptr;
+    size_t mNextTask = 0;
+    size_t mPendingTasks = 0;
+    bool mExit = false;
+    std::vector<std::thread> mThreads;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_COMPOSITION_WORKERS_H
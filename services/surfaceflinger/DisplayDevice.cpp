@@ -634,6 +634,14 @@ uint32_t DisplayDevice::getPrimaryDisplayOrientationTransform() {
     return sPrimaryDisplayOrientation;
 }
 
+void DisplayDevice::recordComposeTime(nsecs_t duration) const {
+    mComposeTiming.record(duration);
+}
+
+void DisplayDevice::recordPresentTime(nsecs_t duration) const {
+    mPresentTiming.record(duration);
+}
+
 void DisplayDevice::dump(String8& result) const {
     const Transform& tr(mGlobalTransform);
     EGLint redSize, greenSize, blueSize, alphaSize;
@@ -655,6 +663,15 @@ void DisplayDevice::dump(String8& result) const {
                         mFrame.left, mFrame.top, mFrame.right, mFrame.bottom, mScissor.left,
                         mScissor.top, mScissor.right, mScissor.bottom, tr[0][0], tr[1][0], tr[2][0],
                         tr[0][1], tr[1][1], tr[2][1], tr[0][2], tr[1][2], tr[2][2]);
+    auto dumpTiming = [&result](const char* name, const CompositionTiming& timing) {
+        if (timing.count > 0) {
+            result.appendFormat("   %s time (ms): last=%.3f, avg=%.3f, max=%.3f over %u frames\n",
+                                name, timing.last / 1e6, timing.total / 1e6 / timing.count,
+                                timing.max / 1e6, timing.count);
+        }
+    };
+    dumpTiming("compose", mComposeTiming);
+    dumpTiming("present", mPresentTiming);
 
     String8 surfaceDump;
     mDisplaySurface->dumpAsString(surfaceDump);
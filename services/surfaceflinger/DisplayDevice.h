@@ -18,6 +18,7 @@
 #define ANDROID_DISPLAY_DEVICE_H
 
 #include "Transform.h"
+#include "VisibleRegionTracker.h"
 
 #include <stdlib.h>
 
@@ -60,6 +61,8 @@ class DisplayDevice : public LightRefBase<DisplayDevice>
 public:
     // region in layer-stack space
     mutable Region dirtyRegion;
+    // visible regions of the layers from the last computeVisibleRegions()
+    mutable VisibleRegionTracker visibleRegionTracker;
     // region in screen space
     mutable Region swapRegion;
     // region in screen space
@@ -212,6 +215,9 @@ public:
      * Debugging
      */
     uint32_t getPageFlipCount() const;
+    // Record how long composing and presenting a frame of this display took.
+    void recordComposeTime(nsecs_t duration) const;
+    void recordPresentTime(nsecs_t duration) const;
     void dump(String8& result) const;
 
 private:
@@ -250,6 +256,25 @@ private:
     // list of layers needing fences
     Vector< sp<Layer> > mLayersNeedingFences;
 
+    // time spent composing and presenting frames, for dumpsys
+    struct CompositionTiming {
+        uint32_t count = 0;
+        nsecs_t last = 0;
+        nsecs_t total = 0;
+        nsecs_t max = 0;
+
+        void record(nsecs_t duration) {
+            count++;
+            last = duration;
+            total += duration;
+            if (duration > max) {
+                max = duration;
+            }
+        }
+    };
+    mutable CompositionTiming mComposeTiming;
+    mutable CompositionTiming mPresentTiming;
+
     /*
      * Transaction state
      */
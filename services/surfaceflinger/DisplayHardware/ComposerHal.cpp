@@ -190,6 +190,14 @@ Composer::Composer(bool useVrComposer)
     }
 }
 
+Composer::Composer()
+    : mWriter(kWriterInitialSize),
+      mIsUsingVrComposer(false)
+{
+}
+
+Composer::~Composer() = default;
+
 std::vector<IComposer::Capability> Composer::getCapabilities()
 {
     std::vector<IComposer::Capability> capabilities;
@@ -225,6 +233,7 @@ bool Composer::isRemote() {
 
 void Composer::resetCommands() {
     mWriter.reset();
+    mCommandDropCount++;
 }
 
 uint32_t Composer::getMaxVirtualDisplayCount()
@@ -740,7 +749,7 @@ Error Composer::execute()
     uint32_t commandLength = 0;
     hidl_vec<hidl_handle> commandHandles;
     if (!mWriter.writeQueue(&queueChanged, &commandLength, &commandHandles)) {
-        mWriter.reset();
+        resetCommands();
         return Error::NO_RESOURCES;
     }
 
@@ -749,7 +758,7 @@ Error Composer::execute()
         auto ret = mClient->setInputCommandQueue(*mWriter.getMQDescriptor());
         auto error = unwrapRet(ret);
         if (error != Error::NONE) {
-            mWriter.reset();
+            resetCommands();
             return error;
         }
     }
@@ -794,6 +803,8 @@ Error Composer::execute()
         ALOGE("executeCommands failed because of %s", ret.description().c_str());
     }
 
+    // Without a reply, none of the commands are known to have been applied.
+    bool commandsDropped = error != Error::NONE;
     if (error == Error::NONE) {
         std::vector<CommandReader::CommandError> commandErrors =
             mReader.takeErrors();
@@ -808,11 +819,16 @@ Error Composer::execute()
             } else {
                 ALOGW("command 0x%x generated error %d",
                         command, cmdErr.error);
+                commandsDropped = true;
             }
         }
     }
 
-    mWriter.reset();
+    if (commandsDropped) {
+        resetCommands();
+    } else {
+        mWriter.reset();
+    }
 
     return error;
 }
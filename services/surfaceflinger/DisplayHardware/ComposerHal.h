@@ -137,6 +137,7 @@ private:
 class Composer {
 public:
     Composer(bool useVrComposer);
+    virtual ~Composer();
 
     std::vector<IComposer::Capability> getCapabilities();
     std::string dumpDebugInfo();
@@ -152,102 +153,120 @@ public:
     // skip a frame but have already queued some commands.
     void resetCommands();
 
+    // Counts the times that written commands were dropped before the composer
+    // could apply them all: when they were reset, when execute failed, or when
+    // one of them failed.  Layer state that is only known from commands written
+    // before the count changed may not have reached the composer.
+    uint32_t getCommandDropCount() const { return mCommandDropCount; }
+
     uint32_t getMaxVirtualDisplayCount();
     bool isUsingVrComposer() const { return mIsUsingVrComposer; }
-    Error createVirtualDisplay(uint32_t width, uint32_t height,
+    virtual Error createVirtualDisplay(uint32_t width, uint32_t height,
             PixelFormat* format, Display* outDisplay);
-    Error destroyVirtualDisplay(Display display);
+    virtual Error destroyVirtualDisplay(Display display);
 
-    Error acceptDisplayChanges(Display display);
+    virtual Error acceptDisplayChanges(Display display);
 
-    Error createLayer(Display display, Layer* outLayer);
-    Error destroyLayer(Display display, Layer layer);
+    virtual Error createLayer(Display display, Layer* outLayer);
+    virtual Error destroyLayer(Display display, Layer layer);
 
-    Error getActiveConfig(Display display, Config* outConfig);
-    Error getChangedCompositionTypes(Display display,
+    virtual Error getActiveConfig(Display display, Config* outConfig);
+    virtual Error getChangedCompositionTypes(Display display,
             std::vector<Layer>* outLayers,
             std::vector<IComposerClient::Composition>* outTypes);
-    Error getColorModes(Display display, std::vector<ColorMode>* outModes);
-    Error getDisplayAttribute(Display display, Config config,
+    virtual Error getColorModes(Display display,
+            std::vector<ColorMode>* outModes);
+    virtual Error getDisplayAttribute(Display display, Config config,
             IComposerClient::Attribute attribute, int32_t* outValue);
-    Error getDisplayConfigs(Display display, std::vector<Config>* outConfigs);
-    Error getDisplayName(Display display, std::string* outName);
+    virtual Error getDisplayConfigs(Display display,
+            std::vector<Config>* outConfigs);
+    virtual Error getDisplayName(Display display, std::string* outName);
 
-    Error getDisplayRequests(Display display, uint32_t* outDisplayRequestMask,
+    virtual Error getDisplayRequests(Display display,
+            uint32_t* outDisplayRequestMask,
             std::vector<Layer>* outLayers,
             std::vector<uint32_t>* outLayerRequestMasks);
 
-    Error getDisplayType(Display display,
+    virtual Error getDisplayType(Display display,
             IComposerClient::DisplayType* outType);
-    Error getDozeSupport(Display display, bool* outSupport);
-    Error getHdrCapabilities(Display display, std::vector<Hdr>* outTypes,
+    virtual Error getDozeSupport(Display display, bool* outSupport);
+    virtual Error getHdrCapabilities(Display display,
+            std::vector<Hdr>* outTypes,
             float* outMaxLuminance, float* outMaxAverageLuminance,
             float* outMinLuminance);
 
-    Error getReleaseFences(Display display, std::vector<Layer>* outLayers,
+    virtual Error getReleaseFences(Display display,
+            std::vector<Layer>* outLayers,
             std::vector<int>* outReleaseFences);
 
-    Error presentDisplay(Display display, int* outPresentFence);
+    virtual Error presentDisplay(Display display, int* outPresentFence);
 
-    Error setActiveConfig(Display display, Config config);
+    virtual Error setActiveConfig(Display display, Config config);
 
     /*
      * The composer caches client targets internally.  When target is nullptr,
      * the composer uses slot to look up the client target from its cache.
      * When target is not nullptr, the cache is updated with the new target.
      */
-    Error setClientTarget(Display display, uint32_t slot,
+    virtual Error setClientTarget(Display display, uint32_t slot,
             const sp<GraphicBuffer>& target,
             int acquireFence, Dataspace dataspace,
             const std::vector<IComposerClient::Rect>& damage);
-    Error setColorMode(Display display, ColorMode mode);
-    Error setColorTransform(Display display, const float* matrix,
+    virtual Error setColorMode(Display display, ColorMode mode);
+    virtual Error setColorTransform(Display display, const float* matrix,
             ColorTransform hint);
-    Error setOutputBuffer(Display display, const native_handle_t* buffer,
+    virtual Error setOutputBuffer(Display display,
+            const native_handle_t* buffer,
             int releaseFence);
-    Error setPowerMode(Display display, IComposerClient::PowerMode mode);
-    Error setVsyncEnabled(Display display, IComposerClient::Vsync enabled);
+    virtual Error setPowerMode(Display display,
+            IComposerClient::PowerMode mode);
+    virtual Error setVsyncEnabled(Display display,
+            IComposerClient::Vsync enabled);
 
-    Error setClientTargetSlotCount(Display display);
+    virtual Error setClientTargetSlotCount(Display display);
 
-    Error validateDisplay(Display display, uint32_t* outNumTypes,
+    virtual Error validateDisplay(Display display, uint32_t* outNumTypes,
             uint32_t* outNumRequests);
 
-    Error presentOrValidateDisplay(Display display, uint32_t* outNumTypes,
-                                   uint32_t* outNumRequests,
-                                   int* outPresentFence,
-                                   uint32_t* state);
+    virtual Error presentOrValidateDisplay(Display display,
+            uint32_t* outNumTypes, uint32_t* outNumRequests,
+            int* outPresentFence, uint32_t* state);
 
-    Error setCursorPosition(Display display, Layer layer,
+    virtual Error setCursorPosition(Display display, Layer layer,
             int32_t x, int32_t y);
     /* see setClientTarget for the purpose of slot */
-    Error setLayerBuffer(Display display, Layer layer, uint32_t slot,
+    virtual Error setLayerBuffer(Display display, Layer layer, uint32_t slot,
             const sp<GraphicBuffer>& buffer, int acquireFence);
-    Error setLayerSurfaceDamage(Display display, Layer layer,
+    virtual Error setLayerSurfaceDamage(Display display, Layer layer,
             const std::vector<IComposerClient::Rect>& damage);
-    Error setLayerBlendMode(Display display, Layer layer,
+    virtual Error setLayerBlendMode(Display display, Layer layer,
             IComposerClient::BlendMode mode);
-    Error setLayerColor(Display display, Layer layer,
+    virtual Error setLayerColor(Display display, Layer layer,
             const IComposerClient::Color& color);
-    Error setLayerCompositionType(Display display, Layer layer,
+    virtual Error setLayerCompositionType(Display display, Layer layer,
             IComposerClient::Composition type);
-    Error setLayerDataspace(Display display, Layer layer,
+    virtual Error setLayerDataspace(Display display, Layer layer,
             Dataspace dataspace);
-    Error setLayerDisplayFrame(Display display, Layer layer,
+    virtual Error setLayerDisplayFrame(Display display, Layer layer,
             const IComposerClient::Rect& frame);
-    Error setLayerPlaneAlpha(Display display, Layer layer,
+    virtual Error setLayerPlaneAlpha(Display display, Layer layer,
             float alpha);
-    Error setLayerSidebandStream(Display display, Layer layer,
+    virtual Error setLayerSidebandStream(Display display, Layer layer,
             const native_handle_t* stream);
-    Error setLayerSourceCrop(Display display, Layer layer,
+    virtual Error setLayerSourceCrop(Display display, Layer layer,
             const IComposerClient::FRect& crop);
-    Error setLayerTransform(Display display, Layer layer,
+    virtual Error setLayerTransform(Display display, Layer layer,
             Transform transform);
-    Error setLayerVisibleRegion(Display display, Layer layer,
+    virtual Error setLayerVisibleRegion(Display display, Layer layer,
             const std::vector<IComposerClient::Rect>& visible);
-    Error setLayerZOrder(Display display, Layer layer, uint32_t z);
-    Error setLayerInfo(Display display, Layer layer, uint32_t type,
-                       uint32_t appId);
+    virtual Error setLayerZOrder(Display display, Layer layer, uint32_t z);
+    virtual Error setLayerInfo(Display display, Layer layer, uint32_t type,
+            uint32_t appId);
+
+protected:
+    // For fakes in tests.  Doesn't connect to a composer service.
+    Composer();
+
 private:
     class CommandWriter : public CommandWriterBase {
     public:
@@ -282,6 +301,8 @@ private:
     // When true, the we attach to the vr_hwcomposer service instead of the
     // hwcomposer. This allows us to redirect surfaces to 3d surfaces in vr.
     const bool mIsUsingVrComposer;
+
+    uint32_t mCommandDropCount = 0;
 };
 
 } // namespace Hwc2
@@ -304,7 +304,7 @@ Error Display::createLayer(Layer** outLayer)
     }
 
     auto layer = std::make_unique<Layer>(
-            mComposer, mCapabilities, mId, layerId);
+            mComposer, mCapabilities, mLayerCommandCounts, mId, layerId);
     *outLayer = layer.get();
     mLayers.emplace(layerId, std::move(layer));
     return Error::None;
@@ -638,6 +638,13 @@ void Display::discardCommands()
     mComposer.resetCommands();
 }
 
+LayerCommandCounts Display::takeLayerCommandCounts()
+{
+    LayerCommandCounts counts = mLayerCommandCounts;
+    mLayerCommandCounts = LayerCommandCounts();
+    return counts;
+}
+
 // For use by Device
 
 void Display::setConnected(bool connected) {
@@ -709,13 +716,29 @@ Layer* Display::getLayerById(hwc2_layer_t id) const
 
 // Layer methods
 
+static bool isSameRegion(const Region& lhs, const Region& rhs)
+{
+    if (lhs.isTriviallyEqual(rhs)) {
+        return true;
+    }
+    size_t lhsCount = 0;
+    size_t rhsCount = 0;
+    auto lhsArray = lhs.getArray(&lhsCount);
+    auto rhsArray = rhs.getArray(&rhsCount);
+    return lhsCount == rhsCount &&
+            std::equal(lhsArray, lhsArray + lhsCount, rhsArray);
+}
+
 Layer::Layer(android::Hwc2::Composer& composer,
              const std::unordered_set<Capability>& capabilities,
+             LayerCommandCounts& commandCounts,
              hwc2_display_t displayId, hwc2_layer_t layerId)
   : mComposer(composer),
     mCapabilities(capabilities),
+    mCommandCounts(commandCounts),
     mDisplayId(displayId),
-    mId(layerId)
+    mId(layerId),
+    mCommandDropCount(composer.getCommandDropCount())
 {
     ALOGV("Created layer %" PRIu64 " on display %" PRIu64, layerId, displayId);
 }
@@ -738,23 +761,70 @@ void Layer::setLayerDestroyedListener(std::function<void(Layer*)> listener) {
     mLayerDestroyedListener = listener;
 }
 
+bool Layer::isSent(SentField field)
+{
+    uint32_t dropCount = mComposer.getCommandDropCount();
+    if (dropCount != mCommandDropCount) {
+        // Any of the commands written before may not have been applied
+        mCommandDropCount = dropCount;
+        mSentFields = 0;
+    }
+    return (mSentFields & field) != 0;
+}
+
+Error Layer::skipCommand()
+{
+    mCommandCounts.skipped++;
+    return Error::None;
+}
+
+Error Layer::onCommandSent(Error error, SentField field)
+{
+    mCommandCounts.sent++;
+    if (error == Error::None) {
+        mSentFields |= field;
+    } else {
+        mSentFields &= ~field;
+    }
+    return error;
+}
+
+Error Layer::onCommandSent(Error error)
+{
+    mCommandCounts.sent++;
+    return error;
+}
+
 Error Layer::setCursorPosition(int32_t x, int32_t y)
 {
     auto intError = mComposer.setCursorPosition(mDisplayId, mId, x, y);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError));
 }
 
 Error Layer::setBuffer(uint32_t slot, const sp<GraphicBuffer>& buffer,
         const sp<Fence>& acquireFence)
 {
+    // A null buffer means the composer already has the buffer in this slot.
+    // It is then the buffer already set, unless the slot changed.
+    if (isSent(SentBuffer) && buffer.get() == nullptr && slot == mBufferSlot &&
+            acquireFence == mAcquireFence) {
+        return skipCommand();
+    }
+    mBufferSlot = slot;
+    mAcquireFence = acquireFence;
     int32_t fenceFd = acquireFence->dup();
     auto intError = mComposer.setLayerBuffer(mDisplayId, mId, slot, buffer,
                                              fenceFd);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentBuffer);
 }
 
 Error Layer::setSurfaceDamage(const Region& damage)
 {
+    if (isSent(SentSurfaceDamage) && isSameRegion(damage, mSurfaceDamage)) {
+        return skipCommand();
+    }
+    mSurfaceDamage = damage;
+
     // We encode default full-screen damage as INVALID_RECT upstream, but as 0
     // rects for HWC
     Hwc2::Error intError = Hwc2::Error::NONE;
@@ -774,29 +844,41 @@ Error Layer::setSurfaceDamage(const Region& damage)
         intError = mComposer.setLayerSurfaceDamage(mDisplayId, mId, hwcRects);
     }
 
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentSurfaceDamage);
 }
 
 Error Layer::setBlendMode(BlendMode mode)
 {
+    if (isSent(SentBlendMode) && mode == mBlendMode) {
+        return skipCommand();
+    }
+    mBlendMode = mode;
     auto intMode = static_cast<Hwc2::IComposerClient::BlendMode>(mode);
     auto intError = mComposer.setLayerBlendMode(mDisplayId, mId, intMode);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentBlendMode);
 }
 
 Error Layer::setColor(hwc_color_t color)
 {
+    if (isSent(SentColor) && color.r == mColor.r && color.g == mColor.g &&
+            color.b == mColor.b && color.a == mColor.a) {
+        return skipCommand();
+    }
+    mColor = color;
     Hwc2::IComposerClient::Color hwcColor{color.r, color.g, color.b, color.a};
     auto intError = mComposer.setLayerColor(mDisplayId, mId, hwcColor);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentColor);
 }
 
+// Not shadowed here: the composer may change the type of a layer when
+// validating, and SurfaceFlinger's Layer already skips setting the type it
+// has.
 Error Layer::setCompositionType(Composition type)
 {
     auto intType = static_cast<Hwc2::IComposerClient::Composition>(type);
     auto intError = mComposer.setLayerCompositionType(
             mDisplayId, mId, intType);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError));
 }
 
 Error Layer::setAnimating(bool enable)
@@ -813,32 +895,40 @@ Error Layer::setAnimating(bool enable)
     auto intError = mComposer.setLayerCompositionType(mDisplayId,
             mId, intType);
 #endif
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError));
 }
 
 Error Layer::setDataspace(android_dataspace_t dataspace)
 {
     if (dataspace == mDataSpace) {
-        return Error::None;
+        return skipCommand();
     }
     mDataSpace = dataspace;
     auto intDataspace = static_cast<Hwc2::Dataspace>(dataspace);
     auto intError = mComposer.setLayerDataspace(mDisplayId, mId, intDataspace);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError));
 }
 
 Error Layer::setDisplayFrame(const Rect& frame)
 {
+    if (isSent(SentDisplayFrame) && frame == mDisplayFrame) {
+        return skipCommand();
+    }
+    mDisplayFrame = frame;
     Hwc2::IComposerClient::Rect hwcRect{frame.left, frame.top,
         frame.right, frame.bottom};
     auto intError = mComposer.setLayerDisplayFrame(mDisplayId, mId, hwcRect);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentDisplayFrame);
 }
 
 Error Layer::setPlaneAlpha(float alpha)
 {
+    if (isSent(SentPlaneAlpha) && alpha == mPlaneAlpha) {
+        return skipCommand();
+    }
+    mPlaneAlpha = alpha;
     auto intError = mComposer.setLayerPlaneAlpha(mDisplayId, mId, alpha);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentPlaneAlpha);
 }
 
 Error Layer::setSidebandStream(const native_handle_t* stream)
@@ -848,27 +938,44 @@ Error Layer::setSidebandStream(const native_handle_t* stream)
                 "device supports sideband streams");
         return Error::Unsupported;
     }
+    if (isSent(SentSidebandStream) && stream == mSidebandStream) {
+        return skipCommand();
+    }
+    mSidebandStream = stream;
     auto intError = mComposer.setLayerSidebandStream(mDisplayId, mId, stream);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentSidebandStream);
 }
 
 Error Layer::setSourceCrop(const FloatRect& crop)
 {
+    if (isSent(SentSourceCrop) && crop == mSourceCrop) {
+        return skipCommand();
+    }
+    mSourceCrop = crop;
     Hwc2::IComposerClient::FRect hwcRect{
         crop.left, crop.top, crop.right, crop.bottom};
     auto intError = mComposer.setLayerSourceCrop(mDisplayId, mId, hwcRect);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentSourceCrop);
 }
 
 Error Layer::setTransform(Transform transform)
 {
+    if (isSent(SentTransform) && transform == mTransform) {
+        return skipCommand();
+    }
+    mTransform = transform;
     auto intTransform = static_cast<Hwc2::Transform>(transform);
     auto intError = mComposer.setLayerTransform(mDisplayId, mId, intTransform);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentTransform);
 }
 
 Error Layer::setVisibleRegion(const Region& region)
 {
+    if (isSent(SentVisibleRegion) && isSameRegion(region, mVisibleRegion)) {
+        return skipCommand();
+    }
+    mVisibleRegion = region;
+
     size_t rectCount = 0;
     auto rectArray = region.getArray(&rectCount);
 
@@ -879,19 +986,28 @@ Error Layer::setVisibleRegion(const Region& region)
     }
 
     auto intError = mComposer.setLayerVisibleRegion(mDisplayId, mId, hwcRects);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentVisibleRegion);
 }
 
 Error Layer::setZOrder(uint32_t z)
 {
+    if (isSent(SentZOrder) && z == mZOrder) {
+        return skipCommand();
+    }
+    mZOrder = z;
     auto intError = mComposer.setLayerZOrder(mDisplayId, mId, z);
-    return static_cast<Error>(intError);
+    return onCommandSent(static_cast<Error>(intError), SentZOrder);
 }
 
 Error Layer::setInfo(uint32_t type, uint32_t appId)
 {
+  if (isSent(SentInfo) && type == mType && appId == mAppId) {
+      return skipCommand();
+  }
+  mType = type;
+  mAppId = appId;
   auto intError = mComposer.setLayerInfo(mDisplayId, mId, type, appId);
-  return static_cast<Error>(intError);
+  return onCommandSent(static_cast<Error>(intError), SentInfo);
 }
 
 } // namespace HWC2
@@ -23,7 +23,10 @@
 #undef HWC2_INCLUDE_STRINGIFICATION
 #undef HWC2_USE_CPP11
 
+#include <ui/FloatRect.h>
 #include <ui/HdrCapabilities.h>
+#include <ui/Rect.h>
+#include <ui/Region.h>
 #include <math/mat4.h>
 
 #include <utils/Log.h>
@@ -119,6 +122,13 @@ private:
     bool mRegisteredCallback;
 };
 
+// Number of layer state commands written for the composer, and skipped because
+// the layer already had that state.
+struct LayerCommandCounts {
+    uint32_t sent = 0;
+    uint32_t skipped = 0;
+};
+
 // Convenience C++ class to access hwc2_device_t Display functions directly.
 class Display
 {
@@ -257,6 +267,9 @@ public:
     bool isConnected() const { return mIsConnected; }
     void setConnected(bool connected);  // For use by Device only
 
+    // Returns the layer commands counted since the last call, and resets them
+    LayerCommandCounts takeLayerCommandCounts();
+
 private:
     int32_t getAttribute(hwc2_config_t configId, Attribute attribute);
     void loadConfig(hwc2_config_t configId);
@@ -277,6 +290,7 @@ private:
     hwc2_display_t mId;
     bool mIsConnected;
     DisplayType mType;
+    LayerCommandCounts mLayerCommandCounts;
     std::unordered_map<hwc2_layer_t, std::unique_ptr<Layer>> mLayers;
     // The ordering in this map matters, for getConfigs(), when it is
     // converted to a vector
@@ -289,6 +303,7 @@ class Layer
 public:
     Layer(android::Hwc2::Composer& composer,
           const std::unordered_set<Capability>& capabilities,
+          LayerCommandCounts& commandCounts,
           hwc2_display_t displayId, hwc2_layer_t layerId);
     ~Layer();
 
@@ -326,16 +341,62 @@ public:
     [[clang::warn_unused_result]] Error setAnimating(bool animating);
 
 private:
+    // The state last sent to the composer is kept, so that the setters skip
+    // the commands which wouldn't change it. The composer keeps the state of a
+    // layer until it is set again. A field is only valid while its bit is set
+    // in mSentFields. Commands are only written here and executed later, so
+    // all bits are cleared whenever the composer reports that it dropped
+    // commands, see Composer::getCommandDropCount(). A bit is also cleared
+    // when writing its command fails.
+    enum SentField : uint32_t {
+        SentBuffer = 1 << 0,
+        SentSurfaceDamage = 1 << 1,
+        SentBlendMode = 1 << 2,
+        SentColor = 1 << 3,
+        SentDisplayFrame = 1 << 4,
+        SentPlaneAlpha = 1 << 5,
+        SentSidebandStream = 1 << 6,
+        SentSourceCrop = 1 << 7,
+        SentTransform = 1 << 8,
+        SentVisibleRegion = 1 << 9,
+        SentZOrder = 1 << 10,
+        SentInfo = 1 << 11,
+    };
+
+    bool isSent(SentField field);
+    Error skipCommand();
+    Error onCommandSent(Error error, SentField field);
+    Error onCommandSent(Error error);
+
     // These are references to data owned by HWC2::Device, which will outlive
     // this HWC2::Layer, so these references are guaranteed to be valid for
     // the lifetime of this object.
     android::Hwc2::Composer& mComposer;
     const std::unordered_set<Capability>& mCapabilities;
+    // Owned by the HWC2::Display of this layer
+    LayerCommandCounts& mCommandCounts;
 
     hwc2_display_t mDisplayId;
     hwc2_layer_t mId;
     android_dataspace mDataSpace = HAL_DATASPACE_UNKNOWN;
     std::function<void(Layer*)> mLayerDestroyedListener;
+
+    uint32_t mSentFields = 0;
+    uint32_t mCommandDropCount;
+    uint32_t mBufferSlot = 0;
+    android::sp<android::Fence> mAcquireFence;
+    android::Region mSurfaceDamage;
+    BlendMode mBlendMode = BlendMode::Invalid;
+    hwc_color_t mColor = {0, 0, 0, 0};
+    android::Rect mDisplayFrame;
+    float mPlaneAlpha = 0.0f;
+    const native_handle_t* mSidebandStream = nullptr;
+    android::FloatRect mSourceCrop;
+    Transform mTransform = Transform::None;
+    android::Region mVisibleRegion;
+    uint32_t mZOrder = 0;
+    uint32_t mType = 0;
+    uint32_t mAppId = 0;
 };
 
 } // namespace HWC2
@@ -439,6 +439,11 @@ status_t HWComposer::prepare(DisplayDevice& displayDevice) {
         return NO_ERROR;
     }
 
+    auto& commands = displayData.lastLayerCommands;
+    commands = hwcDisplay->takeLayerCommandCounts();
+    displayData.totalLayerCommandsSent += commands.sent;
+    displayData.totalLayerCommandsSkipped += commands.skipped;
+
     uint32_t numTypes = 0;
     uint32_t numRequests = 0;
 
@@ -885,6 +890,21 @@ void HWComposer::dump(String8& result) const {
     // all the state going into the layers. This is probably better done in
     // Layer itself, but it's going to take a bit of work to get there.
     result.append(mHwcDevice->dump().c_str());
+
+    Mutex::Autolock _l(mDisplayLock);
+    result.append("Layer commands (sent/skipped):\n");
+    for (size_t displayId = 0; displayId < mDisplayData.size(); displayId++) {
+        auto& displayData = mDisplayData[displayId];
+        if (displayData.hwcDisplay == nullptr) {
+            continue;
+        }
+        result.appendFormat("  Display %zu: last frame %u/%u, total %" PRIu64
+                "/%" PRIu64 "\n", displayId,
+                displayData.lastLayerCommands.sent,
+                displayData.lastLayerCommands.skipped,
+                displayData.totalLayerCommandsSent,
+                displayData.totalLayerCommandsSkipped);
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -896,7 +916,9 @@ HWComposer::DisplayData::DisplayData()
     lastPresentFence(Fence::NO_FENCE),
     outbufHandle(nullptr),
     outbufAcquireFence(Fence::NO_FENCE),
-    vsyncEnabled(HWC2::Vsync::Disable) {
+    vsyncEnabled(HWC2::Vsync::Disable),
+    totalLayerCommandsSent(0),
+    totalLayerCommandsSkipped(0) {
     ALOGV("Created new DisplayData");
 }
 
@@ -198,6 +198,12 @@ private:
 
         bool validateWasSkipped;
         HWC2::Error presentError;
+
+        // layer commands of the last prepared frame, and since the display
+        // was connected
+        HWC2::LayerCommandCounts lastLayerCommands;
+        uint64_t totalLayerCommandsSent;
+        uint64_t totalLayerCommandsSkipped;
     };
 
     std::unique_ptr<HWC2::Device>   mHwcDevice;
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/compiler.h>
+
+#include "LayerGeometry.h"
+
+namespace android {
+
+Rect LayerGeometry::computeScreenBounds(uint32_t w, uint32_t h, const Rect& crop,
+        const Transform& transform, const Rect& finalCrop) {
+    Rect win(w, h);
+
+    if (!crop.isEmpty()) {
+        win.intersect(crop, &win);
+    }
+
+    win = transform.transform(win);
+
+    if (!finalCrop.isEmpty()) {
+        win.intersect(finalCrop, &win);
+    }
+    return win;
+}
+
+Rect LayerGeometry::reduce(const Rect& win, const Region& exclude) {
+    if (CC_LIKELY(exclude.isEmpty())) {
+        return win;
+    }
+    if (exclude.isRect()) {
+        return win.reduce(exclude.getBounds());
+    }
+    return Region(win).subtract(exclude).getBounds();
+}
+
+int LayerGeometry::compareZOrder(uint32_t lhsLayerStack, uint32_t lhsZ, int32_t lhsSequence,
+        uint32_t rhsLayerStack, uint32_t rhsZ, int32_t rhsSequence) {
+    if (lhsLayerStack != rhsLayerStack)
+        return lhsLayerStack - rhsLayerStack;
+
+    if (lhsZ != rhsZ)
+        return lhsZ - rhsZ;
+
+    return lhsSequence - rhsSequence;
+}
+
+}; // namespace android
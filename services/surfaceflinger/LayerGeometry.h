@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_LAYER_GEOMETRY_H
+#define ANDROID_SF_LAYER_GEOMETRY_H
+
+#include <stdint.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+#include "Transform.h"
+
+namespace android {
+
+/*
+ * The parts of a Layer's geometry which only depend on its drawing state. Layer and
+ * LayerVector compute through these, and they build without the rest of SurfaceFlinger,
+ * so that models of SurfaceFlinger can be checked against them.
+ */
+class LayerGeometry {
+public:
+    // The active size clipped to the crop, transformed to the layer stack and clipped
+    // to the final crop: Layer::computeScreenBounds() before the parent's bounds and
+    // the transparent region are taken out.
+    static Rect computeScreenBounds(uint32_t w, uint32_t h, const Rect& crop,
+            const Transform& transform, const Rect& finalCrop);
+
+    // Takes exclude out of win, keeping a rectangle which covers the rest.
+    static Rect reduce(const Rect& win, const Region& exclude);
+
+    // The order of LayerVector: by layer stack, then by z, then by creation sequence.
+    // Returns less than, equal to or greater than zero like a qsort comparator.
+    static int compareZOrder(uint32_t lhsLayerStack, uint32_t lhsZ, int32_t lhsSequence,
+            uint32_t rhsLayerStack, uint32_t rhsZ, int32_t rhsSequence);
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_LAYER_GEOMETRY_H
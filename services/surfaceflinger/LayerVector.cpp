@@ -16,6 +16,7 @@
 
 #include "LayerVector.h"
 #include "Layer.h"
+#include "LayerGeometry.h"
 
 namespace android {
 
@@ -32,17 +33,9 @@ int LayerVector::do_compare(const void* lhs, const void* rhs) const
     const auto& l = *reinterpret_cast<const sp<Layer>*>(lhs);
     const auto& r = *reinterpret_cast<const sp<Layer>*>(rhs);
 
-    uint32_t ls = l->getCurrentState().layerStack;
-    uint32_t rs = r->getCurrentState().layerStack;
-    if (ls != rs)
-        return ls - rs;
-
-    uint32_t lz = l->getCurrentState().z;
-    uint32_t rz = r->getCurrentState().z;
-    if (lz != rz)
-        return lz - rz;
-
-    return l->sequence - r->sequence;
+    return LayerGeometry::compareZOrder(
+            l->getCurrentState().layerStack, l->getCurrentState().z, l->sequence,
+            r->getCurrentState().layerStack, r->getCurrentState().z, r->sequence);
 }
 
 void LayerVector::traverseInZOrder(StateSet stateSet, const Visitor& visitor) const {
@@ -238,6 +238,10 @@ SurfaceFlinger::SurfaceFlinger()
     mPropagateBackpressure = !atoi(value);
     ALOGI_IF(!mPropagateBackpressure, "Disabling backpressure propagation");
 
+    property_get("debug.sf.parallel_composition", value, "0");
+    mParallelComposition = atoi(value);
+    ALOGI_IF(mParallelComposition, "Composing displays in parallel");
+
     property_get("debug.sf.enable_hwc_vds", value, "0");
     mUseHwcVirtualDisplays = atoi(value);
     ALOGI_IF(!mUseHwcVirtualDisplays, "Enabling HWC virtual displays");
@@ -1964,21 +1968,96 @@ void SurfaceFlinger::doComposition() {
     ALOGV("doComposition");
 
     const bool repaintEverything = android_atomic_and(0, &mRepaintEverything);
+    if (mParallelComposition) {
+        size_t displaysOn = 0;
+        for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+            displaysOn += mDisplays[dpy]->isDisplayOn() ? 1 : 0;
+        }
+        if (displaysOn > 1) {
+            doParallelComposition(repaintEverything);
+            return;
+        }
+    }
+
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         const sp<DisplayDevice>& hw(mDisplays[dpy]);
         if (hw->isDisplayOn()) {
-            // transform the dirty region into this screen's coordinate space
-            const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+            composeDisplay(hw, repaintEverything);
+        }
+    }
+    postFramebuffer();
+}
+
+void SurfaceFlinger::doParallelComposition(bool repaintEverything) {
+    ATRACE_CALL();
+    ALOGV("doParallelComposition");
 
-            // repaint the framebuffer (if needed)
-            doDisplayComposition(hw, dirtyRegion);
+    if (mCompositionWorkers == nullptr) {
+        // created here, so that the workers inherit the priority of the main thread
+        mCompositionWorkers.reset(new CompositionWorkers(MAX_COMPOSITION_WORKERS));
+    }
 
-            hw->dirtyRegion.clear();
-            hw->flip(hw->swapRegion);
-            hw->swapRegion.clear();
+    const nsecs_t now = systemTime();
+    mDebugInSwapBuffers = now;
+
+    // Each display is composed and presented by a task. The GL context can only be
+    // current on one thread at a time, so the tasks take turns using it, see
+    // mRenderEngineLock. While one display is presented, the next one is composed.
+    std::vector<std::function<void()>> tasks;
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        sp<const DisplayDevice> hw(mDisplays[dpy]);
+        if (!hw->isDisplayOn()) {
+            continue;
         }
+        tasks.push_back([this, hw, repaintEverything]() {
+            {
+                Mutex::Autolock _l(mRenderEngineLock);
+                hw->makeCurrent(mEGLDisplay, mEGLContext);
+                composeDisplay(hw, repaintEverything);
+                eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            }
+            presentDisplay(hw);
+        });
     }
-    postFramebuffer();
+    eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    mCompositionWorkers->run(tasks);
+
+    // |mStateLock| not needed as we are on the main thread
+    getDefaultDisplayDeviceLocked()->makeCurrent(mEGLDisplay, mEGLContext);
+    onDisplaysPresented(now);
+}
+
+void SurfaceFlinger::composeDisplay(const sp<const DisplayDevice>& hw, bool repaintEverything) {
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+
+    // transform the dirty region into this screen's coordinate space
+    const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+
+    // repaint the framebuffer (if needed)
+    doDisplayComposition(hw, dirtyRegion);
+
+    hw->dirtyRegion.clear();
+    hw->flip(hw->swapRegion);
+    hw->swapRegion.clear();
+
+    hw->recordComposeTime(systemTime() - start);
+}
+
+void SurfaceFlinger::presentDisplay(const sp<const DisplayDevice>& displayDevice) {
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+
+    const auto hwcId = displayDevice->getHwcDisplayId();
+    {
+        ConditionalLock _l(mHwcLock, hwcId >= 0);
+        if (hwcId >= 0) {
+            mHwc->presentAndGetReleaseFences(hwcId);
+        }
+        displayDevice->onSwapBuffersCompleted();
+    }
+
+    displayDevice->recordPresentTime(systemTime() - start);
 }
 
 void SurfaceFlinger::postFramebuffer()
@@ -1994,12 +2073,20 @@ void SurfaceFlinger::postFramebuffer()
         if (!displayDevice->isDisplayOn()) {
             continue;
         }
-        const auto hwcId = displayDevice->getHwcDisplayId();
-        if (hwcId >= 0) {
-            mHwc->presentAndGetReleaseFences(hwcId);
-        }
-        displayDevice->onSwapBuffersCompleted();
+        presentDisplay(displayDevice);
         displayDevice->makeCurrent(mEGLDisplay, mEGLContext);
+    }
+    onDisplaysPresented(now);
+}
+
+void SurfaceFlinger::onDisplaysPresented(nsecs_t postStartTime)
+{
+    for (size_t displayId = 0; displayId < mDisplays.size(); ++displayId) {
+        auto& displayDevice = mDisplays[displayId];
+        if (!displayDevice->isDisplayOn()) {
+            continue;
+        }
+        const auto hwcId = displayDevice->getHwcDisplayId();
         for (auto& layer : displayDevice->getVisibleLayersSortedByZ()) {
             sp<Fence> releaseFence = Fence::NO_FENCE;
             if (layer->getCompositionType(hwcId) == HWC2::Composition::Client) {
@@ -2026,7 +2113,7 @@ void SurfaceFlinger::postFramebuffer()
         }
     }
 
-    mLastSwapBufferTime = systemTime() - now;
+    mLastSwapBufferTime = systemTime() - postStartTime;
     mDebugInSwapBuffers = 0;
 
     // |mStateLock| not needed as we are on the main thread
@@ -2409,11 +2496,8 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
     ATRACE_CALL();
     ALOGV("computeVisibleRegions");
 
-    Region aboveOpaqueLayers;
-    Region aboveCoveredLayers;
-    Region dirty;
-
-    outDirtyRegion.clear();
+    std::vector<VisibleRegionTracker::LayerRegions> layerRegions;
+    std::vector<Layer*> layers;
     bool bIgnoreLayers = false;
     String8 nameLOI = static_cast<String8>("unnamed");
     getIndexLOI(displayDevice->getHwcDisplayId(), bIgnoreLayers, nameLOI);
@@ -2430,24 +2514,19 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
                                     bIgnoreLayers, nameLOI, displayDevice->getLayerStack()))
             return;
 
-        /*
-         * opaqueRegion: area of a surface that is fully opaque.
-         */
-        Region opaqueRegion;
+        VisibleRegionTracker::LayerRegions regions;
+        regions.id = reinterpret_cast<uintptr_t>(layer);
 
         /*
-         * visibleRegion: area of a surface that is visible on screen
-         * and not fully transparent. This is essentially the layer's
-         * footprint minus the opaque regions above it.
-         * Areas covered by a translucent surface are considered visible.
+         * bounds: the footprint of the surface, empty if it is hidden.
          */
-        Region visibleRegion;
+        regions.bounds = Rect::EMPTY_RECT;
 
         /*
-         * coveredRegion: area of a surface that is covered by all
-         * visible regions above it (which includes the translucent areas).
+         * opaque: whether the whole footprint of the surface is fully
+         * opaque.
          */
-        Region coveredRegion;
+        regions.opaque = false;
 
         /*
          * transparentRegion: area of a surface that is hinted to be completely
@@ -2457,25 +2536,23 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
          * beneath it. The hint may not be correct if apps don't respect the
          * SurfaceView restrictions (which, sadly, some don't).
          */
-        Region transparentRegion;
-
 
         // handle hidden surfaces by setting the visible region to empty
         if (CC_LIKELY(layer->isVisible())) {
             const bool translucent = !layer->isOpaque(s);
             Rect bounds(layer->computeScreenBounds());
-            visibleRegion.set(bounds);
             Transform tr = layer->getTransform();
-            if (!visibleRegion.isEmpty()) {
+            if (!bounds.isEmpty()) {
+                regions.bounds = bounds;
                 // Remove the transparent area from the visible region
                 if (translucent) {
                     if (tr.preserveRects()) {
                         // transform the transparent region
-                        transparentRegion = tr.transform(s.activeTransparentRegion);
+                        regions.transparentRegion = tr.transform(s.activeTransparentRegion);
                     } else {
                         // transformation too complex, can't do the
                         // transparent region optimization.
-                        transparentRegion.clear();
+                        regions.transparentRegion.clear();
                     }
                 }
 
@@ -2484,62 +2561,30 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
                 if (s.alpha == 1.0f && !translucent &&
                         ((layerOrientation & Transform::ROT_INVALID) == false)) {
                     // the opaque region is the layer's footprint
-                    opaqueRegion = visibleRegion;
+                    regions.opaque = true;
                 }
             }
         }
 
-        // Clip the covered region to the visible region
-        coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
-
-        // Update aboveCoveredLayers for next (lower) layer
-        aboveCoveredLayers.orSelf(visibleRegion);
+        regions.contentDirty = layer->contentDirty;
+        regions.oldVisibleRegion = layer->visibleRegion;
+        regions.oldCoveredRegion = layer->coveredRegion;
+        layerRegions.push_back(regions);
+        layers.push_back(layer);
+    });
 
-        // subtract the opaque region covered by the layers above us
-        visibleRegion.subtractSelf(aboveOpaqueLayers);
+    // Only the layers which changed, or which are below a change, are recomputed.
+    displayDevice->visibleRegionTracker.compute(layerRegions, outDirtyRegion, outOpaqueRegion);
 
-        // compute this layer's dirty region
-        if (layer->contentDirty) {
-            // we need to invalidate the whole region
-            dirty = visibleRegion;
-            // as well, as the old visible region
-            dirty.orSelf(layer->visibleRegion);
-            layer->contentDirty = false;
-        } else {
-            /* compute the exposed region:
-             *   the exposed region consists of two components:
-             *   1) what's VISIBLE now and was COVERED before
-             *   2) what's EXPOSED now less what was EXPOSED before
-             *
-             * note that (1) is conservative, we start with the whole
-             * visible region but only keep what used to be covered by
-             * something -- which mean it may have been exposed.
-             *
-             * (2) handles areas that were not covered by anything but got
-             * exposed because of a resize.
-             */
-            const Region newExposed = visibleRegion - coveredRegion;
-            const Region oldVisibleRegion = layer->visibleRegion;
-            const Region oldCoveredRegion = layer->coveredRegion;
-            const Region oldExposed = oldVisibleRegion - oldCoveredRegion;
-            dirty = (visibleRegion&oldCoveredRegion) | (newExposed-oldExposed);
-        }
-        dirty.subtractSelf(aboveOpaqueLayers);
-
-        // accumulate to the screen dirty region
-        outDirtyRegion.orSelf(dirty);
-
-        // Update aboveOpaqueLayers for next (lower) layer
-        aboveOpaqueLayers.orSelf(opaqueRegion);
+    for (size_t i = 0; i < layers.size(); i++) {
+        const VisibleRegionTracker::LayerRegions& regions(layerRegions[i]);
+        layers[i]->contentDirty = false;
 
         // Store the visible region in screen space
-        layer->setVisibleRegion(visibleRegion);
-        layer->setCoveredRegion(coveredRegion);
-        layer->setVisibleNonTransparentRegion(
-                visibleRegion.subtract(transparentRegion));
-    });
-
-    outOpaqueRegion = aboveOpaqueLayers;
+        layers[i]->setVisibleRegion(regions.visibleRegion);
+        layers[i]->setCoveredRegion(regions.coveredRegion);
+        layers[i]->setVisibleNonTransparentRegion(regions.visibleNonTransparentRegion);
+    }
 }
 
 void SurfaceFlinger::invalidateLayerStack(const sp<const Layer>& layer, const Region& dirty) {
@@ -2658,7 +2703,11 @@ void SurfaceFlinger::doDisplayComposition(
     displayDevice->swapRegion.orSelf(dirtyRegion);
 
     // swap buffers (presentation)
-    displayDevice->swapBuffers(getHwComposer());
+    {
+        // serializes the HWC calls when displays are composed in parallel
+        ConditionalLock _l(mHwcLock, displayDevice->getHwcDisplayId() >= 0);
+        displayDevice->swapBuffers(getHwComposer());
+    }
 }
 
 bool SurfaceFlinger::doComposeSurfaces(
@@ -3881,6 +3930,10 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.appendFormat("  eglSwapBuffers time: %f us\n",
             inSwapBuffersDuration/1000.0);
 
+    result.appendFormat("  parallel composition: %s (%zu worker threads)\n",
+            mParallelComposition ? "on" : "off",
+            mCompositionWorkers != nullptr ? mCompositionWorkers->getThreadCount() : 0);
+
     result.appendFormat("  transaction time: %f us\n",
             inTransactionDuration/1000.0);
 
@@ -3890,6 +3943,9 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     mEventThread->dump(result);
     result.append("\n");
 
+    mInterceptor.dump(result);
+    result.append("\n");
+
     /*
      * HWC layer minidump
      */
@@ -4165,10 +4221,21 @@ status_t SurfaceFlinger::onTransact(
                 return NO_ERROR;
             }
             case 1020: { // Layer updates interceptor
+                // 1 keeps the trace in memory, 2 streams it to the file and 3 only keeps
+                // the newest events, optionally followed by the size of the ring in bytes
                 n = data.readInt32();
                 if (n) {
                     ALOGV("Interceptor enabled");
-                    mInterceptor.enable(mDrawingState.layersSortedByZ, mDrawingState.displays);
+                    SurfaceInterceptor::Mode mode(SurfaceInterceptor::Mode::InMemory);
+                    if (n == static_cast<int32_t>(SurfaceInterceptor::Mode::Streaming) ||
+                            n == static_cast<int32_t>(SurfaceInterceptor::Mode::FlightRecorder)) {
+                        mode = static_cast<SurfaceInterceptor::Mode>(n);
+                    }
+                    // The ring is allocated up front, so its size is capped
+                    const int32_t ringSize = data.readInt32();
+                    mInterceptor.enable(mDrawingState.layersSortedByZ, mDrawingState.displays,
+                            mode, ringSize > 0 ?
+                                    std::min(static_cast<size_t>(ringSize), MAX_RING_SIZE) : 0);
                 }
                 else{
                     ALOGV("Interceptor disabled");
@@ -52,6 +52,7 @@
 #include <private/gui/LayerState.h>
 
 #include "Barrier.h"
+#include "CompositionWorkers.h"
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "FrameTracker.h"
@@ -243,6 +244,8 @@ private:
     enum { LOG_FRAME_STATS_PERIOD =  30*60*60 };
 
     static const size_t MAX_LAYERS = 4096;
+    // worker threads composing displays next to the main thread
+    static const size_t MAX_COMPOSITION_WORKERS = 2;
 
     // We're reference counted, never destroy SurfaceFlinger directly
     virtual ~SurfaceFlinger();
@@ -606,6 +609,15 @@ private:
     bool doComposeSurfaces(const sp<const DisplayDevice>& displayDevice, const Region& dirty);
 
     void postFramebuffer();
+#ifdef USE_HWC2
+    // The per-display parts of doComposition() and postFramebuffer(), which can run
+    // on the composition workers.
+    void doParallelComposition(bool repaintEverything);
+    void composeDisplay(const sp<const DisplayDevice>& displayDevice, bool repaintEverything);
+    void presentDisplay(const sp<const DisplayDevice>& displayDevice);
+    // Hands the release fences of the presented frames to the layers.
+    void onDisplaysPresented(nsecs_t postStartTime);
+#endif
     void drawWormhole(const sp<const DisplayDevice>& displayDevice, const Region& region) const;
 
     /* ------------------------------------------------------------------------
@@ -756,6 +768,15 @@ private:
     bool mForceFullDamage;
 #ifdef USE_HWC2
     bool mPropagateBackpressure = true;
+
+    // Compose and present the displays on worker threads when several are on,
+    // set with debug.sf.parallel_composition.
+    bool mParallelComposition = false;
+    std::unique_ptr<CompositionWorkers> mCompositionWorkers;
+    // held by the composition worker using the GL context
+    Mutex mRenderEngineLock;
+    // held by the composition worker calling into HWC for a display
+    Mutex mHwcLock;
 #endif
     SurfaceInterceptor mInterceptor;
     bool mUseHwcVirtualDisplays = false;
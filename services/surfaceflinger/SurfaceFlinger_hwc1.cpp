@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <mutex>
 
 #include <EGL/egl.h>
@@ -1932,11 +1933,8 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
 {
     ATRACE_CALL();
 
-    Region aboveOpaqueLayers;
-    Region aboveCoveredLayers;
-    Region dirty;
-
-    outDirtyRegion.clear();
+    std::vector<VisibleRegionTracker::LayerRegions> layerRegions;
+    std::vector<Layer*> layers;
 
     mDrawingState.traverseInReverseZOrder([&](Layer* layer) {
         // start with the whole surface at its current location
@@ -1946,24 +1944,19 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
         if (layer->getLayerStack() != displayDevice->getLayerStack())
             return;
 
-        /*
-         * opaqueRegion: area of a surface that is fully opaque.
-         */
-        Region opaqueRegion;
+        VisibleRegionTracker::LayerRegions regions;
+        regions.id = reinterpret_cast<uintptr_t>(layer);
 
         /*
-         * visibleRegion: area of a surface that is visible on screen
-         * and not fully transparent. This is essentially the layer's
-         * footprint minus the opaque regions above it.
-         * Areas covered by a translucent surface are considered visible.
+         * bounds: the footprint of the surface, empty if it is hidden.
          */
-        Region visibleRegion;
+        regions.bounds = Rect::EMPTY_RECT;
 
         /*
-         * coveredRegion: area of a surface that is covered by all
-         * visible regions above it (which includes the translucent areas).
+         * opaque: whether the whole footprint of the surface is fully
+         * opaque.
          */
-        Region coveredRegion;
+        regions.opaque = false;
 
         /*
          * transparentRegion: area of a surface that is hinted to be completely
@@ -1973,25 +1966,23 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
          * beneath it. The hint may not be correct if apps don't respect the
          * SurfaceView restrictions (which, sadly, some don't).
          */
-        Region transparentRegion;
-
 
         // handle hidden surfaces by setting the visible region to empty
         if (CC_LIKELY(layer->isVisible())) {
             const bool translucent = !layer->isOpaque(s);
             Rect bounds(layer->computeScreenBounds());
-            visibleRegion.set(bounds);
             Transform tr = layer->getTransform();
-            if (!visibleRegion.isEmpty()) {
+            if (!bounds.isEmpty()) {
+                regions.bounds = bounds;
                 // Remove the transparent area from the visible region
                 if (translucent) {
                     if (tr.preserveRects()) {
                         // transform the transparent region
-                        transparentRegion = tr.transform(s.activeTransparentRegion);
+                        regions.transparentRegion = tr.transform(s.activeTransparentRegion);
                     } else {
                         // transformation too complex, can't do the
                         // transparent region optimization.
-                        transparentRegion.clear();
+                        regions.transparentRegion.clear();
                     }
                 }
 
@@ -2000,62 +1991,30 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
                 if (s.alpha==255 && !translucent &&
                         ((layerOrientation & Transform::ROT_INVALID) == false)) {
                     // the opaque region is the layer's footprint
-                    opaqueRegion = visibleRegion;
+                    regions.opaque = true;
                 }
             }
         }
 
-        // Clip the covered region to the visible region
-        coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
-
-        // Update aboveCoveredLayers for next (lower) layer
-        aboveCoveredLayers.orSelf(visibleRegion);
-
-        // subtract the opaque region covered by the layers above us
-        visibleRegion.subtractSelf(aboveOpaqueLayers);
-
-        // compute this layer's dirty region
-        if (layer->contentDirty) {
-            // we need to invalidate the whole region
-            dirty = visibleRegion;
-            // as well, as the old visible region
-            dirty.orSelf(layer->visibleRegion);
-            layer->contentDirty = false;
-        } else {
-            /* compute the exposed region:
-             *   the exposed region consists of two components:
-             *   1) what's VISIBLE now and was COVERED before
-             *   2) what's EXPOSED now less what was EXPOSED before
-             *
-             * note that (1) is conservative, we start with the whole
-             * visible region but only keep what used to be covered by
-             * something -- which mean it may have been exposed.
-             *
-             * (2) handles areas that were not covered by anything but got
-             * exposed because of a resize.
-             */
-            const Region newExposed = visibleRegion - coveredRegion;
-            const Region oldVisibleRegion = layer->visibleRegion;
-            const Region oldCoveredRegion = layer->coveredRegion;
-            const Region oldExposed = oldVisibleRegion - oldCoveredRegion;
-            dirty = (visibleRegion&oldCoveredRegion) | (newExposed-oldExposed);
-        }
-        dirty.subtractSelf(aboveOpaqueLayers);
+        regions.contentDirty = layer->contentDirty;
+        regions.oldVisibleRegion = layer->visibleRegion;
+        regions.oldCoveredRegion = layer->coveredRegion;
+        layerRegions.push_back(regions);
+        layers.push_back(layer);
+    });
 
-        // accumulate to the screen dirty region
-        outDirtyRegion.orSelf(dirty);
+    // Only the layers which changed, or which are below a change, are recomputed.
+    displayDevice->visibleRegionTracker.compute(layerRegions, outDirtyRegion, outOpaqueRegion);
 
-        // Update aboveOpaqueLayers for next (lower) layer
-        aboveOpaqueLayers.orSelf(opaqueRegion);
+    for (size_t i = 0; i < layers.size(); i++) {
+        const VisibleRegionTracker::LayerRegions& regions(layerRegions[i]);
+        layers[i]->contentDirty = false;
 
         // Store the visible region in screen space
-        layer->setVisibleRegion(visibleRegion);
-        layer->setCoveredRegion(coveredRegion);
-        layer->setVisibleNonTransparentRegion(
-                visibleRegion.subtract(transparentRegion));
-    });
-
-    outOpaqueRegion = aboveOpaqueLayers;
+        layers[i]->setVisibleRegion(regions.visibleRegion);
+        layers[i]->setCoveredRegion(regions.coveredRegion);
+        layers[i]->setVisibleNonTransparentRegion(regions.visibleNonTransparentRegion);
+    }
 }
 
 void SurfaceFlinger::invalidateLayerStack(const sp<const Layer>& layer, const Region& dirty) {
@@ -3324,6 +3283,8 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
      */
     mEventThread->dump(result);
 
+    mInterceptor.dump(result);
+
     /*
      * Dump HWComposer state
      */
@@ -3559,10 +3520,21 @@ status_t SurfaceFlinger::onTransact(
                 return NO_ERROR;
             }
             case 1020: { // Layer updates interceptor
+                // 1 keeps the trace in memory, 2 streams it to the file and 3 only keeps
+                // the newest events, optionally followed by the size of the ring in bytes
                 n = data.readInt32();
                 if (n) {
                     ALOGV("Interceptor enabled");
-                    mInterceptor.enable(mDrawingState.layersSortedByZ, mDrawingState.displays);
+                    SurfaceInterceptor::Mode mode(SurfaceInterceptor::Mode::InMemory);
+                    if (n == static_cast<int32_t>(SurfaceInterceptor::Mode::Streaming) ||
+                            n == static_cast<int32_t>(SurfaceInterceptor::Mode::FlightRecorder)) {
+                        mode = static_cast<SurfaceInterceptor::Mode>(n);
+                    }
+                    // The ring is allocated up front, so its size is capped
+                    const int32_t ringSize = data.readInt32();
+                    mInterceptor.enable(mDrawingState.layersSortedByZ, mDrawingState.displays,
+                            mode, ringSize > 0 ?
+                                    std::min(static_cast<size_t>(ringSize), MAX_RING_SIZE) : 0);
                 }
                 else{
                     ALOGV("Interceptor disabled");
@@ -21,6 +21,14 @@
 #include "SurfaceFlinger.h"
 #include "SurfaceInterceptor.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <fstream>
 
 #include <android-base/file.h>
@@ -31,13 +39,38 @@ namespace android {
 
 // ----------------------------------------------------------------------------
 
+// How often the writer thread flushes the ring to the file in streaming mode,
+// or sooner once the ring is half full
+static const std::chrono::milliseconds WRITER_PERIOD(200);
+
+// Whether the increment adds or removes a surface or a display
+static bool isCreationOrDeletion(const Increment& increment) {
+    switch (increment.increment_case()) {
+        case Increment::kSurfaceCreation:
+        case Increment::kSurfaceDeletion:
+        case Increment::kDisplayCreation:
+        case Increment::kDisplayDeletion:
+            return true;
+        default:
+            return false;
+    }
+}
+
 SurfaceInterceptor::SurfaceInterceptor(SurfaceFlinger* flinger)
     :   mFlinger(flinger)
 {
 }
 
+SurfaceInterceptor::~SurfaceInterceptor() {
+    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    if (mWriter.joinable()) {
+        stopWriterLocked();
+    }
+}
+
 void SurfaceInterceptor::enable(const SortedVector<sp<Layer>>& layers,
-        const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays)
+        const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays,
+        Mode mode, size_t ringSize)
 {
     if (mEnabled) {
         return;
@@ -45,8 +78,46 @@ void SurfaceInterceptor::enable(const SortedVector<sp<Layer>>& layers,
     ATRACE_CALL();
     mEnabled = true;
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    mStats = Stats();
+    mStats.mode = mode;
+
+    // The initial snapshot is built in memory in every mode. The streaming mode writes
+    // it as it is, and the flight recorder keeps it up to date as its ring wraps.
+    mMode = Mode::InMemory;
     saveExistingDisplaysLocked(displays);
     saveExistingSurfacesLocked(layers);
+    if (mode == Mode::InMemory) {
+        return;
+    }
+
+    if (mode == Mode::FlightRecorder) {
+        for (const auto& increment : mTrace.increment()) {
+            foldIntoSnapshotLocked(increment);
+        }
+    } else {
+        mTrace.SerializeToString(&mSnapshot);
+    }
+    mTrace.Clear();
+    mRing = std::make_unique<TraceRingBuffer>(ringSize > 0 ? ringSize : DEFAULT_RING_SIZE);
+    if (mode == Mode::Streaming) {
+        int fd = open(mOutputFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                DEFFILEMODE);
+        if (fd < 0) {
+            ALOGE("Could not open %s to stream the trace (%s)", mOutputFileName.c_str(),
+                    strerror(errno));
+            mEnabled = false;
+            mRing.reset();
+            mSnapshot.clear();
+            return;
+        }
+        mStopWriter = false;
+        mWriterNotified = false;
+        mWriterFailed = false;
+        mQueued.clear();
+        mHasQueued = false;
+        mWriter = std::thread(&SurfaceInterceptor::writerMain, this, fd);
+    }
+    mMode = mode;
 }
 
 void SurfaceInterceptor::disable() {
@@ -56,10 +127,29 @@ void SurfaceInterceptor::disable() {
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
     mEnabled = false;
-    status_t err(writeProtoFileLocked());
+    status_t err(NO_ERROR);
+    switch (mMode) {
+        case Mode::InMemory:
+            err = writeProtoFileLocked();
+            break;
+        case Mode::Streaming:
+            err = stopWriterLocked();
+            break;
+        case Mode::FlightRecorder:
+            err = writeFlightRecordingLocked();
+            break;
+    }
     ALOGE_IF(err == PERMISSION_DENIED, "Could not save the proto file! Permission denied");
     ALOGE_IF(err == NOT_ENOUGH_DATA, "Could not save the proto file! There are missing fields");
+    ALOGI("Intercepted %" PRIu64 " events, %" PRIu64 " dropped, %.2f us per event",
+            mStats.events, mStats.dropped,
+            mStats.events > 0 ? mStats.totalTime / 1000.0 / mStats.events : 0.0);
     mTrace.Clear();
+    mMode = Mode::InMemory;
+    mRing.reset();
+    mSnapshot.clear();
+    mSnapshotSurfaces.clear();
+    mSnapshotDisplays.clear();
 }
 
 bool SurfaceInterceptor::isEnabled() {
@@ -72,8 +162,12 @@ void SurfaceInterceptor::saveExistingDisplaysLocked(
     // Caveat: The initial snapshot does not capture the power mode of the existing displays
     ATRACE_CALL();
     for (size_t i = 0 ; i < displays.size() ; i++) {
-        addDisplayCreationLocked(createTraceIncrementLocked(), displays[i]);
-        addInitialDisplayStateLocked(createTraceIncrementLocked(), displays[i]);
+        Increment* creation(createTraceIncrementLocked());
+        addDisplayCreationLocked(creation, displays[i]);
+        saveIncrementLocked(*creation);
+        Increment* state(createTraceIncrementLocked());
+        addInitialDisplayStateLocked(state, displays[i]);
+        saveIncrementLocked(*state);
     }
 }
 
@@ -81,8 +175,12 @@ void SurfaceInterceptor::saveExistingSurfacesLocked(const SortedVector<sp<Layer>
     ATRACE_CALL();
     for (const auto& l : layers) {
         l->traverseInZOrder(LayerVector::StateSet::Drawing, [this](Layer* layer) {
-            addSurfaceCreationLocked(createTraceIncrementLocked(), layer);
-            addInitialSurfaceStateLocked(createTraceIncrementLocked(), layer);
+            Increment* creation(createTraceIncrementLocked());
+            addSurfaceCreationLocked(creation, layer);
+            saveIncrementLocked(*creation);
+            Increment* state(createTraceIncrementLocked());
+            addInitialSurfaceStateLocked(state, layer);
+            saveIncrementLocked(*state);
         });
     }
 }
@@ -125,6 +223,27 @@ void SurfaceInterceptor::addInitialDisplayStateLocked(Increment* increment,
             display.viewport, display.frame);
 }
 
+void SurfaceInterceptor::dump(String8& result) const {
+    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    static const char* const modeNames[] = { "in memory", "streaming", "flight recorder" };
+    result.appendFormat("SurfaceInterceptor: %s, %s mode\n", mEnabled ? "enabled" : "disabled",
+            modeNames[static_cast<int32_t>(mStats.mode) - 1]);
+    result.appendFormat("  %" PRIu64 " events, %" PRIu64 " bytes encoded, %" PRIu64 " %s\n",
+            mStats.events, mStats.bytes, mStats.dropped,
+            mStats.mode == Mode::FlightRecorder ? "overwritten" : "dropped");
+    result.appendFormat("  cost per event: %.2f us average, %.2f us max\n",
+            mStats.events > 0 ? mStats.totalTime / 1000.0 / mStats.events : 0.0,
+            mStats.maxTime / 1000.0);
+    if (mRing != nullptr) {
+        result.appendFormat("  ring: %zu of %zu bytes used\n", mRing->getUsed(),
+                mRing->getCapacity());
+    }
+    if (mMode == Mode::FlightRecorder) {
+        result.appendFormat("  snapshot: %zu surfaces, %zu displays\n",
+                mSnapshotSurfaces.size(), mSnapshotDisplays.size());
+    }
+}
+
 status_t SurfaceInterceptor::writeProtoFileLocked() {
     ATRACE_CALL();
     std::string output;
@@ -142,6 +261,179 @@ status_t SurfaceInterceptor::writeProtoFileLocked() {
     return NO_ERROR;
 }
 
+status_t SurfaceInterceptor::writeFlightRecordingLocked() {
+    ATRACE_CALL();
+    const uint8_t* first;
+    const uint8_t* second;
+    size_t firstSize;
+    size_t secondSize;
+    mRing->peek(&first, &firstSize, &second, &secondSize);
+
+    // The snapshot and the records are serialized Traces, and so is their concatenation
+    Trace snapshot;
+    addSnapshotLocked(&snapshot);
+    std::string output;
+    snapshot.SerializeToString(&output);
+    output.append(reinterpret_cast<const char*>(first), firstSize);
+    output.append(reinterpret_cast<const char*>(second), secondSize);
+    if (!android::base::WriteStringToFile(output, mOutputFileName, true)) {
+        return PERMISSION_DENIED;
+    }
+
+    return NO_ERROR;
+}
+
+void SurfaceInterceptor::foldIntoSnapshotLocked(const Increment& increment) {
+    mSnapshotTime = increment.time_stamp();
+    switch (increment.increment_case()) {
+        case Increment::kTransaction:
+            for (const auto& change : increment.transaction().surface_change()) {
+                auto surface = mSnapshotSurfaces.find(change.id());
+                // A deferred transaction waits for a frame which is long gone
+                if (surface != mSnapshotSurfaces.end() &&
+                        change.SurfaceChange_case() != SurfaceChange::kDeferredTransaction &&
+                        change.SurfaceChange_case() != SurfaceChange::SURFACECHANGE_NOT_SET) {
+                    surface->second.changes[change.SurfaceChange_case()] = change;
+                }
+            }
+            for (const auto& change : increment.transaction().display_change()) {
+                auto display = mSnapshotDisplays.find(change.id());
+                if (display != mSnapshotDisplays.end() &&
+                        change.DisplayChange_case() != DisplayChange::DISPLAYCHANGE_NOT_SET) {
+                    display->second.changes[change.DisplayChange_case()] = change;
+                }
+            }
+            break;
+        case Increment::kSurfaceCreation: {
+            SurfaceSnapshot& surface(mSnapshotSurfaces[increment.surface_creation().id()]);
+            surface.creation = increment;
+            surface.changes.clear();
+        } break;
+        case Increment::kSurfaceDeletion:
+            mSnapshotSurfaces.erase(increment.surface_deletion().id());
+            break;
+        case Increment::kDisplayCreation: {
+            DisplaySnapshot& display(mSnapshotDisplays[increment.display_creation().id()]);
+            display.creation = increment;
+            display.changes.clear();
+            display.powerModeUpdate.Clear();
+        } break;
+        case Increment::kDisplayDeletion:
+            mSnapshotDisplays.erase(increment.display_deletion().id());
+            break;
+        case Increment::kPowerModeUpdate: {
+            auto display = mSnapshotDisplays.find(increment.power_mode_update().id());
+            if (display != mSnapshotDisplays.end()) {
+                display->second.powerModeUpdate = increment;
+            }
+        } break;
+        case Increment::kBufferUpdate:
+        case Increment::kVsyncEvent:
+        case Increment::INCREMENT_NOT_SET:
+            // no state to keep
+            break;
+    }
+}
+
+void SurfaceInterceptor::addSnapshotLocked(Trace* trace) const {
+    // Like the initial snapshot, a creation followed by a transaction with the state of
+    // each display, then of each surface. They all take the time of the last increment
+    // folded in, so that the trace stays in time order.
+    for (const auto& entry : mSnapshotDisplays) {
+        const DisplaySnapshot& display(entry.second);
+        Increment* creation(trace->add_increment());
+        *creation = display.creation;
+        creation->set_time_stamp(mSnapshotTime);
+        if (!display.changes.empty()) {
+            Increment* state(trace->add_increment());
+            state->set_time_stamp(mSnapshotTime);
+            Transaction* transaction(state->mutable_transaction());
+            transaction->set_synchronous(false);
+            transaction->set_animation(false);
+            for (const auto& change : display.changes) {
+                *transaction->add_display_change() = change.second;
+            }
+        }
+        if (display.powerModeUpdate.has_power_mode_update()) {
+            Increment* powerModeUpdate(trace->add_increment());
+            *powerModeUpdate = display.powerModeUpdate;
+            powerModeUpdate->set_time_stamp(mSnapshotTime);
+        }
+    }
+    for (const auto& entry : mSnapshotSurfaces) {
+        const SurfaceSnapshot& surface(entry.second);
+        Increment* creation(trace->add_increment());
+        *creation = surface.creation;
+        creation->set_time_stamp(mSnapshotTime);
+        if (!surface.changes.empty()) {
+            Increment* state(trace->add_increment());
+            state->set_time_stamp(mSnapshotTime);
+            Transaction* transaction(state->mutable_transaction());
+            transaction->set_synchronous(false);
+            transaction->set_animation(false);
+            for (const auto& change : surface.changes) {
+                *transaction->add_surface_change() = change.second;
+            }
+        }
+    }
+}
+
+void SurfaceInterceptor::writerMain(int fd) {
+    bool failed = !android::base::WriteFully(fd, mSnapshot.data(), mSnapshot.size());
+    bool stop = false;
+    while (!stop) {
+        {
+            std::unique_lock<std::mutex> lock(mWriterMutex);
+            mWriterCondition.wait_for(lock, WRITER_PERIOD, [this] {
+                return mStopWriter || mWriterNotified;
+            });
+            stop = mStopWriter;
+        }
+        mWriterNotified = false;
+
+        failed = !writeRing(fd) || failed;
+        if (mHasQueued) {
+            std::string queued;
+            {
+                std::lock_guard<std::mutex> lock(mQueuedMutex);
+                queued.swap(mQueued);
+            }
+            // Nothing enters the ring while increments are queued, so what it holds
+            // now goes before them
+            failed = !writeRing(fd) || failed;
+            failed = !android::base::WriteFully(fd, queued.data(), queued.size()) || failed;
+            std::lock_guard<std::mutex> lock(mQueuedMutex);
+            mHasQueued = !mQueued.empty();
+        }
+    }
+    close(fd);
+    mWriterFailed = failed;
+}
+
+bool SurfaceInterceptor::writeRing(int fd) {
+    const uint8_t* first;
+    const uint8_t* second;
+    size_t firstSize;
+    size_t secondSize;
+    const size_t size = mRing->peek(&first, &firstSize, &second, &secondSize);
+    // The records are consumed even if they can't be written, so that the ring
+    // doesn't fill up and the intercepted events are counted as dropped
+    const bool written = android::base::WriteFully(fd, first, firstSize) &&
+            android::base::WriteFully(fd, second, secondSize);
+    mRing->consume(size);
+    return written;
+}
+
+status_t SurfaceInterceptor::stopWriterLocked() {
+    {
+        std::lock_guard<std::mutex> lock(mWriterMutex);
+        mStopWriter = true;
+    }
+    mWriterCondition.notify_one();
+    mWriter.join();
+    return mWriterFailed ? PERMISSION_DENIED : NO_ERROR;
+}
+
 const sp<const Layer> SurfaceInterceptor::getLayer(const wp<const IBinder>& weakHandle) {
     const sp<const IBinder>& handle(weakHandle.promote());
     const auto layerHandle(static_cast<const Layer::Handle*>(handle.get()));
@@ -159,11 +451,69 @@ int32_t SurfaceInterceptor::getLayerId(const sp<const Layer>& layer) {
 }
 
 Increment* SurfaceInterceptor::createTraceIncrementLocked() {
-    Increment* increment(mTrace.add_increment());
+    Increment* increment;
+    if (mMode == Mode::InMemory) {
+        increment = mTrace.add_increment();
+    } else {
+        increment = &mIncrement;
+        increment->Clear();
+    }
     increment->set_time_stamp(systemTime());
     return increment;
 }
 
+void SurfaceInterceptor::saveIncrementLocked(const Increment& increment) {
+    if (mMode != Mode::InMemory) {
+        const size_t size = increment.ByteSize();
+        if (mEncodedIncrement.size() < size) {
+            mEncodedIncrement.resize(size);
+        }
+        increment.SerializeWithCachedSizesToArray(mEncodedIncrement.data());
+        if (mMode == Mode::Streaming) {
+            bool saved = !mHasQueued && mRing->push(mEncodedIncrement.data(), size);
+            if (!saved && isCreationOrDeletion(increment)) {
+                // Everything after them refers to the surfaces and displays these
+                // create, so they are queued for the writer rather than dropped
+                Trace queued;
+                *queued.add_increment() = increment;
+                std::lock_guard<std::mutex> lock(mQueuedMutex);
+                queued.AppendToString(&mQueued);
+                mHasQueued = true;
+                saved = true;
+            }
+            if (!saved) {
+                mStats.dropped++;
+            }
+            if ((mHasQueued || mRing->getUsed() > mRing->getCapacity() / 2) &&
+                    !mWriterNotified.exchange(true)) {
+                mWriterCondition.notify_one();
+            }
+        } else {
+            // Make room by folding the oldest increments into the snapshot
+            const size_t framedSize = TraceRingBuffer::getFramedSize(size);
+            while (framedSize > mRing->getCapacity() - mRing->getUsed() &&
+                    mRing->pop(&mOverwrittenRecord)) {
+                if (mOverwrittenIncrement.ParseFromString(mOverwrittenRecord)) {
+                    foldIntoSnapshotLocked(mOverwrittenIncrement);
+                }
+                mStats.dropped++;
+            }
+            if (!mRing->push(mEncodedIncrement.data(), size)) {
+                // Larger than the whole ring
+                foldIntoSnapshotLocked(increment);
+                mStats.dropped++;
+            }
+        }
+        mStats.bytes += size;
+    }
+
+    // The timestamp of the increment is when it started being built
+    const nsecs_t time = systemTime() - increment.time_stamp();
+    mStats.events++;
+    mStats.totalTime += time;
+    mStats.maxTime = std::max(mStats.maxTime, time);
+}
+
 SurfaceChange* SurfaceInterceptor::createSurfaceChangeLocked(Transaction* transaction,
         int32_t layerId)
 {
@@ -525,8 +875,9 @@ void SurfaceInterceptor::saveTransaction(const Vector<ComposerState>& stateUpdat
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addTransactionLocked(createTraceIncrementLocked(), stateUpdates, displays, changedDisplays,
-            flags);
+    Increment* increment(createTraceIncrementLocked());
+    addTransactionLocked(increment, stateUpdates, displays, changedDisplays, flags);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::saveSurfaceCreation(const sp<const Layer>& layer) {
@@ -535,7 +886,9 @@ void SurfaceInterceptor::saveSurfaceCreation(const sp<const Layer>& layer) {
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addSurfaceCreationLocked(createTraceIncrementLocked(), layer);
+    Increment* increment(createTraceIncrementLocked());
+    addSurfaceCreationLocked(increment, layer);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::saveSurfaceDeletion(const sp<const Layer>& layer) {
@@ -544,7 +897,9 @@ void SurfaceInterceptor::saveSurfaceDeletion(const sp<const Layer>& layer) {
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addSurfaceDeletionLocked(createTraceIncrementLocked(), layer);
+    Increment* increment(createTraceIncrementLocked());
+    addSurfaceDeletionLocked(increment, layer);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::saveBufferUpdate(const sp<const Layer>& layer, uint32_t width,
@@ -555,7 +910,9 @@ void SurfaceInterceptor::saveBufferUpdate(const sp<const Layer>& layer, uint32_t
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addBufferUpdateLocked(createTraceIncrementLocked(), layer, width, height, frameNumber);
+    Increment* increment(createTraceIncrementLocked());
+    addBufferUpdateLocked(increment, layer, width, height, frameNumber);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::saveVSyncEvent(nsecs_t timestamp) {
@@ -563,7 +920,9 @@ void SurfaceInterceptor::saveVSyncEvent(nsecs_t timestamp) {
         return;
     }
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addVSyncUpdateLocked(createTraceIncrementLocked(), timestamp);
+    Increment* increment(createTraceIncrementLocked());
+    addVSyncUpdateLocked(increment, timestamp);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::saveDisplayCreation(const DisplayDeviceState& info) {
@@ -572,7 +931,9 @@ void SurfaceInterceptor::saveDisplayCreation(const DisplayDeviceState& info) {
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addDisplayCreationLocked(createTraceIncrementLocked(), info);
+    Increment* increment(createTraceIncrementLocked());
+    addDisplayCreationLocked(increment, info);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::saveDisplayDeletion(int32_t displayId) {
@@ -581,7 +942,9 @@ void SurfaceInterceptor::saveDisplayDeletion(int32_t displayId) {
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addDisplayDeletionLocked(createTraceIncrementLocked(), displayId);
+    Increment* increment(createTraceIncrementLocked());
+    addDisplayDeletionLocked(increment, displayId);
+    saveIncrementLocked(*increment);
 }
 
 void SurfaceInterceptor::savePowerModeUpdate(int32_t displayId, int32_t mode) {
@@ -590,7 +953,9 @@ void SurfaceInterceptor::savePowerModeUpdate(int32_t displayId, int32_t mode) {
     }
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addPowerModeUpdateLocked(createTraceIncrementLocked(), displayId, mode);
+    Increment* increment(createTraceIncrementLocked());
+    addPowerModeUpdateLocked(increment, displayId, mode);
+    saveIncrementLocked(*increment);
 }
 
 
@@ -19,11 +19,21 @@
 
 #include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
+#include "TraceRingBuffer.h"
+
 namespace android {
 
 class BufferItem;
@@ -33,6 +43,9 @@ struct DisplayState;
 struct layer_state_t;
 
 constexpr auto DEFAULT_FILENAME = "/data/SurfaceTrace.dat";
+constexpr size_t DEFAULT_RING_SIZE = 4 * 1024 * 1024;
+// The largest ring a caller may ask for
+constexpr size_t MAX_RING_SIZE = 64 * 1024 * 1024;
 
 /*
  * SurfaceInterceptor intercepts and stores incoming streams of window
@@ -40,13 +53,34 @@ constexpr auto DEFAULT_FILENAME = "/data/SurfaceTrace.dat";
  */
 class SurfaceInterceptor {
 public:
+    // How the trace is captured. The file written is a serialized Trace in every mode.
+    enum class Mode : int32_t {
+        // The trace is kept in memory and written when tracing stops
+        InMemory = 1,
+        // Each increment is encoded into a ring as it is intercepted, and a writer
+        // thread streams the ring to the file. Increments which don't fit are dropped,
+        // except for creations and deletions, which are queued for the writer.
+        Streaming = 2,
+        // Each increment is encoded into a ring which only keeps the newest ones. When
+        // tracing stops, the ring is written after a snapshot of the surfaces and
+        // displays as the increments it no longer has left them.
+        FlightRecorder = 3,
+    };
+
     SurfaceInterceptor(SurfaceFlinger* const flinger);
-    // Both vectors are used to capture the current state of SF as the initial snapshot in the trace
+    ~SurfaceInterceptor();
+    // Both vectors are used to capture the current state of SF as the initial snapshot in the trace.
+    // ringSize is the size of the ring of the streaming and flight recorder modes, 0 for the
+    // default. Callers limit it to MAX_RING_SIZE.
     void enable(const SortedVector<sp<Layer>>& layers,
-            const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays);
+            const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays,
+            Mode mode = Mode::InMemory, size_t ringSize = 0);
     void disable();
     bool isEnabled();
 
+    // Dumps the mode and the cost of the intercepted events of the current or last trace
+    void dump(String8& result) const;
+
     // Intercept display and surface transactions
     void saveTransaction(const Vector<ComposerState>& stateUpdates,
             const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays,
@@ -75,11 +109,22 @@ private:
     void addInitialDisplayStateLocked(Increment* increment, const DisplayDeviceState& display);
 
     status_t writeProtoFileLocked();
+    // Writes the snapshot, then the increments kept in the ring
+    status_t writeFlightRecordingLocked();
+    // Applies an increment the flight recorder's ring no longer has to the snapshot
+    void foldIntoSnapshotLocked(const Increment& increment);
+    void addSnapshotLocked(Trace* trace) const;
+    void writerMain(int fd);
+    // Writes out and consumes what the ring holds. Returns false if writing failed.
+    bool writeRing(int fd);
+    status_t stopWriterLocked();
     const sp<const Layer> getLayer(const wp<const IBinder>& weakHandle);
     const std::string getLayerName(const sp<const Layer>& layer);
     int32_t getLayerId(const sp<const Layer>& layer);
 
     Increment* createTraceIncrementLocked();
+    // Called once the increment from createTraceIncrementLocked() is complete
+    void saveIncrementLocked(const Increment& increment);
     void addSurfaceCreationLocked(Increment* increment, const sp<const Layer>& layer);
     void addSurfaceDeletionLocked(Increment* increment, const sp<const Layer>& layer);
     void addBufferUpdateLocked(Increment* increment, const sp<const Layer>& layer, uint32_t width,
@@ -127,11 +172,68 @@ private:
             const DisplayState& state, int32_t displayId);
 
 
+    struct Stats {
+        Mode mode = Mode::InMemory;
+        uint64_t events = 0;
+        uint64_t bytes = 0;
+        // increments which didn't fit in the ring, or which were overwritten in it and
+        // only remain in the snapshot
+        uint64_t dropped = 0;
+        // time spent building and encoding the increments
+        nsecs_t totalTime = 0;
+        nsecs_t maxTime = 0;
+    };
+
     bool mEnabled {false};
+    Mode mMode {Mode::InMemory};
     std::string mOutputFileName {DEFAULT_FILENAME};
-    std::mutex mTraceMutex {};
+    mutable std::mutex mTraceMutex {};
     Trace mTrace {};
+    Stats mStats {};
     SurfaceFlinger* const mFlinger;
+
+    // The streaming and flight recorder modes encode each increment into mRing, through
+    // mIncrement and mEncodedIncrement which are reused.
+    Increment mIncrement {};
+    std::vector<uint8_t> mEncodedIncrement {};
+    std::unique_ptr<TraceRingBuffer> mRing {};
+    // The initial snapshot, which the streaming mode writes before the ring
+    std::string mSnapshot {};
+
+    // What the flight recorder writes before the ring: the surfaces and displays of
+    // the initial snapshot, updated with each increment overwritten in the ring.
+    struct SurfaceSnapshot {
+        Increment creation;
+        // the latest change of each kind, by SurfaceChange_case()
+        std::map<int32_t, SurfaceChange> changes;
+    };
+    struct DisplaySnapshot {
+        Increment creation;
+        // the latest change of each kind, by DisplayChange_case()
+        std::map<int32_t, DisplayChange> changes;
+        Increment powerModeUpdate;
+    };
+    std::map<int32_t, SurfaceSnapshot> mSnapshotSurfaces {};
+    std::map<int32_t, DisplaySnapshot> mSnapshotDisplays {};
+    // The time of the last increment in the snapshot
+    int64_t mSnapshotTime {0};
+    // Reused to decode the overwritten increments
+    std::string mOverwrittenRecord {};
+    Increment mOverwrittenIncrement {};
+
+    // The writer thread of the streaming mode
+    std::thread mWriter {};
+    std::mutex mWriterMutex {};
+    std::condition_variable mWriterCondition {};
+    bool mStopWriter {false};
+    std::atomic<bool> mWriterNotified {false};
+    std::atomic<bool> mWriterFailed {false};
+    // Creations and deletions which didn't fit in the ring, as a serialized Trace. Until
+    // the writer has written them, nothing else enters the ring, so it keeps them in
+    // order by writing out the ring before them.
+    std::mutex mQueuedMutex {};
+    std::string mQueued {};
+    std::atomic<bool> mHasQueued {false};
 };
 
 }
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "TraceRingBuffer.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// The key of a length-delimited field 1
+static const uint8_t RECORD_TAG = (1 << 3) | 2;
+// A varint of a size_t takes at most 10 bytes
+static const size_t MAX_HEADER_SIZE = 1 + 10;
+
+static size_t encodeHeader(size_t size, uint8_t* header) {
+    size_t length = 0;
+    header[length++] = RECORD_TAG;
+    while (size >= 0x80) {
+        header[length++] = static_cast<uint8_t>(size | 0x80);
+        size >>= 7;
+    }
+    header[length++] = static_cast<uint8_t>(size);
+    return length;
+}
+
+TraceRingBuffer::TraceRingBuffer(size_t capacity)
+    :   mHead(0),
+        mTail(0)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mBuffer.reset(new uint8_t[size]);
+    mMask = size - 1;
+}
+
+size_t TraceRingBuffer::getUsed() const {
+    return mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire);
+}
+
+size_t TraceRingBuffer::getFramedSize(size_t size) {
+    uint8_t header[MAX_HEADER_SIZE];
+    return encodeHeader(size, header) + size;
+}
+
+void TraceRingBuffer::copyIn(size_t position, const uint8_t* data, size_t size) {
+    const size_t offset = position & mMask;
+    const size_t first = std::min(size, getCapacity() - offset);
+    memcpy(&mBuffer[offset], data, first);
+    memcpy(&mBuffer[0], data + first, size - first);
+}
+
+size_t TraceRingBuffer::getRecordSize(size_t position, size_t* outHeaderSize) const {
+    // skip the tag, then decode the varint
+    size_t headerSize = 1;
+    size_t size = 0;
+    for (int shift = 0; ; shift += 7) {
+        const uint8_t byte = mBuffer[(position + headerSize++) & mMask];
+        size |= static_cast<size_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    *outHeaderSize = headerSize;
+    return headerSize + size;
+}
+
+bool TraceRingBuffer::push(const uint8_t* data, size_t size) {
+    uint8_t header[MAX_HEADER_SIZE];
+    const size_t headerSize = encodeHeader(size, header);
+    const size_t head = mHead.load(std::memory_order_relaxed);
+    const size_t used = head - mTail.load(std::memory_order_acquire);
+    if (headerSize + size > getCapacity() - used) {
+        return false;
+    }
+    copyIn(head, header, headerSize);
+    copyIn(head + headerSize, data, size);
+    mHead.store(head + headerSize + size, std::memory_order_release);
+    return true;
+}
+
+size_t TraceRingBuffer::peek(const uint8_t** first, size_t* firstSize,
+        const uint8_t** second, size_t* secondSize) const {
+    const size_t tail = mTail.load(std::memory_order_relaxed);
+    const size_t used = mHead.load(std::memory_order_acquire) - tail;
+    const size_t offset = tail & mMask;
+    *first = &mBuffer[offset];
+    *firstSize = std::min(used, getCapacity() - offset);
+    *second = &mBuffer[0];
+    *secondSize = used - *firstSize;
+    return used;
+}
+
+void TraceRingBuffer::consume(size_t size) {
+    mTail.store(mTail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+}
+
+bool TraceRingBuffer::pop(std::string* outRecord) {
+    const size_t tail = mTail.load(std::memory_order_relaxed);
+    if (mHead.load(std::memory_order_acquire) == tail) {
+        return false;
+    }
+    size_t headerSize;
+    const size_t recordSize = getRecordSize(tail, &headerSize);
+    const size_t offset = (tail + headerSize) & mMask;
+    const size_t size = recordSize - headerSize;
+    const size_t first = std::min(size, getCapacity() - offset);
+    outRecord->assign(reinterpret_cast<const char*>(&mBuffer[offset]), first);
+    outRecord->append(reinterpret_cast<const char*>(&mBuffer[0]), size - first);
+    mTail.store(tail + recordSize, std::memory_order_release);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_TRACE_RING_BUFFER_H
+#define ANDROID_SF_TRACE_RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace android {
+
+/*
+ * A preallocated ring of encoded trace records, written by one thread and read by
+ * another without locks.
+ *
+ * Each record is framed as a length-delimited protobuf field 1, the field of the
+ * increments of a Trace. The bytes read out of the ring, in order and from any
+ * record boundary, are therefore a serialized Trace themselves.
+ */
+class TraceRingBuffer {
+public:
+    // The capacity is rounded up to a power of two
+    explicit TraceRingBuffer(size_t capacity);
+
+    size_t getCapacity() const { return mMask + 1; }
+    // Number of bytes written and not consumed yet
+    size_t getUsed() const;
+
+    // Size of a record once framed
+    static size_t getFramedSize(size_t size);
+
+    // Writer side. Adds a record, or returns false without blocking if there
+    // isn't room for it.
+    bool push(const uint8_t* data, size_t size);
+
+    // Reader side. Returns the bytes available in up to two contiguous ranges,
+    // which stay valid until they are consumed.
+    size_t peek(const uint8_t** first, size_t* firstSize,
+            const uint8_t** second, size_t* secondSize) const;
+    void consume(size_t size);
+
+    // Reader side. Removes the oldest record and copies it, without its framing,
+    // to outRecord. Returns false if the ring is empty.
+    bool pop(std::string* outRecord);
+
+private:
+    void copyIn(size_t position, const uint8_t* data, size_t size);
+    // Size of the framed record starting at position, and of its framing
+    size_t getRecordSize(size_t position, size_t* outHeaderSize) const;
+
+    std::unique_ptr<uint8_t[]> mBuffer;
+    size_t mMask;
+    // Positions grow without wrapping, and are masked to index mBuffer. The reader
+    // owns mTail and the writer owns mHead.
+    std::atomic<size_t> mHead;
+    std::atomic<size_t> mTail;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_TRACE_RING_BUFFER_H
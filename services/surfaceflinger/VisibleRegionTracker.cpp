@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "VisibleRegionTracker.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+bool VisibleRegionTracker::isSameRegion(const Region& lhs, const Region& rhs) {
+    if (lhs.isTriviallyEqual(rhs)) {
+        return true;
+    }
+    // Regions are kept in a canonical form, so the same area has the same rectangles.
+    // Anything else is only treated as a change, which is safe.
+    const size_t size = lhs.end() - lhs.begin();
+    return size == size_t(rhs.end() - rhs.begin())
+            && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+bool VisibleRegionTracker::isSameGeometry(const LayerRegions& layer, const Entry& entry) {
+    return layer.bounds == entry.bounds && layer.opaque == entry.opaque
+            && isSameRegion(layer.transparentRegion, entry.transparentRegion);
+}
+
+void VisibleRegionTracker::loadAboveRegions(size_t index,
+        Region& aboveOpaqueLayers, Region& aboveCoveredLayers) const {
+    if (index < mEntries.size()) {
+        aboveOpaqueLayers = mEntries[index].aboveOpaqueLayers;
+        aboveCoveredLayers = mEntries[index].aboveCoveredLayers;
+    } else {
+        // below the last layer
+        aboveOpaqueLayers = mOpaqueLayers;
+        aboveCoveredLayers = mCoveredLayers;
+    }
+}
+
+void VisibleRegionTracker::compute(std::vector<LayerRegions>& layers,
+        Region& outDirtyRegion, Region& outOpaqueRegion)
+{
+    const size_t count = layers.size();
+
+    // Find each layer in the previous pass. If the layers in both passes changed order,
+    // what is above a layer can't be compared with the previous pass, and all the layers
+    // are recomputed.
+    std::vector<ssize_t> previous(count, -1);
+    std::vector<bool> found(mEntries.size(), false);
+    bool reordered = false;
+    ssize_t last = -1;
+    for (size_t i = 0; i < count; i++) {
+        auto index = mIndices.find(layers[i].id);
+        if (index != mIndices.end()) {
+            previous[i] = index->second;
+            found[index->second] = true;
+            reordered |= previous[i] < last;
+            last = previous[i];
+        }
+    }
+
+    /*
+     * changedRegion: where the layers above a layer may differ from the
+     * previous pass. It holds the old and new footprints of the layers that
+     * moved, changed opacity, appeared or went away. A layer that doesn't
+     * overlap it has the same opaque and covering layers above it as before,
+     * so its visible and covered regions are the same too.
+     */
+    Region changedRegion;
+    if (reordered) {
+        std::fill(previous.begin(), previous.end(), -1);
+    } else {
+        for (size_t j = 0; j < mEntries.size(); j++) {
+            if (!found[j]) {
+                changedRegion.orSelf(mEntries[j].bounds);
+            }
+        }
+    }
+
+    // While the regions above the current layer are known to be the ones kept with the
+    // layer at this index of the previous pass, they are used from there instead of
+    // being accumulated. This is the case for the layers above the first change, and
+    // again below a change once its effect is hidden, e.g. under a full screen layer.
+    ssize_t sameAsIndex = 0;
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    Region dirty;
+    std::vector<Entry> entries;
+    entries.reserve(count);
+
+    outDirtyRegion.clear();
+    mRecomputedCount = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        LayerRegions& layer(layers[i]);
+        const Entry* old = previous[i] >= 0 ? &mEntries[previous[i]] : NULL;
+        const bool sameGeometry = old != NULL && isSameGeometry(layer, *old);
+
+        if (sameAsIndex >= 0 && sameAsIndex != previous[i]) {
+            loadAboveRegions(sameAsIndex, aboveOpaqueLayers, aboveCoveredLayers);
+            sameAsIndex = -1;
+        }
+        if (sameAsIndex < 0 && sameGeometry
+                && isSameRegion(aboveOpaqueLayers, old->aboveOpaqueLayers)
+                && isSameRegion(aboveCoveredLayers, old->aboveCoveredLayers)) {
+            sameAsIndex = previous[i];
+        }
+        const bool unchangedAbove = sameAsIndex >= 0;
+        const Region& aboveOpaque(unchangedAbove ? old->aboveOpaqueLayers : aboveOpaqueLayers);
+        const Region& aboveCovered(unchangedAbove ? old->aboveCoveredLayers : aboveCoveredLayers);
+
+        const bool reuse = sameGeometry && (unchangedAbove ||
+                (layer.bounds.isValid() && !changedRegion.intersects(layer.bounds)));
+        if (reuse) {
+            entries.push_back(*old);
+            layer.visibleRegion = old->visibleRegion;
+            layer.coveredRegion = old->coveredRegion;
+            layer.visibleNonTransparentRegion = old->visibleNonTransparentRegion;
+        } else {
+            mRecomputedCount++;
+
+            // Clip the covered region to the visible region
+            layer.coveredRegion = aboveCovered.intersect(layer.bounds);
+
+            // subtract the opaque region covered by the layers above us
+            layer.visibleRegion = Region(layer.bounds).subtract(aboveOpaque);
+            layer.visibleNonTransparentRegion =
+                    layer.visibleRegion.subtract(layer.transparentRegion);
+
+            entries.push_back(Entry());
+            Entry& entry(entries.back());
+            entry.id = layer.id;
+            entry.bounds = layer.bounds;
+            entry.opaque = layer.opaque;
+            entry.transparentRegion = layer.transparentRegion;
+            entry.visibleRegion = layer.visibleRegion;
+            entry.coveredRegion = layer.coveredRegion;
+            entry.visibleNonTransparentRegion = layer.visibleNonTransparentRegion;
+            entry.visibleCoveredRegion = layer.visibleRegion.intersect(layer.coveredRegion);
+
+            if (!sameGeometry) {
+                changedRegion.orSelf(layer.bounds);
+                if (old != NULL) {
+                    changedRegion.orSelf(old->bounds);
+                }
+            }
+        }
+        Entry& entry(entries.back());
+        if (!reuse || !unchangedAbove) {
+            entry.aboveOpaqueLayers = aboveOpaque;
+            entry.aboveCoveredLayers = aboveCovered;
+        }
+
+        // compute this layer's dirty region
+        if (layer.contentDirty) {
+            // we need to invalidate the whole region
+            dirty = layer.visibleRegion;
+            // as well, as the old visible region
+            dirty.orSelf(layer.oldVisibleRegion);
+            dirty.subtractSelf(aboveOpaque);
+        } else if (isSameRegion(layer.oldVisibleRegion, entry.visibleRegion) &&
+                isSameRegion(layer.oldCoveredRegion, entry.coveredRegion)) {
+            // nothing was exposed, only the covered part is redrawn. it is already
+            // outside of the opaque region above.
+            dirty = entry.visibleCoveredRegion;
+        } else {
+            /* compute the exposed region:
+             *   the exposed region consists of two components:
+             *   1) what's VISIBLE now and was COVERED before
+             *   2) what's EXPOSED now less what was EXPOSED before
+             *
+             * note that (1) is conservative, we start with the whole
+             * visible region but only keep what used to be covered by
+             * something -- which mean it may have been exposed.
+             *
+             * (2) handles areas that were not covered by anything but got
+             * exposed because of a resize.
+             */
+            const Region newExposed = layer.visibleRegion - layer.coveredRegion;
+            const Region oldExposed = layer.oldVisibleRegion - layer.oldCoveredRegion;
+            dirty = (layer.visibleRegion & layer.oldCoveredRegion) | (newExposed - oldExposed);
+            dirty.subtractSelf(aboveOpaque);
+        }
+
+        // accumulate to the screen dirty region
+        if (!dirty.isEmpty()) {
+            outDirtyRegion.orSelf(dirty);
+        }
+
+        // Update aboveCoveredLayers and aboveOpaqueLayers for next (lower) layer
+        if (unchangedAbove && sameGeometry) {
+            sameAsIndex = previous[i] + 1;
+        } else {
+            if (unchangedAbove) {
+                aboveOpaqueLayers = aboveOpaque;
+                aboveCoveredLayers = aboveCovered;
+            }
+            sameAsIndex = -1;
+            aboveCoveredLayers.orSelf(layer.bounds);
+            if (layer.opaque) {
+                aboveOpaqueLayers.orSelf(layer.bounds);
+            }
+        }
+    }
+
+    if (sameAsIndex >= 0) {
+        loadAboveRegions(sameAsIndex, aboveOpaqueLayers, aboveCoveredLayers);
+    }
+
+    mEntries.swap(entries);
+    mIndices.clear();
+    for (size_t i = 0; i < count; i++) {
+        mIndices[mEntries[i].id] = i;
+    }
+    mOpaqueLayers = aboveOpaqueLayers;
+    mCoveredLayers = aboveCoveredLayers;
+    outOpaqueRegion = aboveOpaqueLayers;
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_VISIBLE_REGION_TRACKER_H
+#define ANDROID_SF_VISIBLE_REGION_TRACKER_H
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+namespace android {
+
+/*
+ * Computes the visible, covered and dirty regions of the layers of a display, front to
+ * back, for SurfaceFlinger::computeVisibleRegions().
+ *
+ * The visible and covered regions of a layer only depend on its own geometry and on the
+ * footprints and opaque regions of the layers above it. The tracker keeps them from the
+ * previous pass, and only recomputes the layers whose geometry changed, and the layers
+ * below those which overlap what changed. The regions above each layer are kept too, so
+ * they aren't accumulated again above the first change, nor below a change once it is
+ * hidden by a full screen layer. The dirty region is still computed for every layer, from
+ * the regions the layer stored in the previous pass.
+ */
+class VisibleRegionTracker {
+public:
+    struct LayerRegions {
+        // identifies the layer from one pass to the next
+        uintptr_t id;
+        // the footprint of the layer, EMPTY_RECT if it is hidden
+        Rect bounds;
+        // whether the whole footprint is opaque
+        bool opaque;
+        Region transparentRegion;
+        bool contentDirty;
+        // the regions the layer stored in the previous pass
+        Region oldVisibleRegion;
+        Region oldCoveredRegion;
+
+        // results
+        Region visibleRegion;
+        Region coveredRegion;
+        Region visibleNonTransparentRegion;
+    };
+
+    // Computes the results for layers, which are sorted front to back. Returns the dirty
+    // region of the display and the union of the opaque regions of the layers.
+    void compute(std::vector<LayerRegions>& layers,
+            Region& outDirtyRegion, Region& outOpaqueRegion);
+
+    // Number of layers whose visible region the last pass recomputed.
+    size_t getRecomputedCount() const { return mRecomputedCount; }
+
+private:
+    struct Entry {
+        uintptr_t id;
+        Rect bounds;
+        bool opaque;
+        Region transparentRegion;
+        // union of the opaque regions and of the footprints of the layers above
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+        Region visibleRegion;
+        Region coveredRegion;
+        Region visibleNonTransparentRegion;
+        // the dirty region of the layer when nothing changed
+        Region visibleCoveredRegion;
+    };
+
+    static bool isSameRegion(const Region& lhs, const Region& rhs);
+    static bool isSameGeometry(const LayerRegions& layer, const Entry& entry);
+    // Loads the regions above the layer at index in the previous pass.
+    void loadAboveRegions(size_t index, Region& aboveOpaqueLayers,
+            Region& aboveCoveredLayers) const;
+
+    std::vector<Entry> mEntries;
+    std::unordered_map<uintptr_t, size_t> mIndices;
+    // union of the opaque regions and of the footprints of all the layers
+    Region mOpaqueLayers;
+    Region mCoveredLayers;
+    size_t mRecomputedCount = 0;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_VISIBLE_REGION_TRACKER_H
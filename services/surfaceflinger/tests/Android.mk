@@ -34,6 +34,96 @@ LOCAL_TEST_DATA = SurfaceFlinger_test.filter
 # to integrate with auto-test framework.
 include $(BUILD_NATIVE_TEST)
 
+# Unit tests of the incremental visible region computation, which don't need
+# a running SurfaceFlinger.
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_MODULE := VisibleRegionTracker_test
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+   VisibleRegionTracker_test.cpp \
+   ../VisibleRegionTracker.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libui \
+    libutils
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_TEST)
+
+# Unit tests of the composition worker threads.
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_MODULE := CompositionWorkers_test
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+   CompositionWorkers_test.cpp \
+   ../CompositionWorkers.cpp
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_TEST)
+
+# Unit tests of the ring of the SurfaceInterceptor's streaming and flight
+# recorder modes.
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_MODULE := TraceRingBuffer_test
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+   TraceRingBuffer_test.cpp \
+   ../TraceRingBuffer.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libprotobuf-cpp-lite
+
+LOCAL_STATIC_LIBRARIES := libtrace_proto
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_MODULE := HWC2Layer_test
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+   HWC2Layer_test.cpp \
+   ../DisplayHardware/ComposerHal.cpp \
+   ../DisplayHardware/HWC2.cpp
+
+LOCAL_C_INCLUDES := \
+    system/libhwbinder/fast_msgq/include
+
+LOCAL_SHARED_LIBRARIES := \
+    android.frameworks.vr.composer@1.0 \
+    android.hardware.graphics.composer@2.1 \
+    libcutils \
+    libfmq \
+    libhidlbase \
+    libhidltransport \
+    libhwbinder \
+    liblog \
+    libsync \
+    libui \
+    libutils
+
+LOCAL_STATIC_LIBRARIES := libhwcomposer-command-buffer
+
+LOCAL_CFLAGS += -DUSE_HWC2
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code -std=c++1z
+
+include $(BUILD_NATIVE_TEST)
+
 # Include subdirectory makefiles
 # ============================================================
 
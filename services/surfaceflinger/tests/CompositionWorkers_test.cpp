@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "../CompositionWorkers.h"
+
+namespace android {
+
+TEST(CompositionWorkersTest, Run_RunsEachTaskOnce) {
+    CompositionWorkers workers(2);
+    std::atomic<int> counts[5] = {};
+    std::vector<std::function<void()>> tasks;
+    for (int i = 0; i < 5; i++) {
+        tasks.push_back([&counts, i]() { counts[i]++; });
+    }
+    for (int round = 0; round < 100; round++) {
+        workers.run(tasks);
+    }
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(100, counts[i]);
+    }
+}
+
+TEST(CompositionWorkersTest, Run_StartsFirstTaskOnCallingThread) {
+    CompositionWorkers workers(2);
+    std::thread::id first;
+    std::vector<std::function<void()>> tasks = {
+        [&first]() { first = std::this_thread::get_id(); },
+        []() {},
+    };
+    workers.run(tasks);
+    EXPECT_EQ(std::this_thread::get_id(), first);
+}
+
+TEST(CompositionWorkersTest, Run_RunsTasksConcurrently) {
+    CompositionWorkers workers(2);
+    // Each task waits for all of them to have started, which only finishes if they
+    // run on different threads.
+    std::atomic<int> started(0);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::vector<std::function<void()>> tasks(3, [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        }
+        started++;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (started < 3 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+    });
+    workers.run(tasks);
+    EXPECT_EQ(3, started);
+    EXPECT_EQ(3U, threads.size());
+}
+
+TEST(CompositionWorkersTest, Run_WithNoTasks_Returns) {
+    CompositionWorkers workers(1);
+    workers.run(std::vector<std::function<void()>>());
+}
+
+} // namespace android
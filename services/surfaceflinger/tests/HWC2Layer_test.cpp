@@ -0,0 +1,158 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "../DisplayHardware/ComposerHal.h"
+#include "../DisplayHardware/HWC2.h"
+
+namespace android {
+
+using Hwc2::Error;
+using Hwc2::IComposerClient;
+
+// Accepts layer commands without a composer service behind it.  A failing
+// validate drops the queued commands the way Composer::execute does when the
+// transport or the composer fails.
+class FakeComposer : public Hwc2::Composer {
+public:
+    Error destroyLayer(Hwc2::Display, Hwc2::Layer) override {
+        return Error::NONE;
+    }
+
+    Error setLayerZOrder(Hwc2::Display, Hwc2::Layer, uint32_t z) override {
+        zOrderCommands++;
+        lastZOrder = z;
+        return Error::NONE;
+    }
+
+    Error setLayerBlendMode(Hwc2::Display, Hwc2::Layer,
+            IComposerClient::BlendMode) override {
+        blendModeCommands++;
+        return Error::NONE;
+    }
+
+    Error validateDisplay(Hwc2::Display, uint32_t* outNumTypes,
+            uint32_t* outNumRequests) override {
+        *outNumTypes = 0;
+        *outNumRequests = 0;
+        if (failExecute) {
+            resetCommands();
+            return Error::NO_RESOURCES;
+        }
+        return Error::NONE;
+    }
+
+    bool failExecute = false;
+    int zOrderCommands = 0;
+    int blendModeCommands = 0;
+    uint32_t lastZOrder = 0;
+};
+
+class HWC2LayerTest : public ::testing::Test {
+protected:
+    HWC2::Layer* createLayer() {
+        mLayers.emplace_back(std::make_unique<HWC2::Layer>(
+                mComposer, mCapabilities, mCounts, kDisplayId,
+                mLayers.size() + 1));
+        return mLayers.back().get();
+    }
+
+    static constexpr hwc2_display_t kDisplayId = 1;
+
+    FakeComposer mComposer;
+    std::unordered_set<HWC2::Capability> mCapabilities;
+    HWC2::LayerCommandCounts mCounts;
+    std::vector<std::unique_ptr<HWC2::Layer>> mLayers;
+};
+
+TEST_F(HWC2LayerTest, SkipsUnchangedState) {
+    HWC2::Layer* layer = createLayer();
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(3));
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(3));
+    EXPECT_EQ(1, mComposer.zOrderCommands);
+    EXPECT_EQ(1u, mCounts.sent);
+    EXPECT_EQ(1u, mCounts.skipped);
+
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(4));
+    EXPECT_EQ(2, mComposer.zOrderCommands);
+    EXPECT_EQ(4u, mComposer.lastZOrder);
+}
+
+TEST_F(HWC2LayerTest, ResendsStateAfterDiscardedCommands) {
+    HWC2::Layer* layer = createLayer();
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(3));
+    ASSERT_EQ(HWC2::Error::None,
+            layer->setBlendMode(HWC2::BlendMode::Premultiplied));
+
+    // What Display::discardCommands does when a frame is abandoned
+    mComposer.resetCommands();
+
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(3));
+    ASSERT_EQ(HWC2::Error::None,
+            layer->setBlendMode(HWC2::BlendMode::Premultiplied));
+    EXPECT_EQ(2, mComposer.zOrderCommands);
+    EXPECT_EQ(2, mComposer.blendModeCommands);
+
+    // Once resent, the state is cached again
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(3));
+    EXPECT_EQ(2, mComposer.zOrderCommands);
+}
+
+TEST_F(HWC2LayerTest, ResendsStateAfterFailedExecute) {
+    HWC2::Layer* first = createLayer();
+    HWC2::Layer* second = createLayer();
+    ASSERT_EQ(HWC2::Error::None, first->setZOrder(1));
+    ASSERT_EQ(HWC2::Error::None, second->setZOrder(2));
+
+    uint32_t numTypes = 0;
+    uint32_t numRequests = 0;
+    mComposer.failExecute = true;
+    EXPECT_EQ(Error::NO_RESOURCES,
+            mComposer.validateDisplay(kDisplayId, &numTypes, &numRequests));
+
+    // Both layers' commands shared the dropped buffer
+    ASSERT_EQ(HWC2::Error::None, first->setZOrder(1));
+    ASSERT_EQ(HWC2::Error::None, second->setZOrder(2));
+    EXPECT_EQ(4, mComposer.zOrderCommands);
+}
+
+TEST_F(HWC2LayerTest, KeepsStateAfterSuccessfulExecute) {
+    HWC2::Layer* layer = createLayer();
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(1));
+
+    uint32_t numTypes = 0;
+    uint32_t numRequests = 0;
+    EXPECT_EQ(Error::NONE,
+            mComposer.validateDisplay(kDisplayId, &numTypes, &numRequests));
+
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(1));
+    EXPECT_EQ(1, mComposer.zOrderCommands);
+}
+
+TEST_F(HWC2LayerTest, LayerCreatedAfterDropStartsUnsent) {
+    mComposer.resetCommands();
+    HWC2::Layer* layer = createLayer();
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(0));
+    ASSERT_EQ(HWC2::Error::None, layer->setZOrder(0));
+    EXPECT_EQ(1, mComposer.zOrderCommands);
+}
+
+} // namespace android
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "../TraceRingBuffer.h"
+
+namespace android {
+
+static std::string encodeVSync(int64_t when, size_t nameLength = 0) {
+    Increment increment;
+    increment.set_time_stamp(when);
+    if (nameLength > 0) {
+        SurfaceCreation* creation(increment.mutable_surface_creation());
+        creation->set_id(static_cast<int32_t>(when));
+        creation->set_name(std::string(nameLength, 'x'));
+        creation->set_w(1);
+        creation->set_h(1);
+    } else {
+        increment.mutable_vsync_event()->set_when(when);
+    }
+    return increment.SerializeAsString();
+}
+
+static bool push(TraceRingBuffer& ring, const std::string& record) {
+    return ring.push(reinterpret_cast<const uint8_t*>(record.data()), record.size());
+}
+
+static std::string drain(TraceRingBuffer& ring) {
+    const uint8_t* first;
+    const uint8_t* second;
+    size_t firstSize;
+    size_t secondSize;
+    const size_t size = ring.peek(&first, &firstSize, &second, &secondSize);
+    std::string output(reinterpret_cast<const char*>(first), firstSize);
+    output.append(reinterpret_cast<const char*>(second), secondSize);
+    ring.consume(size);
+    return output;
+}
+
+TEST(TraceRingBufferTest, Capacity_IsRoundedUpToPowerOfTwo) {
+    EXPECT_EQ(1024U, TraceRingBuffer(1000).getCapacity());
+    EXPECT_EQ(4096U, TraceRingBuffer(4096).getCapacity());
+}
+
+TEST(TraceRingBufferTest, Records_ParseAsTrace) {
+    TraceRingBuffer ring(1024);
+    ASSERT_TRUE(push(ring, encodeVSync(1)));
+    ASSERT_TRUE(push(ring, encodeVSync(2, 300)));
+    ASSERT_TRUE(push(ring, encodeVSync(3)));
+
+    Trace trace;
+    ASSERT_TRUE(trace.ParseFromString(drain(ring)));
+    ASSERT_EQ(3, trace.increment_size());
+    EXPECT_EQ(1, trace.increment(0).vsync_event().when());
+    EXPECT_EQ(300U, trace.increment(1).surface_creation().name().size());
+    EXPECT_EQ(3, trace.increment(2).time_stamp());
+    EXPECT_EQ(0U, ring.getUsed());
+}
+
+TEST(TraceRingBufferTest, Push_WhenFull_Fails) {
+    TraceRingBuffer ring(64);
+    const std::string record(encodeVSync(1));
+    size_t pushed = 0;
+    while (push(ring, record)) {
+        pushed++;
+    }
+    EXPECT_EQ(64 / TraceRingBuffer::getFramedSize(record.size()), pushed);
+
+    // room is made by reading
+    drain(ring);
+    EXPECT_TRUE(push(ring, record));
+}
+
+TEST(TraceRingBufferTest, Push_RecordLargerThanRing_Fails) {
+    TraceRingBuffer ring(64);
+    EXPECT_FALSE(push(ring, encodeVSync(1, 100)));
+    EXPECT_EQ(0U, ring.getUsed());
+}
+
+TEST(TraceRingBufferTest, Pop_ReturnsOldestRecord) {
+    TraceRingBuffer ring(256);
+    std::string record;
+    EXPECT_FALSE(ring.pop(&record));
+
+    // Making room by popping keeps the newest records, including ones which wrap
+    // around the end of the ring
+    int64_t oldest = 1;
+    for (int64_t i = 1; i <= 100; i++) {
+        const std::string encoded(encodeVSync(i, i % 7 == 0 ? 40 : 0));
+        while (!push(ring, encoded)) {
+            ASSERT_TRUE(ring.pop(&record));
+            Increment increment;
+            ASSERT_TRUE(increment.ParseFromString(record));
+            EXPECT_EQ(oldest++, increment.time_stamp());
+        }
+    }
+
+    Trace trace;
+    ASSERT_TRUE(trace.ParseFromString(drain(ring)));
+    ASSERT_EQ(100 - oldest + 1, trace.increment_size());
+    for (int i = 0; i < trace.increment_size(); i++) {
+        EXPECT_EQ(oldest + i, trace.increment(i).time_stamp());
+    }
+}
+
+TEST(TraceRingBufferTest, ConcurrentWriterAndReader_KeepRecordsInOrder) {
+    TraceRingBuffer ring(512);
+    const int64_t count = 20000;
+    std::string output;
+    std::thread reader([&]() {
+        while (true) {
+            const std::string bytes(drain(ring));
+            output += bytes;
+            Trace trace;
+            if (bytes.empty() && trace.ParseFromString(output) &&
+                    trace.increment_size() == count) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    });
+    for (int64_t i = 1; i <= count; i++) {
+        const std::string record(encodeVSync(i, i % 5 == 0 ? 20 : 0));
+        while (!push(ring, record)) {
+            std::this_thread::yield();
+        }
+    }
+    reader.join();
+
+    Trace trace;
+    ASSERT_TRUE(trace.ParseFromString(output));
+    ASSERT_EQ(count, trace.increment_size());
+    for (int64_t i = 0; i < count; i++) {
+        EXPECT_EQ(i + 1, trace.increment(i).time_stamp());
+    }
+}
+
+} // namespace android
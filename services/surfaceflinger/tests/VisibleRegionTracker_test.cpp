@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../VisibleRegionTracker.h"
+
+namespace android {
+
+typedef VisibleRegionTracker::LayerRegions LayerRegions;
+
+// A layer as SurfaceFlinger sees it: its geometry and the regions it stored in the last pass.
+struct TestLayer {
+    uintptr_t id;
+    Rect bounds;
+    bool hidden;
+    bool opaque;
+    Region transparentRegion;
+    bool contentDirty;
+    Region visibleRegion;
+    Region coveredRegion;
+    Region visibleNonTransparentRegion;
+};
+
+// The front to back pass of SurfaceFlinger::computeVisibleRegions() before the tracker.
+static void computeReference(std::vector<LayerRegions>& layers,
+        Region& outDirtyRegion, Region& outOpaqueRegion) {
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    Region dirty;
+
+    outDirtyRegion.clear();
+    for (LayerRegions& layer : layers) {
+        Region opaqueRegion;
+        Region visibleRegion(layer.bounds);
+        if (layer.opaque) {
+            opaqueRegion = visibleRegion;
+        }
+        Region coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        aboveCoveredLayers.orSelf(visibleRegion);
+        visibleRegion.subtractSelf(aboveOpaqueLayers);
+        if (layer.contentDirty) {
+            dirty = visibleRegion;
+            dirty.orSelf(layer.oldVisibleRegion);
+        } else {
+            const Region newExposed = visibleRegion - coveredRegion;
+            const Region oldExposed = layer.oldVisibleRegion - layer.oldCoveredRegion;
+            dirty = (visibleRegion & layer.oldCoveredRegion) | (newExposed - oldExposed);
+        }
+        dirty.subtractSelf(aboveOpaqueLayers);
+        outDirtyRegion.orSelf(dirty);
+        aboveOpaqueLayers.orSelf(opaqueRegion);
+        layer.visibleRegion = visibleRegion;
+        layer.coveredRegion = coveredRegion;
+        layer.visibleNonTransparentRegion = visibleRegion.subtract(layer.transparentRegion);
+    }
+    outOpaqueRegion = aboveOpaqueLayers;
+}
+
+static bool isSameArea(const Region& lhs, const Region& rhs) {
+    return lhs.subtract(rhs).isEmpty() && rhs.subtract(lhs).isEmpty();
+}
+
+class VisibleRegionTrackerTest : public testing::Test {
+protected:
+    // Each side keeps its own copy of the layers, with the regions its passes stored.
+    std::vector<TestLayer> mLayers;
+    std::vector<TestLayer> mReferenceLayers;
+    VisibleRegionTracker mTracker;
+    uintptr_t mNextId = 1;
+
+    TestLayer& addLayer(const Rect& bounds, bool opaque, size_t position) {
+        TestLayer layer;
+        layer.id = mNextId++;
+        layer.bounds = bounds;
+        layer.hidden = false;
+        layer.opaque = opaque;
+        layer.contentDirty = true;
+        mLayers.insert(mLayers.begin() + position, layer);
+        mReferenceLayers.insert(mReferenceLayers.begin() + position, layer);
+        return mLayers[position];
+    }
+
+    void removeLayer(size_t position) {
+        mLayers.erase(mLayers.begin() + position);
+        mReferenceLayers.erase(mReferenceLayers.begin() + position);
+    }
+
+    // Applies a change to the geometry of both copies of a layer.
+    template <typename F>
+    void edit(size_t position, F f) {
+        f(mLayers[position]);
+        f(mReferenceLayers[position]);
+    }
+
+    static std::vector<LayerRegions> toLayerRegions(const std::vector<TestLayer>& layers) {
+        std::vector<LayerRegions> regions(layers.size());
+        for (size_t i = 0; i < layers.size(); i++) {
+            const TestLayer& layer(layers[i]);
+            regions[i].id = layer.id;
+            regions[i].bounds = layer.hidden ? Rect::EMPTY_RECT : layer.bounds;
+            regions[i].opaque = !layer.hidden && layer.opaque;
+            regions[i].transparentRegion = layer.transparentRegion;
+            regions[i].contentDirty = layer.contentDirty;
+            regions[i].oldVisibleRegion = layer.visibleRegion;
+            regions[i].oldCoveredRegion = layer.coveredRegion;
+        }
+        return regions;
+    }
+
+    static void store(std::vector<TestLayer>& layers, const std::vector<LayerRegions>& regions) {
+        for (size_t i = 0; i < layers.size(); i++) {
+            layers[i].contentDirty = false;
+            layers[i].visibleRegion = regions[i].visibleRegion;
+            layers[i].coveredRegion = regions[i].coveredRegion;
+            layers[i].visibleNonTransparentRegion = regions[i].visibleNonTransparentRegion;
+        }
+    }
+
+    // Runs a pass on both sides and checks that they agree. Returns how many layers the
+    // tracker recomputed.
+    size_t computeAndCompare() {
+        std::vector<LayerRegions> regions(toLayerRegions(mLayers));
+        Region dirty, opaque;
+        mTracker.compute(regions, dirty, opaque);
+        store(mLayers, regions);
+
+        std::vector<LayerRegions> reference(toLayerRegions(mReferenceLayers));
+        Region referenceDirty, referenceOpaque;
+        computeReference(reference, referenceDirty, referenceOpaque);
+        store(mReferenceLayers, reference);
+
+        EXPECT_TRUE(isSameArea(referenceDirty, dirty));
+        EXPECT_TRUE(isSameArea(referenceOpaque, opaque));
+        for (size_t i = 0; i < regions.size(); i++) {
+            EXPECT_TRUE(isSameArea(reference[i].visibleRegion, regions[i].visibleRegion))
+                    << "layer " << i;
+            EXPECT_TRUE(isSameArea(reference[i].coveredRegion, regions[i].coveredRegion))
+                    << "layer " << i;
+            EXPECT_TRUE(isSameArea(reference[i].visibleNonTransparentRegion,
+                    regions[i].visibleNonTransparentRegion)) << "layer " << i;
+        }
+        return mTracker.getRecomputedCount();
+    }
+
+    // A phone-like stack, front to back: navigation and status bars, a toast, the IME,
+    // a dialog over a dim layer, two app windows and the wallpaper.
+    void addPhoneStack() {
+        addLayer(Rect(0, 1824, 1080, 1920), false, mLayers.size());   // navigation bar
+        addLayer(Rect(0, 0, 1080, 72), false, mLayers.size());        // status bar
+        addLayer(Rect(340, 1500, 740, 1600), false, mLayers.size());  // toast
+        addLayer(Rect(0, 1100, 1080, 1824), true, mLayers.size());    // IME
+        addLayer(Rect(90, 600, 990, 1300), false, mLayers.size());    // dialog
+        addLayer(Rect(0, 0, 1080, 1920), false, mLayers.size());      // dim
+        addLayer(Rect(0, 72, 1080, 1824), true, mLayers.size());      // app
+        addLayer(Rect(0, 72, 1080, 1824), true, mLayers.size());      // app below
+        addLayer(Rect(0, 0, 1080, 1920), true, mLayers.size());       // wallpaper
+        // the dialog has rounded corners
+        edit(4, [](TestLayer& layer) {
+            layer.transparentRegion.orSelf(Rect(90, 600, 110, 620));
+            layer.transparentRegion.orSelf(Rect(970, 1280, 990, 1300));
+        });
+    }
+};
+
+TEST_F(VisibleRegionTrackerTest, NoChange_RecomputesNothing) {
+    addPhoneStack();
+    EXPECT_EQ(mLayers.size(), computeAndCompare());
+    EXPECT_EQ(0U, computeAndCompare());
+
+    // new content doesn't change the geometry
+    edit(6, [](TestLayer& layer) { layer.contentDirty = true; });
+    EXPECT_EQ(0U, computeAndCompare());
+}
+
+TEST_F(VisibleRegionTrackerTest, MovingLayer_RecomputesOverlappedLayersOnly) {
+    addPhoneStack();
+    computeAndCompare();
+
+    // the toast moves, only it and the layers below it that it overlaps are recomputed
+    edit(2, [](TestLayer& layer) { layer.bounds.offsetBy(0, -40); });
+    size_t recomputed = computeAndCompare();
+    EXPECT_GT(recomputed, 0U);
+    EXPECT_LT(recomputed, mLayers.size() - 2);
+}
+
+TEST_F(VisibleRegionTrackerTest, ScriptedAnimations_MatchReference) {
+    addPhoneStack();
+    computeAndCompare();
+
+    // the IME slides out
+    for (int y = 1100; y <= 1824; y += 60) {
+        edit(3, [y](TestLayer& layer) { layer.bounds = Rect(0, y, 1080, 1824); });
+        computeAndCompare();
+    }
+    edit(3, [](TestLayer& layer) { layer.hidden = true; });
+    computeAndCompare();
+
+    // the dialog fades out, then goes away with its dim layer
+    edit(4, [](TestLayer& layer) { layer.opaque = false; layer.contentDirty = true; });
+    computeAndCompare();
+    removeLayer(4);
+    removeLayer(4);
+    computeAndCompare();
+
+    // a new app window opens on top of the app and grows to full screen
+    addLayer(Rect(540, 960, 540, 960), false, 4);
+    for (int step = 1; step <= 10; step++) {
+        edit(4, [step](TestLayer& layer) {
+            layer.bounds = Rect(540 - 54 * step, 960 - 88 * step, 540 + 54 * step,
+                    960 + 86 * step);
+        });
+        computeAndCompare();
+    }
+    edit(4, [](TestLayer& layer) { layer.opaque = true; });
+    computeAndCompare();
+
+    // the status bar is pulled down over everything
+    for (int y = 72; y <= 1920; y += 200) {
+        edit(1, [y](TestLayer& layer) { layer.bounds = Rect(0, 0, 1080, y); });
+        computeAndCompare();
+    }
+}
+
+TEST_F(VisibleRegionTrackerTest, RandomChanges_MatchReference) {
+    std::mt19937 random(7);
+    auto uniform = [&random](int lo, int hi) {
+        return std::uniform_int_distribution<int>(lo, hi)(random);
+    };
+    auto randomRect = [&uniform]() {
+        int left = uniform(-100, 1000);
+        int top = uniform(-100, 1800);
+        return Rect(left, top, left + uniform(0, 1200), top + uniform(0, 2000));
+    };
+
+    for (int i = 0; i < 40; i++) {
+        addLayer(randomRect(), uniform(0, 2) != 0, mLayers.size());
+    }
+    for (int frame = 0; frame < 2000; frame++) {
+        const int changes = uniform(0, 3);
+        for (int c = 0; c < changes; c++) {
+            size_t position = uniform(0, mLayers.size() - 1);
+            switch (uniform(0, 9)) {
+                case 0:
+                    addLayer(randomRect(), uniform(0, 1) != 0, position);
+                    break;
+                case 1:
+                    if (mLayers.size() > 1) {
+                        removeLayer(position);
+                    }
+                    break;
+                case 2: {
+                    // change the z-order of a layer
+                    size_t to = uniform(0, mLayers.size() - 1);
+                    TestLayer layer(mLayers[position]);
+                    TestLayer referenceLayer(mReferenceLayers[position]);
+                    mLayers.erase(mLayers.begin() + position);
+                    mReferenceLayers.erase(mReferenceLayers.begin() + position);
+                    mLayers.insert(mLayers.begin() + to, layer);
+                    mReferenceLayers.insert(mReferenceLayers.begin() + to, referenceLayer);
+                    break;
+                }
+                case 3:
+                    edit(position, [](TestLayer& layer) { layer.hidden = !layer.hidden; });
+                    break;
+                case 4:
+                    edit(position, [](TestLayer& layer) { layer.opaque = !layer.opaque; });
+                    break;
+                case 5: {
+                    Rect hole(randomRect());
+                    edit(position, [&hole](TestLayer& layer) {
+                        layer.transparentRegion.set(hole);
+                    });
+                    break;
+                }
+                case 6:
+                    edit(position, [](TestLayer& layer) { layer.contentDirty = true; });
+                    break;
+                default: {
+                    int dx = uniform(-50, 50);
+                    int dy = uniform(-50, 50);
+                    edit(position, [dx, dy](TestLayer& layer) {
+                        layer.bounds.offsetBy(dx, dy);
+                    });
+                    break;
+                }
+            }
+        }
+        computeAndCompare();
+        if (HasFailure()) {
+            FAIL() << "frame " << frame;
+        }
+    }
+}
+
+}; // namespace android